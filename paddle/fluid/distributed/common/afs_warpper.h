@@ -64,6 +64,10 @@ class FsReadChannel {
     }
     return 0;
   }
+  // reads up to size bytes, returns the number of bytes read
+  inline size_t read(char* data, size_t size) {
+    return fread(data, 1, size, _file.get());
+  }
 
  private:
   uint32_t _buffer_size;
@@ -112,6 +116,14 @@ class FsWriteChannel {
   inline uint32_t write_line(const std::string& data) {
     return write_line(data.c_str(), data.size());
   }
+  // writes data as is, without a trailing newline
+  inline uint32_t write(const char* data, size_t size) {
+    size_t write_count = fwrite_unlocked(data, 1, size, _file.get());
+    if (write_count != size) {
+      return -1;
+    }
+    return 0;
+  }
 
  private:
   uint32_t _buffer_size;
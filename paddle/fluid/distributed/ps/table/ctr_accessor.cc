@@ -14,6 +14,7 @@
 
 #include "paddle/fluid/distributed/ps/table/ctr_accessor.h"
 #include <gflags/gflags.h>
+#include <vector>
 #include "glog/logging.h"
 #include "paddle/fluid/string/string_helper.h"
 
@@ -244,6 +245,12 @@ int32_t CtrCommonAccessor::Merge(float** update_values,
 int32_t CtrCommonAccessor::Update(float** update_values,
                                   const float** push_values, size_t num) {
   auto embedx_dim = _config.embedx_dim();
+  // the counters are updated per key, the embeddings are collected and
+  // handed to the sgd rules as one batch
+  std::vector<float*> embed_w(num), embed_sgd(num);
+  std::vector<float*> embedx_w(num), embedx_sgd(num);
+  std::vector<const float*> embed_g(num), embedx_g(num);
+  std::vector<float> scales(num);
   for (size_t value_item = 0; value_item < num; ++value_item) {
     float* update_value = update_values[value_item];
     const float* push_value = push_values[value_item];
@@ -263,15 +270,20 @@ int32_t CtrCommonAccessor::Update(float** update_values,
     }
     VLOG(3) << "accessor show scale:" << _show_scale
             << ", push_show:" << push_show;
-    _embed_sgd_rule->UpdateValue(
-        update_value + common_feature_value.EmbedWIndex(),
-        update_value + common_feature_value.EmbedG2SumIndex(),
-        push_value + CtrCommonPushValue::EmbedGIndex(), push_show);
-    _embedx_sgd_rule->UpdateValue(
-        update_value + common_feature_value.EmbedxWIndex(),
-        update_value + common_feature_value.EmbedxG2SumIndex(),
-        push_value + CtrCommonPushValue::EmbedxGIndex(), push_show);
+    embed_w[value_item] = update_value + common_feature_value.EmbedWIndex();
+    embed_sgd[value_item] =
+        update_value + common_feature_value.EmbedG2SumIndex();
+    embed_g[value_item] = push_value + CtrCommonPushValue::EmbedGIndex();
+    embedx_w[value_item] = update_value + common_feature_value.EmbedxWIndex();
+    embedx_sgd[value_item] =
+        update_value + common_feature_value.EmbedxG2SumIndex();
+    embedx_g[value_item] = push_value + CtrCommonPushValue::EmbedxGIndex();
+    scales[value_item] = push_show;
   }
+  _embed_sgd_rule->UpdateValue(embed_w.data(), embed_sgd.data(),
+                               embed_g.data(), scales.data(), num);
+  _embedx_sgd_rule->UpdateValue(embedx_w.data(), embedx_sgd.data(),
+                                embedx_g.data(), scales.data(), num);
   return 0;
 }
 
@@ -14,11 +14,15 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <mutex>  // NOLINT
 #include <vector>
 #include "gflags/gflags.h"
 
 #include <mct/hash-map.hpp>
 #include "paddle/fluid/distributed/common/chunk_allocator.h"
+#include "paddle/fluid/distributed/ps/table/depends/swiss_hash_map.h"
 
 namespace paddle {
 namespace distributed {
@@ -27,24 +31,193 @@ static const int CTR_SPARSE_SHARD_BUCKET_NUM_BITS = 6;
 static const size_t CTR_SPARSE_SHARD_BUCKET_NUM =
     static_cast<size_t>(1) << CTR_SPARSE_SHARD_BUCKET_NUM_BITS;
 
+// Packs feature value storage of one shard into large slabs. Slots are
+// grouped by their dim (in floats), released slots are kept on a per-dim
+// free list and reused by the next value of the same dim, so values that are
+// erased by Shrink do not return memory to the system heap.
+class FeatureValueSlab {
+ public:
+  explicit FeatureValueSlab(size_t slab_bytes = 1 << 20)
+      : _slab_bytes(slab_bytes) {}
+  FeatureValueSlab(const FeatureValueSlab&) = delete;
+  ~FeatureValueSlab() {
+    for (auto& size_class : _size_classes) {
+      for (float* slab : size_class.slabs) {
+        free(slab);
+      }
+    }
+  }
+
+  float* acquire(size_t dim) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    if (dim >= _size_classes.size()) {
+      _size_classes.resize(dim + 1);
+    }
+    SizeClass& size_class = _size_classes[dim];
+    if (size_class.free_slots == NULL) {
+      create_new_slab(dim, &size_class);
+    }
+    float* slot = reinterpret_cast<float*>(size_class.free_slots);
+    size_class.free_slots = size_class.free_slots->next;
+    ++_used_slots;
+    return slot;
+  }
+
+  void release(float* slot, size_t dim) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    SizeClass& size_class = _size_classes[dim];
+    FreeSlot* node = reinterpret_cast<FreeSlot*>(slot);
+    node->next = size_class.free_slots;
+    size_class.free_slots = node;
+    --_used_slots;
+  }
+
+  // number of slots handed out and not yet released
+  size_t size() const { return _used_slots; }
+  // bytes reserved from the system heap, including free slots
+  size_t memory_bytes() const { return _reserved_bytes; }
+
+ private:
+  struct FreeSlot {
+    FreeSlot* next;
+  };
+  struct SizeClass {
+    std::vector<float*> slabs;
+    FreeSlot* free_slots = NULL;
+  };
+
+  void create_new_slab(size_t dim, SizeClass* size_class) {
+    // a slot must be able to hold the free list link
+    size_t slot_bytes = std::max(dim * sizeof(float), sizeof(FreeSlot));
+    size_t slot_num = std::max<size_t>(1, _slab_bytes / slot_bytes);
+    char* slab = NULL;
+    CHECK_EQ(posix_memalign(reinterpret_cast<void**>(&slab), 64,
+                            slot_bytes * slot_num),
+             0)
+        << "failed to allocate feature value slab of "
+        << slot_bytes * slot_num << " bytes";
+    size_class->slabs.push_back(reinterpret_cast<float*>(slab));
+    _reserved_bytes += slot_bytes * slot_num;
+    // push in reverse order so that slots are handed out by address
+    for (size_t i = slot_num; i > 0; --i) {
+      FreeSlot* node = reinterpret_cast<FreeSlot*>(slab + (i - 1) * slot_bytes);
+      node->next = size_class->free_slots;
+      size_class->free_slots = node;
+    }
+  }
+
+  size_t _slab_bytes;
+  std::vector<SizeClass> _size_classes;  // indexed by dim
+  size_t _used_slots = 0;
+  size_t _reserved_bytes = 0;
+  std::mutex _mutex;
+};
+
+// A feature value is a resizable float array. It is heap backed by default,
+// or backed by a FeatureValueSlab slot of exactly size() floats when it is
+// constructed with a slab, see MemorySparseTable::AcquireValue.
 class FixedFeatureValue {
  public:
-  FixedFeatureValue() {}
-  ~FixedFeatureValue() {}
-  float* data() { return _data.data(); }
-  size_t size() { return _data.size(); }
-  void resize(size_t size) { _data.resize(size); }
-  void shrink_to_fit() { _data.shrink_to_fit(); }
+  FixedFeatureValue() : _capacity(0), _dirty(0) {}
+  explicit FixedFeatureValue(FeatureValueSlab* slab)
+      : _capacity(0), _dirty(0), _slab(slab) {}
+  FixedFeatureValue(const FixedFeatureValue& other)
+      : _capacity(0), _dirty(0), _slab(other._slab) {
+    *this = other;
+  }
+  FixedFeatureValue& operator=(const FixedFeatureValue& other) {
+    if (this != &other) {
+      reallocate(other._size);
+      _size = other._size;
+      if (_size > 0) {
+        memcpy(_data, other._data, _size * sizeof(float));
+      }
+      _dirty = other._dirty;
+    }
+    return *this;
+  }
+  ~FixedFeatureValue() { reallocate(0); }
+  float* data() { return _data; }
+  size_t size() { return _size; }
+  void resize(size_t size) {
+    if (size > _capacity || (_slab != NULL && size != _capacity)) {
+      reallocate(size);
+    }
+    if (size > _size) {
+      memset(_data + _size, 0, (size - _size) * sizeof(float));
+    }
+    _size = size;
+  }
+  void shrink_to_fit() {
+    if (_size != _capacity) {
+      reallocate(_size);
+    }
+  }
+  // whether the value changed since the table was last checkpointed, used by
+  // the delta checkpoints of MemorySparseTable
+  bool dirty() const { return _dirty; }
+  void set_dirty(bool dirty) { _dirty = dirty; }
 
  private:
-  std::vector<float> _data;
+  // moves the first min(size, capacity) floats into storage of capacity
+  // floats, storage of capacity 0 is released
+  void reallocate(size_t capacity) {
+    float* data = NULL;
+    if (capacity > 0) {
+      data = _slab != NULL
+                 ? _slab->acquire(capacity)
+                 : reinterpret_cast<float*>(malloc(capacity * sizeof(float)));
+      size_t keep = std::min<size_t>(capacity, _size);
+      if (keep > 0) {
+        memcpy(data, _data, keep * sizeof(float));
+      }
+    }
+    if (_data != NULL) {
+      if (_slab != NULL) {
+        _slab->release(_data, _capacity);
+      } else {
+        free(_data);
+      }
+    }
+    _data = data;
+    _capacity = static_cast<uint32_t>(capacity);
+    _size = std::min<uint32_t>(_size, _capacity);
+  }
+
+  float* _data = NULL;
+  uint32_t _size = 0;
+  // the dirty bit shares the word of the capacity to keep values at 24 bytes
+  uint32_t _capacity : 31;
+  uint32_t _dirty : 1;
+  FeatureValueSlab* _slab = NULL;
 };
 
-template <class KEY, class VALUE>
+// Hints the cache about the slots a lookup of hash will probe in map. Only
+// SwissHashMap supports it, the other maps of SparseTableShard ignore it.
+template <class MAP>
+struct ShardMapPrefetch {
+  static constexpr bool kSupported = false;
+  static void Prefetch(const MAP& map, size_t hash) {}
+};
+
+template <class KEY, class VALUE, class HASH>
+struct ShardMapPrefetch<SwissHashMap<KEY, VALUE, HASH>> {
+  static constexpr bool kSupported = true;
+  static void Prefetch(const SwissHashMap<KEY, VALUE, HASH>& map,
+                       size_t hash) {
+    map.prefetch(hash);
+  }
+};
+
+// The keys of a shard are indexed by MAP, mct::closed_hash_map by default or
+// SwissHashMap for SwissSparseTableShard, which matches 16 slot tags per probe
+// and lets batched lookups prefetch their slots.
+template <class KEY, class VALUE,
+          class MAP = mct::closed_hash_map<KEY, mct::Pointer, std::hash<KEY>>>
 struct alignas(64) SparseTableShard {
  public:
-  typedef typename mct::closed_hash_map<KEY, mct::Pointer, std::hash<KEY>>
-      map_type;
+  typedef MAP map_type;
+  static constexpr bool kSupportsPrefetch = ShardMapPrefetch<MAP>::kSupported;
   struct iterator {
     typename map_type::iterator it;
     size_t bucket;
@@ -134,6 +307,14 @@ struct alignas(64) SparseTableShard {
     }
     return {it, bucket, _buckets};
   }
+  // hint the cache about the slots a later find/emplace of key will probe,
+  // a no-op unless kSupportsPrefetch
+  void prefetch(const KEY& key) {
+    if (kSupportsPrefetch) {
+      size_t hash = _hasher(key);
+      ShardMapPrefetch<MAP>::Prefetch(_buckets[compute_bucket(hash)], hash);
+    }
+  }
   VALUE& operator[](const KEY& key) { return emplace(key).first.value(); }
   std::pair<iterator, bool> insert(const KEY& key, const VALUE& val) {
     return emplace(key, val);
@@ -197,5 +378,10 @@ struct alignas(64) SparseTableShard {
   std::hash<KEY> _hasher;
 };
 
+template <class KEY, class VALUE>
+using SwissSparseTableShard =
+    SparseTableShard<KEY, VALUE,
+                     SwissHashMap<KEY, mct::Pointer, std::hash<KEY>>>;
+
 }  // namespace distributed
 }  // namespace paddle
@@ -22,6 +22,8 @@
 #include <rocksdb/write_batch.h>
 #include <iostream>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace paddle {
 namespace distributed {
@@ -125,6 +127,48 @@ class RocksDBHandler {
     return 0;
   }
 
+  // looks up all keys with one MultiGet, status[i] is 0 when keys[i] is
+  // found and 1 when it is not
+  int multi_get(int id, const std::vector<std::pair<const char*, int>>& keys,
+                std::vector<std::string>* values, std::vector<int>* status) {
+    std::vector<rocksdb::ColumnFamilyHandle*> handles(keys.size(),
+                                                      _handles[id]);
+    std::vector<rocksdb::Slice> slices;
+    slices.reserve(keys.size());
+    for (auto& key : keys) {
+      slices.emplace_back(key.first, key.second);
+    }
+    std::vector<rocksdb::Status> s =
+        _db->MultiGet(rocksdb::ReadOptions(), handles, slices, values);
+    status->resize(keys.size());
+    for (size_t i = 0; i < keys.size(); ++i) {
+      assert(s[i].ok() || s[i].IsNotFound());
+      (*status)[i] = s[i].IsNotFound() ? 1 : 0;
+    }
+    return 0;
+  }
+
+  // writes the puts and deletes in one batch, keys[i] is deleted when
+  // values[i].first is NULL
+  int write_batch(int id, const std::vector<std::pair<const char*, int>>& keys,
+                  const std::vector<std::pair<const char*, int>>& values) {
+    rocksdb::WriteOptions options;
+    options.disableWAL = true;
+    rocksdb::WriteBatch batch(keys.size() * 128);
+    for (size_t i = 0; i < keys.size(); i++) {
+      rocksdb::Slice key(keys[i].first, keys[i].second);
+      if (values[i].first == NULL) {
+        batch.Delete(_handles[id], key);
+      } else {
+        batch.Put(_handles[id], key,
+                  rocksdb::Slice(values[i].first, values[i].second));
+      }
+    }
+    rocksdb::Status s = _db->Write(options, &batch);
+    assert(s.ok());
+    return 0;
+  }
+
   int del_data(int id, const char* key, int key_len) {
     rocksdb::WriteOptions options;
     options.disableWAL = true;
@@ -0,0 +1,335 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+#include "zlib.h"
+
+namespace paddle {
+namespace distributed {
+
+// Binary shard file of a sparse table. The file is a sequence of blocks:
+//
+//   SparseBinaryBlockHeader
+//   keys   uint64_t x record_num
+//   sizes  uint32_t x record_num
+//   values float x sum(sizes)
+//
+// where everything after the header is zlib compressed when the header says
+// so. A text index with one "offset stored_bytes record_num" line per block
+// is written next to the file, named by SparseBinaryIndexPath, so that the
+// blocks of one file can be decoded by several threads. Files without an
+// index are read by walking the block headers.
+static const uint32_t kSparseBinaryMagic = 0x42535350;  // "PSSB"
+static const size_t kSparseBinaryBlockBytes = 4 << 20;
+
+struct SparseBinaryBlockHeader {
+  uint32_t magic;
+  uint32_t record_num;
+  uint32_t compressed;
+  uint32_t reserved;
+  uint64_t raw_bytes;
+  uint64_t stored_bytes;
+};
+
+struct SparseBinaryBlockIndex {
+  uint64_t offset;
+  uint64_t stored_bytes;
+  uint32_t record_num;
+};
+
+inline std::string SparseBinaryIndexPath(const std::string& path) {
+  return path + ".idx";
+}
+
+class SparseBinaryWriter {
+ public:
+  // write returns 0 on success, as FsWriteChannel::write does
+  typedef std::function<int(const char* data, size_t size)> WriteFunc;
+
+  SparseBinaryWriter(WriteFunc write, bool compress,
+                     size_t block_bytes = kSparseBinaryBlockBytes)
+      : _write(write), _compress(compress), _block_bytes(block_bytes) {}
+
+  int Append(uint64_t key, const float* value, uint32_t size) {
+    _keys.push_back(key);
+    _sizes.push_back(size);
+    _values.insert(_values.end(), value, value + size);
+    ++_record_num;
+    if (RawBytes() >= _block_bytes) {
+      return FlushBlock();
+    }
+    return 0;
+  }
+
+  // writes the last block, the writer must not be used after it
+  int Close() { return _keys.empty() ? 0 : FlushBlock(); }
+
+  size_t record_num() const { return _record_num; }
+
+  std::string IndexString() const {
+    std::stringstream ss;
+    for (auto& block : _index) {
+      ss << block.offset << " " << block.stored_bytes << " "
+         << block.record_num << "\n";
+    }
+    return ss.str();
+  }
+
+ private:
+  size_t RawBytes() const {
+    return _keys.size() * (sizeof(uint64_t) + sizeof(uint32_t)) +
+           _values.size() * sizeof(float);
+  }
+
+  int FlushBlock() {
+    SparseBinaryBlockHeader header;
+    header.magic = kSparseBinaryMagic;
+    header.record_num = _keys.size();
+    header.compressed = _compress ? 1 : 0;
+    header.reserved = 0;
+    header.raw_bytes = RawBytes();
+
+    _raw.resize(header.raw_bytes);
+    char* pos = &_raw[0];
+    memcpy(pos, _keys.data(), _keys.size() * sizeof(uint64_t));
+    pos += _keys.size() * sizeof(uint64_t);
+    memcpy(pos, _sizes.data(), _sizes.size() * sizeof(uint32_t));
+    pos += _sizes.size() * sizeof(uint32_t);
+    memcpy(pos, _values.data(), _values.size() * sizeof(float));
+
+    const std::string* body = &_raw;
+    if (_compress) {
+      uLongf stored = compressBound(header.raw_bytes);
+      _stored.resize(stored);
+      int ret = compress2(reinterpret_cast<Bytef*>(&_stored[0]), &stored,
+                          reinterpret_cast<const Bytef*>(_raw.data()),
+                          header.raw_bytes, Z_BEST_SPEED);
+      CHECK_EQ(ret, Z_OK) << "failed to compress sparse binary block";
+      _stored.resize(stored);
+      body = &_stored;
+    }
+    header.stored_bytes = body->size();
+
+    int ret = _write(reinterpret_cast<const char*>(&header), sizeof(header));
+    if (ret == 0) {
+      ret = _write(body->data(), body->size());
+    }
+    _index.push_back({_offset, sizeof(header) + header.stored_bytes,
+                      header.record_num});
+    _offset += sizeof(header) + header.stored_bytes;
+    _keys.clear();
+    _sizes.clear();
+    _values.clear();
+    return ret;
+  }
+
+  WriteFunc _write;
+  bool _compress;
+  size_t _block_bytes;
+  std::vector<uint64_t> _keys;
+  std::vector<uint32_t> _sizes;
+  std::vector<float> _values;
+  std::string _raw;
+  std::string _stored;
+  std::vector<SparseBinaryBlockIndex> _index;
+  uint64_t _offset = 0;
+  size_t _record_num = 0;
+};
+
+// Decodes the blocks of a binary shard file held in memory, either the mmap
+// of a local file or the content read through a channel. Uncompressed blocks
+// are read in place.
+class SparseBinaryReader {
+ public:
+  SparseBinaryReader(const char* data, size_t size)
+      : _data(data), _size(size) {}
+
+  // returns -1 unless every line of text is one complete block, the writer
+  // ends each line with a newline so a cut off last line is rejected too
+  static int ParseIndex(const std::string& text,
+                        std::vector<SparseBinaryBlockIndex>* index) {
+    if (!text.empty() && text.back() != '\n') {
+      return -1;
+    }
+    std::stringstream ss(text);
+    std::string line;
+    while (std::getline(ss, line)) {
+      std::stringstream fields(line);
+      SparseBinaryBlockIndex block;
+      std::string extra;
+      if (!(fields >> block.offset >> block.stored_bytes >>
+            block.record_num) ||
+          fields >> extra) {
+        return -1;
+      }
+      index->push_back(block);
+    }
+    return 0;
+  }
+
+  // checks that index lists the blocks of the file as ScanIndex finds them,
+  // so a stale or damaged index is not trusted
+  int CheckIndex(const std::vector<SparseBinaryBlockIndex>& index) const {
+    uint64_t offset = 0;
+    for (auto& block : index) {
+      SparseBinaryBlockHeader header;
+      if (block.offset != offset || ReadHeader(offset, &header) != 0 ||
+          block.stored_bytes != sizeof(header) + header.stored_bytes ||
+          block.record_num != header.record_num) {
+        return -1;
+      }
+      offset += block.stored_bytes;
+    }
+    return offset == _size ? 0 : -1;
+  }
+
+  // builds the index from the block headers, for files saved without one
+  int ScanIndex(std::vector<SparseBinaryBlockIndex>* index) const {
+    uint64_t offset = 0;
+    while (offset < _size) {
+      SparseBinaryBlockHeader header;
+      if (ReadHeader(offset, &header) != 0) {
+        return -1;
+      }
+      uint64_t block_bytes = sizeof(header) + header.stored_bytes;
+      index->push_back({offset, block_bytes, header.record_num});
+      offset += block_bytes;
+    }
+    return 0;
+  }
+
+  // calls visit(key, value, size) for every record of the block, buffer
+  // holds the block when it has to be decompressed. Returns -1 when the
+  // block is corrupted.
+  template <class VISITOR>
+  int ReadBlock(const SparseBinaryBlockIndex& block, std::string* buffer,
+                VISITOR visit) const {
+    SparseBinaryBlockHeader header;
+    if (ReadHeader(block.offset, &header) != 0 ||
+        header.record_num != block.record_num) {
+      return -1;
+    }
+    const char* body = _data + block.offset + sizeof(header);
+    if (header.compressed) {
+      buffer->resize(header.raw_bytes);
+      uLongf raw_bytes = header.raw_bytes;
+      if (uncompress(reinterpret_cast<Bytef*>(&(*buffer)[0]), &raw_bytes,
+                     reinterpret_cast<const Bytef*>(body),
+                     header.stored_bytes) != Z_OK ||
+          raw_bytes != header.raw_bytes) {
+        return -1;
+      }
+      body = buffer->data();
+    } else if (header.stored_bytes != header.raw_bytes) {
+      return -1;
+    }
+    if (header.raw_bytes < static_cast<uint64_t>(header.record_num) *
+                               (sizeof(uint64_t) + sizeof(uint32_t))) {
+      return -1;
+    }
+
+    const char* keys = body;
+    const char* sizes = keys + header.record_num * sizeof(uint64_t);
+    const char* values = sizes + header.record_num * sizeof(uint32_t);
+    const char* end = body + header.raw_bytes;
+    for (uint32_t i = 0; i < header.record_num; ++i) {
+      uint64_t key;
+      uint32_t size;
+      memcpy(&key, keys + i * sizeof(uint64_t), sizeof(uint64_t));
+      memcpy(&size, sizes + i * sizeof(uint32_t), sizeof(uint32_t));
+      if (size > (end - values) / sizeof(float)) {
+        return -1;
+      }
+      visit(key, reinterpret_cast<const float*>(values), size);
+      values += size * sizeof(float);
+    }
+    return 0;
+  }
+
+ private:
+  int ReadHeader(uint64_t offset, SparseBinaryBlockHeader* header) const {
+    if (offset + sizeof(*header) > _size) {
+      return -1;
+    }
+    memcpy(header, _data + offset, sizeof(*header));
+    if (header->magic != kSparseBinaryMagic ||
+        offset + sizeof(*header) + header->stored_bytes > _size) {
+      return -1;
+    }
+    return 0;
+  }
+
+  const char* _data;
+  size_t _size;
+};
+
+// read only mmap of a local file
+class SparseBinaryMmap {
+ public:
+  SparseBinaryMmap() {}
+  SparseBinaryMmap(const SparseBinaryMmap&) = delete;
+  SparseBinaryMmap& operator=(const SparseBinaryMmap&) = delete;
+  ~SparseBinaryMmap() {
+    if (_data != NULL) {
+      munmap(_data, _size);
+    }
+  }
+
+  int Open(const std::string& path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      return -1;
+    }
+    _size = st.st_size;
+    if (_size > 0) {
+      void* data = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (data == MAP_FAILED) {
+        close(fd);
+        return -1;
+      }
+      _data = static_cast<char*>(data);
+      madvise(_data, _size, MADV_SEQUENTIAL);
+    }
+    close(fd);
+    return 0;
+  }
+
+  const char* data() const { return _data; }
+  size_t size() const { return _size; }
+
+ private:
+  char* _data = NULL;
+  size_t _size = 0;
+};
+
+}  // namespace distributed
+}  // namespace paddle
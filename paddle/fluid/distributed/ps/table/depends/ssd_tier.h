@@ -0,0 +1,134 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace paddle {
+namespace distributed {
+
+// Count-min sketch of 4 bit counters that estimates how often a key was
+// accessed recently. All counters are halved after every sample_size
+// increments, so the estimate favours keys that are both frequent and recent.
+// It is used by SSDSparseTable to decide which features stay in memory.
+// Not thread safe, every table shard owns one.
+class FrequencySketch {
+ public:
+  FrequencySketch() {}
+  explicit FrequencySketch(size_t capacity) { Resize(capacity); }
+
+  // capacity is the number of keys that are expected to be tracked
+  void Resize(size_t capacity) {
+    size_t words = 8;
+    while (words < capacity / 4) {
+      words <<= 1;
+    }
+    _table.assign(words, 0);
+    _mask = words - 1;
+    _sample_size = capacity < 8 ? 80 : capacity * 10;
+    _additions = 0;
+  }
+
+  void Increment(uint64_t key) {
+    if (_table.empty()) {
+      return;
+    }
+    bool added = false;
+    for (int row = 0; row < kDepth; ++row) {
+      uint64_t hash = Hash(key, row);
+      uint64_t& word = _table[hash & _mask];
+      int shift = Offset(hash);
+      if (((word >> shift) & 0xfULL) != 0xfULL) {
+        word += 1ULL << shift;
+        added = true;
+      }
+    }
+    if (added && ++_additions >= _sample_size) {
+      Reset();
+    }
+  }
+
+  uint32_t Estimate(uint64_t key) const {
+    if (_table.empty()) {
+      return 0;
+    }
+    uint32_t freq = 0xf;
+    for (int row = 0; row < kDepth; ++row) {
+      uint64_t hash = Hash(key, row);
+      uint32_t count = (_table[hash & _mask] >> Offset(hash)) & 0xfULL;
+      freq = count < freq ? count : freq;
+    }
+    return freq;
+  }
+
+ private:
+  static constexpr int kDepth = 4;
+
+  static uint64_t Hash(uint64_t key, int row) {
+    static const uint64_t kSeeds[kDepth] = {
+        0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL, 0x9ae16a3b2f90404fULL,
+        0xcbf29ce484222325ULL};
+    uint64_t hash = (key + kSeeds[row]) * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 32;
+    hash *= 0xff51afd7ed558ccdULL;
+    return hash ^ (hash >> 29);
+  }
+  // picks one of the 16 counters of a word with bits the mask does not use
+  static int Offset(uint64_t hash) { return ((hash >> 60) & 0xf) << 2; }
+
+  void Reset() {
+    for (auto& word : _table) {
+      word = (word >> 1) & 0x7777777777777777ULL;
+    }
+    _additions /= 2;
+  }
+
+  std::vector<uint64_t> _table;
+  uint64_t _mask = 0;
+  size_t _sample_size = 0;
+  size_t _additions = 0;
+};
+
+// Counters of the memory and ssd tiers of SSDSparseTable. Every shard task
+// accumulates its own counts and adds them once per request. writeback counts
+// the values the writeback thread has put into rocksdb, several evictions of
+// a key before it is written count once.
+struct SsdTierStats {
+  std::atomic<uint64_t> mem_hit{0};
+  std::atomic<uint64_t> ssd_hit{0};
+  std::atomic<uint64_t> miss{0};
+  std::atomic<uint64_t> promotion{0};
+  std::atomic<uint64_t> demotion{0};
+  std::atomic<uint64_t> writeback{0};
+
+  std::string ToString() const {
+    uint64_t mem = mem_hit.load();
+    uint64_t ssd = ssd_hit.load();
+    uint64_t total = mem + ssd + miss.load();
+    std::stringstream ss;
+    ss << "mem_hit:" << mem << " ssd_hit:" << ssd << " miss:" << miss.load()
+       << " mem_hit_rate:" << (total == 0 ? 0.0 : 1.0 * mem / total)
+       << " promotion:" << promotion.load() << " demotion:" << demotion.load()
+       << " writeback:" << writeback.load();
+    return ss.str();
+  }
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,310 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <new>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <glog/logging.h>
+
+namespace paddle {
+namespace distributed {
+
+// Open addressing hash map in the style of swiss tables. Every slot has one
+// control byte which is either empty, deleted or the low 7 bits of the key
+// hash. A lookup loads a group of 16 control bytes, matches the 7 bit tag of
+// all of them at once (with SSE2 when available) and only compares the keys
+// of matching slots, so a miss rarely touches the slot array at all.
+//
+// The interface follows the subset of mct::closed_hash_map used by
+// SparseTableShard: hashes are computed by the caller as HASH()(key) and
+// passed in, and erase does not move other elements, so iterators stay valid.
+template <class KEY, class VALUE, class HASH = std::hash<KEY>>
+class SwissHashMap {
+ public:
+  typedef std::pair<KEY, VALUE> value_type;
+  static constexpr size_t kGroupWidth = 16;
+
+  class iterator {
+   public:
+    iterator() : _ctrl(NULL), _slot(NULL), _end(NULL) {}
+    iterator(const int8_t* ctrl, value_type* slot, const int8_t* end)
+        : _ctrl(ctrl), _slot(slot), _end(end) {}
+    value_type& operator*() const { return *_slot; }
+    value_type* operator->() const { return _slot; }
+    iterator& operator++() {
+      ++_ctrl;
+      ++_slot;
+      skip_empty_slots();
+      return *this;
+    }
+    iterator operator++(int) {
+      iterator ret = *this;
+      ++*this;
+      return ret;
+    }
+    friend bool operator==(const iterator& a, const iterator& b) {
+      return a._slot == b._slot;
+    }
+    friend bool operator!=(const iterator& a, const iterator& b) {
+      return a._slot != b._slot;
+    }
+
+   private:
+    friend class SwissHashMap;
+    void skip_empty_slots() {
+      while (_ctrl != _end && *_ctrl < 0) {
+        ++_ctrl;
+        ++_slot;
+      }
+    }
+    const int8_t* _ctrl;
+    value_type* _slot;
+    const int8_t* _end;
+  };
+
+  SwissHashMap() {}
+  SwissHashMap(const SwissHashMap&) = delete;
+  SwissHashMap& operator=(const SwissHashMap&) = delete;
+  ~SwissHashMap() {
+    clear();
+    free(_ctrl);
+    free(_slots);
+  }
+
+  size_t size() const { return _size; }
+  bool empty() const { return _size == 0; }
+  size_t capacity() const { return _capacity; }
+  void max_load_factor(float x) {
+    CHECK(x > 0.0 && x < 1.0) << "max_load_factor must be in (0, 1)";
+    _max_load_factor = x;
+  }
+
+  iterator begin() {
+    iterator it(_ctrl, _slots, _ctrl + _capacity);
+    it.skip_empty_slots();
+    return it;
+  }
+  iterator end() {
+    return iterator(_ctrl + _capacity, _slots + _capacity, _ctrl + _capacity);
+  }
+
+  iterator find_with_hash(const KEY& key, size_t hash) {
+    if (_size == 0) {
+      return end();
+    }
+    hash = mix(hash);
+    int8_t tag = h2(hash);
+    size_t offset = h1(hash) & (_capacity - 1);
+    for (size_t step = kGroupWidth;; step += kGroupWidth) {
+      uint32_t match = match_tag(_ctrl + offset, tag);
+      while (match != 0) {
+        size_t idx = (offset + __builtin_ctz(match)) & (_capacity - 1);
+        if (_slots[idx].first == key) {
+          return iterator(_ctrl + idx, _slots + idx, _ctrl + _capacity);
+        }
+        match &= match - 1;
+      }
+      if (match_tag(_ctrl + offset, kEmpty) != 0) {
+        return end();
+      }
+      offset = (offset + step) & (_capacity - 1);
+    }
+  }
+  iterator find(const KEY& key) { return find_with_hash(key, _hasher(key)); }
+
+  std::pair<iterator, bool> insert_with_hash(const value_type& value,
+                                             size_t hash) {
+    iterator it = find_with_hash(value.first, hash);
+    if (it != end()) {
+      return {it, false};
+    }
+    if (_capacity == 0 ||
+        _size + _deleted + 1 > _capacity * _max_load_factor) {
+      // drop tombstones without growing when they take most of the room
+      rehash(_size + 1 > _capacity * _max_load_factor / 2 ? _capacity * 2
+                                                          : _capacity);
+    }
+    size_t idx = find_insert_slot(mix(hash));
+    if (_ctrl[idx] == kDeleted) {
+      --_deleted;
+    }
+    set_ctrl(idx, h2(mix(hash)));
+    new (_slots + idx) value_type(value);
+    ++_size;
+    return {iterator(_ctrl + idx, _slots + idx, _ctrl + _capacity), true};
+  }
+  std::pair<iterator, bool> insert(const value_type& value) {
+    return insert_with_hash(value, _hasher(value.first));
+  }
+
+  // erase returns the iterator following it, quick_erase does not need to
+  // look for it
+  iterator erase(iterator it) {
+    quick_erase(it);
+    ++it;
+    return it;
+  }
+  void quick_erase(iterator it) {
+    size_t idx = it._slot - _slots;
+    _slots[idx].~value_type();
+    set_ctrl(idx, kDeleted);
+    --_size;
+    ++_deleted;
+  }
+  size_t erase(const KEY& key) {
+    iterator it = find(key);
+    if (it == end()) {
+      return 0;
+    }
+    quick_erase(it);
+    return 1;
+  }
+
+  void clear() {
+    if (_size != 0) {
+      for (size_t i = 0; i < _capacity; ++i) {
+        if (_ctrl[i] >= 0) {
+          _slots[i].~value_type();
+        }
+      }
+    }
+    if (_ctrl != NULL) {
+      memset(_ctrl, kEmpty, _capacity + kGroupWidth);
+    }
+    _size = 0;
+    _deleted = 0;
+  }
+
+  // hint the cache about the first group that a lookup of hash will probe,
+  // issue it a few keys ahead of the lookup itself
+  void prefetch(size_t hash) const {
+    if (_capacity == 0) {
+      return;
+    }
+    size_t offset = h1(mix(hash)) & (_capacity - 1);
+    __builtin_prefetch(_ctrl + offset);
+    __builtin_prefetch(_slots + offset);
+  }
+
+ private:
+  static constexpr int8_t kEmpty = -128;
+  static constexpr int8_t kDeleted = -2;
+
+  // the caller's hash may be the identity, which gives a poor tag
+  static size_t mix(size_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash;
+  }
+  static size_t h1(size_t hash) { return hash >> 7; }
+  static int8_t h2(size_t hash) { return static_cast<int8_t>(hash & 0x7f); }
+
+  // bit i of the result is set if ctrl[i] == tag, for the 16 bytes at ctrl
+  static uint32_t match_tag(const int8_t* ctrl, int8_t tag) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return static_cast<uint32_t>(
+        _mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(tag))));
+#else
+    uint32_t match = 0;
+    for (size_t i = 0; i < kGroupWidth; ++i) {
+      match |= static_cast<uint32_t>(ctrl[i] == tag) << i;
+    }
+    return match;
+#endif
+  }
+  // bit i of the result is set if ctrl[i] is empty or deleted
+  static uint32_t match_empty_or_deleted(const int8_t* ctrl) {
+#ifdef __SSE2__
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return static_cast<uint32_t>(_mm_movemask_epi8(group));
+#else
+    uint32_t match = 0;
+    for (size_t i = 0; i < kGroupWidth; ++i) {
+      match |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+    }
+    return match;
+#endif
+  }
+
+  size_t find_insert_slot(size_t hash) const {
+    size_t offset = h1(hash) & (_capacity - 1);
+    for (size_t step = kGroupWidth;; step += kGroupWidth) {
+      uint32_t match = match_empty_or_deleted(_ctrl + offset);
+      if (match != 0) {
+        return (offset + __builtin_ctz(match)) & (_capacity - 1);
+      }
+      offset = (offset + step) & (_capacity - 1);
+    }
+  }
+
+  // the first kGroupWidth control bytes are mirrored after the last one, so
+  // a group can be loaded at any offset without wrapping around
+  void set_ctrl(size_t idx, int8_t value) {
+    _ctrl[idx] = value;
+    if (idx < kGroupWidth) {
+      _ctrl[_capacity + idx] = value;
+    }
+  }
+
+  void rehash(size_t capacity) {
+    capacity = capacity < kGroupWidth ? kGroupWidth : capacity;
+    int8_t* old_ctrl = _ctrl;
+    value_type* old_slots = _slots;
+    size_t old_capacity = _capacity;
+
+    _ctrl = reinterpret_cast<int8_t*>(malloc(capacity + kGroupWidth));
+    _slots = reinterpret_cast<value_type*>(
+        malloc(capacity * sizeof(value_type)));
+    CHECK(_ctrl != NULL && _slots != NULL)
+        << "failed to allocate swiss hash map of capacity " << capacity;
+    memset(_ctrl, kEmpty, capacity + kGroupWidth);
+    _capacity = capacity;
+    _deleted = 0;
+
+    for (size_t i = 0; i < old_capacity; ++i) {
+      if (old_ctrl[i] >= 0) {
+        size_t hash = mix(_hasher(old_slots[i].first));
+        size_t idx = find_insert_slot(hash);
+        set_ctrl(idx, h2(hash));
+        new (_slots + idx) value_type(std::move(old_slots[i]));
+        old_slots[i].~value_type();
+      }
+    }
+    free(old_ctrl);
+    free(old_slots);
+  }
+
+  int8_t* _ctrl = NULL;
+  value_type* _slots = NULL;
+  size_t _capacity = 0;  // power of 2, or 0 before the first insert
+  size_t _size = 0;
+  size_t _deleted = 0;
+  float _max_load_factor = 0.875;
+  HASH _hasher;
+};
+
+}  // namespace distributed
+}  // namespace paddle
@@ -13,9 +13,14 @@
 // limitations under the License.
 
 #include <omp.h>
+#include <sched.h>
+#include <algorithm>
+#include <fstream>
+#include <set>
 #include <sstream>
 
 #include "paddle/fluid/distributed/common/cost_timer.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_binary_format.h"
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 #include "paddle/fluid/framework/io/fs.h"
 
@@ -30,15 +35,95 @@ DEFINE_bool(pserver_create_value_when_push, true,
 DEFINE_bool(pserver_enable_create_feasign_randomly, false,
             "pserver_enable_create_feasign_randomly");
 DEFINE_int32(pserver_table_save_max_retry, 3, "pserver_table_save_max_retry");
+DEFINE_bool(pserver_sparse_value_slab, false,
+            "pack sparse feature values of a shard into contiguous slabs");
+DEFINE_int32(pserver_sparse_task_pool_size, 24,
+             "number of single thread task pools that serve the local shards "
+             "of a sparse table");
+DEFINE_bool(pserver_sparse_task_pool_numa_bind, false,
+            "bind the sparse table task pools to the numa nodes round robin, "
+            "so that every shard is served and first touched by one node");
+DEFINE_int32(pserver_sparse_batch_size, 64,
+             "number of keys a sparse table shard selects or updates with "
+             "one accessor call");
+DEFINE_int32(pserver_sparse_prefetch_distance, 8,
+             "number of keys a sparse table shard prefetches ahead of the "
+             "key it looks up, only the swiss hash index supports prefetch");
 
 namespace paddle {
 namespace distributed {
 
+// Returns the cpus of every numa node in /sys, or nothing when the topology
+// is unavailable.
+static std::vector<std::vector<int>> NumaNodeCpus() {
+  std::vector<std::vector<int>> node_cpus;
+  for (int node = 0;; ++node) {
+    std::ifstream file(paddle::string::format_string(
+        "/sys/devices/system/node/node%d/cpulist", node));
+    std::string cpulist;
+    if (!std::getline(file, cpulist)) {
+      break;
+    }
+    std::vector<int> cpus;
+    auto ranges = paddle::string::split_string<std::string>(cpulist, ",");
+    for (auto& range : ranges) {
+      auto bounds = paddle::string::split_string<std::string>(range, "-");
+      int first = std::stoi(bounds[0]);
+      int last = bounds.size() > 1 ? std::stoi(bounds[1]) : first;
+      for (int cpu = first; cpu <= last; ++cpu) {
+        cpus.push_back(cpu);
+      }
+    }
+    node_cpus.push_back(std::move(cpus));
+  }
+  return node_cpus;
+}
+
 int32_t MemorySparseTable::Initialize() {
+  _task_pool_size = FLAGS_pserver_sparse_task_pool_size;
+  PADDLE_ENFORCE_GT(_task_pool_size, 0,
+                    paddle::platform::errors::InvalidArgument(
+                        "pserver_sparse_task_pool_size must be positive."));
+  PADDLE_ENFORCE_GT(FLAGS_pserver_sparse_batch_size, 0,
+                    paddle::platform::errors::InvalidArgument(
+                        "pserver_sparse_batch_size must be positive."));
+  PADDLE_ENFORCE_GE(FLAGS_pserver_sparse_prefetch_distance, 0,
+                    paddle::platform::errors::InvalidArgument(
+                        "pserver_sparse_prefetch_distance must not be "
+                        "negative."));
+  _batch_size = FLAGS_pserver_sparse_batch_size;
   _shards_task_pool.resize(_task_pool_size);
   for (int i = 0; i < _shards_task_pool.size(); ++i) {
     _shards_task_pool[i].reset(new ::ThreadPool(1));
   }
+  if (FLAGS_pserver_sparse_task_pool_numa_bind) {
+    auto node_cpus = NumaNodeCpus();
+    if (node_cpus.size() > 1) {
+      std::vector<std::future<void>> binds;
+      for (int i = 0; i < _shards_task_pool.size(); ++i) {
+        auto& cpus = node_cpus[i % node_cpus.size()];
+        binds.push_back(_shards_task_pool[i]->enqueue([i, &cpus]() {
+          cpu_set_t mask;
+          CPU_ZERO(&mask);
+          for (int cpu : cpus) {
+            CPU_SET(cpu, &mask);
+          }
+          if (sched_setaffinity(0, sizeof(mask), &mask) != 0) {
+            LOG(WARNING) << "failed to bind sparse table task pool " << i
+                         << " to its numa node";
+          }
+        }));
+      }
+      for (auto& bind : binds) {
+        bind.wait();
+      }
+      VLOG(0) << "bind " << _task_pool_size << " sparse table task pools to "
+              << node_cpus.size() << " numa nodes";
+    } else {
+      VLOG(0) << "numa topology unavailable or single node, sparse table "
+                 "task pools are not bound";
+    }
+  }
   auto& profiler = CostProfiler::instance();
   profiler.register_profiler("pserver_sparse_update_all");
   profiler.register_profiler("pserver_sparse_select_all");
@@ -62,21 +147,146 @@ int32_t MemorySparseTable::InitializeValue() {
           << _avg_local_shard_num
           << " _real_local_shard_num: " << _real_local_shard_num;
 
-  _local_shards.reset(new shard_type[_real_local_shard_num]);
+  if (FLAGS_pserver_sparse_value_slab) {
+    _value_slabs.reset(new FeatureValueSlab[_real_local_shard_num]);
+  }
+  _local_shards.reset();
+  _swiss_local_shards.reset();
+  _erased_keys.resize(_real_local_shard_num);
+  _prefetch_distance = 0;
+  if (_config.sparse_shard_index() == SWISS_HASH_INDEX) {
+    _swiss_local_shards.reset(new swiss_shard_type[_real_local_shard_num]);
+    _prefetch_distance = FLAGS_pserver_sparse_prefetch_distance;
+  } else {
+    _local_shards.reset(new shard_type[_real_local_shard_num]);
+  }
+  VLOG(1) << "memory sparse table shard index: "
+          << SparseShardIndexType_Name(_config.sparse_shard_index());
 
   return 0;
 }
 
 int32_t MemorySparseTable::Load(const std::string& path,
                                 const std::string& param) {
+  return VisitLocalShards([&](auto* local_shards) {
+    return Load(local_shards, path, param);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::Load(SHARD* local_shards, const std::string& path,
+                                const std::string& param) {
   std::string table_path = TableDir(path);
-  auto file_list = _afs_client.list(table_path);
+  int32_t ret = LoadTableFiles(local_shards, table_path, param,
+                               _afs_client.list(table_path));
+  if (ret != 0) {
+    return ret;
+  }
+  // replay the delta checkpoints saved after the base in order
+  _delta_seq = 0;
+  while (_afs_client.exist(DeltaDir(path, _delta_seq + 1))) {
+    std::string delta_path = DeltaDir(path, _delta_seq + 1);
+    ret = LoadTableFiles(local_shards, delta_path, param,
+                         _afs_client.list(delta_path));
+    if (ret != 0) {
+      return ret;
+    }
+    ++_delta_seq;
+  }
+  if (_delta_seq > 0) {
+    LOG(INFO) << "MemorySparseTable replayed " << _delta_seq
+              << " delta checkpoints of " << path;
+  }
+  MarkCheckpointed(local_shards);
+  return 0;
+}
+
+template <class SHARD>
+void MemorySparseTable::MarkCheckpointed(SHARD* local_shards) {
+  _track_erased = true;
+  for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    for (auto it = local_shards[i].begin(); it != local_shards[i].end();
+         ++it) {
+      it.value().set_dirty(false);
+    }
+    _erased_keys[i].clear();
+  }
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::ApplyTombstones(
+    SHARD* local_shards, std::vector<std::string>* file_list) {
+  size_t file_start_idx = _shard_idx * _avg_local_shard_num;
+  std::set<std::string> tombstones;
+  for (auto it = file_list->begin(); it != file_list->end();) {
+    if (paddle::string::ends_with(*it, ".del")) {
+      tombstones.insert(*it);
+      it = file_list->erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (tombstones.empty()) {
+    return 0;
+  }
+  std::vector<std::string> data_files;
+  for (auto& file : *file_list) {
+    if (!paddle::string::ends_with(file, ".idx")) {
+      data_files.push_back(file);
+    }
+  }
+  if (data_files.size() != static_cast<size_t>(_sparse_table_shard_num)) {
+    LOG(WARNING) << "MemorySparseTable file_size:" << data_files.size()
+                 << " not equal to expect_shard_num:"
+                 << _sparse_table_shard_num;
+    return -1;
+  }
+  for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    std::string tombstone = data_files[file_start_idx + i] + ".del";
+    if (tombstones.count(tombstone) == 0) {
+      continue;
+    }
+    std::string content;
+    if (ReadWholeFile(tombstone, &content) != 0) {
+      LOG(ERROR) << "MemorySparseTable failed to read " << tombstone;
+      return -1;
+    }
+    auto& shard = local_shards[i];
+    for (auto& key :
+         paddle::string::split_string<std::string>(content, "\n")) {
+      if (key.empty()) {
+        continue;
+      }
+      auto itr = shard.find(std::strtoul(key.c_str(), NULL, 10));
+      if (itr != shard.end()) {
+        shard.quick_erase(itr);
+      }
+    }
+  }
+  return 0;
+}
 
+template <class SHARD>
+int32_t MemorySparseTable::LoadTableFiles(SHARD* local_shards,
+                                          const std::string& table_path,
+                                          const std::string& param,
+                                          std::vector<std::string> file_list) {
   std::sort(file_list.begin(), file_list.end());
   for (auto file : file_list) {
     VLOG(1) << "MemorySparseTable::Load() file list: " << file;
   }
 
+  size_t file_start_idx = _shard_idx * _avg_local_shard_num;
+  if (ApplyTombstones(local_shards, &file_list) != 0) {
+    return -1;
+  }
+
+  for (auto& file : file_list) {
+    if (paddle::string::ends_with(file, ".bin")) {
+      return LoadBinary(local_shards, file_list);
+    }
+  }
+
   int load_param = atoi(param.c_str());
   auto expect_shard_num = _sparse_table_shard_num;
   if (file_list.size() != expect_shard_num) {
@@ -85,12 +295,11 @@ int32_t MemorySparseTable::Load(const std::string& path,
     return -1;
   }
   if (file_list.size() == 0) {
-    LOG(WARNING) << "MemorySparseTable load file is empty, path:" << path;
+    LOG(WARNING) << "MemorySparseTable load file is empty, path:"
+                 << table_path;
     return -1;
   }
 
-  size_t file_start_idx = _shard_idx * _avg_local_shard_num;
-
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
 
@@ -115,12 +324,12 @@ int32_t MemorySparseTable::Load(const std::string& path,
       std::string line_data;
       auto read_channel = _afs_client.open_r(channel_config, 0, &err_no);
       char* end = NULL;
-      auto& shard = _local_shards[i];
+      auto& shard = local_shards[i];
       try {
         while (read_channel->read_line(line_data) == 0 &&
                line_data.size() > 1) {
           uint64_t key = std::strtoul(line_data.data(), &end, 10);
-          auto& value = shard[key];
+          auto& value = AcquireValue(&shard, i, key);
           value.resize(feature_value_size);
           int parse_size = _value_accesor->ParseFromString(++end, value.data());
           value.resize(parse_size);
@@ -159,8 +368,51 @@ int32_t MemorySparseTable::Load(const std::string& path,
 
 int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
                                        const std::string& param) {
-  std::string table_path = TableDir(path);
+  return VisitLocalShards([&](auto* local_shards) {
+    return LoadLocalFS(local_shards, path, param);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::LoadLocalFS(SHARD* local_shards,
+                                       const std::string& path,
+                                       const std::string& param) {
+  int32_t ret = LoadLocalFSFiles(local_shards, TableDir(path), param);
+  if (ret != 0) {
+    return ret;
+  }
+  // replay the delta checkpoints saved after the base in order
+  _delta_seq = 0;
+  while (paddle::framework::localfs_exists(DeltaDir(path, _delta_seq + 1))) {
+    ret = LoadLocalFSFiles(local_shards, DeltaDir(path, _delta_seq + 1),
+                           param);
+    if (ret != 0) {
+      return ret;
+    }
+    ++_delta_seq;
+  }
+  if (_delta_seq > 0) {
+    LOG(INFO) << "MemorySparseTable replayed " << _delta_seq
+              << " delta checkpoints of " << path;
+  }
+  MarkCheckpointed(local_shards);
+  return 0;
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::LoadLocalFSFiles(SHARD* local_shards,
+                                            const std::string& table_path,
+                                            const std::string& param) {
   auto file_list = paddle::framework::localfs_list(table_path);
+  std::sort(file_list.begin(), file_list.end());
+  if (ApplyTombstones(local_shards, &file_list) != 0) {
+    return -1;
+  }
+  for (auto& file : file_list) {
+    if (paddle::string::ends_with(file, ".bin")) {
+      return LoadBinary(local_shards, file_list);
+    }
+  }
 
   int load_param = atoi(param.c_str());
   auto expect_shard_num = _sparse_table_shard_num;
@@ -170,7 +422,8 @@ int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
     return -1;
   }
   if (file_list.size() == 0) {
-    LOG(WARNING) << "MemorySparseTable load file is empty, path:" << path;
+    LOG(WARNING) << "MemorySparseTable load file is empty, path:"
+                 << table_path;
     return -1;
   }
 
@@ -192,11 +445,11 @@ int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
       std::string line_data;
       std::ifstream file(file_list[file_start_idx + i]);
       char* end = NULL;
-      auto& shard = _local_shards[i];
+      auto& shard = local_shards[i];
       try {
         while (std::getline(file, line_data) && line_data.size() > 1) {
           uint64_t key = std::strtoul(line_data.data(), &end, 10);
-          auto& value = shard[key];
+          auto& value = AcquireValue(&shard, i, key);
           value.resize(feature_value_size);
           int parse_size = _value_accesor->ParseFromString(++end, value.data());
           value.resize(parse_size);
@@ -230,12 +483,30 @@ int32_t MemorySparseTable::LoadLocalFS(const std::string& path,
 
 int32_t MemorySparseTable::Save(const std::string& dirname,
                                 const std::string& param) {
+  return VisitLocalShards([&](auto* local_shards) {
+    return Save(local_shards, dirname, param);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::Save(SHARD* local_shards,
+                                const std::string& dirname,
+                                const std::string& param) {
   VLOG(0) << "MemorySparseTable::save dirname: " << dirname;
-  int save_param =
-      atoi(param.c_str());  // checkpoint:0  xbox delta:1  xbox base:2
-  std::string table_path = TableDir(dirname);
+  // checkpoint:0  xbox delta:1  xbox base:2  checkpoint delta:6
+  int save_param = atoi(param.c_str());
+  bool is_delta = save_param == kDeltaCheckpointSaveParam;
+  bool is_checkpoint = save_param == 0 || is_delta;
+  // a delta is written like a checkpoint, so that it loads like one
+  int format_param = is_delta ? 0 : save_param;
+  std::string table_path =
+      is_delta ? DeltaDir(dirname, _delta_seq + 1) : TableDir(dirname);
   _afs_client.remove(paddle::string::format_string(
       "%s/part-%03d-*", table_path.c_str(), _shard_idx));
+  if (save_param == 0) {
+    // the deltas of the previous base are stale now
+    _afs_client.remove_dir(DeltaRootDir(dirname));
+  }
   std::atomic<uint32_t> feasign_size_all{0};
 
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
@@ -244,8 +515,36 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
   omp_set_num_threads(thread_num);
 #pragma omp parallel for schedule(dynamic)
   for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    if (UseBinaryFormat(save_param)) {
+      std::string path = paddle::string::format_string(
+          "%s/part-%03d-%05d.bin", table_path.c_str(), _shard_idx,
+          file_start_idx + i);
+      int retry_num = 0;
+      int64_t feasign_size =
+          SaveShardBinary(&local_shards[i], path, save_param);
+      while (feasign_size < 0) {
+        ++retry_num;
+        LOG(ERROR) << "MemorySparseTable save binary failed, retry it! path:"
+                   << path << " , retry_num=" << retry_num;
+        if (retry_num > FLAGS_pserver_table_save_max_retry) {
+          LOG(ERROR) << "MemorySparseTable save binary failed reach max limit!";
+          exit(-1);
+        }
+        feasign_size = SaveShardBinary(&local_shards[i], path, save_param);
+      }
+      if (is_delta && SaveTombstones(i, path) != 0) {
+        LOG(ERROR) << "MemorySparseTable save tombstones failed! path:"
+                   << path;
+        exit(-1);
+      }
+      _erased_keys[i].clear();
+      feasign_size_all += feasign_size;
+      LOG(INFO) << "MemorySparseTable save binary success, path: " << path;
+      continue;
+    }
     FsChannelConfig channel_config;
-    if (_config.compress_in_save() && (save_param == 0 || save_param == 3)) {
+    if (_config.compress_in_save() &&
+        (format_param == 0 || format_param == 3)) {
       channel_config.path = paddle::string::format_string(
           "%s/part-%03d-%05d.gz", table_path.c_str(), _shard_idx,
           file_start_idx + i);
@@ -254,14 +553,15 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
           paddle::string::format_string("%s/part-%03d-%05d", table_path.c_str(),
                                         _shard_idx, file_start_idx + i);
     }
-    channel_config.converter = _value_accesor->Converter(save_param).converter;
+    channel_config.converter =
+        _value_accesor->Converter(format_param).converter;
     channel_config.deconverter =
-        _value_accesor->Converter(save_param).deconverter;
+        _value_accesor->Converter(format_param).deconverter;
     bool is_write_failed = false;
     int feasign_size = 0;
     int retry_num = 0;
     int err_no = 0;
-    auto& shard = _local_shards[i];
+    auto& shard = local_shards[i];
     do {
       err_no = 0;
       feasign_size = 0;
@@ -269,7 +569,12 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
       auto write_channel =
           _afs_client.open_w(channel_config, 1024 * 1024 * 40, &err_no);
       for (auto it = shard.begin(); it != shard.end(); ++it) {
-        if (_value_accesor->Save(it.value().data(), save_param)) {
+        if (is_delta && !it.value().dirty()) {
+          continue;
+        }
+        if (UpdateAndTrackDirty(it.value(), [this, save_param](float* value) {
+              return _value_accesor->Save(value, save_param);
+            })) {
           std::string format_value = _value_accesor->ParseToString(
               it.value().data(), it.value().size());
           if (0 !=
@@ -301,13 +606,33 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
         exit(-1);
       }
     } while (is_write_failed);
+    if (is_delta && SaveTombstones(i, channel_config.path) != 0) {
+      LOG(ERROR) << "MemorySparseTable save tombstones failed! path:"
+                 << channel_config.path;
+      exit(-1);
+    }
     feasign_size_all += feasign_size;
     for (auto it = shard.begin(); it != shard.end(); ++it) {
-      _value_accesor->UpdateStatAfterSave(it.value().data(), save_param);
+      UpdateAndTrackDirty(it.value(), [this, save_param](float* value) {
+        _value_accesor->UpdateStatAfterSave(value, save_param);
+        return true;
+      });
+      if (is_checkpoint) {
+        it.value().set_dirty(false);
+      }
+    }
+    if (is_checkpoint) {
+      _erased_keys[i].clear();
     }
     LOG(INFO) << "MemorySparseTable save prefix success, path: "
               << channel_config.path;
   }
+  if (save_param == 0) {
+    _delta_seq = 0;
+    _track_erased = true;
+  } else if (is_delta) {
+    ++_delta_seq;
+  }
   // int32 may overflow need to change return value
   return 0;
 }
@@ -315,27 +640,63 @@ int32_t MemorySparseTable::Save(const std::string& dirname,
 int32_t MemorySparseTable::SaveLocalFS(const std::string& dirname,
                                        const std::string& param,
                                        const std::string& prefix) {
-  int save_param =
-      atoi(param.c_str());  // checkpoint:0  xbox delta:1  xbox base:2
-  std::string table_path = TableDir(dirname);
-  int feasign_cnt = 0;
+  return VisitLocalShards([&](auto* local_shards) {
+    return SaveLocalFS(local_shards, dirname, param, prefix);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::SaveLocalFS(SHARD* local_shards,
+                                       const std::string& dirname,
+                                       const std::string& param,
+                                       const std::string& prefix) {
+  // checkpoint:0  xbox delta:1  xbox base:2  checkpoint delta:6
+  int save_param = atoi(param.c_str());
+  bool is_delta = save_param == kDeltaCheckpointSaveParam;
+  bool is_checkpoint = save_param == 0 || is_delta;
+  // a delta is written like a checkpoint, so that it loads like one
+  int format_param = is_delta ? 0 : save_param;
+  std::string table_path =
+      is_delta ? DeltaDir(dirname, _delta_seq + 1) : TableDir(dirname);
+  if (save_param == 0) {
+    // the deltas of the previous base are stale now
+    paddle::framework::localfs_remove(DeltaRootDir(dirname));
+  }
+  paddle::framework::localfs_mkdir(table_path);
   size_t file_start_idx = _avg_local_shard_num * _shard_idx;
 
   int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
-  std::atomic<uint32_t> feasign_size_all{0};
 
   omp_set_num_threads(thread_num);
 #pragma omp parallel for schedule(dynamic)
   for (size_t i = 0; i < _real_local_shard_num; ++i) {
-    feasign_cnt = 0;
-    auto& shard = _local_shards[i];
+    int feasign_cnt = 0;
+    auto& shard = local_shards[i];
     std::string file_name = paddle::string::format_string(
         "%s/part-%s-%03d-%05d", table_path.c_str(), prefix.c_str(), _shard_idx,
         file_start_idx + i);
+    if (UseBinaryFormat(save_param)) {
+      file_name += ".bin";
+      int64_t feasign_size = SaveShardBinary(&shard, file_name, save_param);
+      if (is_delta && SaveTombstones(i, file_name) != 0) {
+        LOG(ERROR) << "MemorySparseTable save tombstones failed! path:"
+                   << file_name;
+        exit(-1);
+      }
+      _erased_keys[i].clear();
+      LOG(INFO) << "MemorySparseTable save binary, path:" << file_name
+                << " feasign_cnt: " << feasign_size;
+      continue;
+    }
     std::ofstream os;
     os.open(file_name);
     for (auto it = shard.begin(); it != shard.end(); ++it) {
-      if (_value_accesor->Save(it.value().data(), save_param)) {
+      if (is_delta && !it.value().dirty()) {
+        continue;
+      }
+      if (UpdateAndTrackDirty(it.value(), [this, format_param](float* value) {
+            return _value_accesor->Save(value, format_param);
+          })) {
         std::string format_value =
             _value_accesor->ParseToString(it.value().data(), it.value().size());
         std::string out_line = paddle::string::format_string(
@@ -346,29 +707,276 @@ int32_t MemorySparseTable::SaveLocalFS(const std::string& dirname,
       }
     }
     os.close();
+    if (is_delta && SaveTombstones(i, file_name) != 0) {
+      LOG(ERROR) << "MemorySparseTable save tombstones failed! path:"
+                 << file_name;
+      exit(-1);
+    }
+    if (is_checkpoint) {
+      for (auto it = shard.begin(); it != shard.end(); ++it) {
+        it.value().set_dirty(false);
+      }
+      _erased_keys[i].clear();
+    }
     LOG(INFO) << "MemorySparseTable save prefix success, path:" << file_name
               << "feasign_cnt: " << feasign_cnt;
   }
+  if (save_param == 0) {
+    _delta_seq = 0;
+    _track_erased = true;
+  } else if (is_delta) {
+    ++_delta_seq;
+  }
   return 0;
 }
 
-int64_t MemorySparseTable::LocalSize() {
-  int64_t local_size = 0;
+template <class SHARD>
+int64_t MemorySparseTable::SaveShardBinary(SHARD* shard,
+                                           const std::string& path,
+                                           int save_param) {
+  FsChannelConfig channel_config;
+  channel_config.path = path;
+  int err_no = 0;
+  auto write_channel =
+      _afs_client.open_w(channel_config, 1024 * 1024 * 40, &err_no);
+  SparseBinaryWriter writer(
+      [&write_channel](const char* data, size_t size) -> int {
+        return write_channel->write(data, size) == 0 ? 0 : -1;
+      },
+      _config.compress_in_save());
+  int ret = 0;
+  bool is_delta = save_param == kDeltaCheckpointSaveParam;
+  for (auto it = shard->begin(); it != shard->end() && ret == 0; ++it) {
+    if (is_delta && !it.value().dirty()) {
+      continue;
+    }
+    if (_value_accesor->Save(it.value().data(), save_param)) {
+      ret = writer.Append(it.key(), it.value().data(), it.value().size());
+    }
+  }
+  if (ret == 0) {
+    ret = writer.Close();
+  }
+  write_channel->close();
+  if (ret != 0 || err_no == -1) {
+    _afs_client.remove(path);
+    return -1;
+  }
+
+  channel_config.path = SparseBinaryIndexPath(path);
+  auto index_channel = _afs_client.open_w(channel_config, 0, &err_no);
+  std::string index = writer.IndexString();
+  ret = index_channel->write(index.data(), index.size());
+  index_channel->close();
+  if (ret != 0 || err_no == -1) {
+    _afs_client.remove(path);
+    _afs_client.remove(channel_config.path);
+    return -1;
+  }
+  // binary files are only written by checkpoints, which leave the stats
+  // alone
+  for (auto it = shard->begin(); it != shard->end(); ++it) {
+    it.value().set_dirty(false);
+  }
+  return writer.record_num();
+}
+
+int32_t MemorySparseTable::SaveTombstones(size_t shard_id,
+                                          const std::string& data_path) {
+  auto& erased_keys = _erased_keys[shard_id];
+  if (erased_keys.empty()) {
+    return 0;
+  }
+  FsChannelConfig channel_config;
+  channel_config.path = data_path + ".del";
+  int err_no = 0;
+  auto write_channel = _afs_client.open_w(channel_config, 0, &err_no);
+  for (auto key : erased_keys) {
+    if (write_channel->write_line(std::to_string(key)) != 0) {
+      err_no = -1;
+      break;
+    }
+  }
+  write_channel->close();
+  return err_no == -1 ? -1 : 0;
+}
+
+int32_t MemorySparseTable::ReadWholeFile(const std::string& path,
+                                         std::string* content) {
+  FsChannelConfig channel_config;
+  channel_config.path = path;
+  int err_no = 0;
+  auto read_channel = _afs_client.open_r(channel_config, 0, &err_no);
+  const size_t kReadBytes = 1 << 20;
+  size_t read_bytes = 0;
+  content->clear();
+  do {
+    content->resize(content->size() + kReadBytes);
+    read_bytes = read_channel->read(&(*content)[content->size() - kReadBytes],
+                                    kReadBytes);
+    content->resize(content->size() - kReadBytes + read_bytes);
+  } while (read_bytes == kReadBytes);
+  read_channel->close();
+  return err_no == -1 ? -1 : 0;
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::LoadBinary(
+    SHARD* local_shards, const std::vector<std::string>& file_list) {
+  std::vector<std::string> data_files;
+  for (auto& file : file_list) {
+    if (paddle::string::ends_with(file, ".bin")) {
+      data_files.push_back(file);
+    }
+  }
+  std::sort(data_files.begin(), data_files.end());
+  if (data_files.size() != static_cast<size_t>(_sparse_table_shard_num)) {
+    LOG(WARNING) << "MemorySparseTable binary file_size:" << data_files.size()
+                 << " not equal to expect_shard_num:"
+                 << _sparse_table_shard_num;
+    return -1;
+  }
+  size_t file_start_idx = _shard_idx * _avg_local_shard_num;
+
+  // local files are mapped, remote ones are read into memory
+  std::vector<std::unique_ptr<SparseBinaryMmap>> mmaps(_real_local_shard_num);
+  std::vector<std::string> contents(_real_local_shard_num);
+  std::vector<std::unique_ptr<SparseBinaryReader>> readers(
+      _real_local_shard_num);
+  std::vector<std::vector<SparseBinaryBlockIndex>> indexes(
+      _real_local_shard_num);
+  std::atomic<int> failed{0};
+
+  int thread_num = _real_local_shard_num < 15 ? _real_local_shard_num : 15;
+  omp_set_num_threads(thread_num);
+#pragma omp parallel for schedule(dynamic)
   for (size_t i = 0; i < _real_local_shard_num; ++i) {
-    local_size += _local_shards[i].size();
+    const std::string& path = data_files[file_start_idx + i];
+    if (paddle::framework::fs_select_internal(path) == 0) {
+      mmaps[i].reset(new SparseBinaryMmap());
+      if (mmaps[i]->Open(path) != 0) {
+        LOG(ERROR) << "MemorySparseTable failed to mmap " << path;
+        ++failed;
+        continue;
+      }
+      readers[i].reset(
+          new SparseBinaryReader(mmaps[i]->data(), mmaps[i]->size()));
+    } else {
+      if (ReadWholeFile(path, &contents[i]) != 0) {
+        LOG(ERROR) << "MemorySparseTable failed to read " << path;
+        ++failed;
+        continue;
+      }
+      readers[i].reset(
+          new SparseBinaryReader(contents[i].data(), contents[i].size()));
+    }
+    std::string index_path = SparseBinaryIndexPath(path);
+    std::string index;
+    int ret = -1;
+    if (std::find(file_list.begin(), file_list.end(), index_path) !=
+            file_list.end() &&
+        ReadWholeFile(index_path, &index) == 0) {
+      ret = SparseBinaryReader::ParseIndex(index, &indexes[i]);
+      if (ret == 0) {
+        ret = readers[i]->CheckIndex(indexes[i]);
+      }
+    }
+    if (ret != 0) {
+      VLOG(1) << "MemorySparseTable no usable index for " << path
+              << ", scan its blocks";
+      indexes[i].clear();
+      ret = readers[i]->ScanIndex(&indexes[i]);
+    }
+    if (ret != 0) {
+      LOG(ERROR) << "MemorySparseTable corrupted binary file " << path;
+      ++failed;
+    }
+  }
+  if (failed > 0) {
+    return -1;
+  }
+
+  // blocks are decoded in parallel, also the blocks of one shard, and
+  // inserted under the lock of their shard
+  std::vector<std::pair<size_t, SparseBinaryBlockIndex>> blocks;
+  for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    for (auto& block : indexes[i]) {
+      blocks.emplace_back(i, block);
+    }
+  }
+  std::unique_ptr<std::mutex[]> shard_mutex(
+      new std::mutex[_real_local_shard_num]);
+  // set under the shard lock, a shard with a corrupted block is not loaded
+  std::vector<int> shard_failed(_real_local_shard_num, 0);
+#pragma omp parallel for schedule(dynamic)
+  for (size_t b = 0; b < blocks.size(); ++b) {
+    size_t shard_id = blocks[b].first;
+    thread_local std::string buffer;
+    std::unique_lock<std::mutex> lock(shard_mutex[shard_id],
+                                      std::defer_lock);
+    int ret = readers[shard_id]->ReadBlock(
+        blocks[b].second, &buffer,
+        [this, local_shards, shard_id, &lock](uint64_t key, const float* data,
+                                              uint32_t size) {
+          if (!lock.owns_lock()) {
+            lock.lock();
+          }
+          auto& value = AcquireValue(&local_shards[shard_id], shard_id, key);
+          value.resize(size);
+          memcpy(value.data(), data, size * sizeof(float));
+        });
+    if (ret != 0) {
+      LOG(ERROR) << "MemorySparseTable corrupted block at "
+                 << blocks[b].second.offset << " of "
+                 << data_files[file_start_idx + shard_id];
+      if (!lock.owns_lock()) {
+        lock.lock();
+      }
+      shard_failed[shard_id] = 1;
+      ++failed;
+    }
+  }
+  if (failed > 0) {
+    // the other blocks of a corrupted shard may be inserted already, drop
+    // them rather than leaving a partial shard behind
+    for (size_t i = 0; i < _real_local_shard_num; ++i) {
+      if (shard_failed[i]) {
+        local_shards[i].clear();
+      }
+    }
+    return -1;
   }
-  return local_size;
+  LOG(INFO) << "MemorySparseTable load binary success, " << blocks.size()
+            << " blocks, path from " << data_files[file_start_idx] << " to "
+            << data_files[file_start_idx + _real_local_shard_num - 1];
+  return 0;
+}
+
+int64_t MemorySparseTable::LocalSize() {
+  return VisitLocalShards([this](auto* local_shards) {
+    int64_t local_size = 0;
+    for (size_t i = 0; i < _real_local_shard_num; ++i) {
+      local_size += local_shards[i].size();
+    }
+    return local_size;
+  });
 }
 
 int64_t MemorySparseTable::LocalMFSize() {
+  return VisitLocalShards(
+      [this](auto* local_shards) { return LocalMFSize(local_shards); });
+}
+
+template <class SHARD>
+int64_t MemorySparseTable::LocalMFSize(SHARD* local_shards) {
   std::vector<int64_t> size_arr(_real_local_shard_num, 0);
   std::vector<std::future<int>> tasks(_real_local_shard_num);
   int64_t ret_size = 0;
   for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] =
         _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-            [this, shard_id, &size_arr]() -> int {
-              auto& local_shard = _local_shards[shard_id];
+            [this, local_shards, shard_id, &size_arr]() -> int {
+              auto& local_shard = local_shards[shard_id];
               for (auto it = local_shard.begin(); it != local_shard.end();
                    ++it) {
                 if (_value_accesor->HasMF(it.value().size())) {
@@ -417,8 +1025,36 @@ int32_t MemorySparseTable::Push(TableContext& context) {
   }
 }
 
+void MemorySparseTable::PartitionKeysByShard(
+    const uint64_t* keys, size_t num,
+    std::vector<std::pair<uint64_t, int>>* task_keys,
+    std::vector<size_t>* offsets) {
+  std::vector<int> shard_ids(num);
+  offsets->assign(_real_local_shard_num + 1, 0);
+  for (size_t i = 0; i < num; ++i) {
+    shard_ids[i] = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
+    ++(*offsets)[shard_ids[i] + 1];
+  }
+  for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    (*offsets)[shard_id + 1] += (*offsets)[shard_id];
+  }
+  std::vector<size_t> cursor(offsets->begin(), offsets->end() - 1);
+  task_keys->resize(num);
+  for (size_t i = 0; i < num; ++i) {
+    (*task_keys)[cursor[shard_ids[i]]++] = {keys[i], static_cast<int>(i)};
+  }
+}
+
 int32_t MemorySparseTable::PullSparse(float* pull_values,
                                       const PullSparseValue& pull_value) {
+  return VisitLocalShards([&](auto* local_shards) {
+    return PullSparse(local_shards, pull_values, pull_value);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::PullSparse(SHARD* local_shards, float* pull_values,
+                                      const PullSparseValue& pull_value) {
   CostTimer timer("pserver_sparse_select_all");
   std::vector<std::future<int>> tasks(_real_local_shard_num);
 
@@ -430,52 +1066,71 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
       _value_accesor->GetAccessorInfo().select_size / sizeof(float);
   // std::atomic<uint32_t> missed_keys{0};
 
-  std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
-      _real_local_shard_num);
-  size_t num = pull_value.numel_;
-  for (size_t i = 0; i < num; ++i) {
-    int shard_id = (pull_value.feasigns_[i] % _sparse_table_shard_num) %
-                   _avg_local_shard_num;
-    task_keys[shard_id].push_back({pull_value.feasigns_[i], i});
-  }
+  std::vector<std::pair<uint64_t, int>> task_keys;
+  std::vector<size_t> offsets;
+  PartitionKeysByShard(pull_value.feasigns_, pull_value.numel_, &task_keys,
+                       &offsets);
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] =
         _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-            [this, shard_id, &task_keys, value_size, pull_values, mf_value_size,
-             select_value_size]() -> int {
-              auto& local_shard = _local_shards[shard_id];
-              float data_buffer[value_size];  // NOLINT
-              float* data_buffer_ptr = data_buffer;
-
-              auto& keys = task_keys[shard_id];
-              for (size_t i = 0; i < keys.size(); i++) {
-                uint64_t key = keys[i].first;
-                auto itr = local_shard.find(key);
-                size_t data_size = value_size - mf_value_size;
-                if (itr == local_shard.end()) {
-                  // ++missed_keys;
-                  if (FLAGS_pserver_create_value_when_push) {
-                    memset(data_buffer, 0, sizeof(float) * data_size);
+            [this, local_shards, shard_id, &task_keys, &offsets, value_size,
+             pull_values, mf_value_size, select_value_size]() -> int {
+              auto& local_shard = local_shards[shard_id];
+              const auto* keys = task_keys.data() + offsets[shard_id];
+              size_t key_num = offsets[shard_id + 1] - offsets[shard_id];
+              // values of the batch that are not stored with the full size
+              // are padded in data_buffer before Select
+              std::vector<float> data_buffer(value_size * _batch_size);
+              std::vector<const float*> batch_values;
+              std::vector<float*> batch_selects;
+              for (size_t begin = 0; begin < key_num; begin += _batch_size) {
+                size_t end = std::min<size_t>(key_num, begin + _batch_size);
+                batch_values.clear();
+                batch_selects.clear();
+                for (size_t i = begin; i < end; i++) {
+                  if (_prefetch_distance > 0 &&
+                      i + _prefetch_distance < key_num) {
+                    local_shard.prefetch(keys[i + _prefetch_distance].first);
+                  }
+                  uint64_t key = keys[i].first;
+                  float* data_buffer_ptr =
+                      data_buffer.data() + (i - begin) * value_size;
+                  auto itr = local_shard.find(key);
+                  size_t data_size = value_size - mf_value_size;
+                  if (itr == local_shard.end()) {
+                    // ++missed_keys;
+                    if (FLAGS_pserver_create_value_when_push) {
+                      memset(data_buffer_ptr, 0, sizeof(float) * data_size);
+                    } else {
+                      auto& feature_value =
+                          AcquireValue(&local_shard, shard_id, key);
+                      feature_value.resize(data_size);
+                      feature_value.set_dirty(true);
+                      float* data_ptr = feature_value.data();
+                      _value_accesor->Create(&data_buffer_ptr, 1);
+                      memcpy(data_ptr, data_buffer_ptr,
+                             data_size * sizeof(float));
+                    }
+                  } else if (itr.value().size() == value_size) {
+                    batch_values.push_back(itr.value().data());
+                    batch_selects.push_back(pull_values +
+                                            select_value_size * keys[i].second);
+                    continue;
                   } else {
-                    auto& feature_value = local_shard[key];
-                    feature_value.resize(data_size);
-                    float* data_ptr = feature_value.data();
-                    _value_accesor->Create(&data_buffer_ptr, 1);
-                    memcpy(data_ptr, data_buffer_ptr,
+                    data_size = itr.value().size();
+                    memcpy(data_buffer_ptr, itr.value().data(),
                            data_size * sizeof(float));
                   }
-                } else {
-                  data_size = itr.value().size();
-                  memcpy(data_buffer_ptr, itr.value().data(),
-                         data_size * sizeof(float));
-                }
-                for (int mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
-                  data_buffer[mf_idx] = 0.0;
+                  for (int mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
+                    data_buffer_ptr[mf_idx] = 0.0;
+                  }
+                  batch_values.push_back(data_buffer_ptr);
+                  batch_selects.push_back(pull_values +
+                                          select_value_size * keys[i].second);
                 }
-                auto offset = keys[i].second;
-                float* select_data = pull_values + select_value_size * offset;
-                _value_accesor->Select(&select_data,
-                                       (const float**)&data_buffer_ptr, 1);
+                _value_accesor->Select(batch_selects.data(),
+                                       batch_values.data(),
+                                       batch_values.size());
               }
 
               return 0;
@@ -490,36 +1145,48 @@ int32_t MemorySparseTable::PullSparse(float* pull_values,
 
 int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
                                          const uint64_t* keys, size_t num) {
+  return VisitLocalShards([&](auto* local_shards) {
+    return PullSparsePtr(local_shards, pull_values, keys, num);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::PullSparsePtr(SHARD* local_shards,
+                                         char** pull_values,
+                                         const uint64_t* keys, size_t num) {
   CostTimer timer("pscore_sparse_select_all");
   size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
   size_t mf_value_size =
       _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
 
   std::vector<std::future<int>> tasks(_real_local_shard_num);
-  std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
-      _real_local_shard_num);
-  for (size_t i = 0; i < num; ++i) {
-    int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
-    task_keys[shard_id].push_back({keys[i], i});
-  }
+  std::vector<std::pair<uint64_t, int>> task_keys;
+  std::vector<size_t> offsets;
+  PartitionKeysByShard(keys, num, &task_keys, &offsets);
   // std::atomic<uint32_t> missed_keys{0};
   for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] =
         _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-            [this, shard_id, &task_keys, pull_values, value_size,
-             mf_value_size]() -> int {
-              auto& keys = task_keys[shard_id];
-              auto& local_shard = _local_shards[shard_id];
+            [this, local_shards, shard_id, &task_keys, &offsets, pull_values,
+             value_size, mf_value_size]() -> int {
+              const auto* keys = task_keys.data() + offsets[shard_id];
+              size_t key_num = offsets[shard_id + 1] - offsets[shard_id];
+              auto& local_shard = local_shards[shard_id];
               float data_buffer[value_size];
               float* data_buffer_ptr = data_buffer;
-              for (int i = 0; i < keys.size(); ++i) {
+              for (size_t i = 0; i < key_num; ++i) {
+                if (_prefetch_distance > 0 &&
+                    i + _prefetch_distance < key_num) {
+                  local_shard.prefetch(keys[i + _prefetch_distance].first);
+                }
                 uint64_t key = keys[i].first;
                 auto itr = local_shard.find(key);
                 size_t data_size = value_size - mf_value_size;
                 FixedFeatureValue* ret = NULL;
                 if (itr == local_shard.end()) {
                   // ++missed_keys;
-                  auto& feature_value = local_shard[key];
+                  auto& feature_value =
+                      AcquireValue(&local_shard, shard_id, key);
                   feature_value.resize(data_size);
                   float* data_ptr = feature_value.data();
                   _value_accesor->Create(&data_buffer_ptr, 1);
@@ -528,6 +1195,8 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
                 } else {
                   ret = itr.value_ptr();
                 }
+                // the caller may update the value through the pointer
+                ret->set_dirty(true);
                 int pull_data_idx = keys[i].second;
                 pull_values[pull_data_idx] = (char*)ret;
               }
@@ -542,104 +1211,55 @@ int32_t MemorySparseTable::PullSparsePtr(char** pull_values,
 
 int32_t MemorySparseTable::PushSparse(const uint64_t* keys, const float* values,
                                       size_t num) {
-  CostTimer timer("pserver_sparse_update_all");
-  std::vector<std::future<int>> tasks(_real_local_shard_num);
-  std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
-      _real_local_shard_num);
-  for (size_t i = 0; i < num; ++i) {
-    int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
-    task_keys[shard_id].push_back({keys[i], i});
-  }
-
-  const size_t value_col =
-      _value_accesor->GetAccessorInfo().size / sizeof(float);
-  size_t mf_value_col =
-      _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
   size_t update_value_col =
       _value_accesor->GetAccessorInfo().update_size / sizeof(float);
-
-  for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-    tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
-        [this, shard_id, value_col, mf_value_col, update_value_col, values,
-         &task_keys]() -> int {
-          auto& keys = task_keys[shard_id];
-          auto& local_shard = _local_shards[shard_id];
-          float data_buffer[value_col];  // NOLINT
-          float* data_buffer_ptr = data_buffer;
-          for (int i = 0; i < keys.size(); ++i) {
-            uint64_t key = keys[i].first;
-            uint64_t push_data_idx = keys[i].second;
-            const float* update_data =
-                values + push_data_idx * update_value_col;
-            auto itr = local_shard.find(key);
-            if (itr == local_shard.end()) {
-              if (FLAGS_pserver_enable_create_feasign_randomly &&
-                  !_value_accesor->CreateValue(1, update_data)) {
-                continue;
-              }
-              auto value_size = value_col - mf_value_col;
-              auto& feature_value = local_shard[key];
-              feature_value.resize(value_size);
-              _value_accesor->Create(&data_buffer_ptr, 1);
-              memcpy(feature_value.data(), data_buffer_ptr,
-                     value_size * sizeof(float));
-              itr = local_shard.find(key);
-            }
-
-            auto& feature_value = itr.value();
-            float* value_data = feature_value.data();
-            size_t value_size = feature_value.size();
-
-            if (value_size == value_col) {  // 已拓展到最大size, 则就地update
-              _value_accesor->Update(&value_data, &update_data, 1);
-            } else {
-              // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
-              memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
-              _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
-
-              if (_value_accesor->NeedExtendMF(data_buffer)) {
-                feature_value.resize(value_col);
-                value_data = feature_value.data();
-                _value_accesor->Create(&value_data, 1);
-              }
-              memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
-            }
-          }
-          return 0;
-        });
-  }
-
-  for (size_t shard_id = 0; shard_id < tasks.size(); ++shard_id) {
-    tasks[shard_id].wait();
+  std::vector<const float*> value_ptrs(num);
+  for (size_t i = 0; i < num; ++i) {
+    value_ptrs[i] = values + i * update_value_col;
   }
-  return 0;
+  return PushSparse(keys, value_ptrs.data(), num);
 }
 
 int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
                                       const float** values, size_t num) {
+  return VisitLocalShards([&](auto* local_shards) {
+    return PushSparse(local_shards, keys, values, num);
+  });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::PushSparse(SHARD* local_shards,
+                                      const uint64_t* keys,
+                                      const float** values, size_t num) {
+  CostTimer timer("pserver_sparse_update_all");
   std::vector<std::future<int>> tasks(_real_local_shard_num);
-  std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
-      _real_local_shard_num);
-  for (size_t i = 0; i < num; ++i) {
-    int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
-    task_keys[shard_id].push_back({keys[i], i});
-  }
+  std::vector<std::pair<uint64_t, int>> task_keys;
+  std::vector<size_t> offsets;
+  PartitionKeysByShard(keys, num, &task_keys, &offsets);
 
   size_t value_col = _value_accesor->GetAccessorInfo().size / sizeof(float);
   size_t mf_value_col =
       _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
-  size_t update_value_col =
-      _value_accesor->GetAccessorInfo().update_size / sizeof(float);
 
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     tasks[shard_id] = _shards_task_pool[shard_id % _task_pool_size]->enqueue(
-        [this, shard_id, value_col, mf_value_col, update_value_col, values,
-         &task_keys]() -> int {
-          auto& keys = task_keys[shard_id];
-          auto& local_shard = _local_shards[shard_id];
+        [this, local_shards, shard_id, value_col, mf_value_col, values,
+         &task_keys, &offsets]() -> int {
+          const auto* keys = task_keys.data() + offsets[shard_id];
+          size_t key_num = offsets[shard_id + 1] - offsets[shard_id];
+          auto& local_shard = local_shards[shard_id];
           float data_buffer[value_col];  // NOLINT
           float* data_buffer_ptr = data_buffer;
-          for (int i = 0; i < keys.size(); ++i) {
+          // values already extended to the full size are updated in place,
+          // a batch of them at a time
+          std::vector<float*> batch_values;
+          std::vector<const float*> batch_updates;
+          batch_values.reserve(_batch_size);
+          batch_updates.reserve(_batch_size);
+          for (size_t i = 0; i < key_num; ++i) {
+            if (_prefetch_distance > 0 && i + _prefetch_distance < key_num) {
+              local_shard.prefetch(keys[i + _prefetch_distance].first);
+            }
             uint64_t key = keys[i].first;
             uint64_t push_data_idx = keys[i].second;
             const float* update_data = values[push_data_idx];
@@ -650,7 +1270,7 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
                 continue;
               }
               auto value_size = value_col - mf_value_col;
-              auto& feature_value = local_shard[key];
+              auto& feature_value = AcquireValue(&local_shard, shard_id, key);
               feature_value.resize(value_size);
               _value_accesor->Create(&data_buffer_ptr, 1);
               memcpy(feature_value.data(), data_buffer_ptr,
@@ -658,10 +1278,19 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
               itr = local_shard.find(key);
             }
             auto& feature_value = itr.value();
+            feature_value.set_dirty(true);
             float* value_data = feature_value.data();
             size_t value_size = feature_value.size();
             if (value_size == value_col) {  // 已拓展到最大size, 则就地update
-              _value_accesor->Update(&value_data, &update_data, 1);
+              batch_values.push_back(value_data);
+              batch_updates.push_back(update_data);
+              if (batch_values.size() == _batch_size) {
+                _value_accesor->Update(batch_values.data(),
+                                       batch_updates.data(),
+                                       batch_values.size());
+                batch_values.clear();
+                batch_updates.clear();
+              }
             } else {
               // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
               memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
@@ -674,6 +1303,8 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
               memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
             }
           }
+          _value_accesor->Update(batch_values.data(), batch_updates.data(),
+                                 batch_values.size());
           return 0;
         });
   }
@@ -687,13 +1318,26 @@ int32_t MemorySparseTable::PushSparse(const uint64_t* keys,
 int32_t MemorySparseTable::Flush() { return 0; }
 
 int32_t MemorySparseTable::Shrink(const std::string& param) {
+  return VisitLocalShards(
+      [&](auto* local_shards) { return Shrink(local_shards, param); });
+}
+
+template <class SHARD>
+int32_t MemorySparseTable::Shrink(SHARD* local_shards,
+                                  const std::string& param) {
   VLOG(0) << "MemorySparseTable::Shrink";
   // TODO(zhaocaibei123): implement with multi-thread
   for (int shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
     // Shrink
-    auto& shard = _local_shards[shard_id];
+    auto& shard = local_shards[shard_id];
     for (auto it = shard.begin(); it != shard.end();) {
-      if (_value_accesor->Shrink(it.value().data())) {
+      // the decay of shrink changes the values that are kept
+      if (UpdateAndTrackDirty(it.value(), [this](float* value) {
+            return _value_accesor->Shrink(value);
+          })) {
+        if (_track_erased) {
+          _erased_keys[shard_id].push_back(it.key());
+        }
         it = shard.erase(it);
       } else {
         ++it;
@@ -37,6 +37,7 @@ namespace distributed {
 class MemorySparseTable : public Table {
  public:
   typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+  typedef SwissSparseTableShard<uint64_t, FixedFeatureValue> swiss_shard_type;
   MemorySparseTable() {}
   virtual ~MemorySparseTable() {}
 
@@ -68,6 +69,10 @@ class MemorySparseTable : public Table {
   virtual int32_t Save(const std::string& path,
                        const std::string& param) override;
 
+  // save param of a delta checkpoint, which only writes the features that
+  // changed since the last checkpoint (save param 0 or 6) of the table
+  static const int kDeltaCheckpointSaveParam = 6;
+
   int32_t LoadLocalFS(const std::string& path, const std::string& param);
   int32_t SaveLocalFS(const std::string& path, const std::string& param,
                       const std::string& prefix);
@@ -88,17 +93,162 @@ class MemorySparseTable : public Table {
   virtual int32_t Shrink(const std::string& param) override;
   void Clear() override;
 
+  // a shard_type, or a swiss_shard_type when the table uses the swiss index
   void* GetShard(size_t shard_idx) override {
+    if (_swiss_local_shards != nullptr) {
+      return &_swiss_local_shards[shard_idx];
+    }
     return &_local_shards[shard_idx];
   }
 
  protected:
-  const int _task_pool_size = 24;
+  // calls func with the array of local shards. Their type is picked once by
+  // InitializeValue from TableParameter.sparse_shard_index, so that the
+  // shard accesses of func are bound to one index at compile time.
+  template <class FUNC>
+  auto VisitLocalShards(FUNC&& func)
+      -> decltype(func(static_cast<shard_type*>(nullptr))) {
+    if (_swiss_local_shards != nullptr) {
+      return func(_swiss_local_shards.get());
+    }
+    return func(_local_shards.get());
+  }
+
+  // find or insert the value of key in local shard shard_id, new values are
+  // backed by the shard's value slab when it is enabled
+  template <class SHARD>
+  FixedFeatureValue& AcquireValue(SHARD* shard, size_t shard_id,
+                                  uint64_t key) {
+    if (_value_slabs == nullptr) {
+      return (*shard)[key];
+    }
+    return shard->emplace(key, &_value_slabs[shard_id]).first.value();
+  }
+  FixedFeatureValue& AcquireValue(size_t shard_id, uint64_t key) {
+    return AcquireValue(&_local_shards[shard_id], shard_id, key);
+  }
+
+  // the shard accesses of the methods above, for the local shards of either
+  // index type
+  template <class SHARD>
+  int32_t Load(SHARD* local_shards, const std::string& path,
+               const std::string& param);
+  template <class SHARD>
+  int32_t LoadLocalFS(SHARD* local_shards, const std::string& path,
+                      const std::string& param);
+  template <class SHARD>
+  int32_t Save(SHARD* local_shards, const std::string& path,
+               const std::string& param);
+  template <class SHARD>
+  int32_t SaveLocalFS(SHARD* local_shards, const std::string& path,
+                      const std::string& param, const std::string& prefix);
+  template <class SHARD>
+  int64_t LocalMFSize(SHARD* local_shards);
+  template <class SHARD>
+  int32_t PullSparse(SHARD* local_shards, float* values,
+                     const PullSparseValue& pull_value);
+  template <class SHARD>
+  int32_t PullSparsePtr(SHARD* local_shards, char** pull_values,
+                        const uint64_t* keys, size_t num);
+  template <class SHARD>
+  int32_t PushSparse(SHARD* local_shards, const uint64_t* keys,
+                     const float** values, size_t num);
+  template <class SHARD>
+  int32_t Shrink(SHARD* local_shards, const std::string& param);
+
+  // checkpoints (save param 0) are written in the binary format when the
+  // table config asks for it, other saves are always text
+  bool UseBinaryFormat(int save_param) const {
+    return (save_param == 0 || save_param == kDeltaCheckpointSaveParam) &&
+           _config.sparse_save_format() == BINARY_SAVE_FORMAT;
+  }
+  // writes shard to path in the binary format, returns the number of
+  // feasigns written or -1 when writing failed
+  template <class SHARD>
+  int64_t SaveShardBinary(SHARD* shard, const std::string& path,
+                          int save_param);
+  // loads a binary checkpoint, the data file of local shard i is the
+  // (_shard_idx * _avg_local_shard_num + i)-th .bin file of file_list
+  template <class SHARD>
+  int32_t LoadBinary(SHARD* local_shards,
+                     const std::vector<std::string>& file_list);
+  int32_t ReadWholeFile(const std::string& path, std::string* content);
+
+  // delta checkpoint seq of a checkpoint at path is in DeltaDir(path, seq),
+  // seq counts from 1 after every base checkpoint
+  std::string DeltaRootDir(const std::string& path) {
+    return paddle::string::format_string("%s/%03d_delta", path.c_str(),
+                                         _config.table_id());
+  }
+  std::string DeltaDir(const std::string& path, int seq) {
+    return paddle::string::format_string("%s/%05d/",
+                                         DeltaRootDir(path).c_str(), seq);
+  }
+  // loads the shard files of one checkpoint directory, the base or a delta
+  template <class SHARD>
+  int32_t LoadTableFiles(SHARD* local_shards, const std::string& table_path,
+                         const std::string& param,
+                         std::vector<std::string> file_list);
+  template <class SHARD>
+  int32_t LoadLocalFSFiles(SHARD* local_shards, const std::string& table_path,
+                           const std::string& param);
+  // erases the keys of the <data file>.del tombstones of a delta from the
+  // local shards, and drops the tombstones from file_list
+  template <class SHARD>
+  int32_t ApplyTombstones(SHARD* local_shards,
+                          std::vector<std::string>* file_list);
+  // the loaded values are the checkpoint, later deltas build on it
+  template <class SHARD>
+  void MarkCheckpointed(SHARD* local_shards);
+  // writes the keys erased from a local shard since the last checkpoint
+  // next to its delta file
+  int32_t SaveTombstones(size_t shard_id, const std::string& data_path);
+  // runs an accessor call that may modify value, such as Shrink or the stat
+  // updates of xbox saves, and marks value dirty when it did. Values are
+  // only compared once the table has a checkpoint a delta could build on.
+  template <class FUNC>
+  bool UpdateAndTrackDirty(FixedFeatureValue& value, FUNC func) {
+    if (!_track_erased || value.dirty()) {
+      return func(value.data());
+    }
+    thread_local std::vector<float> before;
+    before.assign(value.data(), value.data() + value.size());
+    bool ret = func(value.data());
+    if (memcmp(before.data(), value.data(), value.size() * sizeof(float)) !=
+        0) {
+      value.set_dirty(true);
+    }
+    return ret;
+  }
+
+  // radix partitions keys by local shard: the (key, index) pairs of local
+  // shard i are task_keys[offsets[i], offsets[i + 1])
+  void PartitionKeysByShard(const uint64_t* keys, size_t num,
+                            std::vector<std::pair<uint64_t, int>>* task_keys,
+                            std::vector<size_t>* offsets);
+
+  int _task_pool_size = 24;
+  // number of keys selected or updated with one accessor call
+  size_t _batch_size = 64;
+  // number of keys a shard prefetches ahead, 0 when its index does not
+  // support prefetch
+  size_t _prefetch_distance = 0;
   int _avg_local_shard_num;
   int _real_local_shard_num;
   int _sparse_table_shard_num;
   std::vector<std::shared_ptr<::ThreadPool>> _shards_task_pool;
+  // must outlive _local_shards, whose values release their slots on clear
+  std::unique_ptr<FeatureValueSlab[]> _value_slabs;
+  // only one of them is allocated, as picked by sparse_shard_index
   std::unique_ptr<shard_type[]> _local_shards;
+  std::unique_ptr<swiss_shard_type[]> _swiss_local_shards;
+  // number of delta checkpoints saved or loaded since the last base
+  int _delta_seq = 0;
+  // keys erased by Shrink since the last checkpoint, per local shard. They
+  // and the dirty values are only tracked once the table has been saved or
+  // loaded from a checkpoint
+  bool _track_erased = false;
+  std::vector<std::vector<uint64_t>> _erased_keys;
 };
 
 }  // namespace distributed
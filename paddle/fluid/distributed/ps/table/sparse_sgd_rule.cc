@@ -14,13 +14,37 @@
 
 #include "paddle/fluid/distributed/ps/table/sparse_sgd_rule.h"
 #include <gflags/gflags.h>
+#include <vector>
+#include "Eigen/Dense"
 #include "glog/logging.h"
+#include "paddle/fluid/platform/place.h"
 
 DEFINE_bool(enable_show_scale_gradient, true, "enable show scale gradient");
+DEFINE_int32(sparse_sgd_rule_jit_min_dim, 32,
+             "embeddings of at least this dim are updated by the jit kernels, "
+             "smaller ones by scalar loops, which are faster for them");
 
 namespace paddle {
 namespace distributed {
 
+// The update rules below run on the kernels of the jit kernel pool, which
+// picks the xbyak generated AVX/AVX2/AVX512 code for the running cpu and
+// falls back to the reference code. The generated code is owned by the
+// thread that looked it up first, so the kernels are looked up on the
+// updating thread, once per batch of values. Embeddings smaller than
+// FLAGS_sparse_sgd_rule_jit_min_dim skip the lookup and the call, and run
+// the scalar loops.
+static bool UseJitKernels(size_t dim) {
+  return dim >= static_cast<size_t>(FLAGS_sparse_sgd_rule_jit_min_dim);
+}
+
+template <typename KernelTuple>
+static typename KernelTuple::func_type GetJitFunc(
+    const typename KernelTuple::attr_type& attr) {
+  return operators::jit::KernelFuncs<KernelTuple, platform::CPUPlace>::Cache()
+      .At(attr);
+}
+
 void SparseNaiveSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
                                     size_t emb_dim) {
   _embedding_dim = emb_dim;
@@ -37,13 +61,42 @@ void SparseNaiveSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = naive_param.weight_bounds(0);
     _max_bound = naive_param.weight_bounds(1);
   }
+  int64_t dim = static_cast<int64_t>(_embedding_dim);
+  _sgd_attr = operators::jit::sgd_attr_t(1, dim, 1, dim, 1);
+}
+
+SparseNaiveSGDRule::SgdFunc SparseNaiveSGDRule::GetSgdFunc() {
+  if (!UseJitKernels(_embedding_dim)) {
+    return NULL;
+  }
+  return GetJitFunc<operators::jit::SgdTuple<float>>(_sgd_attr);
+}
+
+void SparseNaiveSGDRule::Update(float* w, const float* push_value,
+                                SgdFunc sgd_func) {
+  if (sgd_func == NULL) {
+    for (size_t i = 0; i < _embedding_dim; ++i) {
+      w[i] -= learning_rate_ * push_value[i];
+      BoundValue(w[i]);
+    }
+    return;
+  }
+  static const int64_t row = 0;
+  sgd_func(&learning_rate_, w, push_value, &row, w, &_sgd_attr);
+  BoundValue(w, _embedding_dim);
 }
 
 void SparseNaiveSGDRule::UpdateValueWork(float* w, float* sgd,
                                          const float* push_value, float scale) {
-  for (size_t i = 0; i < _embedding_dim; ++i) {
-    w[i] -= learning_rate_ * push_value[i];
-    BoundValue(w[i]);
+  Update(w, push_value, GetSgdFunc());
+}
+
+void SparseNaiveSGDRule::UpdateValuesWork(float** w, float** sgd,
+                                          const float** push_values,
+                                          const float* scales, size_t num) {
+  SgdFunc sgd_func = GetSgdFunc();
+  for (size_t i = 0; i < num; ++i) {
+    Update(w[i], push_values[i], sgd_func);
   }
 }
 
@@ -83,22 +136,65 @@ void SparseAdaGradSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
   }
 }
 
-void SparseAdaGradSGDRule::UpdateValueWork(float* w, float* sgd,
-                                           const float* grad, float scale) {
+SparseAdaGradSGDRule::JitFuncs SparseAdaGradSGDRule::GetJitFuncs() {
+  JitFuncs funcs = {NULL, NULL};
+  if (UseJitKernels(_embedding_dim)) {
+    int dim = static_cast<int>(_embedding_dim);
+    funcs.vscal = GetJitFunc<operators::jit::VScalTuple<float>>(dim);
+    funcs.vadd = GetJitFunc<operators::jit::VAddTuple<float>>(dim);
+  }
+  return funcs;
+}
+
+void SparseAdaGradSGDRule::Update(float* w, float* sgd, const float* grad,
+                                  float scale, const JitFuncs& funcs) {
   float& g2sum = sgd[G2SumIndex()];
   double add_g2sum = 0;
 
-  for (int i = 0; i < _embedding_dim; i++) {
+  if (funcs.vscal == NULL) {
+    for (int i = 0; i < _embedding_dim; i++) {
+      double scaled_grad = grad[i] / scale;
+      w[i] -= learning_rate_ * scaled_grad *
+              sqrt(_initial_g2sum / (_initial_g2sum + g2sum));
+      BoundValue(w[i]);
+      add_g2sum += scaled_grad * scaled_grad;
+    }
+    g2sum += add_g2sum / _embedding_dim;
+    return;
+  }
+
+  int dim = static_cast<int>(_embedding_dim);
+  thread_local std::vector<float> buffer_vec;
+  buffer_vec.resize(_embedding_dim);
+  float* buffer = buffer_vec.data();
+  // w -= lr * sqrt(initial_g2sum / (initial_g2sum + g2sum)) * grad / scale
+  float ratio = -learning_rate_ *
+                sqrt(_initial_g2sum / (_initial_g2sum + g2sum)) / scale;
+  funcs.vscal(&ratio, grad, buffer, dim);
+  funcs.vadd(w, buffer, w, dim);
+  BoundValue(w, _embedding_dim);
+  // summed in double as the scalar loop does
+  for (int i = 0; i < dim; i++) {
     double scaled_grad = grad[i] / scale;
-    w[i] -= learning_rate_ * scaled_grad *
-            sqrt(_initial_g2sum / (_initial_g2sum + g2sum));
-    BoundValue(w[i]);
     add_g2sum += scaled_grad * scaled_grad;
   }
-
   g2sum += add_g2sum / _embedding_dim;
 }
 
+void SparseAdaGradSGDRule::UpdateValueWork(float* w, float* sgd,
+                                           const float* grad, float scale) {
+  Update(w, sgd, grad, scale, GetJitFuncs());
+}
+
+void SparseAdaGradSGDRule::UpdateValuesWork(float** w, float** sgd,
+                                            const float** push_values,
+                                            const float* scales, size_t num) {
+  JitFuncs funcs = GetJitFuncs();
+  for (size_t i = 0; i < num; ++i) {
+    Update(w[i], sgd[i], push_values[i], scales[i], funcs);
+  }
+}
+
 void SparseAdaGradSGDRule::InitValueWork(float* value, float* sgd,
                                          bool zero_init) {
   for (int i = 0; i < _embedding_dim; ++i) {
@@ -139,14 +235,16 @@ void StdAdaGradSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
 
 void StdAdaGradSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
                                         float scale) {
-  for (int i = 0; i < _embedding_dim; i++) {
-    float& g2sum = sgd[G2SumIndex() + i];
-    double scaled_grad = grad[i] / scale;
-    w[i] -= learning_rate_ * scaled_grad *
-            sqrt(_initial_g2sum / (_initial_g2sum + g2sum));
-    BoundValue(w[i]);
-    g2sum += scaled_grad * scaled_grad;
-  }
+  // the jit kernel pool has no per element adagrad kernel, Eigen vectorizes
+  // the sqrt and division with the simd flags of the build
+  Eigen::Map<Eigen::ArrayXf> w_arr(w, _embedding_dim);
+  Eigen::Map<Eigen::ArrayXf> g2sum_arr(sgd + G2SumIndex(), _embedding_dim);
+  Eigen::Map<const Eigen::ArrayXf> grad_arr(grad, _embedding_dim);
+  auto scaled_grad = grad_arr / scale;
+  w_arr -= learning_rate_ * scaled_grad *
+           (_initial_g2sum / (_initial_g2sum + g2sum_arr)).sqrt();
+  g2sum_arr += scaled_grad * scaled_grad;
+  BoundValue(w, _embedding_dim);
 }
 
 void StdAdaGradSGDRule::InitValueWork(float* value, float* sgd,
@@ -186,10 +284,19 @@ void SparseAdamSGDRule::LoadConfig(const SparseCommonSGDRuleParameter& param,
     _min_bound = adam_param.weight_bounds(0);
     _max_bound = adam_param.weight_bounds(1);
   }
+  _adam_attr =
+      operators::jit::adam_attr_t(_beta1_decay_rate, _beta2_decay_rate);
 }
 
-void SparseAdamSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
-                                        float scale) {
+SparseAdamSGDRule::AdamFunc SparseAdamSGDRule::GetAdamFunc() {
+  if (!UseJitKernels(_embedding_dim)) {
+    return NULL;
+  }
+  return GetJitFunc<operators::jit::AdamTuple<float>>(_adam_attr);
+}
+
+void SparseAdamSGDRule::Update(float* w, float* sgd, const float* grad,
+                               AdamFunc adam_func) {
   float* gsum = sgd + GSumIndex();
   float* g2sum = sgd + G2SumIndex();
   float* beta1_pow = sgd + Beta1PowIndex();
@@ -202,19 +309,41 @@ void SparseAdamSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
 
   // lr not change in one update
   lr *= sqrt(1 - beta2_pow_) / (1 - beta1_pow_);
-  for (int i = 0; i < _embedding_dim; i++) {
-    // Calculation
-    gsum[i] = _beta1_decay_rate * gsum[i] + (1 - _beta1_decay_rate) * g[i];
-    g2sum[i] =
-        _beta2_decay_rate * g2sum[i] + (1 - _beta2_decay_rate) * g[i] * g[i];
-    w[i] = w[i] - lr * (gsum[i] / (sqrt(g2sum[i]) + _ada_epsilon));
-    BoundValue(w[i]);
+  // gsum = beta1 * gsum + (1 - beta1) * g
+  // g2sum = beta2 * g2sum + (1 - beta2) * g * g
+  // w = w - lr * (gsum / (sqrt(g2sum) + epsilon))
+  if (adam_func == NULL) {
+    for (int i = 0; i < _embedding_dim; i++) {
+      gsum[i] = _beta1_decay_rate * gsum[i] + (1 - _beta1_decay_rate) * g[i];
+      g2sum[i] =
+          _beta2_decay_rate * g2sum[i] + (1 - _beta2_decay_rate) * g[i] * g[i];
+      w[i] = w[i] - lr * (gsum[i] / (sqrt(g2sum[i]) + _ada_epsilon));
+      BoundValue(w[i]);
+    }
+  } else {
+    adam_func(_beta1_decay_rate, _beta2_decay_rate, -lr, _ada_epsilon,
+              _embedding_dim, g, gsum, g2sum, w, gsum, g2sum, w);
+    BoundValue(w, _embedding_dim);
   }
   // update beta_pow_decay
   (*beta1_pow) *= _beta1_decay_rate;
   (*beta2_pow) *= _beta2_decay_rate;
 }
 
+void SparseAdamSGDRule::UpdateValueWork(float* w, float* sgd, const float* grad,
+                                        float scale) {
+  Update(w, sgd, grad, GetAdamFunc());
+}
+
+void SparseAdamSGDRule::UpdateValuesWork(float** w, float** sgd,
+                                         const float** push_values,
+                                         const float* scales, size_t num) {
+  AdamFunc adam_func = GetAdamFunc();
+  for (size_t i = 0; i < num; ++i) {
+    Update(w[i], sgd[i], push_values[i], adam_func);
+  }
+}
+
 void SparseAdamSGDRule::InitValueWork(float* value, float* sgd,
                                       bool zero_init) {
   for (int i = 0; i < _embedding_dim; ++i) {
@@ -20,6 +20,7 @@
 #include "paddle/fluid/distributed/common/local_random.h"  // for local_uniform_real_distribution
 #include "paddle/fluid/distributed/common/registerer.h"
 #include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/operators/jit/kernels.h"
 
 namespace paddle {
 namespace distributed {
@@ -45,6 +46,20 @@ class SparseValueSGDRule {
                    float scale = 1) {
     UpdateValueWork(w, sgd, push_value, scale);
   }
+  // updates num values with one call, value i is w[i] and sgd[i]
+  void UpdateValue(float** w, float** sgd, const float** push_values,
+                   const float* scales, size_t num) {
+    UpdateValuesWork(w, sgd, push_values, scales, num);
+  }
+  // the rules that run on jit kernels override it to look the kernels up
+  // once per batch
+  virtual void UpdateValuesWork(float** w, float** sgd,
+                                const float** push_values, const float* scales,
+                                size_t num) {
+    for (size_t i = 0; i < num; ++i) {
+      UpdateValueWork(w[i], sgd[i], push_values[i], scales[i]);
+    }
+  }
   template <class T>
   void BoundValue(T& w) {  // NOLINT
     if (!(w >= _min_bound)) {
@@ -53,6 +68,11 @@ class SparseValueSGDRule {
       w = (T)_max_bound;
     }
   }
+  void BoundValue(float* w, size_t n) {
+    for (size_t i = 0; i < n; ++i) {
+      BoundValue(w[i]);
+    }
+  }
   float& MinBound() { return _min_bound; }
   float& MaxBound() { return _max_bound; }
 
@@ -74,11 +94,20 @@ class SparseNaiveSGDRule : public SparseValueSGDRule {
                           size_t emb_dim);
   virtual void UpdateValueWork(float* w, float* sgd, const float* push_value,
                                float scale);
+  virtual void UpdateValuesWork(float** w, float** sgd,
+                                const float** push_values, const float* scales,
+                                size_t num);
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return 0; }
 
  private:
+  typedef operators::jit::SgdTuple<float>::func_type SgdFunc;
+  // the jit kernel of the calling thread, NULL when the scalar loop is used
+  SgdFunc GetSgdFunc();
+  void Update(float* w, const float* push_value, SgdFunc sgd_func);
+
   float learning_rate_;
+  operators::jit::sgd_attr_t _sgd_attr;
 };
 
 class SparseAdaGradSGDRule : public SparseValueSGDRule {
@@ -87,11 +116,23 @@ class SparseAdaGradSGDRule : public SparseValueSGDRule {
                           size_t emb_dim);
   virtual void UpdateValueWork(float* w, float* sgd, const float* push_value,
                                float scale);
+  virtual void UpdateValuesWork(float** w, float** sgd,
+                                const float** push_values, const float* scales,
+                                size_t num);
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return 1; }
   size_t G2SumIndex() { return 0; }
 
  private:
+  // the jit kernels of the calling thread, NULL when the scalar loop is used
+  struct JitFuncs {
+    operators::jit::VScalTuple<float>::func_type vscal;
+    operators::jit::VAddTuple<float>::func_type vadd;
+  };
+  JitFuncs GetJitFuncs();
+  void Update(float* w, float* sgd, const float* grad, float scale,
+              const JitFuncs& funcs);
+
   float learning_rate_;
   float _initial_g2sum;
 };
@@ -117,6 +158,9 @@ class SparseAdamSGDRule : public SparseValueSGDRule {
                           size_t emb_dim);
   virtual void UpdateValueWork(float* w, float* sgd, const float* push_value,
                                float scale);
+  virtual void UpdateValuesWork(float** w, float** sgd,
+                                const float** push_values, const float* scales,
+                                size_t num);
   virtual void InitValueWork(float* value, float* sgd, bool zero_init);
   virtual size_t Dim() { return _embedding_dim * 2 + 2; }
   size_t GSumIndex() { return 0; }
@@ -129,6 +173,13 @@ class SparseAdamSGDRule : public SparseValueSGDRule {
   float _beta1_decay_rate;
   float _beta2_decay_rate;
   float _ada_epsilon;
+  operators::jit::adam_attr_t _adam_attr;
+
+ private:
+  typedef operators::jit::AdamTuple<float>::func_type AdamFunc;
+  // the jit kernel of the calling thread, NULL when the scalar loop is used
+  AdamFunc GetAdamFunc();
+  void Update(float* w, float* sgd, const float* grad, AdamFunc adam_func);
 };
 }  // namespace distributed
 }  // namespace paddle
@@ -13,10 +13,13 @@
 // limitations under the License.
 
 #include "paddle/fluid/distributed/ps/table/ssd_sparse_table.h"
+#include <algorithm>
+#include <chrono>  // NOLINT
 #include "paddle/fluid/distributed/common/cost_timer.h"
 #include "paddle/fluid/distributed/common/local_random.h"
 #include "paddle/fluid/distributed/common/topk_calculator.h"
 #include "paddle/fluid/framework/archive.h"
+#include "paddle/fluid/platform/enforce.h"
 #include "paddle/utils/string/string_helper.h"
 
 DECLARE_bool(pserver_print_missed_key_num_every_push);
@@ -25,28 +28,385 @@ DECLARE_bool(pserver_enable_create_feasign_randomly);
 DEFINE_bool(pserver_open_strict_check, false, "pserver_open_strict_check");
 DEFINE_string(rocksdb_path, "database", "path of sparse table rocksdb file");
 DEFINE_int32(pserver_load_batch_size, 5000, "load batch size for ssd");
+DEFINE_int64(pserver_ssd_mem_capacity, 0,
+             "max number of feasigns kept in memory per shard of a ssd "
+             "table, the least frequently used ones are moved to rocksdb, "
+             "0 means no limit");
+DEFINE_int32(pserver_ssd_admission_min_freq, 2,
+             "min recent access count of a feasign found in rocksdb to move "
+             "it into a full memory shard");
+DEFINE_int32(pserver_ssd_writeback_batch_size, 10000,
+             "number of evicted feasigns written to rocksdb in one batch");
 
 namespace paddle {
 namespace distributed {
 
+SsdWriteback::SsdWriteback(RocksDBHandler* db, size_t shard_num,
+                           size_t batch_size, std::atomic<uint64_t>* written)
+    : _db(db),
+      _batch_size(batch_size),
+      _written(written),
+      _shards(new Shard[shard_num]),
+      _shard_num(shard_num) {
+  _thread = std::thread([this]() { Run(); });
+}
+
+SsdWriteback::~SsdWriteback() {
+  Drain();
+  {
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stop = true;
+  }
+  _cond.notify_all();
+  _thread.join();
+}
+
+void SsdWriteback::Put(size_t shard_id, uint64_t key, const float* value,
+                       size_t size) {
+  Enqueue(shard_id, key,
+          {false, std::string(reinterpret_cast<const char*>(value),
+                              size * sizeof(float))});
+}
+
+void SsdWriteback::Delete(size_t shard_id, uint64_t key) {
+  Enqueue(shard_id, key, {true, std::string()});
+}
+
+void SsdWriteback::Enqueue(size_t shard_id, uint64_t key,
+                           PendingWrite&& write) {
+  auto& shard = _shards[shard_id];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // emplace moves from write even when key is pending already, so look it
+    // up first
+    auto it = shard.pending.find(key);
+    if (it != shard.pending.end()) {
+      it->second = std::move(write);
+      return;
+    }
+    shard.pending.emplace(key, std::move(write));
+  }
+  size_t pending_num = ++_pending_num;
+  if (pending_num % _batch_size == 0) {
+    _cond.notify_one();
+  }
+  // keep the queue bounded when rocksdb falls behind
+  if (pending_num >= _batch_size * 64) {
+    Drain();
+  }
+}
+
+int SsdWriteback::Lookup(size_t shard_id, uint64_t key, std::string* value) {
+  auto& shard = _shards[shard_id];
+  std::lock_guard<std::mutex> lock(shard.mutex);
+  auto it = shard.pending.find(key);
+  if (it == shard.pending.end()) {
+    it = shard.flushing.find(key);
+    if (it == shard.flushing.end()) {
+      return -1;
+    }
+  }
+  if (it->second.is_delete) {
+    return 1;
+  }
+  *value = it->second.value;
+  return 0;
+}
+
+void SsdWriteback::Drain() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  uint64_t seq = ++_request_seq;
+  _cond.notify_all();
+  _cond.wait(lock, [this, seq]() { return _flushed_seq >= seq; });
+}
+
+void SsdWriteback::Run() {
+  std::unique_lock<std::mutex> lock(_mutex);
+  while (!_stop) {
+    _cond.wait_for(lock, std::chrono::seconds(1), [this]() {
+      return _stop || _request_seq > _flushed_seq ||
+             _pending_num.load() >= _batch_size;
+    });
+    uint64_t seq = _request_seq;
+    lock.unlock();
+    for (size_t shard_id = 0; shard_id < _shard_num; ++shard_id) {
+      FlushShard(shard_id);
+    }
+    lock.lock();
+    _flushed_seq = seq;
+    _cond.notify_all();
+  }
+}
+
+void SsdWriteback::FlushShard(size_t shard_id) {
+  auto& shard = _shards[shard_id];
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    if (shard.pending.empty()) {
+      return;
+    }
+    shard.flushing.swap(shard.pending);
+  }
+  std::vector<std::pair<uint64_t, const PendingWrite*>> writes;
+  writes.reserve(shard.flushing.size());
+  for (auto& it : shard.flushing) {
+    writes.emplace_back(it.first, &it.second);
+  }
+  // rocksdb compares the raw key bytes, writing in that order keeps the
+  // memtable inserts sequential
+  std::sort(writes.begin(), writes.end(),
+            [](const std::pair<uint64_t, const PendingWrite*>& a,
+               const std::pair<uint64_t, const PendingWrite*>& b) {
+              return memcmp(&a.first, &b.first, sizeof(uint64_t)) < 0;
+            });
+  for (size_t begin = 0; begin < writes.size(); begin += _batch_size) {
+    size_t end = std::min(begin + _batch_size, writes.size());
+    std::vector<std::pair<const char*, int>> ssd_keys;
+    std::vector<std::pair<const char*, int>> ssd_values;
+    uint64_t put_num = 0;
+    for (size_t i = begin; i < end; ++i) {
+      ssd_keys.emplace_back(reinterpret_cast<const char*>(&writes[i].first),
+                            sizeof(uint64_t));
+      const PendingWrite* write = writes[i].second;
+      if (write->is_delete) {
+        ssd_values.emplace_back(nullptr, 0);
+      } else {
+        ssd_values.emplace_back(write->value.data(), write->value.size());
+        ++put_num;
+      }
+    }
+    _db->write_batch(shard_id, ssd_keys, ssd_values);
+    if (_written != nullptr) {
+      *_written += put_num;
+    }
+  }
+  size_t flushed = writes.size();
+  {
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.flushing.clear();
+  }
+  _pending_num -= flushed;
+}
+
 int32_t SSDSparseTable::Initialize() {
+  // the memory tier works on the closed hash shards of _local_shards
+  PADDLE_ENFORCE_EQ(_config.sparse_shard_index(), CLOSED_HASH_INDEX,
+                    paddle::platform::errors::InvalidArgument(
+                        "SSDSparseTable only supports the closed hash "
+                        "sparse_shard_index."));
   MemorySparseTable::Initialize();
   _db = paddle::distributed::RocksDBHandler::GetInstance();
   _db->initialize(FLAGS_rocksdb_path, _real_local_shard_num);
+  _writeback.reset(new SsdWriteback(_db, _real_local_shard_num,
+                                    FLAGS_pserver_ssd_writeback_batch_size,
+                                    &_tier_stats.writeback));
+  _mem_capacity = FLAGS_pserver_ssd_mem_capacity;
+  if (_mem_capacity > 0) {
+    _sketches.resize(_real_local_shard_num);
+    for (auto& sketch : _sketches) {
+      sketch.Resize(_mem_capacity);
+    }
+  }
+  LOG(INFO) << "SSDSparseTable memory capacity per shard: " << _mem_capacity
+            << ", admission min freq: " << FLAGS_pserver_ssd_admission_min_freq;
   return 0;
 }
 
 int32_t SSDSparseTable::InitializeShard() { return 0; }
 
-int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
-                                   size_t num) {
-  CostTimer timer("pserver_downpour_sparse_select_all");
+void SSDSparseTable::ReadSsd(size_t shard_id,
+                             const std::vector<uint64_t>& keys,
+                             std::vector<std::string>* values,
+                             std::vector<int>* status) {
+  values->resize(keys.size());
+  status->assign(keys.size(), 1);
+  std::vector<size_t> db_idx;
+  std::vector<std::pair<const char*, int>> db_keys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    int ret = _writeback->Lookup(shard_id, keys[i], &(*values)[i]);
+    if (ret == 0) {
+      (*status)[i] = 0;
+    } else if (ret < 0) {
+      db_idx.push_back(i);
+      db_keys.emplace_back(reinterpret_cast<const char*>(&keys[i]),
+                           sizeof(uint64_t));
+    }
+  }
+  if (db_keys.empty()) {
+    return;
+  }
+  std::vector<std::string> db_values;
+  std::vector<int> db_status;
+  _db->multi_get(shard_id, db_keys, &db_values, &db_status);
+  for (size_t i = 0; i < db_idx.size(); ++i) {
+    (*status)[db_idx[i]] = db_status[i];
+    if (db_status[i] == 0) {
+      (*values)[db_idx[i]].swap(db_values[i]);
+    }
+  }
+}
+
+bool SSDSparseTable::Admit(size_t shard_id, uint64_t key) {
+  if (_mem_capacity == 0 || _local_shards[shard_id].size() < _mem_capacity) {
+    return true;
+  }
+  return _sketches[shard_id].Estimate(key) >=
+         static_cast<uint32_t>(FLAGS_pserver_ssd_admission_min_freq);
+}
+
+FixedFeatureValue& SSDSparseTable::Promote(size_t shard_id, uint64_t key,
+                                           const float* data,
+                                           size_t data_size) {
+  auto& feature_value = AcquireValue(shard_id, key);
+  feature_value.resize(data_size);
+  memcpy(feature_value.data(), data, data_size * sizeof(float));
+  // memory holds the only copy from now on
+  _writeback->Delete(shard_id, key);
+  return feature_value;
+}
+
+size_t SSDSparseTable::UpdateBuffer(float* data_buffer, size_t data_size,
+                                    const float* update_data) {
+  size_t value_col = _value_accesor->GetAccessorInfo().size / sizeof(float);
+  _value_accesor->Update(&data_buffer, &update_data, 1);
+  if (data_size < value_col && _value_accesor->NeedExtendMF(data_buffer)) {
+    // the mf part is created fresh, as when extending a value in memory
+    std::vector<float> created(value_col);
+    float* created_ptr = created.data();
+    _value_accesor->Create(&created_ptr, 1);
+    memcpy(data_buffer + data_size, created_ptr + data_size,
+           (value_col - data_size) * sizeof(float));
+    data_size = value_col;
+  }
+  return data_size;
+}
+
+void SSDSparseTable::EvictShard(size_t shard_id) {
+  auto& shard = _local_shards[shard_id];
+  if (_mem_capacity == 0 || shard.size() <= _mem_capacity) {
+    return;
+  }
+  // evict down to 90% of the capacity so that the pass over the shard is
+  // amortized over many inserts
+  size_t evict_num = shard.size() - _mem_capacity * 9 / 10;
+  auto& sketch = _sketches[shard_id];
+
+  // the frequency below which values are evicted is estimated on a sample
+  const size_t kSampleNum = 1024;
+  size_t stride = std::max<size_t>(1, shard.size() / kSampleNum);
+  std::vector<uint32_t> sample;
+  size_t idx = 0;
+  for (auto it = shard.begin(); it != shard.end(); ++it, ++idx) {
+    if (idx % stride == 0) {
+      sample.push_back(sketch.Estimate(it.key()));
+    }
+  }
+  size_t nth = std::min(sample.size() - 1, sample.size() * evict_num /
+                                               shard.size());
+  std::nth_element(sample.begin(), sample.begin() + nth, sample.end());
+  uint32_t threshold = sample[nth];
+
+  size_t evicted = 0;
+  for (int pass = 0; pass < 2 && evicted < evict_num; ++pass) {
+    for (auto it = shard.begin(); it != shard.end() && evicted < evict_num;) {
+      if (pass == 0 && sketch.Estimate(it.key()) > threshold) {
+        ++it;
+        continue;
+      }
+      _writeback->Put(shard_id, it.key(), it.value().data(),
+                      it.value().size());
+      it = shard.erase(it);
+      ++evicted;
+    }
+  }
+  _tier_stats.demotion += evicted;
+}
+
+int32_t SSDSparseTable::PullSparseShard(
+    size_t shard_id, const std::vector<std::pair<uint64_t, int>>& keys,
+    float* pull_values, std::atomic<uint32_t>* missed) {
   size_t value_size = _value_accesor->GetAccessorInfo().size / sizeof(float);
   size_t mf_value_size =
       _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
   size_t select_value_size =
       _value_accesor->GetAccessorInfo().select_size / sizeof(float);
+  auto& local_shard = _local_shards[shard_id];
+  std::vector<float> data_buffer(value_size);
+  float* data_buffer_ptr = data_buffer.data();
+  TierCounter counter;
 
+  auto select = [&](int pull_data_idx, size_t data_size) {
+    for (size_t mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
+      data_buffer[mf_idx] = 0.0;
+    }
+    float* select_data = pull_values + pull_data_idx * select_value_size;
+    _value_accesor->Select(&select_data, (const float**)&data_buffer_ptr, 1);
+  };
+
+  // memory first, the keys it misses go to ssd in one batch
+  std::vector<size_t> ssd_idx;
+  std::vector<uint64_t> ssd_keys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t key = keys[i].first;
+    if (_mem_capacity > 0) {
+      _sketches[shard_id].Increment(key);
+    }
+    auto itr = local_shard.find(key);
+    if (itr == local_shard.end()) {
+      ssd_idx.push_back(i);
+      ssd_keys.push_back(key);
+      continue;
+    }
+    ++counter.mem_hit;
+    size_t data_size = itr.value().size();
+    memcpy(data_buffer_ptr, itr.value().data(), data_size * sizeof(float));
+    select(keys[i].second, data_size);
+  }
+
+  std::vector<std::string> ssd_values;
+  std::vector<int> ssd_status;
+  if (!ssd_keys.empty()) {
+    ReadSsd(shard_id, ssd_keys, &ssd_values, &ssd_status);
+  }
+  for (size_t j = 0; j < ssd_keys.size(); ++j) {
+    uint64_t key = ssd_keys[j];
+    size_t data_size = value_size - mf_value_size;
+    if (ssd_status[j] == 0) {
+      ++counter.ssd_hit;
+      data_size = ssd_values[j].size() / sizeof(float);
+      memcpy(data_buffer_ptr, paddle::string::str_to_float(ssd_values[j]),
+             data_size * sizeof(float));
+      if (Admit(shard_id, key)) {
+        Promote(shard_id, key, data_buffer_ptr, data_size);
+        ++counter.promotion;
+      }
+    } else {
+      ++counter.miss;
+      ++(*missed);
+      if (FLAGS_pserver_create_value_when_push) {
+        memset(data_buffer_ptr, 0, sizeof(float) * data_size);
+      } else {
+        auto& feature_value = AcquireValue(shard_id, key);
+        feature_value.resize(data_size);
+        _value_accesor->Create(&data_buffer_ptr, 1);
+        memcpy(feature_value.data(), data_buffer_ptr,
+               data_size * sizeof(float));
+      }
+    }
+    select(keys[ssd_idx[j]].second, data_size);
+  }
+  EvictShard(shard_id);
+
+  _tier_stats.mem_hit += counter.mem_hit;
+  _tier_stats.ssd_hit += counter.ssd_hit;
+  _tier_stats.miss += counter.miss;
+  _tier_stats.promotion += counter.promotion;
+  return 0;
+}
+
+int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
+                                   size_t num) {
+  CostTimer timer("pserver_downpour_sparse_select_all");
   {  // 从table取值 or create
     std::vector<std::future<int>> tasks(_real_local_shard_num);
     std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
@@ -60,60 +420,10 @@ int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
     for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
       tasks[shard_id] =
           _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-              [this, shard_id, &task_keys, value_size, mf_value_size,
-               select_value_size, pull_values, keys, &missed_keys]() -> int {
-                auto& keys = task_keys[shard_id];
-                auto& local_shard = _local_shards[shard_id];
-                float data_buffer[value_size];
-                float* data_buffer_ptr = data_buffer;
-                for (int i = 0; i < keys.size(); ++i) {
-                  uint64_t key = keys[i].first;
-                  auto itr = local_shard.find(key);
-                  size_t data_size = value_size - mf_value_size;
-                  if (itr == local_shard.end()) {
-                    // pull rocksdb
-                    std::string tmp_string("");
-                    if (_db->get(shard_id, (char*)&key, sizeof(uint64_t),
-                                 tmp_string) > 0) {
-                      ++missed_keys;
-                      if (FLAGS_pserver_create_value_when_push) {
-                        memset(data_buffer, 0, sizeof(float) * data_size);
-                      } else {
-                        auto& feature_value = local_shard[key];
-                        feature_value.resize(data_size);
-                        float* data_ptr =
-                            const_cast<float*>(feature_value.data());
-                        _value_accesor->Create(&data_buffer_ptr, 1);
-                        memcpy(data_ptr, data_buffer_ptr,
-                               data_size * sizeof(float));
-                      }
-                    } else {
-                      data_size = tmp_string.size() / sizeof(float);
-                      memcpy(data_buffer_ptr,
-                             paddle::string::str_to_float(tmp_string),
-                             data_size * sizeof(float));
-                      // from rocksdb to mem
-                      auto& feature_value = local_shard[key];
-                      feature_value.resize(data_size);
-                      memcpy(const_cast<float*>(feature_value.data()),
-                             data_buffer_ptr, data_size * sizeof(float));
-                      _db->del_data(shard_id, (char*)&key, sizeof(uint64_t));
-                    }
-                  } else {
-                    data_size = itr.value().size();
-                    memcpy(data_buffer_ptr, itr.value().data(),
-                           data_size * sizeof(float));
-                  }
-                  for (int mf_idx = data_size; mf_idx < value_size; ++mf_idx) {
-                    data_buffer[mf_idx] = 0.0;
-                  }
-                  int pull_data_idx = keys[i].second;
-                  float* select_data =
-                      pull_values + pull_data_idx * select_value_size;
-                  _value_accesor->Select(&select_data,
-                                         (const float**)&data_buffer_ptr, 1);
-                }
-                return 0;
+              [this, shard_id, &task_keys, pull_values,
+               &missed_keys]() -> int {
+                return PullSparseShard(shard_id, task_keys[shard_id],
+                                       pull_values, &missed_keys);
               });
     }
     for (size_t i = 0; i < _real_local_shard_num; ++i) {
@@ -121,109 +431,132 @@ int32_t SSDSparseTable::PullSparse(float* pull_values, const uint64_t* keys,
     }
     if (FLAGS_pserver_print_missed_key_num_every_push) {
       LOG(WARNING) << "total pull keys:" << num
-                   << " missed_keys:" << missed_keys.load();
+                   << " missed_keys:" << missed_keys.load() << " "
+                   << _tier_stats.ToString();
     }
   }
   return 0;
 }
 
-int32_t SSDSparseTable::PushSparse(const uint64_t* keys, const float* values,
-                                   size_t num) {
-  CostTimer timer("pserver_downpour_sparse_update_all");
+int32_t SSDSparseTable::PushSparseShard(
+    size_t shard_id, const std::vector<std::pair<uint64_t, int>>& keys,
+    const float* values) {
   // 构造value push_value的数据指针
   size_t value_col = _value_accesor->GetAccessorInfo().size / sizeof(float);
   size_t mf_value_col =
       _value_accesor->GetAccessorInfo().mf_size / sizeof(float);
   size_t update_value_col =
       _value_accesor->GetAccessorInfo().update_size / sizeof(float);
-  {
-    std::vector<std::future<int>> tasks(_real_local_shard_num);
-    std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
-        _real_local_shard_num);
-    for (size_t i = 0; i < num; ++i) {
-      int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
-      task_keys[shard_id].push_back({keys[i], i});
+  auto& local_shard = _local_shards[shard_id];
+  std::vector<float> data_buffer(value_col);
+  float* data_buffer_ptr = data_buffer.data();
+  TierCounter counter;
+
+  auto update = [&](FixedFeatureValue& feature_value,
+                    const float* update_data) {
+    float* value_data = feature_value.data();
+    size_t value_size = feature_value.size();
+    if (value_size == value_col) {  // 已拓展到最大size, 则就地update
+      _value_accesor->Update(&value_data, &update_data, 1);
+    } else {  // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
+      memcpy(data_buffer_ptr, value_data, value_size * sizeof(float));
+      _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
+      if (_value_accesor->NeedExtendMF(data_buffer_ptr)) {
+        feature_value.resize(value_col);
+        value_data = feature_value.data();
+        _value_accesor->Create(&value_data, 1);
+      }
+      memcpy(value_data, data_buffer_ptr, value_size * sizeof(float));
     }
-    for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
-      tasks[shard_id] =
-          _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
-              [this, shard_id, value_col, mf_value_col, update_value_col,
-               values, &task_keys]() -> int {
-                auto& keys = task_keys[shard_id];
-                auto& local_shard = _local_shards[shard_id];
-                float data_buffer[value_col];
-                float* data_buffer_ptr = data_buffer;
-                for (int i = 0; i < keys.size(); ++i) {
-                  uint64_t key = keys[i].first;
-                  uint64_t push_data_idx = keys[i].second;
-                  const float* update_data =
-                      values + push_data_idx * update_value_col;
-                  auto itr = local_shard.find(key);
-                  if (itr == local_shard.end()) {
-                    if (FLAGS_pserver_enable_create_feasign_randomly &&
-                        !_value_accesor->CreateValue(1, update_data)) {
-                      continue;
-                    }
-                    auto value_size = value_col - mf_value_col;
-                    auto& feature_value = local_shard[key];
-                    feature_value.resize(value_size);
-                    _value_accesor->Create(&data_buffer_ptr, 1);
-                    memcpy(const_cast<float*>(feature_value.data()),
-                           data_buffer_ptr, value_size * sizeof(float));
-                    itr = local_shard.find(key);
-                  }
-                  auto& feature_value = itr.value();
-                  float* value_data = const_cast<float*>(feature_value.data());
-                  size_t value_size = feature_value.size();
-
-                  if (value_size ==
-                      value_col) {  // 已拓展到最大size, 则就地update
-                    _value_accesor->Update(&value_data, &update_data, 1);
-                  } else {  // 拷入buffer区进行update，然后再回填，不需要的mf则回填时抛弃了
-                    memcpy(data_buffer_ptr, value_data,
-                           value_size * sizeof(float));
-                    _value_accesor->Update(&data_buffer_ptr, &update_data, 1);
-                    if (_value_accesor->NeedExtendMF(data_buffer)) {
-                      feature_value.resize(value_col);
-                      value_data = const_cast<float*>(feature_value.data());
-                      _value_accesor->Create(&value_data, 1);
-                    }
-                    memcpy(value_data, data_buffer_ptr,
-                           value_size * sizeof(float));
-                  }
-                }
-                return 0;
-              });
+  };
+
+  std::vector<size_t> ssd_idx;
+  std::vector<uint64_t> ssd_keys;
+  for (size_t i = 0; i < keys.size(); ++i) {
+    uint64_t key = keys[i].first;
+    if (_mem_capacity > 0) {
+      _sketches[shard_id].Increment(key);
     }
-    for (size_t i = 0; i < _real_local_shard_num; ++i) {
-      tasks[i].wait();
+    auto itr = local_shard.find(key);
+    if (itr == local_shard.end()) {
+      ssd_idx.push_back(i);
+      ssd_keys.push_back(key);
+      continue;
+    }
+    ++counter.mem_hit;
+    update(itr.value(), values + keys[i].second * update_value_col);
+  }
+
+  std::vector<std::string> ssd_values;
+  std::vector<int> ssd_status;
+  if (!ssd_keys.empty()) {
+    ReadSsd(shard_id, ssd_keys, &ssd_values, &ssd_status);
+  }
+  for (size_t j = 0; j < ssd_keys.size(); ++j) {
+    uint64_t key = ssd_keys[j];
+    const float* update_data = values + keys[ssd_idx[j]].second *
+                                            update_value_col;
+    if (ssd_status[j] == 0) {
+      ++counter.ssd_hit;
+      size_t data_size = ssd_values[j].size() / sizeof(float);
+      const float* ssd_data = paddle::string::str_to_float(ssd_values[j]);
+      if (Admit(shard_id, key)) {
+        update(Promote(shard_id, key, ssd_data, data_size), update_data);
+        ++counter.promotion;
+      } else {
+        // cold value, update it without bringing it into memory
+        memcpy(data_buffer_ptr, ssd_data, data_size * sizeof(float));
+        data_size = UpdateBuffer(data_buffer_ptr, data_size, update_data);
+        _writeback->Put(shard_id, key, data_buffer_ptr, data_size);
+      }
+      continue;
+    }
+    ++counter.miss;
+    if (FLAGS_pserver_enable_create_feasign_randomly &&
+        !_value_accesor->CreateValue(1, update_data)) {
+      continue;
     }
+    auto value_size = value_col - mf_value_col;
+    auto& feature_value = AcquireValue(shard_id, key);
+    feature_value.resize(value_size);
+    _value_accesor->Create(&data_buffer_ptr, 1);
+    memcpy(feature_value.data(), data_buffer_ptr, value_size * sizeof(float));
+    update(feature_value, update_data);
   }
-  /*
-  //update && value 的转置
-  thread_local Eigen::MatrixXf update_matrix;
-  float* transposed_update_data[update_value_col];
-  make_matrix_with_eigen(num, update_value_col, update_matrix,
-  transposed_update_data);
-  copy_array_to_eigen(values, update_matrix);
+  EvictShard(shard_id);
 
-  thread_local Eigen::MatrixXf value_matrix;
-  float* transposed_value_data[value_col];
-  make_matrix_with_eigen(num, value_col, value_matrix, transposed_value_data);
-  copy_matrix_to_eigen((const float**)(value_ptrs->data()), value_matrix);
+  _tier_stats.mem_hit += counter.mem_hit;
+  _tier_stats.ssd_hit += counter.ssd_hit;
+  _tier_stats.miss += counter.miss;
+  _tier_stats.promotion += counter.promotion;
+  return 0;
+}
 
-  //批量update
-  {
-      CostTimer accessor_timer("pslib_downpour_sparse_update_accessor");
-      _value_accesor->update(transposed_value_data, (const
-  float**)transposed_update_data, num);
+int32_t SSDSparseTable::PushSparse(const uint64_t* keys, const float* values,
+                                   size_t num) {
+  CostTimer timer("pserver_downpour_sparse_update_all");
+  std::vector<std::future<int>> tasks(_real_local_shard_num);
+  std::vector<std::vector<std::pair<uint64_t, int>>> task_keys(
+      _real_local_shard_num);
+  for (size_t i = 0; i < num; ++i) {
+    int shard_id = (keys[i] % _sparse_table_shard_num) % _avg_local_shard_num;
+    task_keys[shard_id].push_back({keys[i], i});
+  }
+  for (size_t shard_id = 0; shard_id < _real_local_shard_num; ++shard_id) {
+    tasks[shard_id] =
+        _shards_task_pool[shard_id % _shards_task_pool.size()]->enqueue(
+            [this, shard_id, values, &task_keys]() -> int {
+              return PushSparseShard(shard_id, task_keys[shard_id], values);
+            });
+  }
+  for (size_t i = 0; i < _real_local_shard_num; ++i) {
+    tasks[i].wait();
   }
-  copy_eigen_to_matrix(value_matrix, value_ptrs->data());
-  */
   return 0;
 }
 
 int32_t SSDSparseTable::Shrink(const std::string& param) {
+  _writeback->Drain();
   int thread_num = _real_local_shard_num < 20 ? _real_local_shard_num : 20;
   omp_set_num_threads(thread_num);
 #pragma omp parallel for schedule(dynamic)
@@ -262,6 +595,7 @@ int32_t SSDSparseTable::Shrink(const std::string& param) {
 
 int32_t SSDSparseTable::UpdateTable() {
   // TODO implement with multi-thread
+  _writeback->Drain();
   int count = 0;
   for (size_t i = 0; i < _real_local_shard_num; ++i) {
     auto& shard = _local_shards[i];
@@ -279,6 +613,7 @@ int32_t SSDSparseTable::UpdateTable() {
     _db->flush(i);
   }
   LOG(INFO) << "Table>> update count: " << count;
+  LOG(INFO) << "SSDSparseTable tier stats: " << _tier_stats.ToString();
   return 0;
 }
 
@@ -300,6 +635,7 @@ int32_t SSDSparseTable::Save(const std::string& path,
     _local_show_threshold = -1;
     return 0;
   }
+  _writeback->Drain();
   int save_param = atoi(param.c_str());  // batch_model:0  xbox:1
   //    if (save_param == 5) {
   //        return save_patch(path, save_param);
@@ -631,6 +967,7 @@ int32_t SSDSparseTable::Load(size_t start_idx, size_t end_idx,
   if (start_idx >= file_list.size()) {
     return 0;
   }
+  _writeback->Drain();
   int load_param = atoi(param.c_str());
   size_t feature_value_size =
       _value_accesor->GetAccessorInfo().size / sizeof(float);
@@ -712,7 +1049,7 @@ int32_t SSDSparseTable::Load(size_t start_idx, size_t end_idx,
               ssd_mf_count++;
             }
           } else {
-            auto& value = shard[key];
+            auto& value = AcquireValue(local_shard_id, key);
             value.resize(value_size);
             _value_accesor->ParseFromString(end, value.data());
             mem_count++;
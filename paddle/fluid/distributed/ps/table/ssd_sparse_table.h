@@ -14,13 +14,73 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>  // NOLINT
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "gflags/gflags.h"
 #include "paddle/fluid/distributed/ps/table/depends/rocksdb_warpper.h"
+#include "paddle/fluid/distributed/ps/table/depends/ssd_tier.h"
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 
 namespace paddle {
 namespace distributed {
 
+// Writes values evicted from memory back to rocksdb on a background thread.
+// Puts and deletes are collected per shard, the latest one of a key wins, and
+// written in batches sorted by key. Lookup sees the writes that are not in
+// rocksdb yet, so readers never observe a value in neither tier.
+class SsdWriteback {
+ public:
+  // written, when not null, counts the values put into rocksdb
+  SsdWriteback(RocksDBHandler* db, size_t shard_num, size_t batch_size,
+               std::atomic<uint64_t>* written = nullptr);
+  ~SsdWriteback();
+
+  void Put(size_t shard_id, uint64_t key, const float* value, size_t size);
+  void Delete(size_t shard_id, uint64_t key);
+  // returns 0 and fills value when key has a pending put, 1 when it has a
+  // pending delete and -1 when rocksdb is up to date for key
+  int Lookup(size_t shard_id, uint64_t key, std::string* value);
+  // blocks until everything enqueued before the call is in rocksdb
+  void Drain();
+
+ private:
+  struct PendingWrite {
+    bool is_delete;
+    std::string value;
+  };
+  struct Shard {
+    std::mutex mutex;
+    std::unordered_map<uint64_t, PendingWrite> pending;
+    // taken from pending by the thread and being written right now
+    std::unordered_map<uint64_t, PendingWrite> flushing;
+  };
+
+  void Enqueue(size_t shard_id, uint64_t key, PendingWrite&& write);
+  void Run();
+  void FlushShard(size_t shard_id);
+
+  RocksDBHandler* _db;
+  size_t _batch_size;
+  std::atomic<uint64_t>* _written;
+  std::unique_ptr<Shard[]> _shards;
+  size_t _shard_num;
+  std::atomic<size_t> _pending_num{0};
+
+  std::mutex _mutex;
+  std::condition_variable _cond;
+  uint64_t _request_seq = 0;
+  uint64_t _flushed_seq = 0;
+  bool _stop = false;
+  std::thread _thread;
+};
+
 class SSDSparseTable : public MemorySparseTable {
  public:
   typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
@@ -52,7 +112,10 @@ class SSDSparseTable : public MemorySparseTable {
   virtual int32_t PushSparse(const uint64_t* keys, const float* values,
                              size_t num);
 
-  int32_t Flush() override { return 0; }
+  int32_t Flush() override {
+    _writeback->Drain();
+    return 0;
+  }
   virtual int32_t Shrink(const std::string& param) override;
   virtual void Clear() override {
     for (size_t i = 0; i < _real_local_shard_num; ++i) {
@@ -83,9 +146,44 @@ class SSDSparseTable : public MemorySparseTable {
                        const std::vector<std::string>& file_list,
                        const std::string& param);
   int64_t LocalSize();
+  const SsdTierStats& TierStats() const { return _tier_stats; }
 
  private:
+  struct TierCounter {
+    uint64_t mem_hit = 0;
+    uint64_t ssd_hit = 0;
+    uint64_t miss = 0;
+    uint64_t promotion = 0;
+  };
+
+  int32_t PullSparseShard(size_t shard_id,
+                          const std::vector<std::pair<uint64_t, int>>& keys,
+                          float* pull_values, std::atomic<uint32_t>* missed);
+  int32_t PushSparseShard(size_t shard_id,
+                          const std::vector<std::pair<uint64_t, int>>& keys,
+                          const float* values);
+  // reads the keys missing in memory from the writeback queue and rocksdb,
+  // status[i] is 0 when keys[i] is found
+  void ReadSsd(size_t shard_id, const std::vector<uint64_t>& keys,
+               std::vector<std::string>* values, std::vector<int>* status);
+  // whether a value found in rocksdb is moved into memory
+  bool Admit(size_t shard_id, uint64_t key);
+  FixedFeatureValue& Promote(size_t shard_id, uint64_t key, const float* data,
+                             size_t data_size);
+  // updates a value of data_size floats in data_buffer, which has room for
+  // the full value, and returns its new size
+  size_t UpdateBuffer(float* data_buffer, size_t data_size,
+                      const float* update_data);
+  // moves the least frequently used values of the shard to rocksdb once it
+  // holds more than _mem_capacity values
+  void EvictShard(size_t shard_id);
+
   RocksDBHandler* _db;
+  std::unique_ptr<SsdWriteback> _writeback;
+  // 0 keeps every value pulled or pushed in memory
+  size_t _mem_capacity = 0;
+  std::vector<FrequencySketch> _sketches;
+  SsdTierStats _tier_stats;
   int64_t _cache_tk_size;
   double _local_show_threshold{0.0};
 };
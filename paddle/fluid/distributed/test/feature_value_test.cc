@@ -13,7 +13,9 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+#include <chrono>  // NOLINT
 #include <vector>
+#include "glog/logging.h"
 #include "gtest/gtest.h"
 
 namespace paddle {
@@ -44,5 +46,97 @@ TEST(BENCHMARK, LargeScaleKV) {
   ASSERT_FLOAT_EQ(value_data[3], 0.3);
 }
 
+TEST(FeatureValueSlab, AcquireRelease) {
+  typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+  FeatureValueSlab slab;
+  shard_type shard;
+  const size_t dim = 9;
+  const size_t mf_dim = 17;
+  for (uint64_t key = 0; key < 1000; ++key) {
+    auto& value = shard.emplace(key, &slab).first.value();
+    value.resize(dim);
+    for (size_t i = 0; i < dim; ++i) {
+      value.data()[i] = key + i;
+    }
+  }
+  ASSERT_EQ(slab.size(), 1000UL);
+
+  // extending the value keeps its content and moves it to a larger slot
+  auto& extended = shard.find(7).value();
+  extended.set_dirty(true);
+  extended.resize(mf_dim);
+  ASSERT_TRUE(extended.dirty());
+  ASSERT_EQ(extended.size(), mf_dim);
+  ASSERT_FLOAT_EQ(extended.data()[dim - 1], 7 + dim - 1);
+  ASSERT_FLOAT_EQ(extended.data()[dim], 0.0);
+  ASSERT_EQ(slab.size(), 1000UL);
+  size_t reserved = slab.memory_bytes();
+
+  // erased values return their slots to the free list for reuse
+  for (uint64_t key = 0; key < 500; ++key) {
+    shard.erase(key);
+  }
+  ASSERT_EQ(slab.size(), 500UL);
+  for (uint64_t key = 1000; key < 1400; ++key) {
+    shard.emplace(key, &slab).first.value().resize(dim);
+  }
+  ASSERT_EQ(slab.size(), 900UL);
+  ASSERT_EQ(slab.memory_bytes(), reserved);
+  ASSERT_FLOAT_EQ(shard.find(999).value().data()[dim - 1], 999 + dim - 1);
+
+  shard.clear();
+  ASSERT_EQ(slab.size(), 0UL);
+}
+
+TEST(BENCHMARK, FeatureValueSlab) {
+  typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+  const size_t key_num = 1000000;
+  const size_t dim = 9;
+  const int pull_rounds = 10;
+
+  auto run = [&](FeatureValueSlab* slab, const std::string& name) {
+    shard_type shard;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t key = 0; key < key_num; ++key) {
+      auto& value = slab == nullptr ? shard[key]
+                                    : shard.emplace(key, slab).first.value();
+      value.resize(dim);
+      value.data()[0] = key;
+    }
+    auto insert_end = std::chrono::steady_clock::now();
+    std::vector<float> pull_buffer(dim);
+    float sum = 0.0;
+    for (int round = 0; round < pull_rounds; ++round) {
+      for (uint64_t key = 0; key < key_num; ++key) {
+        auto& value = shard.find(key * 7919 % key_num).value();
+        memcpy(pull_buffer.data(), value.data(), value.size() * sizeof(float));
+        sum += pull_buffer[0];
+      }
+    }
+    auto pull_end = std::chrono::steady_clock::now();
+    double insert_ms =
+        std::chrono::duration<double, std::milli>(insert_end - start).count();
+    double pull_ms =
+        std::chrono::duration<double, std::milli>(pull_end - insert_end)
+            .count();
+    LOG(INFO) << name << " insert " << key_num << " keys: " << insert_ms
+              << " ms, pull throughput: "
+              << key_num * pull_rounds / pull_ms / 1000.0
+              << " M keys/s, checksum: " << sum;
+  };
+
+  run(nullptr, "heap feature value");
+  FeatureValueSlab slab;
+  run(&slab, "slab feature value");
+
+  // value storage in bytes per key, the heap layout is an upper bound of the
+  // requested bytes, malloc adds its chunk header and alignment on top of it
+  LOG(INFO) << "heap feature value bytes per key: >= "
+            << sizeof(FixedFeatureValue) + dim * sizeof(float);
+  LOG(INFO) << "slab feature value bytes per key: "
+            << sizeof(FixedFeatureValue) +
+                   static_cast<double>(slab.memory_bytes()) / key_num;
+}
+
 }  // namespace distributed
 }  // namespace paddle
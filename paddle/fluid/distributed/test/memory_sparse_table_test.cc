@@ -15,18 +15,372 @@ limitations under the License. */
 #include <ThreadPool.h>
 
 #include <unistd.h>
+#include <chrono>  // NOLINT
+#include <fstream>
 #include <string>
 #include <thread>  // NOLINT
 
 #include "google/protobuf/text_format.h"
 #include "gtest/gtest.h"
 #include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/distributed/ps/table/depends/sparse_binary_format.h"
 #include "paddle/fluid/distributed/ps/table/memory_sparse_table.h"
 #include "paddle/fluid/distributed/ps/table/table.h"
+#include "paddle/fluid/framework/io/fs.h"
+
+DECLARE_int32(pserver_sparse_batch_size);
 
 namespace paddle {
 namespace distributed {
 
+// A CtrCommonAccessor table with naive sgd rules. An initial_range of 0
+// makes the initial values, and so the whole table, deterministic.
+static void InitCtrTableConfig(TableParameter *table_config, int emb_dim,
+                               float initial_range,
+                               SparseShardIndexType index_type) {
+  table_config->set_table_class("MemorySparseTable");
+  table_config->set_shard_num(10);
+  table_config->set_sparse_shard_index(index_type);
+  TableAccessorParameter *accessor_config = table_config->mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(emb_dim + 3);
+  accessor_config->set_embedx_dim(emb_dim);
+  accessor_config->set_embedx_threshold(5);
+  auto *ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.2);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_base_threshold(0.5);
+  ctr_param->set_delta_threshold(0.2);
+  ctr_param->set_delta_keep_days(16);
+  ctr_param->set_show_click_decay_rate(0.99);
+  for (auto *sgd_param : {accessor_config->mutable_embed_sgd_param(),
+                          accessor_config->mutable_embedx_sgd_param()}) {
+    sgd_param->set_name("SparseNaiveSGDRule");
+    auto *naive_param = sgd_param->mutable_naive();
+    naive_param->set_learning_rate(0.1);
+    naive_param->set_initial_range(initial_range);
+    naive_param->add_weight_bounds(-10.0);
+    naive_param->add_weight_bounds(10.0);
+  }
+}
+
+static std::unique_ptr<Table> CreateTable(const TableParameter &table_config) {
+  FsClientParameter fs_config;
+  std::unique_ptr<Table> table(new MemorySparseTable());
+  table->SetShard(0, 1);
+  EXPECT_EQ(table->Initialize(table_config, fs_config), 0);
+  return table;
+}
+
+static std::unique_ptr<Table> CreateCtrTable(
+    int emb_dim, SparseShardIndexType index_type = CLOSED_HASH_INDEX) {
+  TableParameter table_config;
+  InitCtrTableConfig(&table_config, emb_dim, 0.0, index_type);
+  return CreateTable(table_config);
+}
+
+static std::string ReadFile(const std::string &path) {
+  std::ifstream in(path, std::ios::binary);
+  return std::string(std::istreambuf_iterator<char>(in),
+                     std::istreambuf_iterator<char>());
+}
+
+static void WriteFile(const std::string &path, const std::string &content) {
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  out << content;
+}
+
+static void PullCtrTable(Table *table, const std::vector<uint64_t> &keys,
+                         int emb_dim, std::vector<float> *values) {
+  std::vector<uint64_t> pull_keys(keys);
+  std::vector<uint32_t> fres(keys.size(), 1);
+  auto pull_value = PullSparseValue(pull_keys, fres, emb_dim);
+  values->assign(keys.size() * (emb_dim + 3), 0);
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.pull_context.pull_value = pull_value;
+  table_context.pull_context.values = values->data();
+  table->Pull(table_context);
+}
+
+// pushes a show, a click every other round and gradients derived from the
+// key and the round, so that the embedx of the keys is created after a few
+// rounds
+static void PushCtrTable(Table *table, const std::vector<uint64_t> &keys,
+                         int emb_dim, int round) {
+  std::vector<float> push_values;
+  for (auto key : keys) {
+    push_values.push_back(0);  // slot
+    push_values.push_back(1);  // show
+    push_values.push_back(round % 2);
+    for (int k = 0; k < emb_dim + 1; k++) {
+      push_values.push_back(0.01 * ((key + k + round) % 7) - 0.03);
+    }
+  }
+  TableContext table_context;
+  table_context.value_type = Sparse;
+  table_context.push_context.keys = keys.data();
+  table_context.push_context.values = push_values.data();
+  table_context.num = keys.size();
+  table->Push(table_context);
+}
+
+static std::vector<float> RunCtrTableRounds(int batch_size,
+                                            SparseShardIndexType index_type,
+                                            int rounds,
+                                            const std::vector<uint64_t> &keys,
+                                            int emb_dim) {
+  int old_batch_size = FLAGS_pserver_sparse_batch_size;
+  FLAGS_pserver_sparse_batch_size = batch_size;
+  auto table = CreateCtrTable(emb_dim, index_type);
+  FLAGS_pserver_sparse_batch_size = old_batch_size;
+  std::vector<float> values;
+  for (int round = 0; round < rounds; ++round) {
+    PullCtrTable(table.get(), keys, emb_dim, &values);
+    PushCtrTable(table.get(), keys, emb_dim, round);
+  }
+  PullCtrTable(table.get(), keys, emb_dim, &values);
+  return values;
+}
+
+// batches of any size, the last one partial, and the prefetch of the swiss
+// index select and update the same values as one key at a time
+TEST(MemorySparseTable, BatchedPullPush) {
+  const int emb_dim = 8;
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 500; ++key) {
+    keys.push_back(key * 7919);
+  }
+  // a repeated key is pushed twice in one call
+  keys.push_back(keys[3]);
+  auto expect = RunCtrTableRounds(1, CLOSED_HASH_INDEX, 8, keys, emb_dim);
+  for (int batch_size : {3, 64, 1000}) {
+    for (auto index_type : {CLOSED_HASH_INDEX, SWISS_HASH_INDEX}) {
+      auto values =
+          RunCtrTableRounds(batch_size, index_type, 8, keys, emb_dim);
+      ASSERT_EQ(values.size(), expect.size());
+      for (size_t i = 0; i < values.size(); ++i) {
+        ASSERT_FLOAT_EQ(values[i], expect[i])
+            << "batch_size " << batch_size << " index " << index_type;
+      }
+    }
+  }
+}
+
+TEST(MemorySparseTable, InvalidBatchSize) {
+  int old_batch_size = FLAGS_pserver_sparse_batch_size;
+  for (int batch_size : {0, -1}) {
+    FLAGS_pserver_sparse_batch_size = batch_size;
+    TableParameter table_config;
+    InitCtrTableConfig(&table_config, 8, 0.0, CLOSED_HASH_INDEX);
+    FsClientParameter fs_config;
+    std::unique_ptr<Table> table(new MemorySparseTable());
+    table->SetShard(0, 1);
+    EXPECT_THROW(table->Initialize(table_config, fs_config),
+                 paddle::platform::EnforceNotMet);
+  }
+  FLAGS_pserver_sparse_batch_size = old_batch_size;
+}
+
+// a binary checkpoint with a corrupted block fails to load and leaves no
+// partial shard behind, a damaged index falls back to scanning the blocks
+TEST(MemorySparseTable, BinaryLoadCorrupted) {
+  const int emb_dim = 8;
+  TableParameter table_config;
+  InitCtrTableConfig(&table_config, emb_dim, 0.0, CLOSED_HASH_INDEX);
+  table_config.set_sparse_save_format(BINARY_SAVE_FORMAT);
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 2000; ++key) {
+    keys.push_back(key);
+  }
+  auto table = CreateTable(table_config);
+  std::vector<float> expect;
+  for (int round = 0; round < 6; ++round) {
+    PullCtrTable(table.get(), keys, emb_dim, &expect);
+    PushCtrTable(table.get(), keys, emb_dim, round);
+  }
+  const std::string path = "./work/binary_load_corrupted";
+  ASSERT_EQ(table->Save(path, "0"), 0);
+  PullCtrTable(table.get(), keys, emb_dim, &expect);
+
+  // shard 3 of the 10 holds the keys ending with 3
+  const std::string shard_path = path + "/000/part-000-00003.bin";
+  const std::string index = ReadFile(shard_path + ".idx");
+  ASSERT_FALSE(index.empty());
+  WriteFile(shard_path + ".idx", index.substr(0, index.size() - 1));
+  auto loaded = CreateTable(table_config);
+  ASSERT_EQ(loaded->Load(path, "0"), 0);
+  std::vector<float> values;
+  PullCtrTable(loaded.get(), keys, emb_dim, &values);
+  ASSERT_EQ(values.size(), expect.size());
+  for (size_t i = 0; i < values.size(); ++i) {
+    ASSERT_FLOAT_EQ(values[i], expect[i]);
+  }
+
+  // the size of the last record of the uncompressed block runs past its
+  // end, after the other records of the shard are inserted
+  WriteFile(shard_path + ".idx", index);
+  std::string data = ReadFile(shard_path);
+  SparseBinaryBlockHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  ASSERT_EQ(header.compressed, 0U);
+  ASSERT_EQ(header.record_num, 200U);
+  uint32_t size = 1 << 20;
+  memcpy(&data[sizeof(header) + header.record_num * sizeof(uint64_t) +
+               (header.record_num - 1) * sizeof(uint32_t)],
+         &size, sizeof(size));
+  WriteFile(shard_path, data);
+  auto corrupted = CreateTable(table_config);
+  ASSERT_EQ(corrupted->Load(path, "0"), -1);
+  ASSERT_EQ(static_cast<MemorySparseTable *>(corrupted.get())->LocalSize(),
+            1800);
+  typedef SparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+  auto *shard = static_cast<shard_type *>(corrupted->GetShard(3));
+  ASSERT_EQ(shard->size(), 0U);
+}
+
+// a base checkpoint, updates and erases by Shrink, then a delta checkpoint
+// load into a table equal to the saved one
+TEST(MemorySparseTable, DeltaCheckpointRoundTrip) {
+  const int emb_dim = 8;
+  for (auto save_format : {TEXT_SAVE_FORMAT, BINARY_SAVE_FORMAT}) {
+    TableParameter table_config;
+    InitCtrTableConfig(&table_config, emb_dim, 0.0, CLOSED_HASH_INDEX);
+    table_config.set_sparse_save_format(save_format);
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> hot_keys;
+    for (uint64_t key = 0; key < 1000; ++key) {
+      keys.push_back(key);
+      if (key % 2 == 0) {
+        hot_keys.push_back(key);
+      }
+    }
+    auto table = CreateTable(table_config);
+    PushCtrTable(table.get(), keys, emb_dim, 0);
+    for (int round = 1; round < 6; ++round) {
+      PushCtrTable(table.get(), hot_keys, emb_dim, round);
+    }
+    const std::string path = "./work/delta_checkpoint_" +
+                             SparseTableSaveFormat_Name(save_format);
+    ASSERT_EQ(table->Save(path, "0"), 0);
+
+    // a few values are updated, Shrink decays all of them and erases the
+    // keys that were pushed once
+    std::vector<uint64_t> updated(hot_keys.begin(), hot_keys.begin() + 50);
+    PushCtrTable(table.get(), updated, emb_dim, 6);
+    ASSERT_EQ(table->Shrink("0"), 0);
+    auto *memory_table = static_cast<MemorySparseTable *>(table.get());
+    ASSERT_EQ(memory_table->LocalSize(), static_cast<int64_t>(hot_keys.size()));
+    ASSERT_EQ(table->Save(path, "6"), 0);
+
+    auto loaded = CreateTable(table_config);
+    ASSERT_EQ(loaded->Load(path, "0"), 0);
+    ASSERT_EQ(static_cast<MemorySparseTable *>(loaded.get())->LocalSize(),
+              memory_table->LocalSize());
+    std::vector<float> expect;
+    std::vector<float> values;
+    PullCtrTable(table.get(), hot_keys, emb_dim, &expect);
+    PullCtrTable(loaded.get(), hot_keys, emb_dim, &values);
+    ASSERT_EQ(values.size(), expect.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_NEAR(values[i], expect[i], 1e-5)
+          << SparseTableSaveFormat_Name(save_format) << " key "
+          << hot_keys[i / (emb_dim + 3)];
+    }
+  }
+}
+
+// deltas saved to the local fs go to their own directories and keep the
+// keys erased before them: a key erased by Shrink, pushed again and erased
+// again in later deltas is not resurrected by the earlier ones on load
+TEST(MemorySparseTable, LocalFSDeltaCheckpoints) {
+  const int emb_dim = 8;
+  for (auto save_format : {TEXT_SAVE_FORMAT, BINARY_SAVE_FORMAT}) {
+    TableParameter table_config;
+    InitCtrTableConfig(&table_config, emb_dim, 0.0, CLOSED_HASH_INDEX);
+    table_config.set_sparse_save_format(save_format);
+    std::vector<uint64_t> keys;
+    std::vector<uint64_t> hot_keys;
+    std::vector<uint64_t> cold_keys;
+    for (uint64_t key = 0; key < 1000; ++key) {
+      keys.push_back(key);
+      if (key % 2 == 0) {
+        hot_keys.push_back(key);
+      } else if (key < 200) {
+        cold_keys.push_back(key);
+      }
+    }
+    auto table = CreateTable(table_config);
+    auto *memory_table = static_cast<MemorySparseTable *>(table.get());
+    PushCtrTable(table.get(), keys, emb_dim, 0);
+    for (int round = 1; round < 6; ++round) {
+      PushCtrTable(table.get(), hot_keys, emb_dim, round);
+    }
+    const std::string path =
+        "./work/local_delta_" + SparseTableSaveFormat_Name(save_format);
+    ASSERT_EQ(memory_table->SaveLocalFS(path, "0", "test"), 0);
+
+    // delta 1 erases the keys pushed once, delta 2 has a few of them again,
+    // delta 3 erases them again
+    std::vector<uint64_t> updated(hot_keys.begin(), hot_keys.begin() + 50);
+    PushCtrTable(table.get(), updated, emb_dim, 6);
+    ASSERT_EQ(table->Shrink("0"), 0);
+    ASSERT_EQ(memory_table->LocalSize(), static_cast<int64_t>(hot_keys.size()));
+    ASSERT_EQ(memory_table->SaveLocalFS(path, "6", "test"), 0);
+    PushCtrTable(table.get(), cold_keys, emb_dim, 6);
+    ASSERT_EQ(memory_table->LocalSize(),
+              static_cast<int64_t>(hot_keys.size() + cold_keys.size()));
+    ASSERT_EQ(memory_table->SaveLocalFS(path, "6", "test"), 0);
+    ASSERT_EQ(table->Shrink("0"), 0);
+    ASSERT_EQ(memory_table->LocalSize(), static_cast<int64_t>(hot_keys.size()));
+    ASSERT_EQ(memory_table->SaveLocalFS(path, "6", "test"), 0);
+    for (auto delta : {"00001", "00002", "00003"}) {
+      ASSERT_TRUE(
+          paddle::framework::localfs_exists(path + "/000_delta/" + delta));
+    }
+
+    auto loaded = CreateTable(table_config);
+    auto *loaded_table = static_cast<MemorySparseTable *>(loaded.get());
+    ASSERT_EQ(loaded_table->LoadLocalFS(path, "0"), 0);
+    ASSERT_EQ(loaded_table->LocalSize(), memory_table->LocalSize());
+    std::vector<float> expect;
+    std::vector<float> values;
+    PullCtrTable(table.get(), hot_keys, emb_dim, &expect);
+    PullCtrTable(loaded.get(), hot_keys, emb_dim, &values);
+    ASSERT_EQ(values.size(), expect.size());
+    for (size_t i = 0; i < values.size(); ++i) {
+      ASSERT_NEAR(values[i], expect[i], 1e-5)
+          << SparseTableSaveFormat_Name(save_format) << " key "
+          << hot_keys[i / (emb_dim + 3)];
+    }
+
+    // a new base drops the deltas of the old one
+    ASSERT_EQ(memory_table->SaveLocalFS(path, "0", "test"), 0);
+    ASSERT_FALSE(paddle::framework::localfs_exists(path + "/000_delta"));
+  }
+}
+
+TEST(BENCHMARK, MemorySparseTablePullPush) {
+  const int emb_dim = 8;
+  const int rounds = 10;
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 100000; ++key) {
+    keys.push_back(key * 7919);
+  }
+  for (auto index_type : {CLOSED_HASH_INDEX, SWISS_HASH_INDEX}) {
+    for (int batch_size : {1, 64}) {
+      auto start = std::chrono::steady_clock::now();
+      RunCtrTableRounds(batch_size, index_type, rounds, keys, emb_dim);
+      double ms = std::chrono::duration<double, std::milli>(
+                      std::chrono::steady_clock::now() - start)
+                      .count();
+      LOG(INFO) << SparseShardIndexType_Name(index_type) << " batch size "
+                << batch_size << ": " << ms / rounds
+                << " ms per pull and push of " << keys.size() << " keys";
+    }
+  }
+}
+
 TEST(MemorySparseTable, SGD) {
   int emb_dim = 8;
   int trainers = 2;
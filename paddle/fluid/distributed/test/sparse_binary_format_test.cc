@@ -0,0 +1,167 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/depends/sparse_binary_format.h"
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace distributed {
+
+static void WriteRecords(bool compress, std::string* data,
+                         std::string* index) {
+  SparseBinaryWriter writer(
+      [data](const char* buf, size_t size) -> int {
+        data->append(buf, size);
+        return 0;
+      },
+      compress, 1024);
+  std::vector<float> value(20);
+  for (uint64_t key = 0; key < 1000; ++key) {
+    // values with and without the mf part
+    uint32_t size = key % 3 == 0 ? 20 : 8;
+    for (uint32_t i = 0; i < size; ++i) {
+      value[i] = key * 100 + i;
+    }
+    ASSERT_EQ(writer.Append(key, value.data(), size), 0);
+  }
+  ASSERT_EQ(writer.Close(), 0);
+  ASSERT_EQ(writer.record_num(), 1000UL);
+  *index = writer.IndexString();
+}
+
+static void CheckRecords(const std::string& data,
+                         const std::vector<SparseBinaryBlockIndex>& index) {
+  ASSERT_GT(index.size(), 1UL);
+  SparseBinaryReader reader(data.data(), data.size());
+  std::string buffer;
+  uint64_t expect_key = 0;
+  for (auto& block : index) {
+    int ret = reader.ReadBlock(
+        block, &buffer,
+        [&expect_key](uint64_t key, const float* value, uint32_t size) {
+          ASSERT_EQ(key, expect_key);
+          ASSERT_EQ(size, key % 3 == 0 ? 20U : 8U);
+          for (uint32_t i = 0; i < size; ++i) {
+            ASSERT_FLOAT_EQ(value[i], key * 100 + i);
+          }
+          ++expect_key;
+        });
+    ASSERT_EQ(ret, 0);
+  }
+  ASSERT_EQ(expect_key, 1000UL);
+}
+
+TEST(SparseBinaryFormat, ReadWrite) {
+  for (bool compress : {false, true}) {
+    std::string data;
+    std::string index_text;
+    WriteRecords(compress, &data, &index_text);
+
+    std::vector<SparseBinaryBlockIndex> index;
+    ASSERT_EQ(SparseBinaryReader::ParseIndex(index_text, &index), 0);
+    CheckRecords(data, index);
+
+    std::vector<SparseBinaryBlockIndex> scanned;
+    SparseBinaryReader reader(data.data(), data.size());
+    ASSERT_EQ(reader.CheckIndex(index), 0);
+    ASSERT_EQ(reader.ScanIndex(&scanned), 0);
+    ASSERT_EQ(scanned.size(), index.size());
+    CheckRecords(data, scanned);
+  }
+}
+
+TEST(SparseBinaryFormat, Corrupted) {
+  std::string data;
+  std::string index_text;
+  WriteRecords(true, &data, &index_text);
+  std::vector<SparseBinaryBlockIndex> index;
+  ASSERT_EQ(SparseBinaryReader::ParseIndex(index_text, &index), 0);
+
+  data[index[1].offset + sizeof(SparseBinaryBlockHeader) + 4] ^= 0x5a;
+  SparseBinaryReader reader(data.data(), data.size());
+  std::string buffer;
+  auto visit = [](uint64_t key, const float* value, uint32_t size) {};
+  ASSERT_EQ(reader.ReadBlock(index[0], &buffer, visit), 0);
+  ASSERT_EQ(reader.ReadBlock(index[1], &buffer, visit), -1);
+
+  // a truncated file fails the scan instead of reading past its end
+  std::vector<SparseBinaryBlockIndex> scanned;
+  SparseBinaryReader truncated(data.data(), data.size() - 1);
+  ASSERT_EQ(truncated.ScanIndex(&scanned), -1);
+}
+
+TEST(SparseBinaryFormat, BadIndex) {
+  std::string data;
+  std::string index_text;
+  WriteRecords(false, &data, &index_text);
+  SparseBinaryReader reader(data.data(), data.size());
+
+  // a last line cut off in the middle of a record or of a number
+  std::vector<SparseBinaryBlockIndex> index;
+  size_t last_line = index_text.rfind('\n', index_text.size() - 2) + 1;
+  size_t last_field = index_text.rfind(' ');
+  for (size_t size : {last_field, last_field + 1, index_text.size() - 1}) {
+    index.clear();
+    ASSERT_EQ(
+        SparseBinaryReader::ParseIndex(index_text.substr(0, size), &index), -1);
+  }
+  index.clear();
+  ASSERT_EQ(SparseBinaryReader::ParseIndex("0 10 1 1\n", &index), -1);
+  // a cut off number still parses, but does not match the block header
+  index.clear();
+  ASSERT_EQ(SparseBinaryReader::ParseIndex(
+                index_text.substr(0, index_text.size() - 2) + "\n", &index),
+            0);
+  ASSERT_EQ(reader.CheckIndex(index), -1);
+
+  // an index that misses a block or does not match the headers
+  index.clear();
+  ASSERT_EQ(
+      SparseBinaryReader::ParseIndex(index_text.substr(0, last_line), &index),
+      0);
+  ASSERT_EQ(reader.CheckIndex(index), -1);
+  index.clear();
+  ASSERT_EQ(SparseBinaryReader::ParseIndex(index_text, &index), 0);
+  index[1].record_num += 1;
+  ASSERT_EQ(reader.CheckIndex(index), -1);
+}
+
+TEST(SparseBinaryFormat, RecordNumPastBlock) {
+  std::string data;
+  std::string index_text;
+  WriteRecords(false, &data, &index_text);
+  std::vector<SparseBinaryBlockIndex> index;
+  ASSERT_EQ(SparseBinaryReader::ParseIndex(index_text, &index), 0);
+
+  // more records than the keys and sizes of the block can hold
+  SparseBinaryBlockHeader header;
+  memcpy(&header, data.data(), sizeof(header));
+  header.record_num =
+      header.raw_bytes / (sizeof(uint64_t) + sizeof(uint32_t)) + 1;
+  memcpy(&data[0], &header, sizeof(header));
+  index[0].record_num = header.record_num;
+  SparseBinaryReader reader(data.data(), data.size());
+  std::string buffer;
+  size_t visited = 0;
+  ASSERT_EQ(reader.ReadBlock(index[0], &buffer,
+                             [&visited](uint64_t key, const float* value,
+                                        uint32_t size) { ++visited; }),
+            -1);
+  ASSERT_EQ(visited, 0UL);
+}
+
+}  // namespace distributed
+}  // namespace paddle
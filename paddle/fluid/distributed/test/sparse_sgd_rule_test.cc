@@ -13,11 +13,16 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include "paddle/fluid/distributed/ps/table/sparse_sgd_rule.h"
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <thread>  // NOLINT
+#include <vector>
 #include "gtest/gtest.h"
 #include "paddle/fluid/distributed/ps.pb.h"
 
+DECLARE_int32(sparse_sgd_rule_jit_min_dim);
+
 namespace paddle {
 namespace distributed {
 
@@ -187,5 +192,178 @@ TEST(downpour_sparse_adam_test, test_init_and_update) {
     ASSERT_FLOAT_EQ(value[i], label[i]) << "i is " << i;
   }
 }
+
+static SparseCommonSGDRuleParameter NaiveParam() {
+  SparseCommonSGDRuleParameter param;
+  param.set_name("naive");
+  param.mutable_naive()->set_learning_rate(0.1);
+  param.mutable_naive()->set_initial_range(0.3);
+  return param;
+}
+
+static SparseCommonSGDRuleParameter AdaGradParam() {
+  SparseCommonSGDRuleParameter param;
+  param.set_name("adagrad");
+  param.mutable_adagrad()->set_learning_rate(0.1);
+  param.mutable_adagrad()->set_initial_range(0.3);
+  param.mutable_adagrad()->set_initial_g2sum(10);
+  return param;
+}
+
+static SparseCommonSGDRuleParameter AdamParam() {
+  SparseCommonSGDRuleParameter param;
+  param.set_name("adam");
+  auto* adam_param = param.mutable_adam();
+  adam_param->set_learning_rate(0.1);
+  adam_param->set_initial_range(0.3);
+  adam_param->set_beta1_decay_rate(0.9);
+  adam_param->set_beta2_decay_rate(0.999);
+  adam_param->set_ada_epsilon(1e-08);
+  adam_param->add_weight_bounds(-10.0);
+  adam_param->add_weight_bounds(10.0);
+  return param;
+}
+
+// Runs steps batched updates of num values from the same initial values,
+// returns the updated values.
+template <typename Rule>
+std::vector<float> RunBatchUpdate(const SparseCommonSGDRuleParameter& param,
+                                  int embed_dim, bool batch) {
+  const size_t num = 8;
+  Rule rule;
+  rule.LoadConfig(param, embed_dim);
+  const int value_dim = embed_dim + rule.Dim();
+
+  std::vector<float> values(num * value_dim);
+  std::vector<float> grads(num * embed_dim);
+  std::vector<float*> w(num), sgd(num);
+  std::vector<const float*> push_values(num);
+  std::vector<float> scales(num);
+  for (size_t i = 0; i < num; ++i) {
+    float* value = values.data() + i * value_dim;
+    rule.InitValue(value, value + embed_dim, true);
+    for (int j = 0; j < embed_dim; ++j) {
+      value[j] = (j % 7 - 3.0) * 0.1;
+      grads[i * embed_dim + j] = (j % 5 - 2.0) * (i + 1);
+    }
+    w[i] = value;
+    sgd[i] = value + embed_dim;
+    push_values[i] = grads.data() + i * embed_dim;
+    scales[i] = i + 1;
+  }
+
+  for (int step = 0; step < 3; ++step) {
+    if (batch) {
+      rule.UpdateValue(w.data(), sgd.data(), push_values.data(), scales.data(),
+                       num);
+      continue;
+    }
+    for (size_t i = 0; i < num; ++i) {
+      rule.UpdateValue(w[i], sgd[i], push_values[i], scales[i]);
+    }
+  }
+  return values;
+}
+
+// The batched update looks the jit kernels up once for the batch, it must
+// match the single value updates below and above the dim the kernels are
+// used from.
+template <typename Rule>
+void TestBatchUpdate(const SparseCommonSGDRuleParameter& param) {
+  for (int embed_dim : {13, FLAGS_sparse_sgd_rule_jit_min_dim + 8}) {
+    auto batch_values = RunBatchUpdate<Rule>(param, embed_dim, true);
+    auto single_values = RunBatchUpdate<Rule>(param, embed_dim, false);
+    ASSERT_EQ(batch_values.size(), single_values.size());
+    for (size_t i = 0; i < batch_values.size(); ++i) {
+      ASSERT_FLOAT_EQ(batch_values[i], single_values[i])
+          << "embed_dim is " << embed_dim << ", i is " << i;
+    }
+  }
+}
+
+TEST(sparse_sgd_rule_test, batch_update) {
+  TestBatchUpdate<SparseNaiveSGDRule>(NaiveParam());
+  TestBatchUpdate<SparseAdaGradSGDRule>(AdaGradParam());
+  TestBatchUpdate<SparseAdamSGDRule>(AdamParam());
+}
+
+// The jit kernels and the scalar loops compute the same update.
+template <typename Rule>
+void TestJitMatchesScalar(const SparseCommonSGDRuleParameter& param) {
+  const int embed_dim = 40;
+  const int jit_min_dim = FLAGS_sparse_sgd_rule_jit_min_dim;
+  FLAGS_sparse_sgd_rule_jit_min_dim = embed_dim;
+  auto jit_values = RunBatchUpdate<Rule>(param, embed_dim, true);
+  FLAGS_sparse_sgd_rule_jit_min_dim = embed_dim + 1;
+  auto scalar_values = RunBatchUpdate<Rule>(param, embed_dim, true);
+  FLAGS_sparse_sgd_rule_jit_min_dim = jit_min_dim;
+  ASSERT_EQ(jit_values.size(), scalar_values.size());
+  for (size_t i = 0; i < jit_values.size(); ++i) {
+    ASSERT_NEAR(jit_values[i], scalar_values[i],
+                1e-5 * std::max(1.0f, std::fabs(scalar_values[i])))
+        << "i is " << i;
+  }
+}
+
+TEST(sparse_sgd_rule_test, jit_matches_scalar) {
+  TestJitMatchesScalar<SparseNaiveSGDRule>(NaiveParam());
+  TestJitMatchesScalar<SparseAdaGradSGDRule>(AdaGradParam());
+  TestJitMatchesScalar<SparseAdamSGDRule>(AdamParam());
+}
+
+// The generated jit code is owned by the thread that looked it up first. A
+// rule loaded by a thread that has exited must still update on other
+// threads, as the shard task pools of a table do.
+template <typename Rule>
+void TestUpdateOnOtherThreads(const SparseCommonSGDRuleParameter& param) {
+  // large enough to be updated by the jit kernels
+  const int embed_dim = FLAGS_sparse_sgd_rule_jit_min_dim + 8;
+  const int steps = 3;
+  Rule expect_rule;
+  expect_rule.LoadConfig(param, embed_dim);
+  Rule rule;
+  std::thread load_thread([&]() { rule.LoadConfig(param, embed_dim); });
+  load_thread.join();
+
+  const int value_dim = embed_dim + rule.Dim();
+  std::vector<float> init_value(value_dim);
+  expect_rule.InitValue(init_value.data(), init_value.data() + embed_dim,
+                        true);
+  std::vector<float> grad(embed_dim);
+  for (int i = 0; i < embed_dim; ++i) {
+    grad[i] = (i % 5 - 2.0) * 0.5;
+  }
+  std::vector<float> expect = init_value;
+  for (int step = 0; step < steps; ++step) {
+    expect_rule.UpdateValue(expect.data(), expect.data() + embed_dim,
+                            grad.data());
+  }
+
+  const int num_threads = 4;
+  std::vector<std::vector<float>> values(num_threads, init_value);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < num_threads; ++t) {
+    threads.emplace_back([&, t]() {
+      float* value = values[t].data();
+      for (int step = 0; step < steps; ++step) {
+        rule.UpdateValue(value, value + embed_dim, grad.data());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (int t = 0; t < num_threads; ++t) {
+    for (int i = 0; i < value_dim; ++i) {
+      ASSERT_FLOAT_EQ(values[t][i], expect[i]) << "i is " << i;
+    }
+  }
+}
+
+TEST(sparse_sgd_rule_test, update_on_other_threads) {
+  TestUpdateOnOtherThreads<SparseNaiveSGDRule>(NaiveParam());
+  TestUpdateOnOtherThreads<SparseAdaGradSGDRule>(AdaGradParam());
+  TestUpdateOnOtherThreads<SparseAdamSGDRule>(AdamParam());
+}
 }  // namespace distributed
 }  // namespace paddle
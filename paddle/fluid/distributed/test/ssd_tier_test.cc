@@ -0,0 +1,355 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/depends/ssd_tier.h"
+#include <memory>
+#include <string>
+#include <vector>
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps.pb.h"
+#include "paddle/fluid/distributed/ps/table/ssd_sparse_table.h"
+
+DECLARE_string(rocksdb_path);
+DECLARE_int64(pserver_ssd_mem_capacity);
+DECLARE_int32(pserver_ssd_admission_min_freq);
+
+namespace paddle {
+namespace distributed {
+
+// rocksdb can not open a path twice in one process, every db gets its own
+static std::string NextRocksDBPath() {
+  static int db_num = 0;
+  return "ssd_tier_test_db_" + std::to_string(db_num++);
+}
+
+// A one shard CtrCommonAccessor table with naive sgd rules and an
+// initial_range of 0, so the values only depend on the pulls and pushes.
+static void InitTierTableConfig(TableParameter* table_config,
+                                const std::string& table_class, int emb_dim) {
+  table_config->set_table_class(table_class);
+  table_config->set_shard_num(1);
+  TableAccessorParameter* accessor_config = table_config->mutable_accessor();
+  accessor_config->set_accessor_class("CtrCommonAccessor");
+  accessor_config->set_fea_dim(emb_dim + 3);
+  accessor_config->set_embedx_dim(emb_dim);
+  accessor_config->set_embedx_threshold(1);
+  auto* ctr_param = accessor_config->mutable_ctr_accessor_param();
+  ctr_param->set_nonclk_coeff(0.2);
+  ctr_param->set_click_coeff(1);
+  ctr_param->set_base_threshold(0.5);
+  ctr_param->set_delta_threshold(0.2);
+  ctr_param->set_delta_keep_days(16);
+  ctr_param->set_show_click_decay_rate(0.99);
+  for (auto* sgd_param : {accessor_config->mutable_embed_sgd_param(),
+                          accessor_config->mutable_embedx_sgd_param()}) {
+    sgd_param->set_name("SparseNaiveSGDRule");
+    auto* naive_param = sgd_param->mutable_naive();
+    naive_param->set_learning_rate(0.1);
+    naive_param->set_initial_range(0.0);
+    naive_param->add_weight_bounds(-10.0);
+    naive_param->add_weight_bounds(10.0);
+  }
+}
+
+// a SSDSparseTable keeping at most mem_capacity values in memory, and the
+// MemorySparseTable it is checked against
+struct TierTables {
+  TierTables(int emb_dim, int64_t mem_capacity, int admission_min_freq)
+      : emb_dim(emb_dim),
+        old_path(FLAGS_rocksdb_path),
+        old_min_freq(FLAGS_pserver_ssd_admission_min_freq) {
+    FsClientParameter fs_config;
+    TableParameter ssd_config;
+    InitTierTableConfig(&ssd_config, "SSDSparseTable", emb_dim);
+    int64_t old_capacity = FLAGS_pserver_ssd_mem_capacity;
+    FLAGS_rocksdb_path = NextRocksDBPath();
+    FLAGS_pserver_ssd_mem_capacity = mem_capacity;
+    FLAGS_pserver_ssd_admission_min_freq = admission_min_freq;
+    ssd.reset(new SSDSparseTable());
+    ssd->SetShard(0, 1);
+    EXPECT_EQ(static_cast<Table*>(ssd.get())->Initialize(ssd_config, fs_config),
+              0);
+    FLAGS_pserver_ssd_mem_capacity = old_capacity;
+
+    TableParameter mem_config;
+    InitTierTableConfig(&mem_config, "MemorySparseTable", emb_dim);
+    mem.reset(new MemorySparseTable());
+    mem->SetShard(0, 1);
+    EXPECT_EQ(static_cast<Table*>(mem.get())->Initialize(mem_config, fs_config),
+              0);
+  }
+
+  ~TierTables() {
+    ssd.reset();
+    FLAGS_rocksdb_path = old_path;
+    FLAGS_pserver_ssd_admission_min_freq = old_min_freq;
+  }
+
+  std::vector<float> Pull(Table* table, const std::vector<uint64_t>& keys) {
+    std::vector<uint64_t> pull_keys(keys);
+    std::vector<uint32_t> fres(keys.size(), 1);
+    auto pull_value = PullSparseValue(pull_keys, fres, emb_dim);
+    std::vector<float> values(keys.size() * (emb_dim + 3), 0);
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.pull_context.pull_value = pull_value;
+    table_context.pull_context.values = values.data();
+    table->Pull(table_context);
+    return values;
+  }
+
+  void Push(Table* table, const std::vector<uint64_t>& keys, int round) {
+    std::vector<float> push_values;
+    for (auto key : keys) {
+      push_values.push_back(0);  // slot
+      push_values.push_back(1);  // show
+      push_values.push_back(round % 2);
+      for (int k = 0; k < emb_dim + 1; k++) {
+        push_values.push_back(0.01 * ((key + k + round) % 7) - 0.03);
+      }
+    }
+    TableContext table_context;
+    table_context.value_type = Sparse;
+    table_context.push_context.keys = keys.data();
+    table_context.push_context.values = push_values.data();
+    table_context.num = keys.size();
+    table->Push(table_context);
+  }
+
+  // pulls keys from both tables and checks they select the same values
+  void PullAndCheck(const std::vector<uint64_t>& keys) {
+    auto ssd_values = Pull(ssd.get(), keys);
+    auto mem_values = Pull(mem.get(), keys);
+    ASSERT_EQ(ssd_values.size(), mem_values.size());
+    for (size_t i = 0; i < ssd_values.size(); ++i) {
+      ASSERT_FLOAT_EQ(ssd_values[i], mem_values[i])
+          << "key " << keys[i / (emb_dim + 3)];
+    }
+  }
+
+  void PushBoth(const std::vector<uint64_t>& keys, int round) {
+    Push(ssd.get(), keys, round);
+    Push(mem.get(), keys, round);
+  }
+
+  int emb_dim;
+  // the admission flag is read on every pull and push, so it is kept until
+  // the tables are destroyed
+  std::string old_path;
+  int old_min_freq;
+  std::unique_ptr<SSDSparseTable> ssd;
+  std::unique_ptr<MemorySparseTable> mem;
+};
+
+// the keys of [0, key_num) the ssd table holds in rocksdb, found by the ssd
+// hits of pulling them one at a time
+static std::vector<uint64_t> KeysOnSsd(TierTables* tables, uint64_t key_num) {
+  std::vector<uint64_t> ssd_keys;
+  for (uint64_t key = 0; key < key_num; ++key) {
+    uint64_t ssd_hit = tables->ssd->TierStats().ssd_hit.load();
+    tables->PullAndCheck({key});
+    if (tables->ssd->TierStats().ssd_hit.load() > ssd_hit) {
+      ssd_keys.push_back(key);
+    }
+  }
+  return ssd_keys;
+}
+
+TEST(FrequencySketch, Estimate) {
+  FrequencySketch sketch(1024);
+  ASSERT_EQ(sketch.Estimate(1), 0U);
+  for (int i = 0; i < 5; ++i) {
+    sketch.Increment(1);
+  }
+  sketch.Increment(2);
+  ASSERT_GE(sketch.Estimate(1), 5U);
+  ASSERT_GE(sketch.Estimate(2), 1U);
+  ASSERT_LT(sketch.Estimate(2), sketch.Estimate(1));
+  // counters saturate at 15
+  for (int i = 0; i < 100; ++i) {
+    sketch.Increment(1);
+  }
+  ASSERT_EQ(sketch.Estimate(1), 15U);
+}
+
+TEST(FrequencySketch, Aging) {
+  FrequencySketch sketch(64);
+  for (int i = 0; i < 15; ++i) {
+    sketch.Increment(1);
+  }
+  ASSERT_EQ(sketch.Estimate(1), 15U);
+  // enough other accesses halve the old counts
+  for (uint64_t key = 100; key < 100 + 64 * 10; ++key) {
+    sketch.Increment(key);
+  }
+  ASSERT_LE(sketch.Estimate(1), 7U);
+}
+
+TEST(SsdTierStats, ToString) {
+  SsdTierStats stats;
+  stats.mem_hit += 3;
+  stats.ssd_hit += 1;
+  std::string str = stats.ToString();
+  ASSERT_NE(str.find("mem_hit:3"), std::string::npos);
+  ASSERT_NE(str.find("mem_hit_rate:0.75"), std::string::npos);
+}
+
+TEST(SsdWriteback, Drain) {
+  auto* db = RocksDBHandler::GetInstance();
+  db->initialize(NextRocksDBPath(), 2);
+  std::atomic<uint64_t> written{0};
+  SsdWriteback writeback(db, 2, 4, &written);
+  std::vector<float> value = {1.0, 2.0, 3.0};
+  uint64_t key = 7;
+  std::string str;
+
+  writeback.Put(1, key, value.data(), value.size());
+  // readers see the pending write before it is in rocksdb
+  ASSERT_EQ(writeback.Lookup(1, key, &str), 0);
+  ASSERT_EQ(str.size(), value.size() * sizeof(float));
+  ASSERT_EQ(writeback.Lookup(0, key, &str), -1);
+  writeback.Drain();
+  ASSERT_EQ(written.load(), 1U);
+  ASSERT_EQ(writeback.Lookup(1, key, &str), -1);
+  str.clear();
+  ASSERT_EQ(db->get(1, reinterpret_cast<const char*>(&key), sizeof(key), str),
+            0);
+  ASSERT_EQ(memcmp(str.data(), value.data(), str.size()), 0);
+
+  writeback.Delete(1, key);
+  ASSERT_EQ(writeback.Lookup(1, key, &str), 1);
+  writeback.Drain();
+  // deletes are not counted as written values
+  ASSERT_EQ(written.load(), 1U);
+  ASSERT_EQ(db->get(1, reinterpret_cast<const char*>(&key), sizeof(key), str),
+            1);
+
+  // more writes than the queue bound are all written
+  for (uint64_t i = 0; i < 1000; ++i) {
+    writeback.Put(i % 2, i, value.data(), value.size());
+  }
+  writeback.Drain();
+  ASSERT_EQ(written.load(), 1001U);
+  for (uint64_t i = 0; i < 1000; ++i) {
+    ASSERT_EQ(
+        db->get(i % 2, reinterpret_cast<const char*>(&i), sizeof(i), str), 0);
+  }
+}
+
+TEST(SSDSparseTable, EvictToSsd) {
+  TierTables tables(4, 8, 2);
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 20; ++key) {
+    keys.push_back(key);
+  }
+  tables.PushBoth(keys, 0);
+  // 20 values shrink to 90% of the capacity of 8
+  ASSERT_EQ(tables.ssd->LocalSize(), 7);
+  ASSERT_EQ(tables.ssd->TierStats().demotion.load(), 13U);
+  tables.ssd->Flush();
+  ASSERT_EQ(tables.ssd->TierStats().writeback.load(), 13U);
+  auto ssd_keys = KeysOnSsd(&tables, 20);
+  ASSERT_FALSE(ssd_keys.empty());
+  ASSERT_LE(tables.ssd->LocalSize(), 8);
+}
+
+TEST(SSDSparseTable, PromoteOnPull) {
+  TierTables tables(4, 8, 1);
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 20; ++key) {
+    keys.push_back(key);
+  }
+  tables.PushBoth(keys, 0);
+  tables.ssd->Flush();
+  const auto& stats = tables.ssd->TierStats();
+  uint64_t key = 0;
+  for (; key < keys.size(); ++key) {
+    uint64_t ssd_hit = stats.ssd_hit.load();
+    tables.PullAndCheck({key});
+    if (stats.ssd_hit.load() > ssd_hit) {
+      break;
+    }
+  }
+  ASSERT_LT(key, keys.size());
+  ASSERT_EQ(stats.promotion.load(), 1U);
+  // the promoted key is served from memory
+  uint64_t mem_hit = stats.mem_hit.load();
+  uint64_t ssd_hit = stats.ssd_hit.load();
+  tables.PullAndCheck({key});
+  ASSERT_EQ(stats.mem_hit.load(), mem_hit + 1);
+  ASSERT_EQ(stats.ssd_hit.load(), ssd_hit);
+  // and its stale copy is deleted from rocksdb
+  tables.ssd->Flush();
+  std::string str;
+  ASSERT_EQ(RocksDBHandler::GetInstance()->get(
+                0, reinterpret_cast<const char*>(&key), sizeof(key), str),
+            1);
+}
+
+TEST(SSDSparseTable, ColdPushWriteback) {
+  // counters saturate at 15, so a full shard admits nothing
+  TierTables tables(4, 8, 16);
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 20; ++key) {
+    keys.push_back(key);
+  }
+  tables.PushBoth(keys, 0);
+  tables.ssd->Flush();
+  // fill the free slot so that the shard is full
+  auto ssd_keys = KeysOnSsd(&tables, 20);
+  ASSERT_EQ(tables.ssd->LocalSize(), 8);
+  ssd_keys = KeysOnSsd(&tables, 20);
+  ASSERT_EQ(ssd_keys.size(), 12U);
+
+  const auto& stats = tables.ssd->TierStats();
+  uint64_t promotion = stats.promotion.load();
+  uint64_t writeback = stats.writeback.load();
+  for (int round = 1; round < 4; ++round) {
+    tables.PushBoth(ssd_keys, round);
+  }
+  tables.ssd->Flush();
+  // the cold values are updated in rocksdb and stay out of memory
+  ASSERT_EQ(stats.promotion.load(), promotion);
+  ASSERT_EQ(tables.ssd->LocalSize(), 8);
+  ASSERT_GE(stats.writeback.load(), writeback + ssd_keys.size());
+  tables.PullAndCheck(keys);
+  ASSERT_EQ(KeysOnSsd(&tables, 20), ssd_keys);
+}
+
+TEST(SSDSparseTable, MatchesMemoryTable) {
+  for (int min_freq : {1, 2, 16}) {
+    TierTables tables(4, 16, min_freq);
+    std::vector<uint64_t> keys;
+    for (uint64_t key = 0; key < 200; ++key) {
+      keys.push_back(key * 7919);
+    }
+    for (int round = 0; round < 6; ++round) {
+      // a hot head pulled and pushed every round and a rotating tail
+      std::vector<uint64_t> batch(keys.begin(), keys.begin() + 8);
+      for (size_t i = 8 + round; i < keys.size(); i += 5) {
+        batch.push_back(keys[i]);
+      }
+      tables.PullAndCheck(batch);
+      tables.PushBoth(batch, round);
+      ASSERT_LE(tables.ssd->LocalSize(), 16);
+    }
+    tables.PullAndCheck(keys);
+    tables.ssd->Flush();
+    ASSERT_GT(tables.ssd->TierStats().ssd_hit.load(), 0U);
+    ASSERT_GT(tables.ssd->TierStats().writeback.load(), 0U);
+  }
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -0,0 +1,183 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/distributed/ps/table/depends/swiss_hash_map.h"
+#include <chrono>  // NOLINT
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+#include "paddle/fluid/distributed/ps/table/depends/feature_value.h"
+
+DEFINE_int64(shard_index_benchmark_key_num, 1000000,
+             "number of keys in the sparse shard index benchmark, "
+             "set it to 10M-1B for a realistic table");
+
+namespace paddle {
+namespace distributed {
+
+TEST(SwissHashMap, InsertFindErase) {
+  SwissHashMap<uint64_t, int> map;
+  std::unordered_map<uint64_t, int> expect;
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 100000; ++i) {
+    uint64_t key = rng() % 50000;
+    if (rng() % 4 == 0) {
+      ASSERT_EQ(map.erase(key), expect.erase(key));
+    } else {
+      auto res = map.insert({key, i});
+      auto expect_res = expect.insert({key, i});
+      ASSERT_EQ(res.second, expect_res.second);
+      ASSERT_EQ(res.first->second, expect_res.first->second);
+    }
+  }
+  ASSERT_EQ(map.size(), expect.size());
+  for (uint64_t key = 0; key < 50000; ++key) {
+    auto it = map.find(key);
+    auto expect_it = expect.find(key);
+    ASSERT_EQ(it == map.end(), expect_it == expect.end());
+    if (it != map.end()) {
+      ASSERT_EQ(it->second, expect_it->second);
+    }
+  }
+  size_t iterated = 0;
+  for (auto it = map.begin(); it != map.end();) {
+    ASSERT_EQ(expect.count(it->first), 1UL);
+    ++iterated;
+    it = it->first % 2 == 0 ? map.erase(it) : ++it;
+  }
+  ASSERT_EQ(iterated, expect.size());
+  for (auto it = map.begin(); it != map.end(); ++it) {
+    ASSERT_EQ(it->first % 2, 1UL);
+  }
+  map.clear();
+  ASSERT_TRUE(map.empty());
+  ASSERT_TRUE(map.begin() == map.end());
+}
+
+TEST(SwissHashMap, StringKey) {
+  SwissHashMap<std::string, int> map;
+  for (int i = 0; i < 1000; ++i) {
+    map.insert({std::to_string(i), i});
+  }
+  ASSERT_EQ(map.size(), 1000UL);
+  ASSERT_EQ(map.find("123")->second, 123);
+  ASSERT_EQ(map.erase("123"), 1UL);
+  ASSERT_TRUE(map.find("123") == map.end());
+}
+
+TEST(SparseTableShard, SwissIndex) {
+  typedef SwissSparseTableShard<uint64_t, FixedFeatureValue> shard_type;
+  static_assert(shard_type::kSupportsPrefetch, "swiss shards prefetch");
+  static_assert(
+      !SparseTableShard<uint64_t, FixedFeatureValue>::kSupportsPrefetch,
+      "closed hash shards do not prefetch");
+  shard_type shard;
+  for (uint64_t key = 0; key < 10000; ++key) {
+    auto& value = shard[key * 7919];
+    value.resize(1);
+    value.data()[0] = key;
+  }
+  ASSERT_EQ(shard.size(), 10000UL);
+  for (uint64_t key = 0; key < 10000; ++key) {
+    shard.prefetch(key * 7919);
+    auto it = shard.find(key * 7919);
+    ASSERT_TRUE(it != shard.end());
+    ASSERT_FLOAT_EQ(it.value().data()[0], key);
+  }
+  ASSERT_TRUE(shard.find(1) == shard.end());
+  size_t iterated = 0;
+  for (auto it = shard.begin(); it != shard.end();) {
+    ++iterated;
+    it = it.value().data()[0] < 5000 ? shard.erase(it) : ++it;
+  }
+  ASSERT_EQ(iterated, 10000UL);
+  ASSERT_EQ(shard.size(), 5000UL);
+}
+
+// runs insert, batched prefetching lookup, iterate and shrink on a shard of
+// type SHARD
+template <class SHARD>
+static void BenchmarkShardIndex(const std::string& name) {
+  const size_t key_num = FLAGS_shard_index_benchmark_key_num;
+  const size_t batch_size = 1024;
+  const size_t prefetch_distance = 8;
+  std::mt19937_64 rng(0);
+  std::vector<uint64_t> keys(key_num);
+  for (auto& key : keys) {
+    key = rng();
+  }
+  std::vector<uint64_t> lookups(key_num);
+  for (auto& key : lookups) {
+    key = keys[rng() % key_num];
+  }
+
+  auto elapsed_ms = [](std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(
+               std::chrono::steady_clock::now() - start)
+        .count();
+  };
+  SHARD shard;
+  auto start = std::chrono::steady_clock::now();
+  for (auto key : keys) {
+    shard[key].resize(1);
+  }
+  double insert_ms = elapsed_ms(start);
+
+  start = std::chrono::steady_clock::now();
+  size_t found = 0;
+  for (size_t begin = 0; begin < key_num; begin += batch_size) {
+    size_t end = std::min(begin + batch_size, key_num);
+    for (size_t i = begin; i < end; ++i) {
+      if (i + prefetch_distance < end) {
+        shard.prefetch(lookups[i + prefetch_distance]);
+      }
+      found += shard.find(lookups[i]) != shard.end();
+    }
+  }
+  double lookup_ms = elapsed_ms(start);
+  CHECK_EQ(found, key_num);
+
+  start = std::chrono::steady_clock::now();
+  size_t iterated = 0;
+  for (auto it = shard.begin(); it != shard.end(); ++it) {
+    iterated += it.value().size();
+  }
+  double iterate_ms = elapsed_ms(start);
+
+  start = std::chrono::steady_clock::now();
+  for (auto it = shard.begin(); it != shard.end();) {
+    it = it.key() % 2 == 0 ? shard.erase(it) : ++it;
+  }
+  double shrink_ms = elapsed_ms(start);
+
+  LOG(INFO) << name << " with " << key_num << " keys, M ops/s:"
+            << " insert " << key_num / insert_ms / 1000.0 << " lookup "
+            << key_num / lookup_ms / 1000.0 << " iterate "
+            << iterated / iterate_ms / 1000.0 << " shrink "
+            << key_num / shrink_ms / 1000.0;
+}
+
+TEST(BENCHMARK, SparseTableShardIndex) {
+  BenchmarkShardIndex<SparseTableShard<uint64_t, FixedFeatureValue>>(
+      "closed hash index");
+  BenchmarkShardIndex<SwissSparseTableShard<uint64_t, FixedFeatureValue>>(
+      "swiss hash index");
+}
+
+}  // namespace distributed
+}  // namespace paddle
@@ -20,16 +20,21 @@ limitations under the License. */
 #include "paddle/fluid/framework/data_feed.h"
 #include "paddle/fluid/framework/fleet/ps_gpu_wrapper.h"
 #ifdef _LINUX
+#include <fcntl.h>
 #include <stdio_ext.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
 #endif
 #include "io/fs.h"
+#include "paddle/fluid/framework/data_feed_columnar.h"
+#include "paddle/fluid/framework/data_feed_number_parser.h"
 #include "paddle/fluid/platform/monitor.h"
 #include "paddle/fluid/platform/timer.h"
 
 USE_INT_STAT(STAT_total_feasign_num_in_mem);
 DECLARE_bool(enable_ins_parser_file);
+DECLARE_bool(enable_fast_multislot_parser);
 namespace paddle {
 namespace framework {
 
@@ -52,6 +57,9 @@ class BufferedLineFileReader {
 
  public:
   typedef std::function<bool(const std::string&)> LineFunc;
+  // called with a line and its length, str[len] is '\0'. The line points
+  // into the read buffer and is only valid during the call
+  typedef std::function<bool(const char* str, size_t len)> SpanFunc;
 
  private:
   template <typename T>
@@ -99,6 +107,52 @@ class BufferedLineFileReader {
     return lines;
   }
 
+  // same as read_lines without copying every line into a string, only a
+  // line split by two reads is joined
+  template <typename T>
+  int read_line_spans(T* reader, SpanFunc func, int skip_lines) {
+    int lines = 0;
+    size_t ret = 0;
+    total_len_ = 0;
+    error_line_ = 0;
+
+    SampleFunc spfunc = get_sample_func();
+    auto line_func = [&](const char* str, size_t len) {
+      ++lines;
+      if (lines > skip_lines && spfunc()) {
+        if (!func(str, len)) {
+          ++error_line_;
+        }
+      }
+    };
+    std::string x;
+    while (!is_error() && (ret = reader->read(buff_, MAX_FILE_BUFF_SIZE)) > 0) {
+      total_len_ += ret;
+      char* ptr = buff_;
+      char* end = buff_ + ret;
+      char* eol = reinterpret_cast<char*>(memchr(ptr, '\n', ret));
+      while (eol != NULL) {
+        *eol = '\0';
+        if (x.empty()) {
+          line_func(ptr, eol - ptr);
+        } else {
+          x.append(ptr, eol - ptr);
+          line_func(x.c_str(), x.size());
+          x.clear();
+        }
+        ptr = eol + 1;
+        eol = reinterpret_cast<char*>(memchr(ptr, '\n', end - ptr));
+      }
+      if (ptr < end) {
+        x.append(ptr, end - ptr);
+      }
+    }
+    if (!is_error() && !x.empty()) {
+      line_func(x.c_str(), x.size());
+    }
+    return lines;
+  }
+
  public:
   BufferedLineFileReader()
       : random_engine_(std::random_device()()),
@@ -114,6 +168,10 @@ class BufferedLineFileReader {
     FILEReader reader(fp);
     return read_lines<FILEReader>(&reader, func, skip_lines);
   }
+  int read_file_spans(FILE* fp, SpanFunc func, int skip_lines) {
+    FILEReader reader(fp);
+    return read_line_spans<FILEReader>(&reader, func, skip_lines);
+  }
   uint64_t file_size(void) { return total_len_; }
   void set_sample_rate(float r) { sample_rate_ = r; }
   size_t get_sample_line() { return sample_line_; }
@@ -709,8 +767,10 @@ bool MultiSlotDataFeed::CheckFile(const char* filename) {
     const char* str = line.c_str();
     char* endptr = const_cast<char*>(str);
     int len = line.length();
+    MultiSlotNumberParser parser(FLAGS_enable_fast_multislot_parser,
+                                 str + len);
     for (size_t i = 0; i < all_slots_.size(); ++i) {
-      auto num = strtol(endptr, &endptr, 10);
+      auto num = parser.ParseInt(endptr, &endptr);
       if (num < 0) {
         VLOG(0) << "error: the number of ids is a negative number: " << num;
         VLOG(0) << "please check line<" << instance_cout << "> in file<"
@@ -739,7 +799,7 @@ bool MultiSlotDataFeed::CheckFile(const char* filename) {
       }
       if (all_slots_type_[i] == "float") {
         for (int j = 0; j < num; ++j) {
-          strtof(endptr, &endptr);
+          parser.ParseFloat(endptr, &endptr);
           if (errno == ERANGE) {
             VLOG(0) << "error: the value is out of the range of "
                        "representable values for float";
@@ -766,7 +826,7 @@ bool MultiSlotDataFeed::CheckFile(const char* filename) {
         }
       } else if (all_slots_type_[i] == "uint64") {
         for (int j = 0; j < num; ++j) {
-          strtoull(endptr, &endptr, 10);
+          parser.ParseUint64(endptr, &endptr);
           if (errno == ERANGE) {
             VLOG(0) << "error: the value is out of the range of "
                        "representable values for uint64_t";
@@ -836,10 +896,12 @@ bool MultiSlotDataFeed::ParseOneInstanceFromPipe(
     std::string line = std::string(str);
 
     char* endptr = const_cast<char*>(str);
+    MultiSlotNumberParser parser(FLAGS_enable_fast_multislot_parser,
+                                 str + reader.length());
     int pos = 0;
     for (size_t i = 0; i < use_slots_index_.size(); ++i) {
       int idx = use_slots_index_[i];
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
 
       if (num <= 0) {
         std::stringstream ss;
@@ -866,12 +928,12 @@ bool MultiSlotDataFeed::ParseOneInstanceFromPipe(
         (*instance)[idx].Init(all_slots_type_[i]);
         if ((*instance)[idx].GetType()[0] == 'f') {  // float
           for (int j = 0; j < num; ++j) {
-            float feasign = strtof(endptr, &endptr);
+            float feasign = parser.ParseFloat(endptr, &endptr);
             (*instance)[idx].AddValue(feasign);
           }
         } else if ((*instance)[idx].GetType()[0] == 'u') {  // uint64
           for (int j = 0; j < num; ++j) {
-            uint64_t feasign = (uint64_t)strtoull(endptr, &endptr, 10);
+            uint64_t feasign = parser.ParseUint64(endptr, &endptr);
             (*instance)[idx].AddValue(feasign);
           }
         }
@@ -901,10 +963,12 @@ bool MultiSlotDataFeed::ParseOneInstance(std::vector<MultiSlotType>* instance) {
     // parse line
     const char* str = line.c_str();
     char* endptr = const_cast<char*>(str);
+    MultiSlotNumberParser parser(FLAGS_enable_fast_multislot_parser,
+                                 str + line.size());
     int pos = 0;
     for (size_t i = 0; i < use_slots_index_.size(); ++i) {
       int idx = use_slots_index_[i];
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
       PADDLE_ENFORCE_NE(
           num, 0,
           platform::errors::InvalidArgument(
@@ -923,12 +987,12 @@ bool MultiSlotDataFeed::ParseOneInstance(std::vector<MultiSlotType>* instance) {
         (*instance)[idx].Init(all_slots_type_[i]);
         if ((*instance)[idx].GetType()[0] == 'f') {  // float
           for (int j = 0; j < num; ++j) {
-            float feasign = strtof(endptr, &endptr);
+            float feasign = parser.ParseFloat(endptr, &endptr);
             (*instance)[idx].AddValue(feasign);
           }
         } else if ((*instance)[idx].GetType()[0] == 'u') {  // uint64
           for (int j = 0; j < num; ++j) {
-            uint64_t feasign = (uint64_t)strtoull(endptr, &endptr, 10);
+            uint64_t feasign = parser.ParseUint64(endptr, &endptr);
             (*instance)[idx].AddValue(feasign);
           }
         }
@@ -1112,9 +1176,11 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
     std::string line = std::string(str);
     // VLOG(3) << line;
     char* endptr = const_cast<char*>(str);
+    MultiSlotNumberParser parser(FLAGS_enable_fast_multislot_parser,
+                                 str + reader.length());
     int pos = 0;
     if (parse_ins_id_) {
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
       CHECK(num == 1);  // NOLINT
       pos = endptr - str + 1;
       size_t len = 0;
@@ -1126,7 +1192,7 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
       VLOG(3) << "ins_id " << instance->ins_id_;
     }
     if (parse_content_) {
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
       CHECK(num == 1);  // NOLINT
       pos = endptr - str + 1;
       size_t len = 0;
@@ -1138,7 +1204,7 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
       VLOG(3) << "content " << instance->content_;
     }
     if (parse_logkey_) {
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
       CHECK(num == 1);  // NOLINT
       pos = endptr - str + 1;
       size_t len = 0;
@@ -1160,7 +1226,7 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
     }
     for (size_t i = 0; i < use_slots_index_.size(); ++i) {
       int idx = use_slots_index_[i];
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
       PADDLE_ENFORCE_NE(
           num, 0,
           platform::errors::InvalidArgument(
@@ -1183,14 +1249,14 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
                            str));
 
         char* uidptr = endptr;
-        uint64_t feasign = (uint64_t)strtoull(uidptr, &uidptr, 10);
+        uint64_t feasign = parser.ParseUint64(uidptr, &uidptr);
         instance->uid_ = feasign;
       }
 #endif
       if (idx != -1) {
         if (all_slots_type_[i][0] == 'f') {  // float
           for (int j = 0; j < num; ++j) {
-            float feasign = strtof(endptr, &endptr);
+            float feasign = parser.ParseFloat(endptr, &endptr);
             // if float feasign is equal to zero, ignore it
             // except when slot is dense
             if (fabs(feasign) < 1e-6 && !use_slots_is_dense_[i]) {
@@ -1202,7 +1268,7 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstanceFromPipe(Record* instance) {
           }
         } else if (all_slots_type_[i][0] == 'u') {  // uint64
           for (int j = 0; j < num; ++j) {
-            uint64_t feasign = (uint64_t)strtoull(endptr, &endptr, 10);
+            uint64_t feasign = parser.ParseUint64(endptr, &endptr);
             // if uint64 feasign is equal to zero, ignore it
             // except when slot is dense
             if (feasign == 0 && !use_slots_is_dense_[i]) {
@@ -1241,10 +1307,12 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
     // parse line
     const char* str = line.c_str();
     char* endptr = const_cast<char*>(str);
+    MultiSlotNumberParser parser(FLAGS_enable_fast_multislot_parser,
+                                 str + line.size());
     int pos = 0;
     for (size_t i = 0; i < use_slots_index_.size(); ++i) {
       int idx = use_slots_index_[i];
-      int num = strtol(&str[pos], &endptr, 10);
+      int num = parser.ParseInt(&str[pos], &endptr);
       PADDLE_ENFORCE_NE(
           num, 0,
           platform::errors::InvalidArgument(
@@ -1262,7 +1330,7 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
       if (idx != -1) {
         if (all_slots_type_[i][0] == 'f') {  // float
           for (int j = 0; j < num; ++j) {
-            float feasign = strtof(endptr, &endptr);
+            float feasign = parser.ParseFloat(endptr, &endptr);
             if (fabs(feasign) < 1e-6) {
               continue;
             }
@@ -1272,7 +1340,7 @@ bool MultiSlotInMemoryDataFeed::ParseOneInstance(Record* instance) {
           }
         } else if (all_slots_type_[i][0] == 'u') {  // uint64
           for (int j = 0; j < num; ++j) {
-            uint64_t feasign = (uint64_t)strtoull(endptr, &endptr, 10);
+            uint64_t feasign = parser.ParseUint64(endptr, &endptr);
             if (feasign == 0) {
               continue;
             }
@@ -2254,6 +2322,10 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByCommand(void) {
   while (this->PickOneFile(&filename)) {
     VLOG(3) << "PickOneFile, filename=" << filename
             << ", thread_id=" << thread_id_;
+    if (IsSlotColumnarFile(filename)) {
+      LoadColumnarFile(filename);
+      continue;
+    }
     int lines = 0;
     std::vector<SlotRecord> record_vec;
     platform::Timer timeline;
@@ -2267,14 +2339,15 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByCommand(void) {
       CHECK(this->fp_ != nullptr);
       __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
 
-      lines = line_reader.read_file(
+      lines = line_reader.read_file_spans(
           this->fp_.get(),
-          [this, &record_vec, &offset, &filename](const std::string& line) {
-            if (ParseOneInstance(line, &record_vec[offset])) {
+          [this, &record_vec, &offset, &filename](const char* str,
+                                                  size_t len) {
+            if (ParseOneInstance(str, len, &record_vec[offset])) {
               ++offset;
             } else {
               LOG(WARNING) << "read file:[" << filename
-                           << "] item error, line:[" << line << "]";
+                           << "] item error, line:[" << str << "]";
               return false;
             }
             if (offset >= OBJPOOL_BLOCK_SIZE) {
@@ -2310,6 +2383,228 @@ void SlotRecordInMemoryDataFeed::LoadIntoMemoryByCommand(void) {
 #endif
 }
 
+std::vector<std::string> SlotRecordInMemoryDataFeed::ColumnarSlotDesc()
+    const {
+  std::vector<std::string> uint64_desc;
+  std::vector<std::string> float_desc;
+  for (auto& info : used_slots_info_) {
+    auto& desc = info.type[0] == 'u' ? uint64_desc : float_desc;
+    desc.push_back(info.slot + " " + info.type);
+  }
+  uint64_desc.insert(uint64_desc.end(), float_desc.begin(), float_desc.end());
+  return uint64_desc;
+}
+
+#ifdef _LINUX
+// read only mmap of a local columnar file, unmapped when it goes out of
+// scope, also when loading it fails
+class SlotColumnarMmap {
+ public:
+  SlotColumnarMmap() {}
+  SlotColumnarMmap(const SlotColumnarMmap&) = delete;
+  SlotColumnarMmap& operator=(const SlotColumnarMmap&) = delete;
+  ~SlotColumnarMmap() {
+    if (data_ != NULL) {
+      munmap(data_, size_);
+    }
+  }
+
+  void Open(const std::string& filename) {
+    int fd = open(filename.c_str(), O_RDONLY);
+    PADDLE_ENFORCE_GE(fd, 0, platform::errors::Unavailable(
+                                 "Cannot open columnar file %s.", filename));
+    struct stat st;
+    int ret = fstat(fd, &st);
+    void* addr = MAP_FAILED;
+    if (ret == 0 && st.st_size > 0) {
+      addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    PADDLE_ENFORCE_EQ(ret, 0, platform::errors::Unavailable(
+                                  "Cannot stat columnar file %s.", filename));
+    if (st.st_size == 0) {
+      return;
+    }
+    PADDLE_ENFORCE_NE(addr, MAP_FAILED,
+                      platform::errors::Unavailable(
+                          "Cannot mmap columnar file %s.", filename));
+    data_ = static_cast<char*>(addr);
+    size_ = st.st_size;
+    madvise(data_, size_, MADV_SEQUENTIAL);
+  }
+
+  const char* data() const { return data_; }
+  size_t size() const { return size_; }
+
+ private:
+  char* data_ = NULL;
+  size_t size_ = 0;
+};
+#endif
+
+int SlotRecordInMemoryDataFeed::LoadColumnarFile(const std::string& filename) {
+  int record_num = 0;
+#ifdef _LINUX
+  platform::Timer timeline;
+  timeline.Start();
+  int err_no = 0;
+  std::vector<std::string> slot_desc;
+  {
+    auto fp = fs_open_read(SlotColumnarManifestPath(filename), &err_no, "");
+    PADDLE_ENFORCE_EQ(err_no, 0,
+                      platform::errors::Unavailable(
+                          "Cannot open the manifest of columnar file %s.",
+                          filename));
+    string::LineFileReader reader;
+    uint32_t version = 0;
+    while (reader.getline(fp.get())) {
+      std::string line(reader.get(), reader.length());
+      if (line.compare(0, 14, "slot_columnar ") == 0) {
+        version = std::stoul(line.substr(14));
+      } else if (line.compare(0, 5, "slot ") == 0) {
+        slot_desc.push_back(line.substr(5));
+      }
+    }
+    PADDLE_ENFORCE_EQ(version, kSlotColumnarVersion,
+                      platform::errors::InvalidArgument(
+                          "Columnar file %s has version %d, expected %d.",
+                          filename, version, kSlotColumnarVersion));
+  }
+  PADDLE_ENFORCE_EQ(
+      slot_desc == ColumnarSlotDesc(), true,
+      platform::errors::PreconditionNotMet(
+          "The slots of columnar file %s do not match the used slots of the "
+          "data feed, dump it again with the current slots.",
+          filename));
+
+  SlotColumnarReader reader(uint64_use_slot_size_, float_use_slot_size_);
+  std::string buffer;
+  std::vector<SlotRecord> records;
+  auto load_block = [&](const SlotColumnarBlockHeader& header,
+                        const char* stored) {
+    SlotRecordPool().get(&records, header.record_num);
+    PADDLE_ENFORCE_EQ(
+        reader.ReadBlock(header, stored, &buffer, records.data()), 0,
+        platform::errors::InvalidArgument("Columnar file %s is corrupted.",
+                                          filename));
+    record_num += header.record_num;
+    input_channel_->Write(std::move(records));
+    records.clear();
+  };
+  auto corrupted = platform::errors::InvalidArgument(
+      "Columnar file %s is truncated or corrupted.", filename);
+
+  if (fs_select_internal(filename) == 0) {
+    // local files are mapped and uncompressed blocks are read in place
+    SlotColumnarMmap mapped;
+    mapped.Open(filename);
+    const char* data = mapped.data();
+    size_t size = mapped.size();
+    size_t offset = 0;
+    while (offset < size) {
+      SlotColumnarBlockHeader header;
+      PADDLE_ENFORCE_LE(offset + sizeof(header), size, corrupted);
+      memcpy(&header, data + offset, sizeof(header));
+      offset += sizeof(header);
+      PADDLE_ENFORCE_EQ(SlotColumnarReader::CheckHeader(header) &&
+                            header.stored_bytes <= size - offset,
+                        true, corrupted);
+      load_block(header, data + offset);
+      offset += header.stored_bytes;
+    }
+  } else {
+    auto fp = fs_open_read(filename, &err_no, "");
+    PADDLE_ENFORCE_EQ(err_no, 0, platform::errors::Unavailable(
+                                     "Cannot open columnar file %s.",
+                                     filename));
+    SlotColumnarBlockHeader header;
+    std::string stored;
+    while (fread(&header, sizeof(header), 1, fp.get()) == 1) {
+      PADDLE_ENFORCE_EQ(SlotColumnarReader::CheckHeader(header), true,
+                        corrupted);
+      stored.resize(header.stored_bytes);
+      PADDLE_ENFORCE_EQ(
+          fread(&stored[0], 1, stored.size(), fp.get()), stored.size(),
+          corrupted);
+      load_block(header, stored.data());
+    }
+  }
+  timeline.Pause();
+  VLOG(3) << "LoadColumnarFile() file=" << filename
+          << ", records=" << record_num
+          << ", cost time=" << timeline.ElapsedSec()
+          << " seconds, thread_id=" << thread_id_;
+#endif
+  return record_num;
+}
+
+void SlotRecordInMemoryDataFeed::DumpColumnar(const std::string& output_dir) {
+#ifdef _LINUX
+  fs_mkdir(output_dir);
+  std::vector<std::string> slot_desc = ColumnarSlotDesc();
+  BufferedLineFileReader line_reader;
+  SlotRecord rec = make_slotrecord();
+  std::string filename;
+  while (this->PickOneFile(&filename)) {
+    platform::Timer timeline;
+    timeline.Start();
+    std::string path = output_dir + "/" + SlotColumnarFileName(filename);
+    int err_no = 0;
+    auto out = fs_open_write(path, &err_no, "");
+    PADDLE_ENFORCE_EQ(err_no, 0, platform::errors::Unavailable(
+                                     "Cannot open columnar file %s.", path));
+    SlotColumnarWriter writer(
+        [&out](const char* data, size_t size) {
+          return fwrite(data, 1, size, out.get());
+        },
+        uint64_use_slot_size_, float_use_slot_size_, true);
+
+    this->fp_ = fs_open_read(filename, &err_no, this->pipe_command_);
+    CHECK(this->fp_ != nullptr);
+    __fsetlocking(&*(this->fp_), FSETLOCKING_BYCALLER);
+    // the lines are not retried on errors as the loader does, that would
+    // write them twice
+    int lines = line_reader.read_file_spans(
+        this->fp_.get(),
+        [this, &rec, &writer, &filename, &path](const char* str,
+                                                size_t len) {
+          rec->reset();
+          if (!ParseOneInstance(str, len, &rec)) {
+            LOG(WARNING) << "read file:[" << filename
+                         << "] item error, line:[" << str << "]";
+            return false;
+          }
+          PADDLE_ENFORCE_EQ(writer.Append(*rec), 0,
+                            platform::errors::Unavailable(
+                                "Failed to write columnar file %s.", path));
+          return true;
+        },
+        0);
+    PADDLE_ENFORCE_EQ(line_reader.is_error(), false,
+                      platform::errors::InvalidArgument(
+                          "Too many error lines in file %s.", filename));
+    PADDLE_ENFORCE_EQ(writer.Close(), 0,
+                      platform::errors::Unavailable(
+                          "Failed to write columnar file %s.", path));
+    out.reset();
+
+    std::string manifest = writer.Manifest(slot_desc);
+    auto manifest_fp =
+        fs_open_write(SlotColumnarManifestPath(path), &err_no, "");
+    PADDLE_ENFORCE_EQ(
+        err_no == 0 && fwrite(manifest.data(), 1, manifest.size(),
+                              manifest_fp.get()) == manifest.size(),
+        true, platform::errors::Unavailable(
+                  "Failed to write the manifest of columnar file %s.", path));
+    timeline.Pause();
+    VLOG(3) << "DumpColumnar() file=" << filename << " to " << path
+            << ", lines=" << lines << ", records=" << writer.record_num()
+            << ", cost time=" << timeline.ElapsedSec() << " seconds";
+  }
+  free_slotrecord(rec);
+#endif
+}
+
 static void parser_log_key(const std::string& log_key, uint64_t* search_id,
                            uint32_t* cmatch, uint32_t* rank) {
   std::string searchid_str = log_key.substr(16, 16);
@@ -2320,19 +2615,43 @@ static void parser_log_key(const std::string& log_key, uint64_t* search_id,
   *rank = static_cast<uint32_t>(strtoul(rank_str.c_str(), NULL, 16));
 }
 
+// unsigned decimal without the base and locale handling of strtoull. A
+// sign, or more digits than surely fit in uint64_t, goes to strtoull, so
+// the result is always the one strtoull gives
+static inline uint64_t parse_uint64(const char* str, char** endptr) {
+  const char* begin = str;
+  while (*str == ' ' || *str == '\t') {
+    ++str;
+  }
+  const char* digits = str;
+  uint64_t value = 0;
+  while (static_cast<unsigned>(*str - '0') < 10U) {
+    value = value * 10 + (*str - '0');
+    ++str;
+  }
+  if (str - digits > 19 || *digits == '+' || *digits == '-') {
+    return strtoull(begin, endptr, 10);
+  }
+  *endptr = const_cast<char*>(str);
+  return value;
+}
+
 bool SlotRecordInMemoryDataFeed::ParseOneInstance(const std::string& line,
                                                   SlotRecord* ins) {
+  return ParseOneInstance(line.c_str(), line.size(), ins);
+}
+
+bool SlotRecordInMemoryDataFeed::ParseOneInstance(const char* str,
+                                                  size_t line_len,
+                                                  SlotRecord* ins) {
+  if (line_len == 0) {
+    return false;
+  }
   SlotRecord& rec = (*ins);
   // parse line
-  const char* str = line.c_str();
   char* endptr = const_cast<char*>(str);
   int pos = 0;
 
-  thread_local std::vector<std::vector<float>> slot_float_feasigns;
-  thread_local std::vector<std::vector<uint64_t>> slot_uint64_feasigns;
-  slot_float_feasigns.resize(float_use_slot_size_);
-  slot_uint64_feasigns.resize(uint64_use_slot_size_);
-
   if (parse_ins_id_) {
     int num = strtol(&str[pos], &endptr, 10);
     CHECK(num == 1);  // NOLINT
@@ -2341,7 +2660,7 @@ bool SlotRecordInMemoryDataFeed::ParseOneInstance(const std::string& line,
     while (str[pos + len] != ' ') {
       ++len;
     }
-    rec->ins_id_ = std::string(str + pos, len);
+    rec->ins_id_.assign(str + pos, len);
     pos += len + 1;
   }
   if (parse_logkey_) {
@@ -2366,8 +2685,15 @@ bool SlotRecordInMemoryDataFeed::ParseOneInstance(const std::string& line,
     pos += len + 1;
   }
 
-  int float_total_slot_num = 0;
-  int uint64_total_slot_num = 0;
+  // feasigns are appended to the record in place, slots come in the order of
+  // slot_value_idx. A record taken back from SlotRecordPool keeps the
+  // capacity of its vectors, so no memory is allocated per record
+  auto& float_feasigns = rec->slot_float_feasigns_;
+  auto& uint64_feasigns = rec->slot_uint64_feasigns_;
+  float_feasigns.slot_values.clear();
+  uint64_feasigns.slot_values.clear();
+  float_feasigns.slot_offsets.resize(float_use_slot_size_ + 1);
+  uint64_feasigns.slot_offsets.resize(uint64_use_slot_size_ + 1);
 
   for (size_t i = 0; i < all_slots_info_.size(); ++i) {
     auto& info = all_slots_info_[i];
@@ -2380,42 +2706,40 @@ bool SlotRecordInMemoryDataFeed::ParseOneInstance(const std::string& line,
                    str);
     if (info.used_idx != -1) {
       if (info.type[0] == 'f') {  // float
-        auto& slot_fea = slot_float_feasigns[info.slot_value_idx];
-        slot_fea.clear();
+        auto& slot_values = float_feasigns.slot_values;
+        float_feasigns.slot_offsets[info.slot_value_idx] = slot_values.size();
         for (int j = 0; j < num; ++j) {
           float feasign = strtof(endptr, &endptr);
           if (fabs(feasign) < 1e-6 && !used_slots_info_[info.used_idx].dense) {
             continue;
           }
-          slot_fea.push_back(feasign);
-          ++float_total_slot_num;
+          slot_values.push_back(feasign);
         }
       } else if (info.type[0] == 'u') {  // uint64
-        auto& slot_fea = slot_uint64_feasigns[info.slot_value_idx];
-        slot_fea.clear();
+        auto& slot_values = uint64_feasigns.slot_values;
+        uint64_feasigns.slot_offsets[info.slot_value_idx] = slot_values.size();
         for (int j = 0; j < num; ++j) {
-          uint64_t feasign =
-              static_cast<uint64_t>(strtoull(endptr, &endptr, 10));
-          slot_fea.push_back(feasign);
-          ++uint64_total_slot_num;
+          slot_values.push_back(parse_uint64(endptr, &endptr));
         }
       }
-      pos = endptr - str;
     } else {
-      for (int j = 0; j <= num; ++j) {
-        // pos = line.find_first_of(' ', pos + 1);
-        while (line[pos + 1] != ' ') {
-          pos++;
+      for (int j = 0; j < num; ++j) {
+        while (*endptr == ' ') {
+          ++endptr;
+        }
+        while (*endptr != ' ' && *endptr != '\0') {
+          ++endptr;
         }
       }
     }
+    pos = endptr - str;
   }
-  rec->slot_float_feasigns_.add_slot_feasigns(slot_float_feasigns,
-                                              float_total_slot_num);
-  rec->slot_uint64_feasigns_.add_slot_feasigns(slot_uint64_feasigns,
-                                               uint64_total_slot_num);
+  float_feasigns.slot_offsets[float_use_slot_size_] =
+      float_feasigns.slot_values.size();
+  uint64_feasigns.slot_offsets[uint64_use_slot_size_] =
+      uint64_feasigns.slot_values.size();
 
-  return (uint64_total_slot_num > 0);
+  return !uint64_feasigns.slot_values.empty();
 }
 
 void SlotRecordInMemoryDataFeed::AssignFeedVar(const Scope& scope) {
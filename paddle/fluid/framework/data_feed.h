@@ -853,6 +853,12 @@ class DataFeed {
     PADDLE_THROW(platform::errors::Unimplemented(
         "This function(LoadIntoMemory) is not implemented."));
   }
+  // converts the files of the filelist into columnar binary files in
+  // output_dir, see data_feed_columnar.h
+  virtual void DumpColumnar(const std::string& output_dir) {
+    PADDLE_THROW(platform::errors::Unimplemented(
+        "This function(DumpColumnar) is not implemented."));
+  }
   virtual void SetPlace(const paddle::platform::Place& place) {
     place_ = place;
   }
@@ -1399,6 +1405,7 @@ class SlotRecordInMemoryDataFeed : public InMemoryDataFeed<SlotRecord> {
   }
   virtual void Init(const DataFeedDesc& data_feed_desc);
   virtual void LoadIntoMemory();
+  virtual void DumpColumnar(const std::string& output_dir);
   void ExpandSlotRecord(SlotRecord* ins);
 
  protected:
@@ -1414,10 +1421,16 @@ class SlotRecordInMemoryDataFeed : public InMemoryDataFeed<SlotRecord> {
   virtual void LoadIntoMemoryByLib(void);
   virtual void LoadIntoMemoryByLine(void);
   virtual void LoadIntoMemoryByFile(void);
+  // loads a file written by DumpColumnar, returns the record number
+  int LoadColumnarFile(const std::string& filename);
+  // "<name> <type>" of the used slots in the columnar order
+  std::vector<std::string> ColumnarSlotDesc() const;
   virtual void SetInputChannel(void* channel) {
     input_channel_ = static_cast<ChannelObject<SlotRecord>*>(channel);
   }
   bool ParseOneInstance(const std::string& line, SlotRecord* rec);
+  // parses the line in place, str must be '\0' terminated at str[line_len]
+  bool ParseOneInstance(const char* str, size_t line_len, SlotRecord* rec);
   virtual void PutToFeedVec(const SlotRecord* ins_vec, int num);
   virtual void AssignFeedVar(const Scope& scope);
 #if defined(PADDLE_WITH_CUDA) && defined(PADDLE_WITH_HETERPS)
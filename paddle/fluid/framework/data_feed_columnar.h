@@ -0,0 +1,386 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <stdint.h>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "glog/logging.h"
+#include "paddle/fluid/framework/data_feed.h"
+#include "zlib.h"
+
+namespace paddle {
+namespace framework {
+
+// Columnar binary file of SlotRecords. It is written once from a text file by
+// DataFeed::DumpColumnar and loaded by SlotRecordInMemoryDataFeed without
+// any text parsing. The file is a sequence of blocks:
+//
+//   SlotColumnarBlockHeader
+//   search_id uint64_t x n, rank uint32_t x n, cmatch uint32_t x n
+//   ins_id    offsets uint32_t x (n + 1), chars
+//   every used uint64 slot: offsets uint32_t x (n + 1), values uint64_t
+//   every used float slot:  offsets uint32_t x (n + 1), values float
+//
+// where n is the record number of the block, offsets start at 0 in every
+// block and everything after the header is zlib compressed when the header
+// says so. The manifest next to the file, named by SlotColumnarManifestPath,
+// lists the used slots the file was written with and its blocks:
+//
+//   slot_columnar <version>
+//   slot <name> <type>
+//   block <offset> <stored_bytes> <record_num>
+static const char* const kSlotColumnarSuffix = ".col";
+static const uint32_t kSlotColumnarMagic = 0x4c4f4353;  // "SCOL"
+static const uint32_t kSlotColumnarVersion = 1;
+static const uint32_t kSlotColumnarBlockRecords = 4096;
+
+struct SlotColumnarBlockHeader {
+  uint32_t magic;
+  uint32_t record_num;
+  uint32_t compressed;
+  uint32_t reserved;
+  uint64_t raw_bytes;
+  uint64_t stored_bytes;
+};
+
+inline std::string SlotColumnarManifestPath(const std::string& path) {
+  return path + ".manifest";
+}
+
+// name of the columnar file dumped from input_path. It is derived from the
+// whole path, with '%', '/' and ':' escaped as in urls, so that inputs with
+// the same base name in different directories do not overwrite each other
+inline std::string SlotColumnarFileName(const std::string& input_path) {
+  std::string name;
+  name.reserve(input_path.size() + 8);
+  for (char c : input_path) {
+    if (c == '%') {
+      name += "%25";
+    } else if (c == '/') {
+      name += "%2F";
+    } else if (c == ':') {
+      name += "%3A";
+    } else {
+      name += c;
+    }
+  }
+  return name + kSlotColumnarSuffix;
+}
+
+inline bool IsSlotColumnarFile(const std::string& path) {
+  size_t suffix_len = strlen(kSlotColumnarSuffix);
+  return path.size() > suffix_len &&
+         path.compare(path.size() - suffix_len, suffix_len,
+                      kSlotColumnarSuffix) == 0;
+}
+
+class SlotColumnarWriter {
+ public:
+  // write returns the number of bytes written, as fwrite does
+  typedef std::function<size_t(const char* data, size_t size)> WriteFunc;
+
+  SlotColumnarWriter(WriteFunc write, int uint64_slot_num, int float_slot_num,
+                     bool compress,
+                     uint32_t block_records = kSlotColumnarBlockRecords)
+      : _write(write),
+        _compress(compress),
+        _block_records(block_records),
+        _uint64_slots(uint64_slot_num),
+        _float_slots(float_slot_num) {
+    Clear();
+  }
+
+  // returns -1 when a block could not be written
+  int Append(const SlotRecordObject& rec) {
+    _search_ids.push_back(rec.search_id);
+    _ranks.push_back(rec.rank);
+    _cmatches.push_back(rec.cmatch);
+    _ins_ids.append(rec.ins_id_);
+    _ins_id_offsets.push_back(_ins_ids.size());
+    AppendSlots(rec.slot_uint64_feasigns_, &_uint64_slots);
+    AppendSlots(rec.slot_float_feasigns_, &_float_slots);
+    ++_record_num;
+    if (_search_ids.size() >= _block_records) {
+      return FlushBlock();
+    }
+    return 0;
+  }
+
+  // writes the last block, the writer must not be used after it
+  int Close() { return _search_ids.empty() ? 0 : FlushBlock(); }
+
+  size_t record_num() const { return _record_num; }
+
+  // slot_desc holds "<name> <type>" of every used slot, uint64 slots first
+  std::string Manifest(const std::vector<std::string>& slot_desc) const {
+    std::stringstream ss;
+    ss << "slot_columnar " << kSlotColumnarVersion << "\n";
+    for (auto& slot : slot_desc) {
+      ss << "slot " << slot << "\n";
+    }
+    ss << _blocks.str();
+    return ss.str();
+  }
+
+ private:
+  template <typename T>
+  struct Column {
+    std::vector<uint32_t> offsets;
+    std::vector<T> values;
+  };
+
+  template <typename T>
+  static void AppendSlots(const SlotValues<T>& slot_values,
+                          std::vector<Column<T>>* columns) {
+    const auto& offsets = slot_values.slot_offsets;
+    for (size_t i = 0; i < columns->size(); ++i) {
+      auto& column = (*columns)[i];
+      if (i + 1 < offsets.size()) {
+        column.values.insert(column.values.end(),
+                             slot_values.slot_values.begin() + offsets[i],
+                             slot_values.slot_values.begin() + offsets[i + 1]);
+      }
+      column.offsets.push_back(column.values.size());
+    }
+  }
+
+  template <typename T>
+  static void AppendBytes(const std::vector<T>& vec, std::string* raw) {
+    raw->append(reinterpret_cast<const char*>(vec.data()),
+                vec.size() * sizeof(T));
+  }
+
+  template <typename T>
+  static void AppendColumns(const std::vector<Column<T>>& columns,
+                            std::string* raw) {
+    for (auto& column : columns) {
+      AppendBytes(column.offsets, raw);
+      AppendBytes(column.values, raw);
+    }
+  }
+
+  void Clear() {
+    _search_ids.clear();
+    _ranks.clear();
+    _cmatches.clear();
+    _ins_ids.clear();
+    _ins_id_offsets.assign(1, 0);
+    for (auto& column : _uint64_slots) {
+      column.offsets.assign(1, 0);
+      column.values.clear();
+    }
+    for (auto& column : _float_slots) {
+      column.offsets.assign(1, 0);
+      column.values.clear();
+    }
+  }
+
+  int FlushBlock() {
+    _raw.clear();
+    AppendBytes(_search_ids, &_raw);
+    AppendBytes(_ranks, &_raw);
+    AppendBytes(_cmatches, &_raw);
+    AppendBytes(_ins_id_offsets, &_raw);
+    _raw.append(_ins_ids);
+    AppendColumns(_uint64_slots, &_raw);
+    AppendColumns(_float_slots, &_raw);
+
+    SlotColumnarBlockHeader header;
+    header.magic = kSlotColumnarMagic;
+    header.record_num = _search_ids.size();
+    header.compressed = _compress ? 1 : 0;
+    header.reserved = 0;
+    header.raw_bytes = _raw.size();
+    const std::string* body = &_raw;
+    if (_compress) {
+      uLongf stored = compressBound(_raw.size());
+      _stored.resize(stored);
+      int ret = compress2(reinterpret_cast<Bytef*>(&_stored[0]), &stored,
+                          reinterpret_cast<const Bytef*>(_raw.data()),
+                          _raw.size(), Z_BEST_SPEED);
+      CHECK_EQ(ret, Z_OK) << "failed to compress slot columnar block";
+      _stored.resize(stored);
+      body = &_stored;
+    }
+    header.stored_bytes = body->size();
+
+    int ret = 0;
+    if (_write(reinterpret_cast<const char*>(&header), sizeof(header)) !=
+            sizeof(header) ||
+        _write(body->data(), body->size()) != body->size()) {
+      ret = -1;
+    }
+    _blocks << "block " << _offset << " " << sizeof(header) + body->size()
+            << " " << header.record_num << "\n";
+    _offset += sizeof(header) + body->size();
+    Clear();
+    return ret;
+  }
+
+  WriteFunc _write;
+  bool _compress;
+  uint32_t _block_records;
+  std::vector<uint64_t> _search_ids;
+  std::vector<uint32_t> _ranks;
+  std::vector<uint32_t> _cmatches;
+  std::vector<uint32_t> _ins_id_offsets;
+  std::string _ins_ids;
+  std::vector<Column<uint64_t>> _uint64_slots;
+  std::vector<Column<float>> _float_slots;
+  std::string _raw;
+  std::string _stored;
+  std::stringstream _blocks;
+  uint64_t _offset = 0;
+  size_t _record_num = 0;
+};
+
+// Decodes the blocks of a columnar file into SlotRecords. The stored block
+// may point into an mmap of the file, uncompressed blocks are read in place.
+class SlotColumnarReader {
+ public:
+  SlotColumnarReader(int uint64_slot_num, int float_slot_num)
+      : _uint64_slot_num(uint64_slot_num), _float_slot_num(float_slot_num) {}
+
+  static bool CheckHeader(const SlotColumnarBlockHeader& header) {
+    return header.magic == kSlotColumnarMagic &&
+           (header.compressed != 0 || header.raw_bytes == header.stored_bytes);
+  }
+
+  // fills records[0, header.record_num) from the block body, buffer holds
+  // the body when it has to be decompressed. Returns -1 when the block is
+  // corrupted.
+  int ReadBlock(const SlotColumnarBlockHeader& header, const char* stored,
+                std::string* buffer, SlotRecord* records) const {
+    if (!CheckHeader(header)) {
+      return -1;
+    }
+    const char* pos = stored;
+    if (header.compressed) {
+      buffer->resize(header.raw_bytes);
+      uLongf raw_bytes = header.raw_bytes;
+      if (uncompress(reinterpret_cast<Bytef*>(&(*buffer)[0]), &raw_bytes,
+                     reinterpret_cast<const Bytef*>(stored),
+                     header.stored_bytes) != Z_OK ||
+          raw_bytes != header.raw_bytes) {
+        return -1;
+      }
+      pos = buffer->data();
+    }
+    const char* end = pos + header.raw_bytes;
+    uint32_t num = header.record_num;
+
+    const char* search_ids = Take(&pos, end, num * sizeof(uint64_t));
+    const char* ranks = Take(&pos, end, num * sizeof(uint32_t));
+    const char* cmatches = Take(&pos, end, num * sizeof(uint32_t));
+    std::vector<uint32_t>& offsets = _offsets;
+    if (search_ids == NULL || ranks == NULL || cmatches == NULL ||
+        ReadOffsets(&pos, end, num, &offsets) != 0) {
+      return -1;
+    }
+    const char* ins_ids = Take(&pos, end, offsets[num]);
+    if (ins_ids == NULL) {
+      return -1;
+    }
+    for (uint32_t i = 0; i < num; ++i) {
+      SlotRecord rec = records[i];
+      memcpy(&rec->search_id, search_ids + i * sizeof(uint64_t),
+             sizeof(uint64_t));
+      memcpy(&rec->rank, ranks + i * sizeof(uint32_t), sizeof(uint32_t));
+      memcpy(&rec->cmatch, cmatches + i * sizeof(uint32_t), sizeof(uint32_t));
+      rec->ins_id_.assign(ins_ids + offsets[i], offsets[i + 1] - offsets[i]);
+      rec->slot_uint64_feasigns_.slot_values.clear();
+      rec->slot_uint64_feasigns_.slot_offsets.resize(_uint64_slot_num + 1);
+      rec->slot_float_feasigns_.slot_values.clear();
+      rec->slot_float_feasigns_.slot_offsets.resize(_float_slot_num + 1);
+    }
+    if (ReadColumns(&pos, end, num, _uint64_slot_num, records,
+                    &SlotRecordObject::slot_uint64_feasigns_) != 0 ||
+        ReadColumns(&pos, end, num, _float_slot_num, records,
+                    &SlotRecordObject::slot_float_feasigns_) != 0) {
+      return -1;
+    }
+    return pos == end ? 0 : -1;
+  }
+
+ private:
+  static const char* Take(const char** pos, const char* end, size_t bytes) {
+    if (static_cast<size_t>(end - *pos) < bytes) {
+      return NULL;
+    }
+    const char* ret = *pos;
+    *pos += bytes;
+    return ret;
+  }
+
+  static int ReadOffsets(const char** pos, const char* end, uint32_t num,
+                         std::vector<uint32_t>* offsets) {
+    const char* data = Take(pos, end, (num + 1) * sizeof(uint32_t));
+    if (data == NULL) {
+      return -1;
+    }
+    offsets->resize(num + 1);
+    memcpy(offsets->data(), data, (num + 1) * sizeof(uint32_t));
+    for (uint32_t i = 0; i < num; ++i) {
+      if ((*offsets)[i] > (*offsets)[i + 1]) {
+        return -1;
+      }
+    }
+    return (*offsets)[0] == 0 ? 0 : -1;
+  }
+
+  // slot s of every record gets the values of column s, the last slot
+  // closes the offsets of the records
+  template <typename T>
+  int ReadColumns(const char** pos, const char* end, uint32_t num,
+                  int slot_num, SlotRecord* records,
+                  SlotValues<T> SlotRecordObject::*member) const {
+    std::vector<uint32_t>& offsets = _offsets;
+    for (int slot = 0; slot < slot_num; ++slot) {
+      if (ReadOffsets(pos, end, num, &offsets) != 0) {
+        return -1;
+      }
+      const char* values = Take(pos, end, offsets[num] * sizeof(T));
+      if (values == NULL) {
+        return -1;
+      }
+      for (uint32_t i = 0; i < num; ++i) {
+        auto& slot_values = records[i]->*member;
+        slot_values.slot_offsets[slot] = slot_values.slot_values.size();
+        size_t count = offsets[i + 1] - offsets[i];
+        size_t old_size = slot_values.slot_values.size();
+        slot_values.slot_values.resize(old_size + count);
+        memcpy(slot_values.slot_values.data() + old_size,
+               values + offsets[i] * sizeof(T), count * sizeof(T));
+      }
+    }
+    for (uint32_t i = 0; i < num; ++i) {
+      auto& slot_values = records[i]->*member;
+      slot_values.slot_offsets[slot_num] = slot_values.slot_values.size();
+    }
+    return 0;
+  }
+
+  int _uint64_slot_num;
+  int _float_slot_num;
+  mutable std::vector<uint32_t> _offsets;
+};
+
+}  // namespace framework
+}  // namespace paddle
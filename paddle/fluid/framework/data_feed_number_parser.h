@@ -0,0 +1,198 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <float.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <cstring>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace paddle {
+namespace framework {
+
+// Number parser of the MultiSlot text format. ParseInt, ParseUint64 and
+// ParseFloat return exactly what strtol, strtoull (base 10) and strtof
+// return, and set *endptr the same way. When fast is set, tokens of the
+// common form (plain digits, or a short decimal fraction for floats) are
+// converted inline: the digit run is found 16 bytes at a time with SSE2 and
+// converted 8 digits at a time. Any other token, e.g. a sign on an integer,
+// an exponent, too many digits or garbage, goes to libc, so the result and
+// errno stay identical for every input.
+//
+// str must be '\0' terminated and end must point at the terminator, SIMD
+// loads never read past it.
+class MultiSlotNumberParser {
+ public:
+  MultiSlotNumberParser(bool fast, const char* end) : _fast(fast), _end(end) {}
+
+  long ParseInt(const char* str, char** endptr) const {  // NOLINT
+    uint64_t value = 0;
+    if (_fast && ParseDigits(str, 18, &value, endptr)) {
+      return static_cast<long>(value);  // NOLINT
+    }
+    return strtol(str, endptr, 10);
+  }
+
+  uint64_t ParseUint64(const char* str, char** endptr) const {
+    uint64_t value = 0;
+    if (_fast && ParseDigits(str, 20, &value, endptr)) {
+      return value;
+    }
+    return static_cast<uint64_t>(strtoull(str, endptr, 10));
+  }
+
+  float ParseFloat(const char* str, char** endptr) const {
+    float value = 0;
+    if (_fast && ParseDecimal(str, &value, endptr)) {
+      return value;
+    }
+    return strtof(str, endptr);
+  }
+
+ private:
+  static bool IsSpace(char c) {
+    return c == ' ' || (c >= '\t' && c <= '\r');
+  }
+  static bool IsDigit(char c) { return static_cast<unsigned>(c - '0') < 10U; }
+
+  const char* SkipSpace(const char* p) const {
+    while (IsSpace(*p)) {
+      ++p;
+    }
+    return p;
+  }
+
+  // number of digits starting at p
+  size_t DigitRun(const char* p) const {
+    size_t run = 0;
+#ifdef __SSE2__
+    const __m128i lower = _mm_set1_epi8('0' - 1);
+    const __m128i upper = _mm_set1_epi8('9' + 1);
+    while (p + run + 16 <= _end) {
+      __m128i chunk =
+          _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + run));
+      __m128i digits = _mm_and_si128(_mm_cmpgt_epi8(chunk, lower),
+                                     _mm_cmplt_epi8(chunk, upper));
+      uint32_t others = ~static_cast<uint32_t>(_mm_movemask_epi8(digits));
+      if ((others & 0xffff) != 0) {
+        return run + __builtin_ctz(others);
+      }
+      run += 16;
+    }
+#endif
+    while (IsDigit(p[run])) {
+      ++run;
+    }
+    return run;
+  }
+
+  // converts 8 ascii digits at once, the most significant first
+  static uint64_t EightDigits(const char* p) {
+    uint64_t val;
+    memcpy(&val, p, sizeof(val));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    val = ((val & 0x0F0F0F0F0F0F0F0FULL) * 2561) >> 8;
+    val = ((val & 0x00FF00FF00FF00FFULL) * 6553601) >> 16;
+    return ((val & 0x0000FFFF0000FFFFULL) * 42949672960001ULL) >> 32;
+#else
+    uint64_t ret = 0;
+    for (int i = 0; i < 8; ++i) {
+      ret = ret * 10 + (p[i] - '0');
+    }
+    return ret;
+#endif
+  }
+
+  static uint64_t Digits(const char* p, size_t num) {
+    uint64_t value = 0;
+    for (; num >= 8; num -= 8, p += 8) {
+      value = value * 100000000ULL + EightDigits(p);
+    }
+    for (; num > 0; --num, ++p) {
+      value = value * 10 + (*p - '0');
+    }
+    return value;
+  }
+
+  // an unsigned integer of at most max_digits digits that fits the result
+  // type, 20 digit numbers are compared against the uint64 maximum
+  bool ParseDigits(const char* str, size_t max_digits, uint64_t* value,
+                   char** endptr) const {
+    const char* p = SkipSpace(str);
+    size_t run = DigitRun(p);
+    if (run == 0 || run > max_digits ||
+        (run == 20 && memcmp(p, "18446744073709551615", 20) > 0)) {
+      return false;
+    }
+    *value = Digits(p, run);
+    *endptr = const_cast<char*>(p + run);
+    return true;
+  }
+
+  // [+-]digits[.digits] with a mantissa below 2^24 and at most 10 fraction
+  // digits. Both the mantissa and the power of ten are exact floats then,
+  // so one division rounds the same way strtof does.
+  bool ParseDecimal(const char* str, float* value, char** endptr) const {
+#if FLT_EVAL_METHOD == 0
+    static const float kPow10[] = {1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f,
+                                   1e6f, 1e7f, 1e8f, 1e9f, 1e10f};
+    const char* p = SkipSpace(str);
+    bool negative = *p == '-';
+    if (*p == '-' || *p == '+') {
+      ++p;
+    }
+    size_t int_run = DigitRun(p);
+    if (int_run == 0 || int_run > 8 ||
+        (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))) {
+      return false;
+    }
+    uint64_t mantissa = Digits(p, int_run);
+    p += int_run;
+    size_t frac_run = 0;
+    if (*p == '.') {
+      ++p;
+      frac_run = DigitRun(p);
+      if (frac_run > 10) {
+        return false;
+      }
+      for (size_t i = 0; i < frac_run; ++i) {
+        mantissa = mantissa * 10 + (p[i] - '0');
+      }
+      p += frac_run;
+    }
+    if (*p == 'e' || *p == 'E' || mantissa >= (1ULL << 24)) {
+      return false;
+    }
+    float ret = static_cast<float>(mantissa);
+    if (frac_run > 0) {
+      ret /= kPow10[frac_run];
+    }
+    *value = negative ? -ret : ret;
+    *endptr = const_cast<char*>(p);
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  bool _fast;
+  const char* _end;
+};
+
+}  // namespace framework
+}  // namespace paddle
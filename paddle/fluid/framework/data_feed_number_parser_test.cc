@@ -0,0 +1,142 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/framework/data_feed_number_parser.h"
+#include <chrono>  // NOLINT
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "glog/logging.h"
+#include "gtest/gtest.h"
+
+namespace paddle {
+namespace framework {
+
+// every token is parsed by the fast and the libc parser, both have to agree
+// on the value and on where the token ends
+void ExpectSameAsLibc(const std::string& line) {
+  const char* str = line.c_str();
+  MultiSlotNumberParser fast(true, str + line.size());
+  MultiSlotNumberParser libc(false, str + line.size());
+  for (size_t pos = 0; pos < line.size(); ++pos) {
+    char* fast_end = NULL;
+    char* libc_end = NULL;
+    ASSERT_EQ(fast.ParseInt(str + pos, &fast_end),
+              libc.ParseInt(str + pos, &libc_end))
+        << line << " at " << pos;
+    ASSERT_EQ(fast_end, libc_end) << line << " at " << pos;
+    ASSERT_EQ(fast.ParseUint64(str + pos, &fast_end),
+              libc.ParseUint64(str + pos, &libc_end))
+        << line << " at " << pos;
+    ASSERT_EQ(fast_end, libc_end) << line << " at " << pos;
+    float fast_value = fast.ParseFloat(str + pos, &fast_end);
+    float libc_value = libc.ParseFloat(str + pos, &libc_end);
+    ASSERT_EQ(memcmp(&fast_value, &libc_value, sizeof(float)), 0)
+        << line << " at " << pos << ": " << fast_value << " vs "
+        << libc_value;
+    ASSERT_EQ(fast_end, libc_end) << line << " at " << pos;
+  }
+}
+
+TEST(MultiSlotNumberParser, SameAsLibc) {
+  ExpectSameAsLibc(
+      "3 3978 620 82 1 1926.08 1 1926 1 6.02 1 1996\t0.618 -0 -0.0 +7 -12");
+  ExpectSameAsLibc("18446744073709551615 18446744073709551616 9999999999999");
+  ExpectSameAsLibc("1234567890123456789 12345678901234567890123 0000000001");
+  ExpectSameAsLibc("0.1 0.2 0.3 3.14159265 16777215 16777216 16777217.5");
+  ExpectSameAsLibc("1e5 1.5E-3 2.e 0x1f 0X1p3 00x1 inf nan -inf .5 5. -.5");
+  ExpectSameAsLibc("12abc 7.5.5 1..2 - + -- \v\f\r\n 42 1.00000000001");
+  ExpectSameAsLibc("");
+
+  std::mt19937_64 rng(0);
+  for (int i = 0; i < 200; ++i) {
+    std::stringstream ss;
+    for (int j = 0; j < 50; ++j) {
+      switch (rng() % 4) {
+        case 0:
+          ss << rng() << " ";
+          break;
+        case 1:
+          ss << (rng() % 100000) << "." << (rng() % 1000000) << " ";
+          break;
+        case 2:
+          ss.precision(rng() % 12 + 1);
+          ss << std::uniform_real_distribution<float>(-1e4, 1e4)(rng) << " ";
+          break;
+        default:
+          ss << (rng() >> (rng() % 64)) << "\t";
+      }
+    }
+    ExpectSameAsLibc(ss.str());
+  }
+}
+
+TEST(BENCHMARK, MultiSlotNumberParser) {
+  const int line_num = 20000;
+  const int slot_num = 100;
+  std::mt19937_64 rng(0);
+  std::vector<std::string> lines(line_num);
+  size_t bytes = 0;
+  for (auto& line : lines) {
+    std::stringstream ss;
+    for (int slot = 0; slot < slot_num; ++slot) {
+      int num = 1 + rng() % 5;
+      ss << num;
+      for (int j = 0; j < num; ++j) {
+        // one slot in ten is a float slot as in the usual ctr samples
+        if (slot % 10 == 0) {
+          ss << " " << rng() % 1000 << "." << rng() % 1000;
+        } else {
+          ss << " " << rng();
+        }
+      }
+      ss << " ";
+    }
+    line = ss.str();
+    bytes += line.size();
+  }
+
+  auto run = [&](bool fast) {
+    auto start = std::chrono::steady_clock::now();
+    uint64_t checksum = 0;
+    for (auto& line : lines) {
+      const char* str = line.c_str();
+      MultiSlotNumberParser parser(fast, str + line.size());
+      char* endptr = const_cast<char*>(str);
+      for (int slot = 0; slot < slot_num; ++slot) {
+        long num = parser.ParseInt(endptr, &endptr);  // NOLINT
+        for (long j = 0; j < num; ++j) {              // NOLINT
+          if (slot % 10 == 0) {
+            checksum += static_cast<uint64_t>(parser.ParseFloat(endptr,
+                                                                &endptr));
+          } else {
+            checksum += parser.ParseUint64(endptr, &endptr);
+          }
+        }
+      }
+    }
+    double sec = std::chrono::duration<double>(
+                     std::chrono::steady_clock::now() - start)
+                     .count();
+    LOG(INFO) << (fast ? "fast parser: " : "libc parser: ")
+              << line_num / sec << " lines/sec, " << bytes / sec / 1e6
+              << " MB/sec, checksum " << checksum;
+    return checksum;
+  };
+  ASSERT_EQ(run(false), run(true));
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -451,6 +451,27 @@ void DatasetImpl<T>::LoadIntoMemory() {
           << ", cost time=" << timeline.ElapsedSec() << " seconds";
 }
 
+template <typename T>
+void DatasetImpl<T>::DumpColumnar(const std::string& output_dir) {
+  VLOG(3) << "DatasetImpl<T>::DumpColumnar() begin";
+  platform::Timer timeline;
+  timeline.Start();
+  std::vector<std::thread> dump_threads;
+  for (int64_t i = 0; i < thread_num_; ++i) {
+    dump_threads.push_back(
+        std::thread(&paddle::framework::DataFeed::DumpColumnar,
+                    readers_[i].get(), output_dir));
+  }
+  for (std::thread& t : dump_threads) {
+    t.join();
+  }
+  // the readers picked every file, let the next load start from the first
+  file_idx_ = 0;
+  timeline.Pause();
+  VLOG(3) << "DatasetImpl<T>::DumpColumnar() end"
+          << ", cost time=" << timeline.ElapsedSec() << " seconds";
+}
+
 template <typename T>
 void DatasetImpl<T>::PreLoadIntoMemory() {
   VLOG(3) << "DatasetImpl<T>::PreLoadIntoMemory() begin";
@@ -112,6 +112,10 @@ class Dataset {
   virtual void RegisterClientToClientMsgHandler() = 0;
   // load all data into memory
   virtual void LoadIntoMemory() = 0;
+  // converts the text files of the filelist into columnar binary files in
+  // output_dir, which LoadIntoMemory reads without parsing when the filelist
+  // is set to them
+  virtual void DumpColumnar(const std::string& output_dir) = 0;
   // load all data into memory in async mode
   virtual void PreLoadIntoMemory() = 0;
   // wait async load done
@@ -218,6 +222,7 @@ class DatasetImpl : public Dataset {
   virtual void CreateChannel();
   virtual void RegisterClientToClientMsgHandler();
   virtual void LoadIntoMemory();
+  virtual void DumpColumnar(const std::string& output_dir);
   virtual void PreLoadIntoMemory();
   virtual void WaitPreLoadDone();
   virtual void ReleaseMemory();
@@ -0,0 +1,201 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/infer_shape_cache.h"
+
+#include <utility>
+
+#include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/framework/variable.h"
+#include "paddle/fluid/platform/flags.h"
+#include "paddle/phi/core/tensor_utils.h"
+
+PADDLE_DEFINE_EXPORTED_int32(
+    infer_shape_cache_capacity, 0,
+    "The number of input shape signatures whose InferShape results are "
+    "cached by every operator, the least recently used one is evicted "
+    "first. Repeated input shapes then skip InferShape, which helps dynamic "
+    "shape inference with a few distinct shapes. 0 disables the cache.");
+
+namespace paddle {
+namespace framework {
+
+// markers that separate the variables of a signature
+static constexpr int64_t kNullVar = -1;
+static constexpr int64_t kUninitializedVar = -2;
+static constexpr int64_t kTensorVar = -3;
+
+constexpr int64_t InferShapeCache::kMaxKeyedValueNumel;
+
+static bool IsIntegerType(phi::DataType dtype) {
+  return dtype == phi::DataType::INT32 || dtype == phi::DataType::INT64;
+}
+
+template <typename T>
+static void AppendValues(const LoDTensor& tensor,
+                         InferShapeCache::Signature* signature) {
+  const T* data = tensor.data<T>();
+  for (int64_t i = 0; i < tensor.numel(); ++i) {
+    signature->push_back(static_cast<int64_t>(data[i]));
+  }
+}
+
+static bool AppendTensor(const LoDTensor& tensor,
+                         InferShapeCache::Signature* signature) {
+  signature->push_back(kTensorVar);
+  signature->push_back(static_cast<int64_t>(tensor.dtype()));
+  const auto& dims = tensor.dims();
+  signature->push_back(dims.size());
+  for (int i = 0; i < dims.size(); ++i) {
+    signature->push_back(dims[i]);
+  }
+  const auto& lod = tensor.lod();
+  signature->push_back(lod.size());
+  for (auto& level : lod) {
+    signature->push_back(level.size());
+    signature->insert(signature->end(), level.begin(), level.end());
+  }
+
+  if (IsIntegerType(tensor.dtype()) && tensor.IsInitialized() &&
+      tensor.numel() <= InferShapeCache::kMaxKeyedValueNumel) {
+    if (!platform::is_cpu_place(tensor.place())) {
+      return false;
+    }
+    if (tensor.dtype() == phi::DataType::INT32) {
+      AppendValues<int32_t>(tensor, signature);
+    } else {
+      AppendValues<int64_t>(tensor, signature);
+    }
+  }
+  return true;
+}
+
+bool InferShapeCache::GetSignature(const VariableValueMap& inputs,
+                                   const VariableValueMap& outputs,
+                                   Signature* signature) {
+  signature->clear();
+  for (auto& pair : inputs) {
+    signature->push_back(pair.second.size());
+    for (auto* var : pair.second) {
+      if (var == nullptr) {
+        signature->push_back(kNullVar);
+      } else if (!var->IsInitialized()) {
+        signature->push_back(kUninitializedVar);
+      } else if (!var->IsType<LoDTensor>() ||
+                 !AppendTensor(var->Get<LoDTensor>(), signature)) {
+        return false;
+      }
+    }
+  }
+  for (auto& pair : outputs) {
+    for (auto* var : pair.second) {
+      if (var != nullptr && var->IsInitialized() && !var->IsType<LoDTensor>()) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static size_t NonNullVarNum(const VariableValueMap& vars) {
+  size_t num = 0;
+  for (auto& pair : vars) {
+    for (auto* var : pair.second) {
+      num += var != nullptr;
+    }
+  }
+  return num;
+}
+
+size_t InferShapeCache::SignatureHash::operator()(
+    const Signature& signature) const {
+  size_t seed = signature.size();
+  for (auto value : signature) {
+    seed ^= std::hash<int64_t>()(value) + 0x9e3779b9 + (seed << 6) +
+            (seed >> 2);
+  }
+  return seed;
+}
+
+bool InferShapeCache::Apply(const Signature& signature,
+                            const VariableValueMap& outputs) {
+  std::lock_guard<std::mutex> guard(mutex_);
+  auto iter = index_.find(signature);
+  if (iter == index_.end() ||
+      iter->second->outputs.size() != NonNullVarNum(outputs)) {
+    ++misses_;
+    return false;
+  }
+  entries_.splice(entries_.begin(), entries_, iter->second);
+  ++hits_;
+
+  auto meta = iter->second->outputs.begin();
+  for (auto& pair : outputs) {
+    for (auto* var : pair.second) {
+      if (var == nullptr) {
+        continue;
+      }
+      auto* tensor = var->GetMutable<LoDTensor>();
+      tensor->Resize(meta->dims);
+      tensor->set_lod(meta->lod);
+      if (meta->dtype != phi::DataType::UNDEFINED) {
+        auto* mutable_meta = phi::DenseTensorUtils::GetMutableMeta(tensor);
+        mutable_meta->dtype = meta->dtype;
+        mutable_meta->layout = meta->layout;
+      }
+      ++meta;
+    }
+  }
+  return true;
+}
+
+void InferShapeCache::Insert(Signature signature,
+                             const VariableValueMap& outputs) {
+  Entry entry;
+  for (auto& pair : outputs) {
+    for (auto* var : pair.second) {
+      if (var == nullptr) {
+        continue;
+      }
+      // InferShape may create outputs of other types
+      if (!var->IsType<LoDTensor>()) {
+        return;
+      }
+      auto& tensor = var->Get<LoDTensor>();
+      phi::DenseTensorMeta meta(tensor.dtype(), tensor.dims(), tensor.layout(),
+                                tensor.lod());
+      entry.outputs.push_back(std::move(meta));
+    }
+  }
+
+  std::lock_guard<std::mutex> guard(mutex_);
+  if (capacity_ == 0 || index_.count(signature) > 0) {
+    return;
+  }
+  if (entries_.size() >= capacity_) {
+    index_.erase(entries_.back().signature);
+    entries_.pop_back();
+  }
+  entry.signature = std::move(signature);
+  entries_.push_front(std::move(entry));
+  index_.emplace(entries_.front().signature, entries_.begin());
+}
+
+size_t InferShapeCache::Size() const {
+  std::lock_guard<std::mutex> guard(mutex_);
+  return entries_.size();
+}
+
+}  // namespace framework
+}  // namespace paddle
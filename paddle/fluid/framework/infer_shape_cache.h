@@ -0,0 +1,86 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <list>
+#include <mutex>  // NOLINT
+#include <unordered_map>
+#include <vector>
+
+#include "paddle/fluid/framework/type_defs.h"
+#include "paddle/phi/core/tensor_meta.h"
+
+namespace paddle {
+namespace framework {
+
+/*
+ * Memoizes the output meta that InferShape computes for one operator, keyed
+ * by the dims, data types and LoD of its inputs. The values of small CPU
+ * integer inputs are part of the key too, since they may be shape tensors.
+ *
+ * Only ops whose inputs and outputs are all LoDTensor can be cached, and an
+ * op with a small integer input on a device place is never cached because
+ * reading the value would need a synchronization. The least recently used
+ * signature is evicted when the cache is full.
+ */
+class InferShapeCache {
+ public:
+  using Signature = std::vector<int64_t>;
+
+  explicit InferShapeCache(size_t capacity) : capacity_(capacity) {}
+
+  // Integer inputs with at most this number of elements are keyed by value.
+  static constexpr int64_t kMaxKeyedValueNumel = 16;
+
+  // Returns false if InferShape of the variables can not be cached.
+  static bool GetSignature(const VariableValueMap& inputs,
+                           const VariableValueMap& outputs,
+                           Signature* signature);
+
+  // Sets the outputs to the meta cached for signature, returns false if
+  // signature is not cached.
+  bool Apply(const Signature& signature, const VariableValueMap& outputs);
+
+  // Records the outputs after InferShape ran for signature.
+  void Insert(Signature signature, const VariableValueMap& outputs);
+
+  size_t Hits() const { return hits_; }
+  size_t Misses() const { return misses_; }
+  size_t Size() const;
+
+ private:
+  struct SignatureHash {
+    size_t operator()(const Signature& signature) const;
+  };
+
+  struct Entry {
+    Signature signature;
+    // in the order of the outputs, nullptr variables are skipped
+    std::vector<phi::DenseTensorMeta> outputs;
+  };
+
+  size_t capacity_;
+  size_t hits_{0};
+  size_t misses_{0};
+  mutable std::mutex mutex_;
+  // the most recently used first
+  std::list<Entry> entries_;
+  std::unordered_map<Signature, std::list<Entry>::iterator, SignatureHash>
+      index_;
+};
+
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,111 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/infer_shape_cache.h"
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/framework/selected_rows_utils.h"
+#include "paddle/fluid/framework/variable.h"
+
+namespace paddle {
+namespace framework {
+
+// the output of an elementwise op on x
+static void InferShape(const Variable& x, Variable* out) {
+  out->GetMutable<LoDTensor>()->Resize(x.Get<LoDTensor>().dims());
+}
+
+TEST(InferShapeCache, ApplyAndEvict) {
+  Variable x, out;
+  x.GetMutable<LoDTensor>()->Resize({2, 3});
+  VariableValueMap inputs = {{"X", {&x}}};
+  VariableValueMap outputs = {{"Out", {&out}}};
+
+  InferShapeCache cache(2);
+  InferShapeCache::Signature signature;
+  ASSERT_TRUE(InferShapeCache::GetSignature(inputs, outputs, &signature));
+  ASSERT_FALSE(cache.Apply(signature, outputs));
+  InferShape(x, &out);
+  cache.Insert(signature, outputs);
+
+  // a different shape misses
+  x.GetMutable<LoDTensor>()->Resize({4, 3});
+  InferShapeCache::Signature other;
+  ASSERT_TRUE(InferShapeCache::GetSignature(inputs, outputs, &other));
+  ASSERT_NE(signature, other);
+  ASSERT_FALSE(cache.Apply(other, outputs));
+  InferShape(x, &out);
+  cache.Insert(other, outputs);
+
+  // the first shape hits
+  ASSERT_TRUE(cache.Apply(signature, outputs));
+  EXPECT_EQ(out.Get<LoDTensor>().dims(), phi::make_ddim({2, 3}));
+  EXPECT_EQ(cache.Hits(), 1UL);
+  EXPECT_EQ(cache.Misses(), 2UL);
+
+  // {4, 3} is the least recently used one
+  x.GetMutable<LoDTensor>()->Resize({8, 3});
+  InferShapeCache::Signature third;
+  ASSERT_TRUE(InferShapeCache::GetSignature(inputs, outputs, &third));
+  InferShape(x, &out);
+  cache.Insert(third, outputs);
+  EXPECT_EQ(cache.Size(), 2UL);
+  EXPECT_FALSE(cache.Apply(other, outputs));
+  EXPECT_TRUE(cache.Apply(signature, outputs));
+  EXPECT_TRUE(cache.Apply(third, outputs));
+  EXPECT_EQ(out.Get<LoDTensor>().dims(), phi::make_ddim({8, 3}));
+}
+
+TEST(InferShapeCache, Signature) {
+  Variable x, shape, out;
+  x.GetMutable<LoDTensor>()->Resize({2, 3});
+  auto* shape_tensor = shape.GetMutable<LoDTensor>();
+  shape_tensor->Resize({2});
+  auto* shape_data = shape_tensor->mutable_data<int64_t>(platform::CPUPlace());
+  shape_data[0] = 3;
+  shape_data[1] = 2;
+  VariableValueMap inputs = {{"Shape", {&shape}}, {"X", {&x}}};
+  VariableValueMap outputs = {{"Out", {&out}}};
+
+  // the values of small integer inputs are a part of the signature
+  InferShapeCache::Signature signature, other;
+  ASSERT_TRUE(InferShapeCache::GetSignature(inputs, outputs, &signature));
+  shape_data[0] = 6;
+  shape_data[1] = 1;
+  ASSERT_TRUE(InferShapeCache::GetSignature(inputs, outputs, &other));
+  EXPECT_NE(signature, other);
+
+  // so is the LoD
+  x.GetMutable<LoDTensor>()->set_lod({{0, 1, 2}});
+  InferShapeCache::Signature with_lod;
+  ASSERT_TRUE(InferShapeCache::GetSignature(inputs, outputs, &with_lod));
+  EXPECT_NE(other, with_lod);
+
+  // optional inputs
+  VariableValueMap optional_inputs = {{"X", {&x}}, {"Y", {nullptr}}};
+  EXPECT_TRUE(
+      InferShapeCache::GetSignature(optional_inputs, outputs, &signature));
+
+  // only LoDTensor can be cached
+  Variable rows;
+  rows.GetMutable<phi::SelectedRows>();
+  VariableValueMap rows_inputs = {{"X", {&rows}}};
+  EXPECT_FALSE(InferShapeCache::GetSignature(rows_inputs, outputs, &other));
+  VariableValueMap rows_outputs = {{"Out", {&rows}}};
+  EXPECT_FALSE(InferShapeCache::GetSignature(inputs, rows_outputs, &other));
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -13,10 +13,14 @@ See the License for the specific language governing permissions and
 limitations under the License. */
 
 #include <gtest/gtest.h>
+#include <sys/time.h>
+#include <algorithm>
 #include <cmath>
+#include <set>
 #include <string>
 
 #include "paddle/fluid/framework/ir/fusion_group/code_generator.h"
+#include "paddle/fluid/framework/ir/fusion_group/cpu_code_generator.h"
 #include "paddle/fluid/framework/ir/fusion_group/operation.h"
 #include "paddle/fluid/framework/ir/pass_tester_helper.h"
 #include "paddle/fluid/platform/device_code.h"
@@ -26,8 +30,6 @@ namespace phi {
 class DenseTensor;
 }  // namespace phi
 
-#if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
-
 namespace paddle {
 namespace framework {
 namespace ir {
@@ -135,6 +137,53 @@ void CheckOutput(const std::vector<OperationExpression>& expressions,
           elementwise_mul_grad_dx(0, var[input_ids[1]], 0, var[input_ids[3]]);
       var[output_ids[1]] =
           elementwise_mul_grad_dy(var[input_ids[0]], 0, 0, var[input_ids[3]]);
+    } else if (op_type == "sqrt") {
+      var[output_ids[0]] = std::sqrt(var[input_ids[0]]);
+    } else if (op_type == "square") {
+      var[output_ids[0]] = var[input_ids[0]] * var[input_ids[0]];
+    } else if (op_type == "assign") {
+      var[output_ids[0]] = var[input_ids[0]];
+    } else if (op_type == "scale") {
+      auto attrs = expression.GetAttr();
+      float scale = BOOST_GET_CONST(float, attrs["scale"]);
+      float bias = BOOST_GET_CONST(float, attrs["bias"]);
+      var[output_ids[0]] = BOOST_GET_CONST(bool, attrs["bias_after_scale"])
+                               ? scale * var[input_ids[0]] + bias
+                               : scale * (var[input_ids[0]] + bias);
+    } else if (op_type == "elementwise_div") {
+      var[output_ids[0]] = var[input_ids[0]] / var[input_ids[1]];
+    } else if (op_type == "elementwise_min") {
+      var[output_ids[0]] = std::min(var[input_ids[0]], var[input_ids[1]]);
+    } else if (op_type == "elementwise_max") {
+      var[output_ids[0]] = std::max(var[input_ids[0]], var[input_ids[1]]);
+    } else if (op_type == "sum") {
+      var[output_ids[0]] = 0;
+      for (auto id : input_ids) {
+        var[output_ids[0]] += var[id];
+      }
+    } else if (op_type == "fill_constant") {
+      auto attrs = expression.GetAttr();
+      var[output_ids[0]] =
+          std::stof(BOOST_GET_CONST(std::string, attrs["str_value"]));
+    } else if (op_type == "sqrt_grad") {
+      var[output_ids[0]] = var[input_ids[2]] * 0.5f / var[input_ids[1]];
+    } else if (op_type == "square_grad") {
+      var[output_ids[0]] = var[input_ids[2]] * 2.0f * var[input_ids[0]];
+    } else if (op_type == "elementwise_sub_grad") {
+      var[output_ids[0]] = elementwise_sub_grad_dx(0, 0, 0, var[input_ids[3]]);
+      var[output_ids[1]] = elementwise_sub_grad_dy(0, 0, 0, var[input_ids[3]]);
+    } else if (op_type == "elementwise_div_grad") {
+      float dout = var[input_ids[3]];
+      var[output_ids[0]] = dout / var[input_ids[1]];
+      var[output_ids[1]] = -dout * var[input_ids[2]] / var[input_ids[1]];
+    } else if (op_type == "elementwise_min_grad") {
+      bool is_x = var[input_ids[0]] < var[input_ids[1]];
+      var[output_ids[0]] = is_x ? var[input_ids[3]] : 0;
+      var[output_ids[1]] = is_x ? 0 : var[input_ids[3]];
+    } else if (op_type == "elementwise_max_grad") {
+      bool is_x = var[input_ids[0]] > var[input_ids[1]];
+      var[output_ids[0]] = is_x ? var[input_ids[3]] : 0;
+      var[output_ids[1]] = is_x ? 0 : var[input_ids[3]];
     }
   }
 
@@ -169,6 +218,7 @@ void SetupRandomCPUTensor(LoDTensor* tensor) {
 
 namespace fusion_group = paddle::framework::ir::fusion_group;
 
+#if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
 template <typename T>
 void TestMainImpl(std::string func_name, std::string code_str,
                   std::vector<paddle::framework::LoDTensor> cpu_tensors, int n,
@@ -248,12 +298,43 @@ void TestMainImpl(std::string func_name, std::string code_str,
     }
   }
 }
+#endif
+
+void TestMainImplCPU(
+    std::string func_name,
+    const std::vector<fusion_group::OperationExpression>& expressions,
+    std::vector<paddle::framework::LoDTensor> cpu_tensors, int n,
+    std::vector<int> input_ids, std::vector<int> output_ids) {
+  auto device_code =
+      fusion_group::CPUCodeGenerator().Generate(func_name, expressions);
+  ASSERT_NE(device_code, nullptr);
+  EXPECT_EQ(device_code->Compile(), true);
+
+  std::vector<float*> cpu_ptrs(cpu_tensors.size());
+  std::vector<void*> args;
+  args.push_back(&n);
+
+  for (auto id : input_ids) {
+    if (id >= 0) {
+      fusion_group::SetupRandomCPUTensor<float>(&cpu_tensors[id]);
+      cpu_ptrs[id] = cpu_tensors[id].data<float>();
+      args.push_back(&cpu_ptrs[id]);
+    }
+  }
+
+  for (auto id : output_ids) {
+    cpu_ptrs[id] = cpu_tensors[id].data<float>();
+    args.push_back(&cpu_ptrs[id]);
+  }
+
+  device_code->Launch(n, &args);
+}
 
 void TestElementwiseMain(
     std::string func_name, std::string code_str,
     std::vector<fusion_group::OperationExpression> expressions,
     std::vector<int> input_ids, std::vector<int> output_ids,
-    std::string dtype) {
+    std::string dtype, bool use_gpu = true) {
   std::unordered_set<int> ids;
   for (auto id : input_ids) {
     ids.insert(id);
@@ -271,12 +352,19 @@ void TestElementwiseMain(
   }
 
   int n = cpu_tensors[0].numel();
-  if (dtype == "__half") {
-    TestMainImpl<paddle::platform::float16>(func_name, code_str, cpu_tensors, n,
-                                            input_ids, output_ids);
+  if (!use_gpu) {
+    TestMainImplCPU(func_name, expressions, cpu_tensors, n, input_ids,
+                    output_ids);
   } else {
-    TestMainImpl<float>(func_name, code_str, cpu_tensors, n, input_ids,
-                        output_ids);
+#if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
+    if (dtype == "__half") {
+      TestMainImpl<paddle::platform::float16>(func_name, code_str, cpu_tensors,
+                                              n, input_ids, output_ids);
+    } else {
+      TestMainImpl<float>(func_name, code_str, cpu_tensors, n, input_ids,
+                          output_ids);
+    }
+#endif
   }
 
   // Check the results
@@ -290,22 +378,24 @@ void TestElementwiseMain(
 void TestMain(std::string func_name,
               std::vector<fusion_group::OperationExpression> expressions,
               std::vector<int> input_ids, std::vector<int> output_ids,
-              std::string dtype) {
+              std::string dtype, bool use_gpu = true) {
   fusion_group::OperationMap::Init();
   fusion_group::CodeGenerator code_generator;
-  std::string code_str = code_generator.Generate(func_name, expressions);
+  std::string code_str =
+      use_gpu ? code_generator.Generate(func_name, expressions) : "";
   VLOG(3) << code_str;
 
   LOG(INFO) << "dtype: " << dtype;
   TestElementwiseMain(func_name, code_str, expressions, input_ids, output_ids,
-                      dtype);
+                      dtype, use_gpu);
 }
 
 void TestMain(fusion_group::SubGraph* subgraph, std::vector<int> input_ids,
-              std::vector<int> output_ids, std::string dtype) {
+              std::vector<int> output_ids, std::string dtype,
+              bool use_gpu = true) {
   fusion_group::OperationMap::Init();
   fusion_group::CodeGenerator code_generator;
-  std::string code_str = code_generator.Generate(subgraph);
+  std::string code_str = use_gpu ? code_generator.Generate(subgraph) : "";
   VLOG(3) << code_str;
 
   // Need to check the accuracy according to expressions.
@@ -313,9 +403,10 @@ void TestMain(fusion_group::SubGraph* subgraph, std::vector<int> input_ids,
       code_generator.ConvertToExpressions(subgraph);
 
   TestElementwiseMain(subgraph->GetFuncName(), code_str, expressions, input_ids,
-                      output_ids, dtype);
+                      output_ids, dtype, use_gpu);
 }
 
+#if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
 TEST(code_generator, elementwise) {
   for (std::string dtype : {"float", "__half"}) {
     // t2 = t0 * t1
@@ -369,6 +460,8 @@ TEST(code_generator, elementwise_grad) {
   }
 }
 
+#endif
+
 std::unique_ptr<paddle::framework::ir::Graph> BuildGraph(bool backward,
                                                          std::string dtype) {
   // inputs                     operator            output
@@ -463,6 +556,7 @@ std::unordered_set<paddle::framework::ir::Node*> DistilGradNodes(
   return grad_nodes;
 }
 
+#if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
 TEST(code_generator, subgraph) {
   for (std::string dtype : {"float", "__half"}) {
     std::unique_ptr<paddle::framework::ir::Graph> graph =
@@ -501,3 +595,308 @@ TEST(code_generator, subgraph_grad) {
   }
 }
 #endif
+
+TEST(code_generator, cpu_elementwise) {
+  std::string dtype = "float";
+  // t2 = t0 * t1
+  // t4 = t2 + t3
+  // t6 = t4 - t5
+  // t7 = relu(t6)
+  // t8 = sigmoid(t7)
+  fusion_group::OperationExpression exp1("elementwise_mul", {0, 1}, {2}, dtype,
+                                         dtype);
+  fusion_group::OperationExpression exp2("elementwise_add", {2, 3}, {4}, dtype,
+                                         dtype);
+  fusion_group::OperationExpression exp3("elementwise_sub", {4, 5}, {6}, dtype,
+                                         dtype);
+  fusion_group::OperationExpression exp4("relu", {6}, {7}, dtype, dtype);
+  fusion_group::OperationExpression exp5("sigmoid", {7}, {8}, dtype, dtype);
+  std::vector<fusion_group::OperationExpression> expressions = {
+      exp1, exp2, exp3, exp4, exp5};
+
+  std::vector<int> input_ids = {0, 1, 3, 5};
+  std::vector<int> output_ids = {2, 4, 6, 7, 8};
+  TestMain("elementwise_kernel_0", expressions, input_ids, output_ids, dtype,
+           false);
+}
+
+TEST(code_generator, cpu_elementwise_grad) {
+  std::string dtype = "float";
+  // t2' = relu_grad(t2, t3, t3')
+  // t0', t1' = elementwise_mul_grad(t0, t1, t2, t2')
+  fusion_group::OperationExpression exp1("relu_grad", {-1, 3, 7}, {6}, dtype,
+                                         dtype);
+  fusion_group::OperationExpression exp2("elementwise_mul_grad", {0, 1, 2, 6},
+                                         {4, 5}, dtype, dtype);
+  std::vector<fusion_group::OperationExpression> expressions = {exp1, exp2};
+
+  std::vector<int> input_ids = {0, 1, 2, 3, 7};
+  std::vector<int> output_ids = {4, 5, 6};
+  TestMain("elementwise_grad_kernel_0", expressions, input_ids, output_ids,
+           dtype, false);
+}
+
+TEST(code_generator, cpu_operations) {
+  std::string dtype = "float";
+  // t3 = square(t0)
+  // t4 = sqrt(t3)
+  // t5 = sigmoid(t1)
+  // t6 = t4 / t5
+  // t7 = min(t6, t2)
+  // t8 = max(t7, t0)
+  // t9 = scale(t8)
+  // t10 = fill_constant()
+  // t11 = sum(t9, t10, t1)
+  // t12 = assign(t11)
+  paddle::framework::AttributeMap scale_attrs;
+  scale_attrs["scale"] = 2.0f;
+  scale_attrs["bias"] = 0.5f;
+  scale_attrs["bias_after_scale"] = false;
+  paddle::framework::AttributeMap fill_constant_attrs;
+  fill_constant_attrs["str_value"] = std::string("0.25");
+  std::vector<fusion_group::OperationExpression> expressions = {
+      fusion_group::OperationExpression("square", {0}, {3}, dtype, dtype),
+      fusion_group::OperationExpression("sqrt", {3}, {4}, dtype, dtype),
+      fusion_group::OperationExpression("sigmoid", {1}, {5}, dtype, dtype),
+      fusion_group::OperationExpression("elementwise_div", {4, 5}, {6}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("elementwise_min", {6, 2}, {7}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("elementwise_max", {7, 0}, {8}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("scale", {8}, {9}, dtype, dtype),
+      fusion_group::OperationExpression("fill_constant", {}, {10}, "", dtype),
+      fusion_group::OperationExpression("sum", {9, 10, 1}, {11}, dtype, dtype),
+      fusion_group::OperationExpression("assign", {11}, {12}, dtype, dtype)};
+  expressions[6].SetAttr(scale_attrs);
+  expressions[7].SetAttr(fill_constant_attrs);
+
+  std::vector<int> input_ids = {0, 1, 2};
+  std::vector<int> output_ids = {3, 4, 5, 6, 7, 8, 9, 10, 11, 12};
+  TestMain("operations_kernel_0", expressions, input_ids, output_ids, dtype,
+           false);
+}
+
+TEST(code_generator, cpu_operations_grad) {
+  std::string dtype = "float";
+  // t4 = sigmoid(t1), so that the divisor is not close to 0
+  // t5, t6 = elementwise_div_grad(t0, t4, t2, t3)
+  // t7, t8 = elementwise_min_grad(t0, t2, t3)
+  // t9, t10 = elementwise_max_grad(t0, t2, t3)
+  // t11, t12 = elementwise_sub_grad(t3)
+  // t13 = square_grad(t0, t3)
+  // t14 = sqrt_grad(t4, t3)
+  // t15 = tanh_grad(t2, t3)
+  // t16 = sigmoid_grad(t2, t3)
+  std::vector<fusion_group::OperationExpression> expressions = {
+      fusion_group::OperationExpression("sigmoid", {1}, {4}, dtype, dtype),
+      fusion_group::OperationExpression("elementwise_div_grad", {0, 4, 2, 3},
+                                        {5, 6}, dtype, dtype),
+      fusion_group::OperationExpression("elementwise_min_grad", {0, 2, -1, 3},
+                                        {7, 8}, dtype, dtype),
+      fusion_group::OperationExpression("elementwise_max_grad", {0, 2, -1, 3},
+                                        {9, 10}, dtype, dtype),
+      fusion_group::OperationExpression("elementwise_sub_grad",
+                                        {-1, -1, -1, 3}, {11, 12}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("square_grad", {0, -1, 3}, {13}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("sqrt_grad", {-1, 4, 3}, {14}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("tanh_grad", {-1, 2, 3}, {15}, dtype,
+                                        dtype),
+      fusion_group::OperationExpression("sigmoid_grad", {-1, 2, 3}, {16},
+                                        dtype, dtype)};
+
+  std::vector<int> input_ids = {0, 1, 2, 3};
+  std::vector<int> output_ids = {4,  5,  6,  7,  8,  9,  10,
+                                 11, 12, 13, 14, 15, 16};
+  TestMain("operations_grad_kernel_0", expressions, input_ids, output_ids,
+           dtype, false);
+}
+
+TEST(code_generator, cpu_unsupported) {
+  fusion_group::OperationMap::Init();
+  fusion_group::CPUCodeGenerator code_generator;
+  // float16 is not supported on CPU
+  fusion_group::OperationExpression half_relu("relu", {0}, {1}, "__half",
+                                              "__half");
+  EXPECT_EQ(code_generator.Generate("unsupported_kernel_0", {half_relu}),
+            nullptr);
+  // neither are the casts between data types
+  fusion_group::OperationExpression cast("cast", {0}, {1}, "float", "double");
+  EXPECT_EQ(code_generator.Generate("unsupported_kernel_1", {cast}), nullptr);
+  // the unused inputs of grad operations can not be read
+  fusion_group::OperationExpression mul_grad(
+      "elementwise_mul_grad", {-1, 1, 2, 3}, {4, 5}, "float", "float");
+  EXPECT_ANY_THROW(code_generator.Generate("unsupported_kernel_2", {mul_grad}));
+}
+
+TEST(code_generator, cpu_subgraph) {
+  std::unique_ptr<paddle::framework::ir::Graph> graph =
+      BuildGraph(false, "float");
+  fusion_group::SubGraph subgraph(0, "elementwise_kernel_1", true,
+                                  graph->Nodes());
+
+  std::vector<int> input_ids = {0, 1, 2, 3};
+  std::vector<int> output_ids = {4, 5, 6, 7, 8};
+  TestMain(&subgraph, input_ids, output_ids, "float", false);
+}
+
+TEST(code_generator, cpu_subgraph_grad) {
+  std::unique_ptr<paddle::framework::ir::Graph> graph =
+      BuildGraph(true, "float");
+  fusion_group::SubGraph subgraph(0, "elementwise_grad_kernel_1", true,
+                                  DistilGradNodes(graph));
+
+  std::vector<int> input_ids = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<int> output_ids = {10, 11, 12, 13, 14, 15, 16, 17};
+  TestMain(&subgraph, input_ids, output_ids, "float", false);
+}
+
+inline double GetCurrentUS() {
+  struct timeval time;
+  gettimeofday(&time, NULL);
+  return 1e+6 * time.tv_sec + time.tv_usec;
+}
+
+// Launches a kernel generated for the expressions, the arguments are ordered
+// the same as CodeGenerator::EmitParameters.
+void LaunchCPUKernel(
+    const paddle::platform::DeviceCode& device_code,
+    const std::vector<fusion_group::OperationExpression>& expressions,
+    std::vector<float*>* ptrs, size_t n) {
+  std::set<int> input_ids, output_ids, intermediate_ids;
+  for (auto& expression : expressions) {
+    for (auto id : expression.GetInputIds()) {
+      if (id >= 0) {
+        input_ids.insert(id);
+      }
+    }
+    for (auto id : expression.GetOutputIds()) {
+      output_ids.insert(id);
+    }
+    for (auto id : expression.GetIntermediateOutputIds()) {
+      intermediate_ids.insert(id);
+    }
+  }
+
+  std::vector<void*> args = {&n};
+  for (auto id : input_ids) {
+    if (output_ids.find(id) == output_ids.end()) {
+      args.push_back(&(*ptrs)[id]);
+    }
+  }
+  for (auto id : output_ids) {
+    if (intermediate_ids.find(id) == intermediate_ids.end()) {
+      args.push_back(&(*ptrs)[id]);
+    }
+  }
+  device_code.Launch(n, &args);
+}
+
+// Compares running the expressions as one fused kernel with running one kernel
+// per operation, which writes all the intermediate results to memory like the
+// program without fusion_group.
+void TestCPUFusionBenchmark(
+    std::string name,
+    std::vector<fusion_group::OperationExpression> expressions,
+    std::vector<int> input_ids, int output_id) {
+  fusion_group::OperationMap::Init();
+  fusion_group::CPUCodeGenerator code_generator;
+
+  std::vector<std::unique_ptr<paddle::platform::CPUDeviceCode>> unfused_codes;
+  for (size_t i = 0; i < expressions.size(); ++i) {
+    std::string func_name = name + "_" + std::to_string(i);
+    unfused_codes.push_back(
+        code_generator.Generate(func_name, {expressions[i]}));
+    ASSERT_NE(unfused_codes.back(), nullptr);
+    EXPECT_EQ(unfused_codes.back()->Compile(), true);
+  }
+
+  // Only the last output is written by the fused kernel.
+  std::vector<fusion_group::OperationExpression> fused_expressions;
+  for (auto& expression : expressions) {
+    std::vector<int> intermediate_ids;
+    for (auto id : expression.GetOutputIds()) {
+      if (id != output_id) {
+        intermediate_ids.push_back(id);
+      }
+    }
+    fused_expressions.emplace_back(
+        expression.GetOpType(), expression.GetInputIds(),
+        expression.GetOutputIds(), expression.GetRHSType(),
+        expression.GetLHSType(), intermediate_ids);
+    fused_expressions.back().SetAttr(expression.GetAttr());
+  }
+  auto fused_code =
+      code_generator.Generate(name + "_fused", fused_expressions);
+  ASSERT_NE(fused_code, nullptr);
+  EXPECT_EQ(fused_code->Compile(), true);
+
+  size_t n = 2048 * 512;
+  std::vector<std::vector<float>> vars(output_id + 2, std::vector<float>(n));
+  std::vector<float*> ptrs(vars.size());
+  for (size_t i = 0; i < vars.size(); ++i) {
+    ptrs[i] = vars[i].data();
+  }
+  std::mt19937 rng(100);
+  std::uniform_real_distribution<float> uniform_dist(-1, 1);
+  for (auto id : input_ids) {
+    for (size_t i = 0; i < n; ++i) {
+      vars[id][i] = uniform_dist(rng);
+    }
+  }
+
+  const int repeat = 20;
+  auto st = GetCurrentUS();
+  for (int i = 0; i < repeat; ++i) {
+    for (size_t j = 0; j < expressions.size(); ++j) {
+      LaunchCPUKernel(*unfused_codes[j], {expressions[j]}, &ptrs, n);
+    }
+  }
+  auto mt = GetCurrentUS();
+  // The fused kernel writes to the extra variable.
+  std::vector<float*> fused_ptrs = ptrs;
+  fused_ptrs[output_id] = ptrs.back();
+  for (int i = 0; i < repeat; ++i) {
+    LaunchCPUKernel(*fused_code, fused_expressions, &fused_ptrs, n);
+  }
+  auto et = GetCurrentUS();
+
+  LOG(INFO) << name << " with " << n << " elements: unfused takes "
+            << (mt - st) / repeat << " us, fused takes " << (et - mt) / repeat
+            << " us.";
+  for (size_t i = 0; i < n; ++i) {
+    EXPECT_NEAR(vars.back()[i], vars[output_id][i], 1e-5);
+  }
+}
+
+TEST(code_generator, cpu_benchmark) {
+  std::string dtype = "float";
+  // The tail of a MLP layer, the bias is expanded to the shape of fc's output.
+  // t2 = t0 + t1
+  // t3 = relu(t2)
+  fusion_group::OperationExpression add_bias("elementwise_add", {0, 1}, {2},
+                                             dtype, dtype);
+  fusion_group::OperationExpression relu("relu", {2}, {3}, dtype, dtype);
+  TestCPUFusionBenchmark("mlp_tail", {add_bias, relu}, {0, 1}, 3);
+
+  // The tail of the interaction of DLRM.
+  // t1 = scale(t0)
+  // t3 = t1 + t2
+  // t4 = sigmoid(t3)
+  // t6 = t4 * t5
+  fusion_group::OperationExpression scale("scale", {0}, {1}, dtype, dtype);
+  paddle::framework::AttributeMap attrs;
+  attrs["scale"] = 0.5f;
+  attrs["bias"] = 0.1f;
+  attrs["bias_after_scale"] = true;
+  scale.SetAttr(attrs);
+  fusion_group::OperationExpression add("elementwise_add", {1, 2}, {3}, dtype,
+                                        dtype);
+  fusion_group::OperationExpression sigmoid("sigmoid", {3}, {4}, dtype, dtype);
+  fusion_group::OperationExpression mul("elementwise_mul", {4, 5}, {6}, dtype,
+                                        dtype);
+  TestCPUFusionBenchmark("dlrm_tail", {scale, add, sigmoid, mul}, {0, 2, 5}, 6);
+}
@@ -0,0 +1,312 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/framework/ir/fusion_group/cpu_code_generator.h"
+
+#include <set>
+#include <unordered_map>
+
+#include "paddle/fluid/framework/ir/fusion_group/code_generator.h"
+
+namespace paddle {
+namespace framework {
+namespace ir {
+namespace fusion_group {
+
+using platform::CPUCodeBuilder;
+using platform::CPUCodeOp;
+using platform::CPUCodeOperand;
+
+template <typename T>
+static T GetAttrOrDefault(const AttributeMap& attrs, const std::string& name,
+                          T default_value) {
+  auto iter = attrs.find(name);
+  if (iter == attrs.end()) {
+    return default_value;
+  }
+  return BOOST_GET_CONST(T, iter->second);
+}
+
+static CPUCodeOperand Const(double value) {
+  return CPUCodeBuilder::Const(value);
+}
+
+// The values of the inputs of an operation, ordered like the input names in
+// OperationMap.
+class OperationInputs {
+ public:
+  OperationInputs(const std::string& op_type, const std::vector<int>& ids,
+                  const std::unordered_map<int, CPUCodeOperand>& values)
+      : op_type_(op_type), ids_(ids), values_(values) {}
+
+  size_t size() const { return ids_.size(); }
+
+  CPUCodeOperand operator[](size_t i) const {
+    PADDLE_ENFORCE_LT(i, ids_.size(),
+                      platform::errors::InvalidArgument(
+                          "Only %d inputs are provided, but need %d for "
+                          "operation < %s >.",
+                          ids_.size(), i + 1, op_type_));
+    PADDLE_ENFORCE_GE(ids_[i], 0,
+                      platform::errors::InvalidArgument(
+                          "Expected %d-th input id > 0 for operation < %s "
+                          ">. Received %d.",
+                          i, op_type_, ids_[i]));
+    auto iter = values_.find(ids_[i]);
+    PADDLE_ENFORCE_NE(iter, values_.end(),
+                      platform::errors::InvalidArgument(
+                          "The %d-th input (id %d) of operation < %s > is "
+                          "used before it is computed.",
+                          i, ids_[i], op_type_));
+    return iter->second;
+  }
+
+ private:
+  const std::string& op_type_;
+  const std::vector<int>& ids_;
+  const std::unordered_map<int, CPUCodeOperand>& values_;
+};
+
+// Emits the forward operations, which have the same definitions as the
+// expressions in OperationMap.
+static bool EmitForward(const std::string& op_type, const AttributeMap& attrs,
+                        const OperationInputs& in, CPUCodeBuilder* b,
+                        CPUCodeOperand* out) {
+  if (op_type == "relu") {
+    *out = b->Emit(CPUCodeOp::kSelect, b->Emit(CPUCodeOp::kGT, in[0], Const(0)),
+                   in[0], Const(0));
+  } else if (op_type == "sigmoid") {
+    // 1.0 / (1.0 + exp(-x))
+    CPUCodeOperand exp =
+        b->Emit(CPUCodeOp::kExp, b->Emit(CPUCodeOp::kNeg, in[0]));
+    *out = b->Emit(CPUCodeOp::kDiv, Const(1),
+                   b->Emit(CPUCodeOp::kAdd, Const(1), exp));
+  } else if (op_type == "tanh") {
+    // 2.0 / (1.0 + exp(-2.0 * x)) - 1.0
+    CPUCodeOperand exp =
+        b->Emit(CPUCodeOp::kExp, b->Emit(CPUCodeOp::kMul, Const(-2), in[0]));
+    CPUCodeOperand div = b->Emit(CPUCodeOp::kDiv, Const(2),
+                                 b->Emit(CPUCodeOp::kAdd, Const(1), exp));
+    *out = b->Emit(CPUCodeOp::kSub, div, Const(1));
+  } else if (op_type == "sqrt") {
+    *out = b->Emit(CPUCodeOp::kSqrt, in[0]);
+  } else if (op_type == "square") {
+    *out = b->Emit(CPUCodeOp::kMul, in[0], in[0]);
+  } else if (op_type == "assign" || op_type == "cast") {
+    *out = in[0];
+  } else if (op_type == "scale") {
+    CPUCodeOperand scale = Const(GetAttrOrDefault<float>(attrs, "scale", 1.0f));
+    CPUCodeOperand bias = Const(GetAttrOrDefault<float>(attrs, "bias", 0.0f));
+    if (GetAttrOrDefault<bool>(attrs, "bias_after_scale", true)) {
+      *out = b->Emit(CPUCodeOp::kAdd, b->Emit(CPUCodeOp::kMul, scale, in[0]),
+                     bias);
+    } else {
+      *out = b->Emit(CPUCodeOp::kMul, scale,
+                     b->Emit(CPUCodeOp::kAdd, in[0], bias));
+    }
+  } else if (op_type == "elementwise_add") {
+    *out = b->Emit(CPUCodeOp::kAdd, in[0], in[1]);
+  } else if (op_type == "elementwise_sub") {
+    *out = b->Emit(CPUCodeOp::kSub, in[0], in[1]);
+  } else if (op_type == "elementwise_mul") {
+    *out = b->Emit(CPUCodeOp::kMul, in[0], in[1]);
+  } else if (op_type == "elementwise_div") {
+    *out = b->Emit(CPUCodeOp::kDiv, in[0], in[1]);
+  } else if (op_type == "elementwise_min") {
+    *out = b->Emit(CPUCodeOp::kSelect, b->Emit(CPUCodeOp::kLT, in[0], in[1]),
+                   in[0], in[1]);
+  } else if (op_type == "elementwise_max") {
+    *out = b->Emit(CPUCodeOp::kSelect, b->Emit(CPUCodeOp::kGT, in[0], in[1]),
+                   in[0], in[1]);
+  } else if (op_type == "sum") {
+    *out = in[0];
+    for (size_t i = 1; i < in.size(); ++i) {
+      *out = b->Emit(CPUCodeOp::kAdd, *out, in[i]);
+    }
+  } else if (op_type == "fill_constant") {
+    std::string str_value =
+        GetAttrOrDefault<std::string>(attrs, "str_value", "");
+    *out = Const(str_value.empty()
+                     ? GetAttrOrDefault<float>(attrs, "value", 0.0f)
+                     : std::stod(str_value));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Emits the backward operations. The inputs of the unary operations are
+// x, out, dout, and the ones of the binary operations are x, y, out, dout.
+static bool EmitBackward(const std::string& op_type,
+                         const OperationInputs& in, CPUCodeBuilder* b,
+                         std::vector<CPUCodeOperand>* out) {
+  if (op_type == "relu_grad") {
+    out->push_back(b->Emit(CPUCodeOp::kSelect,
+                           b->Emit(CPUCodeOp::kGT, in[1], Const(0)), in[2],
+                           Const(0)));
+  } else if (op_type == "sigmoid_grad") {
+    // dout * out * (1 - out)
+    out->push_back(b->Emit(CPUCodeOp::kMul,
+                           b->Emit(CPUCodeOp::kMul, in[2], in[1]),
+                           b->Emit(CPUCodeOp::kSub, Const(1), in[1])));
+  } else if (op_type == "tanh_grad") {
+    // dout * (1 - out * out)
+    CPUCodeOperand square = b->Emit(CPUCodeOp::kMul, in[1], in[1]);
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[2],
+                           b->Emit(CPUCodeOp::kSub, Const(1), square)));
+  } else if (op_type == "sqrt_grad") {
+    // dout * 0.5 / out
+    out->push_back(b->Emit(CPUCodeOp::kDiv,
+                           b->Emit(CPUCodeOp::kMul, in[2], Const(0.5)),
+                           in[1]));
+  } else if (op_type == "square_grad") {
+    // dout * 2.0 * x
+    out->push_back(b->Emit(CPUCodeOp::kMul,
+                           b->Emit(CPUCodeOp::kMul, in[2], Const(2)), in[0]));
+  } else if (op_type == "elementwise_add_grad") {
+    out->push_back(in[3]);
+    out->push_back(in[3]);
+  } else if (op_type == "elementwise_sub_grad") {
+    out->push_back(in[3]);
+    out->push_back(b->Emit(CPUCodeOp::kNeg, in[3]));
+  } else if (op_type == "elementwise_mul_grad") {
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[3], in[1]));
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[3], in[0]));
+  } else if (op_type == "elementwise_div_grad") {
+    // dout / y, -dout * out / y
+    out->push_back(b->Emit(CPUCodeOp::kDiv, in[3], in[1]));
+    CPUCodeOperand neg = b->Emit(CPUCodeOp::kNeg, in[3]);
+    out->push_back(b->Emit(CPUCodeOp::kDiv,
+                           b->Emit(CPUCodeOp::kMul, neg, in[2]), in[1]));
+  } else if (op_type == "elementwise_min_grad") {
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[3],
+                           b->Emit(CPUCodeOp::kLT, in[0], in[1])));
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[3],
+                           b->Emit(CPUCodeOp::kGE, in[0], in[1])));
+  } else if (op_type == "elementwise_max_grad") {
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[3],
+                           b->Emit(CPUCodeOp::kGT, in[0], in[1])));
+    out->push_back(b->Emit(CPUCodeOp::kMul, in[3],
+                           b->Emit(CPUCodeOp::kLE, in[0], in[1])));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// All the values of a kernel on CPU should be float, or all double.
+static bool GetCPUDataType(const std::vector<OperationExpression>& expressions,
+                           bool* is_double) {
+  std::string dtype;
+  for (auto& expression : expressions) {
+    for (auto& type : {expression.GetRHSType(), expression.GetLHSType()}) {
+      if (type.empty()) {
+        // operations without inputs, like fill_constant
+        continue;
+      }
+      if (type != "float" && type != "double") {
+        return false;
+      }
+      if (!dtype.empty() && dtype != type) {
+        return false;
+      }
+      dtype = type;
+    }
+  }
+  *is_double = dtype == "double";
+  return true;
+}
+
+std::unique_ptr<platform::CPUDeviceCode> CPUCodeGenerator::Generate(
+    SubGraph* subgraph) {
+  std::vector<OperationExpression> expressions =
+      CodeGenerator().ConvertToExpressions(subgraph);
+  return Generate(subgraph->GetFuncName(), expressions);
+}
+
+std::unique_ptr<platform::CPUDeviceCode> CPUCodeGenerator::Generate(
+    std::string func_name,
+    const std::vector<OperationExpression>& expressions) {
+  bool is_double = false;
+  if (!GetCPUDataType(expressions, &is_double)) {
+    LOG(WARNING) << "Failed to generate < " << func_name
+                 << " > for CPU: all the values should be float, or all "
+                    "double.";
+    return nullptr;
+  }
+
+  std::set<int> input_ids, output_ids, intermediate_ids;
+  for (auto& expression : expressions) {
+    for (auto id : expression.GetInputIds()) {
+      if (id >= 0) {
+        input_ids.insert(id);
+      }
+    }
+    for (auto id : expression.GetOutputIds()) {
+      output_ids.insert(id);
+    }
+    for (auto id : expression.GetIntermediateOutputIds()) {
+      intermediate_ids.insert(id);
+    }
+  }
+
+  CPUCodeBuilder builder(is_double);
+  std::unordered_map<int, CPUCodeOperand> values;
+  for (auto id : input_ids) {
+    if (output_ids.find(id) == output_ids.end()) {
+      values[id] = builder.AddInput();
+    }
+  }
+
+  for (auto expression : expressions) {
+    std::string op_type = expression.GetOpType();
+    std::vector<int> ids = expression.GetInputIds();
+    OperationInputs in(op_type, ids, values);
+
+    std::vector<CPUCodeOperand> out;
+    CPUCodeOperand forward_out;
+    if (EmitForward(op_type, expression.GetAttr(), in, &builder,
+                    &forward_out)) {
+      out.push_back(forward_out);
+    } else if (!EmitBackward(op_type, in, &builder, &out)) {
+      LOG(WARNING) << "Failed to generate < " << func_name
+                   << " > for CPU: operation < " << op_type
+                   << " > is not supported.";
+      return nullptr;
+    }
+
+    std::vector<int> out_ids = expression.GetOutputIds();
+    PADDLE_ENFORCE_LE(
+        out_ids.size(), out.size(),
+        platform::errors::InvalidArgument(
+            "Operation < %s > has %d outputs, but only %d are defined.",
+            op_type, out_ids.size(), out.size()));
+    for (size_t i = 0; i < out_ids.size(); ++i) {
+      values[out_ids[i]] = out[i];
+    }
+  }
+
+  for (auto id : output_ids) {
+    if (intermediate_ids.find(id) == intermediate_ids.end()) {
+      builder.AddOutput(values[id]);
+    }
+  }
+  return std::unique_ptr<platform::CPUDeviceCode>(new platform::CPUDeviceCode(
+      platform::CPUPlace(), func_name, builder.Program()));
+}
+
+}  // namespace fusion_group
+}  // namespace ir
+}  // namespace framework
+}  // namespace paddle
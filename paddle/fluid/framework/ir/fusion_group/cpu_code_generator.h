@@ -0,0 +1,49 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/framework/ir/fusion_group/code_generator_helper.h"
+#include "paddle/fluid/framework/ir/fusion_group/subgraph.h"
+#include "paddle/fluid/platform/cpu_device_code.h"
+
+namespace paddle {
+namespace framework {
+namespace ir {
+namespace fusion_group {
+
+class SubGraph;
+
+// Generates the platform::CPUDeviceCode of elementwise expressions. The
+// instructions are emitted from the type and the attributes of every
+// operation, no source code is generated. The arguments of the kernel are
+// ordered like the parameters of the CUDA kernels of CodeGenerator.
+class CPUCodeGenerator {
+ public:
+  // Returns nullptr if an operation or a data type is not supported on CPU.
+  std::unique_ptr<platform::CPUDeviceCode> Generate(
+      std::string func_name,
+      const std::vector<OperationExpression>& expressions);
+
+  std::unique_ptr<platform::CPUDeviceCode> Generate(SubGraph* subgraph);
+};
+
+}  // namespace fusion_group
+}  // namespace ir
+}  // namespace framework
+}  // namespace paddle
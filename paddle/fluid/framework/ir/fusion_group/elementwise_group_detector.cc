@@ -60,9 +60,13 @@ static bool IsEqualAndNotEmpty(const std::vector<int64_t>& l,
 }
 
 bool GroupDetector::CheckPrecondition(const Node* n) {
+  bool is_first = true;
+  proto::VarType::Type data_type_0 = proto::VarType::BOOL;
   auto check_data_type = [&](const std::vector<Node*>& nodes) -> bool {
-    bool is_first = true;
-    proto::VarType::Type data_type_0 = proto::VarType::BOOL;
+    // On CPU, the inputs and outputs should have the same data type.
+    if (use_gpu_) {
+      is_first = true;
+    }
     for (auto* n : nodes) {
       if (n && n->IsVar() && n->Var()) {
         if (n->Var()->GetType() != proto::VarType::LOD_TENSOR) {
@@ -72,7 +76,7 @@ bool GroupDetector::CheckPrecondition(const Node* n) {
         proto::VarType::Type data_type_i = n->Var()->GetDataType();
         if (data_type_i == proto::VarType::FP32 ||
             data_type_i == proto::VarType::FP64 ||
-            data_type_i == proto::VarType::FP16) {
+            (use_gpu_ && data_type_i == proto::VarType::FP16)) {
           if (is_first) {
             data_type_0 = data_type_i;
             is_first = false;
@@ -103,7 +107,9 @@ bool GroupDetector::CheckPrecondition(const Node* n) {
     return false;
   };
 
-  return n && n->IsOp() && n->Op() && !check_running_on_cpu(n) &&
+  // Operators forced to run on CPU are only excluded from the kernels for GPU.
+  return n && n->IsOp() && n->Op() &&
+         !(use_gpu_ && check_running_on_cpu(n)) &&
          check_data_type(n->inputs) && check_data_type(n->outputs);
 }
 
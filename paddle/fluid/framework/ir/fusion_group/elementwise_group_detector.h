@@ -35,10 +35,15 @@ namespace fusion_group {
 class GroupDetector {
  protected:
   bool CheckPrecondition(const Node* n);
+
+  // The kernels for CPU do not support float16 and type casting.
+  bool use_gpu_{true};
 };
 
 class ElementwiseGroupDetector : GroupDetector {
  public:
+  explicit ElementwiseGroupDetector(bool use_gpu = true) { use_gpu_ = use_gpu; }
+
   std::vector<std::vector<Node*>> operator()(Graph* graph);
 
  private:
@@ -14,6 +14,7 @@ limitations under the License. */
 
 #include "paddle/fluid/framework/ir/fusion_group/fusion_group_pass.h"
 #include "paddle/fluid/framework/ir/fusion_group/code_generator.h"
+#include "paddle/fluid/framework/ir/fusion_group/cpu_code_generator.h"
 #include "paddle/fluid/framework/ir/fusion_group/elementwise_group_detector.h"
 #include "paddle/fluid/framework/ir/graph_pattern_detector.h"
 #include "paddle/fluid/framework/ir/pass_tester_helper.h"
@@ -31,32 +32,38 @@ namespace ir {
 
 class Node;
 
+static platform::Place GetFusionGroupPlace(bool use_gpu) {
+  // TODO(liuyiqun): supported different places
+  if (use_gpu) {
+    return platform::CUDAPlace(0);
+  }
+  return platform::CPUPlace();
+}
+
 void FusionGroupPass::ApplyImpl(ir::Graph* graph) const {
   FusePassBase::Init("fusion_group_pass", graph);
-  if (Get<bool>("use_gpu")) {
-    // TODO(liuyiqun): open this check.
-    // if (!platform::CUDADeviceCode::IsAvailable()) {
-    //   LOG(WARNING)
-    //       << "Disable fusion_group because CUDA Driver or NVRTC is not
-    //       avaiable.";
-    //   return 0;
-    // }
-
-    fusion_group::OperationMap::Init();
-    int num_elementwise_groups = DetectFusionGroup(graph, 0);
-    AddStatis(num_elementwise_groups);
-    LOG(INFO) << "Detect " << num_elementwise_groups
-              << " elementwise fusion groups.";
-  }
+  // TODO(liuyiqun): open this check.
+  // if (!platform::CUDADeviceCode::IsAvailable()) {
+  //   LOG(WARNING)
+  //       << "Disable fusion_group because CUDA Driver or NVRTC is not
+  //       avaiable.";
+  //   return 0;
+  // }
+
+  fusion_group::OperationMap::Init();
+  int num_elementwise_groups = DetectFusionGroup(graph, 0);
+  AddStatis(num_elementwise_groups);
+  LOG(INFO) << "Detect " << num_elementwise_groups
+            << " elementwise fusion groups.";
 }
 
 int FusionGroupPass::DetectFusionGroup(Graph* graph, int type) const {
-  // TODO(liuyiqun): supported different places
-  platform::CUDAPlace place = platform::CUDAPlace(0);
+  bool use_gpu = Get<bool>("use_gpu");
+  platform::Place place = GetFusionGroupPlace(use_gpu);
   int index = platform::DeviceCodePool::Init({place}).size(place);
 
   std::vector<std::vector<Node*>> subgraphs =
-      fusion_group::ElementwiseGroupDetector()(graph);
+      fusion_group::ElementwiseGroupDetector(use_gpu)(graph);
 
   int num_subgraphs = 0;
   size_t min_subgraph_size = 2;
@@ -79,14 +86,28 @@ int FusionGroupPass::DetectFusionGroup(Graph* graph, int type) const {
 }
 
 bool FusionGroupPass::GenerateCode(fusion_group::SubGraph* subgraph) const {
-  fusion_group::CodeGenerator code_generator;
-  std::string code_str = code_generator.Generate(subgraph);
-  VLOG(4) << code_str;
-
-  // TODO(liuyiqun): supported different places
-  platform::CUDAPlace place = platform::CUDAPlace(0);
-  std::unique_ptr<platform::CUDADeviceCode> device_code(
-      new platform::CUDADeviceCode(place, subgraph->GetFuncName(), code_str));
+  bool use_gpu = Get<bool>("use_gpu");
+  platform::Place place = GetFusionGroupPlace(use_gpu);
+  std::unique_ptr<platform::DeviceCode> device_code;
+  if (use_gpu) {
+#if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
+    fusion_group::CodeGenerator code_generator;
+    std::string code_str = code_generator.Generate(subgraph);
+    VLOG(4) << code_str;
+
+    device_code.reset(new platform::CUDADeviceCode(
+        place, subgraph->GetFuncName(), code_str));
+#else
+    PADDLE_THROW(platform::errors::PreconditionNotMet(
+        "fusion_group_pass for GPU is not supported, please re-compile with "
+        "WITH_GPU=ON or WITH_ROCM=ON."));
+#endif
+  } else {
+    device_code = fusion_group::CPUCodeGenerator().Generate(subgraph);
+    if (device_code == nullptr) {
+      return false;
+    }
+  }
   bool is_compiled = device_code->Compile();
   if (is_compiled) {
     platform::DeviceCodePool& pool = platform::DeviceCodePool::Init({place});
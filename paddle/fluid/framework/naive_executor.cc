@@ -13,9 +13,18 @@
 // limitations under the License.
 
 #include "paddle/fluid/framework/naive_executor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>  // NOLINT
+#include <condition_variable>  // NOLINT
+#include <mutex>  // NOLINT
 #include <string>
+#include <thread>  // NOLINT
+#include <unordered_map>
+#include "paddle/fluid/framework/details/exception_holder.h"
 #include "paddle/fluid/framework/op_registry.h"
 #include "paddle/fluid/framework/variable_helper.h"
+#include "paddle/fluid/operators/reader/blocking_queue.h"
 #include "paddle/fluid/platform/denormal.h"
 #ifdef PADDLE_WITH_MKLDNN
 #include "paddle/fluid/platform/mkldnn_helper.h"
@@ -26,6 +35,8 @@
 
 namespace paddle {
 namespace framework {
+NaiveExecutor::NaiveExecutor(const platform::Place &place) : place_(place) {}
+
 void NaiveExecutor::Prepare(Scope *scope, const ProgramDesc &program_desc,
                             int block_id, bool with_feed_fetch_ops) {
   if (!scope) {
@@ -35,7 +46,9 @@ void NaiveExecutor::Prepare(Scope *scope, const ProgramDesc &program_desc,
   }
 
   VLOG(3) << "NaiveExecutor init with scope " << scope;
+  pipeline_.reset();
   CreateOps(program_desc, block_id, with_feed_fetch_ops);
+  op_cost_runs_ = 0;
 }
 
 void NaiveExecutor::Run() {
@@ -52,6 +65,267 @@ void NaiveExecutor::Run() {
   }
 }
 
+// The stage threads of RunPipeline. They are kept while the split of the
+// stages does not change, and wait on their queues between the calls.
+//
+// An op with kEnableCacheRuntimeContext caches the RuntimeContext of the
+// scope it last ran in, and every micro batch runs in its own scope. So such
+// ops get an instance per micro batch scope, which keeps the context of its
+// scope from one call to the next.
+class NaiveExecutor::PipelineWorkers {
+ public:
+  PipelineWorkers(NaiveExecutor *executor, size_t queue_capacity)
+      : executor_(executor), queue_capacity_(queue_capacity) {
+    for (auto &op : executor_->ops_) {
+      caches_context_.push_back(
+          dynamic_cast<OperatorWithKernel *>(op.get()) != nullptr &&
+          op->HasAttr(kEnableCacheRuntimeContext));
+    }
+    size_t stage_num = executor_->stage_begins_.size();
+    cache_runs_.resize(stage_num, 0);
+    cache_hits_.resize(stage_num, 0);
+    for (size_t s = 0; s < stage_num; ++s) {
+      queues_.emplace_back(
+          new operators::reader::BlockingQueue<size_t>(queue_capacity));
+    }
+    for (size_t s = 0; s < stage_num; ++s) {
+      threads_.emplace_back(&PipelineWorkers::RunStage, this, s);
+    }
+  }
+
+  ~PipelineWorkers() {
+    for (auto &queue : queues_) {
+      queue->Close();
+    }
+    for (auto &thread : threads_) {
+      thread.join();
+    }
+  }
+
+  size_t queue_capacity() const { return queue_capacity_; }
+
+  PipelineCacheStats cache_stats() const {
+    PipelineCacheStats stats;
+    for (size_t s = 0; s < cache_runs_.size(); ++s) {
+      stats.runs += cache_runs_[s];
+      stats.hits += cache_hits_[s];
+    }
+    return stats;
+  }
+
+  // Runs micro_batch_scopes[begin:] through the stages and waits for them.
+  void Run(const std::vector<Scope *> &micro_batch_scopes, size_t begin) {
+    // the op instances of the scopes of earlier calls are dropped
+    std::unordered_map<const Scope *, ScopeOps> scope_ops;
+    for (size_t i = begin; i < micro_batch_scopes.size(); ++i) {
+      const Scope *scope = micro_batch_scopes[i];
+      if (scope_ops.count(scope) != 0) {
+        continue;
+      }
+      auto it = scope_ops_.find(scope);
+      scope_ops[scope] =
+          it != scope_ops_.end() ? std::move(it->second) : MakeScopeOps();
+    }
+    scope_ops_.swap(scope_ops);
+    micro_batch_scopes_ = &micro_batch_scopes;
+    exception_holder_.Clear();
+    failed_ = false;
+    done_ = false;
+    for (size_t i = begin; i < micro_batch_scopes.size(); ++i) {
+      queues_[0]->Send(i);
+    }
+    queues_[0]->Send(kEndOfRun);
+    {
+      std::unique_lock<std::mutex> lock(done_mutex_);
+      done_cv_.wait(lock, [this] { return done_; });
+    }
+    if (exception_holder_.IsCaught()) {
+      exception_holder_.ReThrow();
+    }
+  }
+
+ private:
+  // passed through all the stages after the micro batches of a run
+  static constexpr size_t kEndOfRun = static_cast<size_t>(-1);
+
+  // the ops to run in one micro batch scope, the ones of the executor but
+  // for an instance of each op that caches its RuntimeContext
+  struct ScopeOps {
+    std::vector<std::unique_ptr<OperatorBase>> instances;
+    std::vector<OperatorBase *> ops;
+  };
+
+  ScopeOps MakeScopeOps() const {
+    ScopeOps scope_ops;
+    auto &ops = executor_->ops_;
+    for (size_t i = 0; i < ops.size(); ++i) {
+      if (!caches_context_[i]) {
+        scope_ops.ops.push_back(ops[i].get());
+        continue;
+      }
+      scope_ops.instances.emplace_back(
+          OpRegistry::CreateOp(ops[i]->Type(), ops[i]->Inputs(),
+                               ops[i]->Outputs(), ops[i]->Attrs(), false));
+      scope_ops.ops.push_back(scope_ops.instances.back().get());
+    }
+    return scope_ops;
+  }
+
+  void RunStage(size_t stage) {
+#ifdef PADDLE_WITH_MKLDNN
+    platform::AttachPointerHashToMKLDNNKey(executor_, executor_->place_);
+#endif
+    platform::ScopedFlushDenormal flush;
+    auto &stage_begins = executor_->stage_begins_;
+    size_t begin = stage_begins[stage];
+    size_t end = stage + 1 < stage_begins.size() ? stage_begins[stage + 1]
+                                                 : executor_->ops_.size();
+    size_t micro_batch = 0;
+    while (queues_[stage]->Receive(&micro_batch)) {
+      // after a failure the rest of the run is passed on without running
+      if (micro_batch != kEndOfRun && !failed_.load()) {
+        try {
+          const Scope &scope = *(*micro_batch_scopes_)[micro_batch];
+          auto &scope_ops = scope_ops_.at(&scope).ops;
+          for (size_t i = begin; i < end; ++i) {
+            if (caches_context_[i]) {
+              ++cache_runs_[stage];
+              if (static_cast<OperatorWithKernel *>(scope_ops[i])
+                      ->HasCachedRuntimeContext(scope)) {
+                ++cache_hits_[stage];
+              }
+            }
+            scope_ops[i]->SetIsCalledByExecutor(false);
+            scope_ops[i]->Run(scope, executor_->place_);
+          }
+        } catch (...) {
+          exception_holder_.Catch(std::current_exception());
+          failed_ = true;
+        }
+      }
+      if (stage + 1 < queues_.size()) {
+        queues_[stage + 1]->Send(micro_batch);
+      } else if (micro_batch == kEndOfRun) {
+        std::lock_guard<std::mutex> lock(done_mutex_);
+        done_ = true;
+        done_cv_.notify_one();
+      }
+    }
+  }
+
+  NaiveExecutor *executor_;
+  size_t queue_capacity_;
+  // whether ops_[i] of the executor caches its RuntimeContext
+  std::vector<bool> caches_context_;
+  // set by Run for the micro batch scopes of the call
+  std::unordered_map<const Scope *, ScopeOps> scope_ops_;
+  // the runs of the ops of stage s that cache their RuntimeContext, and the
+  // ones that found it cached
+  std::vector<size_t> cache_runs_;
+  std::vector<size_t> cache_hits_;
+  // queues_[s] holds the micro batches that wait for stage s
+  std::vector<std::unique_ptr<operators::reader::BlockingQueue<size_t>>>
+      queues_;
+  std::vector<std::thread> threads_;
+  // set by Run before the micro batches are sent to the stages
+  const std::vector<Scope *> *micro_batch_scopes_{nullptr};
+  std::atomic<bool> failed_{false};
+  details::ExceptionHolder exception_holder_;
+  std::mutex done_mutex_;
+  std::condition_variable done_cv_;
+  bool done_{false};
+};
+
+constexpr size_t NaiveExecutor::PipelineWorkers::kEndOfRun;
+
+void NaiveExecutor::RunPipeline(const std::vector<Scope *> &micro_batch_scopes,
+                                size_t num_stages, size_t queue_capacity) {
+  PADDLE_ENFORCE_GT(num_stages, static_cast<size_t>(0),
+                    platform::errors::InvalidArgument(
+                        "The pipeline needs at least one stage."));
+  if (micro_batch_scopes.empty() || ops_.empty()) {
+    return;
+  }
+#ifdef PADDLE_WITH_MKLDNN
+  platform::AttachPointerHashToMKLDNNKey(this, place_);
+  platform::RegisterModelLayout(ops_, place_);
+#endif
+  platform::ScopedFlushDenormal flush;
+
+  // the first micro batch that runs op by op warms the ops up, and the ops
+  // are timed on the second one
+  size_t first_pipelined = 0;
+  while (op_cost_runs_ < 2 && first_pipelined < micro_batch_scopes.size()) {
+    op_costs_.resize(ops_.size());
+    for (size_t i = 0; i < ops_.size(); ++i) {
+      auto start = std::chrono::steady_clock::now();
+      ops_[i]->SetIsCalledByExecutor(false);
+      ops_[i]->Run(*micro_batch_scopes[first_pipelined], place_);
+      op_costs_[i] = std::chrono::duration<double, std::micro>(
+                         std::chrono::steady_clock::now() - start)
+                         .count();
+    }
+    ++op_cost_runs_;
+    ++first_pipelined;
+    num_stages_ = 0;
+  }
+  if (first_pipelined == micro_batch_scopes.size()) {
+    return;
+  }
+  if (num_stages_ != num_stages) {
+    pipeline_.reset();
+    stage_begins_ = SplitStagesByCost(op_costs_, num_stages);
+    num_stages_ = num_stages;
+    VLOG(3) << "naive executor pipeline of " << stage_begins_.size()
+            << " stages for " << ops_.size() << " ops";
+  }
+  if (pipeline_ == nullptr || pipeline_->queue_capacity() != queue_capacity) {
+    pipeline_.reset();
+    pipeline_.reset(new PipelineWorkers(this, queue_capacity));
+  }
+  pipeline_->Run(micro_batch_scopes, first_pipelined);
+}
+
+NaiveExecutor::PipelineCacheStats NaiveExecutor::GetPipelineCacheStats()
+    const {
+  return pipeline_ == nullptr ? PipelineCacheStats() : pipeline_->cache_stats();
+}
+
+std::vector<size_t> NaiveExecutor::SplitStagesByCost(
+    const std::vector<double> &op_costs, size_t num_stages) {
+  // the stages of a greedy split that closes a stage before it exceeds limit
+  auto Split = [&op_costs](double limit) {
+    std::vector<size_t> begins = {0};
+    double stage_cost = 0;
+    for (size_t i = 0; i < op_costs.size(); ++i) {
+      if (stage_cost + op_costs[i] > limit && i > begins.back()) {
+        begins.push_back(i);
+        stage_cost = 0;
+      }
+      stage_cost += op_costs[i];
+    }
+    return begins;
+  };
+  if (op_costs.empty()) {
+    return {0};
+  }
+  // binary search for the smallest limit that needs at most num_stages
+  double low = *std::max_element(op_costs.begin(), op_costs.end());
+  double high = 0;
+  for (auto cost : op_costs) {
+    high += cost;
+  }
+  for (int iter = 0; iter < 64 && low < high; ++iter) {
+    double mid = low + (high - low) / 2;
+    if (Split(mid).size() <= num_stages) {
+      high = mid;
+    } else {
+      low = mid;
+    }
+  }
+  return Split(high);
+}
+
 void NaiveExecutor::CreateVariables(const ProgramDesc &desc, int block_id,
                                     bool persistable, Scope *scope) {
   PADDLE_ENFORCE_NOT_NULL(scope,
@@ -125,10 +399,13 @@ void NaiveExecutor::CleanFeedFetchOps() {
       ops.emplace_back(std::move(op));
     }
   }
+  pipeline_.reset();
   ops_.swap(ops);
+  op_cost_runs_ = 0;
 }
 
 NaiveExecutor::~NaiveExecutor() {
+  pipeline_.reset();
 #ifdef PADDLE_WITH_MKLDNN
   // Clear mkl-dnn cache,
   // this is needed to have mkl-dnn unit tests working
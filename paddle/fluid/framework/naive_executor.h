@@ -40,7 +40,7 @@ class Scope;
 
 class NaiveExecutor {
  public:
-  explicit NaiveExecutor(const platform::Place& place) : place_(place) {}
+  explicit NaiveExecutor(const platform::Place& place);
 
   ~NaiveExecutor();
 
@@ -59,6 +59,35 @@ class NaiveExecutor {
   // Run all the operators.
   void Run();
 
+  // Pipelined mode for many micro batches. micro_batch_scopes are child
+  // scopes of scope() that hold the feed and the non-persistable variables
+  // of one micro batch each, see CreateVariables. The ops are split into
+  // num_stages stages of about the same cost. The first two micro batches
+  // the executor runs go op by op, the first one warms the ops up and the
+  // second one times them. Every stage runs its ops in its own thread, on one
+  // micro batch after the other, and passes them on over a queue of at most
+  // queue_capacity micro batches. The threads are kept for the next calls
+  // while the stages and queue_capacity stay the same. The ops that cache
+  // their RuntimeContext (kEnableCacheRuntimeContext) get an instance per
+  // micro batch scope, so that the cache holds across the calls with the
+  // same scopes.
+  void RunPipeline(const std::vector<Scope*>& micro_batch_scopes,
+                   size_t num_stages, size_t queue_capacity = 1);
+
+  // The runs of the ops that cache their RuntimeContext in the stages of
+  // RunPipeline, since the stages were last split, and how many of them
+  // reused the cached context.
+  struct PipelineCacheStats {
+    size_t runs{0};
+    size_t hits{0};
+  };
+  PipelineCacheStats GetPipelineCacheStats() const;
+
+  // Returns the first op of every stage for the ops of op_costs, split into
+  // at most num_stages contiguous stages with the smallest maximum cost.
+  static std::vector<size_t> SplitStagesByCost(
+      const std::vector<double>& op_costs, size_t num_stages);
+
   // Get an tensor to operating directly, without the need for feed_ops.
   LoDTensor* FindTensor(const std::string& name);
 
@@ -77,6 +106,14 @@ class NaiveExecutor {
   // Catch the required resource to avoid recreate.
   std::vector<std::unique_ptr<OperatorBase>> ops_;
   Scope* scope_;
+  // the pipeline of RunPipeline, op_costs_ is in us and is measured in the
+  // second run op by op
+  class PipelineWorkers;
+  std::vector<double> op_costs_;
+  int op_cost_runs_{0};
+  size_t num_stages_{0};
+  std::vector<size_t> stage_begins_;
+  std::unique_ptr<PipelineWorkers> pipeline_;
 };
 
 }  // namespace framework
@@ -15,8 +15,12 @@
 #include "paddle/fluid/framework/naive_executor.h"
 #include <gtest/gtest.h>
 #include <algorithm>
+#include <chrono>  // NOLINT
+#include <string>
+#include <vector>
 #include "paddle/fluid/framework/op_registry.h"
 #include "paddle/fluid/framework/program_desc.h"
+#include "paddle/phi/core/kernel_registry.h"
 
 namespace paddle {
 namespace framework {
@@ -40,6 +44,7 @@ TEST(NaiveExecutor, Basic) {
   auto place = platform::CPUPlace();
   NaiveExecutor exe(place);
   exe.Prepare(nullptr, program, 0, false);
+  exe.CreateVariables(program, 0, false, exe.scope());
   auto* a_tensor = exe.FindTensor("a");
   auto* b_tensor = exe.FindTensor("b");
   auto* c_tensor = exe.FindTensor("c");
@@ -64,7 +69,172 @@ TEST(NaiveExecutor, Basic) {
   }
 }
 
+// a long chain of small ops, which cache their RuntimeContext when
+// cache_runtime_context, as runtime_context_cache_pass makes them do
+static ProgramDesc BuildSmallOpsProgram(int layers,
+                                        bool cache_runtime_context = false) {
+  ProgramDesc program;
+  auto* block = program.MutableBlock(0);
+  block->Var("x")->SetType(proto::VarType::LOD_TENSOR);
+  block->Var("bias")->SetType(proto::VarType::LOD_TENSOR);
+  std::string x = "x";
+  for (int i = 0; i < layers; ++i) {
+    std::string sum = "sum_" + std::to_string(i);
+    std::string out = "relu_" + std::to_string(i);
+    block->Var(sum)->SetType(proto::VarType::LOD_TENSOR);
+    block->Var(out)->SetType(proto::VarType::LOD_TENSOR);
+
+    auto* add = block->AppendOp();
+    add->SetType("elementwise_add");
+    add->SetInput("X", {x});
+    add->SetInput("Y", {"bias"});
+    add->SetOutput("Out", {sum});
+    add->SetAttr("axis", -1);
+
+    auto* relu = block->AppendOp();
+    relu->SetType("relu");
+    relu->SetInput("X", {sum});
+    relu->SetOutput("Out", {out});
+    if (cache_runtime_context) {
+      add->SetAttr(kEnableCacheRuntimeContext, true);
+      relu->SetAttr(kEnableCacheRuntimeContext, true);
+    }
+    x = out;
+  }
+  return program;
+}
+
+TEST(NaiveExecutor, SplitStagesByCost) {
+  EXPECT_EQ(NaiveExecutor::SplitStagesByCost({1, 1, 1, 1, 4}, 2),
+            (std::vector<size_t>{0, 4}));
+  EXPECT_EQ(NaiveExecutor::SplitStagesByCost({3, 1, 1, 1, 3}, 3),
+            (std::vector<size_t>{0, 1, 4}));
+  EXPECT_EQ(NaiveExecutor::SplitStagesByCost({1, 2}, 5),
+            (std::vector<size_t>{0, 1}));
+  EXPECT_EQ(NaiveExecutor::SplitStagesByCost({1, 2, 3}, 1),
+            (std::vector<size_t>{0}));
+}
+
+// runs micro batch i with x = i, which gives i + 0.5 * layers
+static double RunSmallOpsPipeline(
+    const ProgramDesc& program, int layers, size_t num_stages,
+    int micro_batches, int steps,
+    NaiveExecutor::PipelineCacheStats* cache_stats = nullptr) {
+  auto place = platform::CPUPlace();
+  Scope scope;
+  NaiveExecutor exe(place);
+  exe.Prepare(&scope.NewScope(), program, 0, false);
+  std::vector<Scope*> micro_batch_scopes;
+  for (int i = 0; i < micro_batches; ++i) {
+    auto* micro_batch_scope = &exe.scope()->NewScope();
+    exe.CreateVariables(program, 0, false, micro_batch_scope);
+    for (auto name : {"x", "bias"}) {
+      auto* tensor =
+          micro_batch_scope->FindVar(name)->GetMutable<framework::LoDTensor>();
+      tensor->Resize({2, 2});
+      float value = name[0] == 'x' ? i : 0.5f;
+      std::fill_n(tensor->mutable_data<float>(place), 4, value);
+    }
+    micro_batch_scopes.push_back(micro_batch_scope);
+  }
+
+  // the first run warms the ops up on the first micro batch and times them
+  // on the second one
+  exe.RunPipeline(micro_batch_scopes, num_stages, 2);
+  auto start = std::chrono::steady_clock::now();
+  for (int step = 0; step < steps; ++step) {
+    exe.RunPipeline(micro_batch_scopes, num_stages, 2);
+  }
+  double step_us = std::chrono::duration<double, std::micro>(
+                       std::chrono::steady_clock::now() - start)
+                       .count() /
+                   steps;
+
+  std::string out = "relu_" + std::to_string(layers - 1);
+  for (int i = 0; i < micro_batches; ++i) {
+    auto& tensor = micro_batch_scopes[i]->FindVar(out)->Get<LoDTensor>();
+    for (int j = 0; j < 4; ++j) {
+      EXPECT_EQ(tensor.data<float>()[j], i + 0.5f * layers);
+    }
+  }
+  if (cache_stats != nullptr) {
+    *cache_stats = exe.GetPipelineCacheStats();
+  }
+  return step_us;
+}
+
+TEST(NaiveExecutor, RunPipeline) {
+  const int layers = 100;
+  const int micro_batches = 16;
+  const int steps = 20;
+  auto program = BuildSmallOpsProgram(layers);
+  double one_stage_us =
+      RunSmallOpsPipeline(program, layers, 1, micro_batches, steps);
+  double four_stages_us =
+      RunSmallOpsPipeline(program, layers, 4, micro_batches, steps);
+  LOG(INFO) << micro_batches << " micro batches of " << 2 * layers
+            << " ops, step time with 1 stage: " << one_stage_us
+            << " us, with 4 stages: " << four_stages_us << " us";
+
+  // the ops build the RuntimeContext of every micro batch scope once
+  auto cached_program = BuildSmallOpsProgram(layers, true);
+  NaiveExecutor::PipelineCacheStats cache_stats;
+  double cached_us = RunSmallOpsPipeline(cached_program, layers, 4,
+                                         micro_batches, steps, &cache_stats);
+  // the first call pipelines all but the two micro batches that run op by
+  // op, the others all of them
+  EXPECT_EQ(cache_stats.runs,
+            static_cast<size_t>(2 * layers *
+                                (micro_batches - 2 + steps * micro_batches)));
+  EXPECT_EQ(cache_stats.runs - cache_stats.hits,
+            static_cast<size_t>(2 * layers * micro_batches));
+  LOG(INFO) << "step time with 4 stages and cached runtime contexts: "
+            << cached_us << " us, cache hit rate: "
+            << static_cast<double>(cache_stats.hits) / cache_stats.runs;
+}
+
+TEST(NaiveExecutor, RunPipelineRethrows) {
+  const int layers = 4;
+  auto program = BuildSmallOpsProgram(layers);
+  auto place = platform::CPUPlace();
+  Scope scope;
+  NaiveExecutor exe(place);
+  exe.Prepare(&scope.NewScope(), program, 0, false);
+  std::vector<Scope*> micro_batch_scopes;
+  auto Fill = [&place](Scope* micro_batch_scope, const std::string& name,
+                       float value) {
+    auto* tensor =
+        micro_batch_scope->FindVar(name)->GetMutable<framework::LoDTensor>();
+    tensor->Resize({2, 2});
+    std::fill_n(tensor->mutable_data<float>(place), 4, value);
+  };
+  for (int i = 0; i < 4; ++i) {
+    auto* micro_batch_scope = &exe.scope()->NewScope();
+    exe.CreateVariables(program, 0, false, micro_batch_scope);
+    Fill(micro_batch_scope, "bias", 0.5f);
+    // x of the micro batch 2, which runs in the pipeline, is not initialized
+    if (i != 2) {
+      Fill(micro_batch_scope, "x", i);
+    }
+    micro_batch_scopes.push_back(micro_batch_scope);
+  }
+  EXPECT_ANY_THROW(exe.RunPipeline(micro_batch_scopes, 2));
+
+  // the stage threads are kept and run the next call
+  Fill(micro_batch_scopes[2], "x", 2);
+  exe.RunPipeline(micro_batch_scopes, 2);
+  std::string out = "relu_" + std::to_string(layers - 1);
+  for (int i = 0; i < 4; ++i) {
+    auto& tensor = micro_batch_scopes[i]->FindVar(out)->Get<LoDTensor>();
+    EXPECT_EQ(tensor.data<float>()[0], i + 0.5f * layers);
+  }
+}
+
 }  // namespace framework
 }  // namespace paddle
 
 USE_OP_ITSELF(elementwise_add);
+USE_OP_ITSELF(relu);
+
+PD_DECLARE_KERNEL(add, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(relu, CPU, ALL_LAYOUT);
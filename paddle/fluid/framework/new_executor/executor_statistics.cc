@@ -19,9 +19,11 @@
 #include <ostream>
 #include <queue>
 #include <set>
+#include <sstream>
 #include <unordered_map>
 #include <vector>
 #include "glog/logging.h"
+#include "paddle/fluid/framework/new_executor/workqueue/workqueue_utils.h"
 #include "paddle/fluid/platform/flags.h"
 #include "paddle/fluid/platform/os_info.h"
 #include "paddle/fluid/platform/profiler/utils.h"
@@ -622,6 +624,27 @@ void StaticGraphExecutorPerfStatistics(
   if (engine.Apply(*profiling_data) == 0) {
     engine.Log(FLAGS_static_executor_perfstat_filepath);
   }
+  LOG(INFO) << "workqueue threads:\n" << WorkQueueThreadStatistics();
+}
+
+std::string WorkQueueThreadStatistics() {
+  auto thread_names = platform::GetAllThreadNames();
+  // sorted by name so that the threads of one queue are listed together
+  std::map<std::string, WorkQueueThreadStats> stats;
+  for (auto& kv : GetAllWorkQueueThreadStats()) {
+    auto iter = thread_names.find(kv.first);
+    stats.emplace(iter == thread_names.end() ? std::to_string(kv.first)
+                                             : iter->second,
+                  kv.second);
+  }
+  std::ostringstream ss;
+  for (auto& kv : stats) {
+    ss << kv.first << " tasks: " << kv.second.tasks
+       << " affinity_hits: " << kv.second.affinity_hits
+       << " steals: " << kv.second.steals << " spins: " << kv.second.spins
+       << " parks: " << kv.second.parks << "\n";
+  }
+  return ss.str();
 }
 
 }  // namespace framework
@@ -15,6 +15,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 #include "paddle/fluid/platform/profiler/event_node.h"
 
 namespace paddle {
@@ -23,5 +24,9 @@ namespace framework {
 void StaticGraphExecutorPerfStatistics(
     std::shared_ptr<const platform::NodeTrees> profiling_data);
 
+// Scheduling counters (tasks, affinity hits, steals, spins and parks) of the
+// live workqueue threads, one line per thread.
+std::string WorkQueueThreadStatistics();
+
 }  // namespace framework
 }  // namespace paddle
@@ -13,6 +13,10 @@
 // limitations under the License.
 
 #include "paddle/fluid/framework/new_executor/interpretercore.h"
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <list>
+#include <sstream>
 #include <unordered_set>
 #include "paddle/fluid/framework/details/nan_inf_utils.h"
 #include "paddle/fluid/framework/details/share_tensor_buffer_functor.h"
@@ -20,6 +24,8 @@
 #include "paddle/fluid/framework/new_executor/garbage_collector/fast_garbage_collector.h"
 #include "paddle/fluid/framework/new_executor/interpretercore_util.h"
 #include "paddle/fluid/framework/operator.h"
+#include "paddle/fluid/memory/allocation/allocation_tracer.h"
+#include "paddle/fluid/memory/stats.h"
 #include "paddle/fluid/platform/os_info.h"
 #include "paddle/fluid/platform/profiler/event_tracing.h"
 #include "paddle/phi/core/kernel_context.h"
@@ -32,6 +38,20 @@ PADDLE_DEFINE_EXPORTED_bool(new_executor_use_inplace, true,
 PADDLE_DEFINE_EXPORTED_bool(new_executor_use_local_scope, true,
                             "Use local_scope in new executor(especially used "
                             "in UT), can turn off for better performance");
+PADDLE_DEFINE_EXPORTED_bool(new_executor_use_critical_path_schedule, true,
+                            "Dispatch the ready ops of new executor by the "
+                            "cost of their longest path to the end of the "
+                            "program, with op costs timed in the first run");
+PADDLE_DEFINE_EXPORTED_string(new_executor_plan_cache_dir, "",
+                              "Directory where new executor saves the "
+                              "dependence, inplace and gc analysis of a "
+                              "program and loads it from when the same "
+                              "program is built again. Empty to disable.");
+PADDLE_DEFINE_EXPORTED_bool(new_executor_use_static_memory_plan, false,
+                            "Place the intermediate vars of new executor in "
+                            "one arena planned from the var sizes of the "
+                            "first run instead of freeing them by gc, for "
+                            "programs with fixed shapes");
 
 DECLARE_bool(check_nan_inf);
 DECLARE_bool(benchmark);
@@ -52,6 +72,16 @@ bool IsInterpretercoreFastGCEnabled() {
          FLAGS_fast_eager_deletion_mode;
 }
 
+static int64_t AllocatedMemoryStat(const platform::Place& place, bool peak) {
+  if (platform::is_cpu_place(place)) {
+    return peak ? HOST_MEMORY_STAT_PEAK_VALUE(Allocated, 0)
+                : HOST_MEMORY_STAT_CURRENT_VALUE(Allocated, 0);
+  }
+  int dev_id = place.GetDeviceId();
+  return peak ? DEVICE_MEMORY_STAT_PEAK_VALUE(Allocated, dev_id)
+              : DEVICE_MEMORY_STAT_CURRENT_VALUE(Allocated, dev_id);
+}
+
 InterpreterCore::InterpreterCore(const platform::Place& place,
                                  const BlockDesc& block,
                                  VariableScope* global_scope)
@@ -200,13 +230,22 @@ void InterpreterCore::ClearLoDTensorArrayInLocalScope() {
   }
 }
 
-void InterpreterCore::BuildOperatorDependences() {
+void InterpreterCore::BuildOperatorDependences(
+    const interpreter::InterpreterPlan* plan) {
   // analysis the dependences between ops, set the dependecy_count_ and Call
   // Schedule
   auto op_nums = vec_instruction_.size();
   dependecy_count_.resize(op_nums);
-  auto op2downstream = interpreter::build_op_downstream_map(
-      vec_instruction_, &op_happens_before_);
+  std::map<int, std::list<int>> op2downstream;
+  if (plan != nullptr) {
+    for (size_t op = 0; op < op_nums; ++op) {
+      auto& downstream = plan->instructions[op].downstream;
+      op2downstream[op].assign(downstream.begin(), downstream.end());
+    }
+  } else {
+    op2downstream = interpreter::build_op_downstream_map(vec_instruction_,
+                                                         &op_happens_before_);
+  }
   for (size_t op = 0; op < vec_instruction_.size(); ++op) {
     auto op_list = op2downstream[op];
     std::vector<size_t> downsteam_vector(op_list.begin(), op_list.end());
@@ -233,8 +272,71 @@ void InterpreterCore::Convert(
     vec_instruction_.emplace_back(op_idx, std::move(op_func_node), *dev_ctx_);
   }
 
-  BuildOperatorDependences();
+  interpreter::InterpreterPlan plan;
+  bool use_plan = false;
+  if (!FLAGS_new_executor_plan_cache_dir.empty()) {
+    plan_key_ = PlanKey();
+    use_plan = LoadPlan(&plan);
+    VLOG(3) << "interpreter plan " << std::hex << plan_key_ << std::dec
+            << (use_plan ? " loaded" : " not found");
+  }
+
+  BuildOperatorDependences(use_plan ? &plan : nullptr);
 
+  if (use_plan) {
+    ApplyPlan(plan);
+  } else {
+    BuildLastLiveOps();
+  }
+  for (size_t i = 0; i < last_live_ops_.size(); ++i) {
+    vec_meta_info[i].var_ref_count_ = last_live_ops_[i].size();
+  }
+
+  for (size_t i = 0; i < vec_instruction_.size(); ++i) {
+    BuildAndCacheInstructionCtx(&vec_instruction_[i]);
+  }
+
+  BuildSkipShareLoDInfo();
+
+  for (size_t i = 0; i < vec_instruction_.size(); ++i) {
+    gc_event_.emplace_back(vec_instruction_[i].DeviceContext().GetPlace(),
+                           platform::GenerateDeviceEventFlag());
+  }
+  bool inplaced = false;
+  for (auto inst : vec_instruction_) {
+    if (inst.OpBase()->Type() == "share_buffer" ||
+        inst.OpBase()->Type() == "share_data") {
+      VLOG(4) << "Already inplaced, skip inplace now.";
+      inplaced = true;
+    }
+  }
+
+  if (FLAGS_new_executor_use_inplace && !inplaced && !use_plan) {
+    BuildInplace();
+  }
+
+  BuildCriticalPathPriority();
+  // the costs of a loaded plan were measured already
+  record_instr_cost_ =
+      FLAGS_new_executor_use_critical_path_schedule && !use_plan;
+  instr_threads_.assign(op_nums, {{-1, -1}});
+  record_memory_plan_ = FLAGS_new_executor_use_static_memory_plan;
+  if (record_memory_plan_) {
+    var_plan_bytes_.assign(var_nums, 0);
+    var_plan_shared_.assign(var_nums, false);
+  }
+  if (!FLAGS_new_executor_plan_cache_dir.empty() && !use_plan &&
+      !record_instr_cost_) {
+    SavePlan();
+  }
+
+  // prepare for the first time.
+  async_work_queue_->PrepareAtomicDeps(dependecy_count_);
+  async_work_queue_->PrepareAtomicVarRef(vec_meta_info);
+}
+
+void InterpreterCore::BuildLastLiveOps() {
+  auto op_nums = vec_instruction_.size();
   // calculate last_live_ops_
   for (size_t op_idx = 0; op_idx < op_nums; ++op_idx) {
     auto& instr = vec_instruction_[op_idx];
@@ -316,35 +418,178 @@ void InterpreterCore::Convert(
       }
     }
     last_live_ops_[i] = minumum_last_live_ops;
-    vec_meta_info[i].var_ref_count_ = last_live_ops_[i].size();
   }
+}
+
+// GetNameById searches all the variables, the names in a plan are looked up
+// through the VarDesc where there is one
+static std::string PlanVarName(const VariableScope& scope, int id) {
+  auto* var_desc = scope.VarDesc(id);
+  return var_desc ? var_desc->Name() : scope.GetNameById(id);
+}
 
+uint64_t InterpreterCore::PlanKey() const {
+  // everything the analysis depends on: the ops with their kernel type and
+  // place, and their variables with type, persistable and inplace flags
+  std::ostringstream desc;
+  desc << FLAGS_new_executor_use_inplace << "\n";
+  auto DescribeVars = [this, &desc](
+      const std::map<std::string, std::vector<int>>& vars) {
+    for (auto& item : vars) {
+      desc << " " << item.first << ":";
+      for (auto id : item.second) {
+        if (id == kEmptyVarIndex) {
+          desc << " " << kEmptyVarName;
+          continue;
+        }
+        auto* var = global_scope_->Var(id);
+        auto* var_desc = global_scope_->VarDesc(id);
+        desc << " " << PlanVarName(*global_scope_, id) << "/"
+             << (var->IsInitialized() ? var->Type() : -1) << "/"
+             << (var_desc && var_desc->Persistable()) << "/"
+             << global_scope_->GetVarSikpInplace(id);
+      }
+    }
+  };
+  for (auto& instr : vec_instruction_) {
+    desc << instr.OpBase()->Type() << " "
+         << static_cast<int>(instr.KernelType()) << " "
+         << instr.DeviceContext().GetPlace() << " in";
+    DescribeVars(instr.Inputs());
+    desc << " out";
+    DescribeVars(instr.Outputs());
+    for (auto& pair : instr.InplaceBackMap()) {
+      desc << " back " << pair.first << "->" << pair.second;
+    }
+    desc << "\n";
+  }
+  return interpreter::InstructionListKey(desc.str());
+}
+
+bool InterpreterCore::LoadPlan(interpreter::InterpreterPlan* plan) const {
+  if (!interpreter::LoadPlan(FLAGS_new_executor_plan_cache_dir, plan_key_,
+                             plan) ||
+      plan->instructions.size() != vec_instruction_.size()) {
+    return false;
+  }
   for (size_t i = 0; i < vec_instruction_.size(); ++i) {
-    BuildAndCacheInstructionCtx(&vec_instruction_[i]);
+    auto& instr = plan->instructions[i];
+    if (instr.op_type != vec_instruction_[i].OpBase()->Type() ||
+        instr.kernel_type !=
+            static_cast<int>(vec_instruction_[i].KernelType())) {
+      return false;
+    }
+    for (auto& pair : instr.inplace) {
+      if (!global_scope_->HasVar(pair.first) ||
+          !global_scope_->HasVar(pair.second)) {
+        return false;
+      }
+    }
+  }
+  for (auto& kv : plan->last_live_ops) {
+    if (!global_scope_->HasVar(kv.first)) {
+      return false;
+    }
   }
+  return true;
+}
 
-  BuildSkipShareLoDInfo();
+void InterpreterCore::ApplyPlan(const interpreter::InterpreterPlan& plan) {
+  for (auto& kv : plan.last_live_ops) {
+    auto var_id = global_scope_->VarId(kv.first);
+    for (auto op_idx : kv.second) {
+      last_live_ops_[var_id].insert(op_idx);
+      vec_instruction_[op_idx].AddGCCheckVar(var_id);
+    }
+  }
+  instr_cost_.resize(vec_instruction_.size());
+  for (size_t i = 0; i < vec_instruction_.size(); ++i) {
+    auto& instr = plan.instructions[i];
+    instr_cost_[i] = instr.cost;
+    for (auto& pair : instr.inplace) {
+      vec_instruction_[i].AddInplace(global_scope_->Var(pair.first),
+                                     global_scope_->Var(pair.second));
+    }
+  }
+}
 
+void InterpreterCore::SavePlan() {
+  interpreter::InterpreterPlan plan;
+  plan.key = plan_key_;
+  plan.instructions.resize(vec_instruction_.size());
+  std::unordered_map<const Variable*, std::string> var_names;
   for (size_t i = 0; i < vec_instruction_.size(); ++i) {
-    gc_event_.emplace_back(vec_instruction_[i].DeviceContext().GetPlace(),
-                           platform::GenerateDeviceEventFlag());
+    auto& instr = vec_instruction_[i];
+    auto& instr_plan = plan.instructions[i];
+    instr_plan.op_type = instr.OpBase()->Type();
+    instr_plan.kernel_type = static_cast<int>(instr.KernelType());
+    instr_plan.cost = instr_cost_[i];
+    auto& next_instr = instr.NextInstructions();
+    for (auto* ids : {&next_instr.DirectRunIds(), &next_instr.EventRunIds(),
+                      &next_instr.SyncRunIds()}) {
+      instr_plan.downstream.insert(instr_plan.downstream.end(), ids->begin(),
+                                   ids->end());
+    }
+    std::sort(instr_plan.downstream.begin(), instr_plan.downstream.end());
+    for (auto* vars : {&instr.Inputs(), &instr.Outputs()}) {
+      for (auto& item : *vars) {
+        for (auto id : item.second) {
+          if (id != kEmptyVarIndex) {
+            var_names[global_scope_->Var(id)] =
+                PlanVarName(*global_scope_, id);
+          }
+        }
+      }
+    }
+    for (auto& pair : instr.InplaceInfo()) {
+      instr_plan.inplace.emplace_back(var_names.at(pair.first),
+                                      var_names.at(pair.second));
+    }
   }
-  bool inplaced = false;
-  for (auto inst : vec_instruction_) {
-    if (inst.OpBase()->Type() == "share_buffer" ||
-        inst.OpBase()->Type() == "share_data") {
-      VLOG(4) << "Already inplaced, skip inplace now.";
-      inplaced = true;
+  for (auto& kv : last_live_ops_) {
+    if (kv.second.empty()) {
+      continue;
     }
+    plan.last_live_ops[PlanVarName(*global_scope_, kv.first)].assign(
+        kv.second.begin(), kv.second.end());
+  }
+  if (interpreter::SavePlan(FLAGS_new_executor_plan_cache_dir, plan)) {
+    VLOG(3) << "interpreter plan saved to "
+            << interpreter::PlanFilePath(FLAGS_new_executor_plan_cache_dir,
+                                         plan_key_);
   }
+}
 
-  if (FLAGS_new_executor_use_inplace && !inplaced) {
-    BuildInplace();
+void InterpreterCore::BuildCriticalPathPriority() {
+  size_t op_nums = vec_instruction_.size();
+  if (instr_cost_.size() != op_nums) {
+    instr_cost_.assign(op_nums, 1.0);
+  }
+  instr_priority_.assign(op_nums, 0.0);
+  // the downstream ops of an op always come after it in the program, so one
+  // backward pass sees them first
+  for (size_t i = op_nums; i-- > 0;) {
+    auto& next_instr = vec_instruction_[i].NextInstructions();
+    double longest_next = 0.0;
+    for (auto* ids : {&next_instr.DirectRunIds(), &next_instr.EventRunIds(),
+                      &next_instr.SyncRunIds()}) {
+      for (auto next_id : *ids) {
+        longest_next = std::max(longest_next, instr_priority_[next_id]);
+      }
+    }
+    instr_priority_[i] = instr_cost_[i] + longest_next;
   }
+}
 
-  // prepare for the first time.
-  async_work_queue_->PrepareAtomicDeps(dependecy_count_);
-  async_work_queue_->PrepareAtomicVarRef(vec_meta_info);
+void InterpreterCore::SortByPriority(std::vector<size_t>* instr_ids) const {
+  if (!FLAGS_new_executor_use_critical_path_schedule ||
+      instr_ids->size() < 2) {
+    return;
+  }
+  std::stable_sort(instr_ids->begin(), instr_ids->end(),
+                   [this](size_t a, size_t b) {
+                     return instr_priority_[a] > instr_priority_[b];
+                   });
 }
 
 bool InterpreterCore::BuildInplaceCheckVarIsOnlyInput(size_t var_index) {
@@ -480,7 +725,8 @@ void InterpreterCore::RunInstruction(const Instruction& instr_node) {
       // see OperatorWithKernel::RunImpl in operator.cc for why
       if (!(op_with_kernel->HasAttr(kAllKernelsMustComputeRuntimeShape) &&
             op_with_kernel->Attr<bool>(kAllKernelsMustComputeRuntimeShape))) {
-        op_with_kernel->Info().infer_shape_(
+        op_with_kernel->InferShapeWithCache(
+            *instr_node.InnerRuntimeContext(),
             instr_node.InnerInferShapeContext().get());
       }
     }
@@ -502,6 +748,7 @@ void InterpreterCore::RunInstruction(const Instruction& instr_node) {
     platform::RecordEvent compute_event(
         "compute", platform::TracerEventType::OperatorInner, 1,
         platform::EventRole::kInnerOp);
+    memory::allocation::AllocationTraceScope trace_scope(op->Type());
     if (op_with_kernel == nullptr) {
       instr_node.OpBase()->Run(*local_scope, place_);
     } else {
@@ -583,14 +830,31 @@ void InterpreterCore::ExecuteInstructionList(
 
   exception_holder_.Clear();
 
+  if (!planned_holders_.empty()) {
+    ApplyMemoryPlan();
+  } else if (UNLIKELY(record_memory_plan_)) {
+    memory_stat_before_plan_ = AllocatedMemoryStat(place_, false);
+  }
+
+  std::vector<size_t> ready_ops;
   for (size_t i = 0; i < dependecy_count_.size(); ++i) {
     if (dependecy_count_[i] == 0) {
-      async_work_queue_->AddTask(vec_instr.at(i).KernelType(), [
-        this, i, atomic_deps = atomic_deps.get(),
-        atomic_var_ref = atomic_var_ref.get()
-      ] { RunInstructionAsync(i, atomic_deps, atomic_var_ref); });
+      ready_ops.push_back(i);
     }
   }
+  SortByPriority(&ready_ops);
+  for (auto i : ready_ops) {
+    auto fn = [
+      this, i, atomic_deps = atomic_deps.get(),
+      atomic_var_ref = atomic_var_ref.get()
+    ] { RunInstructionAsync(i, atomic_deps, atomic_var_ref); };
+    // no producer runs before i, so it prefers the thread it ran on in the
+    // last step
+    auto kernel_type = vec_instr.at(i).KernelType();
+    async_work_queue_->AddTask(
+        kernel_type, std::move(fn),
+        instr_threads_[i][static_cast<size_t>(kernel_type)]);
+  }
 
   auto event_name = main_thread_blocker_.WaitEvent();
   VLOG(1) << "event_name: " << event_name;
@@ -610,6 +874,25 @@ void InterpreterCore::ExecuteInstructionList(
     VLOG(4) << "clear ok";
     exception_holder_.ReThrow();
   }
+
+  if (UNLIKELY(record_instr_cost_)) {
+    record_instr_cost_ = false;
+    BuildCriticalPathPriority();
+    if (!FLAGS_new_executor_plan_cache_dir.empty()) {
+      SavePlan();
+    }
+    VLOG(4) << "Critical path cost: "
+            << (instr_priority_.empty()
+                    ? 0.0
+                    : *std::max_element(instr_priority_.begin(),
+                                        instr_priority_.end()))
+            << " us";
+  }
+
+  if (UNLIKELY(record_memory_plan_)) {
+    record_memory_plan_ = false;
+    BuildMemoryPlan();
+  }
 }
 
 void InterpreterCore::RunNextInstructions(
@@ -621,64 +904,91 @@ void InterpreterCore::RunNextInstructions(
   VLOG(4) << "atomic 1:" << atomic_deps;
   auto& next_instr = instr.NextInstructions();
 
-  auto IsReady = [atomic_deps](size_t next_id) {
+  auto IsReady = [this, &instr, atomic_deps](size_t next_id) {
     VLOG(4) << "atomic:" << atomic_deps << " op_id: " << next_id
             << ", remain deps: " << (*atomic_deps)[next_id];
-    return (*atomic_deps)[next_id].fetch_sub(1, std::memory_order_relaxed) == 1;
+    if ((*atomic_deps)[next_id].fetch_sub(1, std::memory_order_relaxed) != 1) {
+      return false;
+    }
+    // instr is the last producer of next_id and dispatches it
+    instr_threads_[next_id] = instr_threads_[instr.Id()];
+    return true;
   };
 
+  auto AddTask = [this, &instr, atomic_deps, atomic_var_ref](size_t next_id) {
+    auto kernel_type = vec_instruction_[next_id].KernelType();
+    auto fn = [this, next_id, atomic_deps, atomic_var_ref] {
+      RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
+    };
+    if (kernel_type == instr.KernelType()) {
+      // goes to the queue of the current thread, which produced the inputs
+      async_work_queue_->AddTask(kernel_type, std::move(fn));
+    } else {
+      async_work_queue_->AddTask(
+          kernel_type, std::move(fn),
+          instr_threads_[next_id][static_cast<size_t>(kernel_type)]);
+    }
+  };
+  auto OnOwnPool = [this](size_t next_id) {
+    return async_work_queue_->CurrentThreadId(
+               vec_instruction_[next_id].KernelType()) >= 0;
+  };
+  // ready ops are run by priority, the one with the longest remaining path
+  // first, see interpreter::add_tasks_by_priority for the order they are
+  // added to the queues in
+  thread_local std::vector<size_t> ready_ops;
+
   if (instr.KernelType() == OpFuncType::kQueueAsync) {
     // move all sync_ops into other threads
+    ready_ops.clear();
     for (auto next_id : next_instr.SyncRunIds()) {
       if (IsReady(next_id)) {
-        async_work_queue_->AddTask(
-            vec_instruction_[next_id].KernelType(),
-            [this, next_id, atomic_deps, atomic_var_ref]() {
-              RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
-            });
+        ready_ops.push_back(next_id);
       }
     }
+    SortByPriority(&ready_ops);
+    interpreter::add_tasks_by_priority(ready_ops, 0, OnOwnPool, AddTask);
     // keep all async_ops running in current thread
+    ready_ops.clear();
     for (auto next_id : next_instr.DirectRunIds()) {
       if (IsReady(next_id)) {
-        reserved_next_ops->push(next_id);
+        ready_ops.push_back(next_id);
       }
     }
     for (auto next_id : next_instr.EventRunIds()) {
       if (IsReady(next_id)) {
-        reserved_next_ops->push(next_id);
+        ready_ops.push_back(next_id);
       }
     }
+    SortByPriority(&ready_ops);
+    for (auto next_id : ready_ops) {
+      reserved_next_ops->push(next_id);
+    }
   } else {
     // move async_ops into async_thread
+    ready_ops.clear();
     for (auto next_id : next_instr.EventRunIds()) {
       if (IsReady(next_id)) {
-        async_work_queue_->AddTask(
-            vec_instruction_[next_id].KernelType(),
-            [this, next_id, atomic_deps, atomic_var_ref] {
-              RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
-            });
+        ready_ops.push_back(next_id);
       }
     }
+    SortByPriority(&ready_ops);
+    interpreter::add_tasks_by_priority(ready_ops, 0, OnOwnPool, AddTask);
     auto direct_run_ops = interpreter::merge_vector(next_instr.SyncRunIds(),
                                                     next_instr.DirectRunIds());
-    size_t first_op = 0;
+    ready_ops.clear();
     for (auto next_id : direct_run_ops) {
       if (IsReady(next_id)) {
-        // only keep one op running in current thread
-        if (first_op == 0) {
-          first_op = next_id;
-          continue;
-        }
-        // move rest ops into other threads
-        async_work_queue_->AddTask(
-            vec_instruction_[next_id].KernelType(),
-            [this, next_id, atomic_deps, atomic_var_ref] {
-              RunInstructionAsync(next_id, atomic_deps, atomic_var_ref);
-            });
+        ready_ops.push_back(next_id);
       }
     }
-    if (first_op != 0) reserved_next_ops->push(first_op);
+    SortByPriority(&ready_ops);
+    // only keep one op running in current thread, the most critical one,
+    // and move rest ops into other threads
+    interpreter::add_tasks_by_priority(ready_ops, 1, OnOwnPool, AddTask);
+    if (!ready_ops.empty()) {
+      reserved_next_ops->push(ready_ops[0]);
+    }
   }
 }
 
@@ -702,10 +1012,24 @@ void InterpreterCore::RunInstructionAsync(
     platform::RecordEvent instruction_event(
         op->Type(), platform::TracerEventType::Operator, 1);
 
+    instr_threads_[instr_id][static_cast<size_t>(instr_node.KernelType())] =
+        async_work_queue_->CurrentThreadId(instr_node.KernelType());
+
     try {
       interpreter::WaitEvent(instr_node, place_);
 
-      RunInstruction(instr_node);
+      if (UNLIKELY(record_instr_cost_)) {
+        auto start = std::chrono::steady_clock::now();
+        RunInstruction(instr_node);
+        instr_cost_[instr_id] = std::chrono::duration<double, std::micro>(
+                                    std::chrono::steady_clock::now() - start)
+                                    .count();
+      } else {
+        RunInstruction(instr_node);
+      }
+      if (UNLIKELY(record_memory_plan_)) {
+        RecordMemoryPlanVars(instr_node);
+      }
 
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
       RecordStreamForGC(instr_node);
@@ -863,6 +1187,10 @@ void InterpreterCore::CheckGC(
     if (var_scope.VarDesc(var_id) && var_scope.VarDesc(var_id)->Persistable()) {
       continue;
     }
+    // planned vars keep their part of the memory arena
+    if (!is_planned_var_.empty() && is_planned_var_[var_id]) {
+      continue;
+    }
     if (is_ready) {
       VLOG(6) << "Async delete variable with name : "
               << var_scope.GetNameById(var_id);
@@ -885,6 +1213,152 @@ void InterpreterCore::CheckGC(
   }
 }
 
+void InterpreterCore::RecordMemoryPlanVars(const Instruction& instr) {
+  std::lock_guard<std::mutex> guard(memory_plan_mutex_);
+  // the vars of instr that share one buffer, e.g. the input and output of an
+  // inplace op or of reshape, can not be planned apart
+  std::unordered_map<const phi::Allocation*, size_t> holder_vars;
+  auto Record = [this, &holder_vars](size_t var_id, bool is_output) {
+    auto* var = global_scope_->Var(var_id);
+    if (var == nullptr || !var->IsType<LoDTensor>()) {
+      var_plan_shared_[var_id] = true;
+      return;
+    }
+    auto& holder = var->Get<LoDTensor>().Holder();
+    if (holder == nullptr) {
+      return;
+    }
+    auto iter = holder_vars.emplace(holder.get(), var_id).first;
+    if (iter->second != var_id || holder.use_count() > 1 ||
+        !(holder->place() == place_)) {
+      var_plan_shared_[var_id] = true;
+      var_plan_shared_[iter->second] = true;
+    }
+    if (is_output) {
+      var_plan_bytes_[var_id] =
+          std::max(var_plan_bytes_[var_id], holder->size());
+    }
+  };
+  for (auto& item : instr.Inputs()) {
+    for (auto id : item.second) {
+      if (id != kEmptyVarIndex) {
+        Record(id, false);
+      }
+    }
+  }
+  for (auto& item : instr.Outputs()) {
+    for (auto id : item.second) {
+      if (id != kEmptyVarIndex) {
+        Record(id, true);
+      }
+    }
+  }
+}
+
+void InterpreterCore::BuildMemoryPlan() {
+  auto var_nums = var_plan_bytes_.size();
+  std::vector<int> def_op(var_nums, -1);
+  std::vector<std::vector<size_t>> var_ops(var_nums);
+  for (size_t i = 0; i < vec_instruction_.size(); ++i) {
+    auto& instr = vec_instruction_[i];
+    for (auto& item : instr.Inputs()) {
+      for (auto id : item.second) {
+        if (id != kEmptyVarIndex) {
+          var_ops[id].push_back(i);
+        }
+      }
+    }
+    for (auto& item : instr.Outputs()) {
+      for (auto id : item.second) {
+        if (id == kEmptyVarIndex) {
+          continue;
+        }
+        // vars written more than once are not planned
+        def_op[id] = def_op[id] == -1 ? static_cast<int>(i) : -2;
+      }
+    }
+  }
+
+  std::vector<std::vector<size_t>> next_ops(vec_instruction_.size());
+  for (size_t i = 0; i < vec_instruction_.size(); ++i) {
+    auto& next_instr = vec_instruction_[i].NextInstructions();
+    for (auto* ids : {&next_instr.DirectRunIds(), &next_instr.EventRunIds(),
+                      &next_instr.SyncRunIds()}) {
+      next_ops[i].insert(next_ops[i].end(), ids->begin(), ids->end());
+    }
+  }
+  interpreter::StaticMemoryPlanner planner(next_ops);
+
+  // only the vars that gc collects, so nothing reads them after the step,
+  // and only if all their accesses come after the instruction writing them
+  std::vector<size_t> var_ids;
+  std::vector<interpreter::PlannedTensor> tensors;
+  size_t total_bytes = 0;
+  for (auto& kv : last_live_ops_) {
+    size_t var_id = kv.first;
+    if (var_id >= var_nums) {
+      continue;
+    }
+    auto* var_desc = global_scope_->VarDesc(var_id);
+    if (kv.second.empty() || def_op[var_id] < 0 ||
+        var_plan_shared_[var_id] || var_plan_bytes_[var_id] == 0 ||
+        (var_desc && var_desc->Persistable())) {
+      continue;
+    }
+    interpreter::PlannedTensor tensor;
+    tensor.size = var_plan_bytes_[var_id];
+    tensor.def_op = def_op[var_id];
+    tensor.use_ops = var_ops[var_id];
+    bool after_def = true;
+    for (auto op : tensor.use_ops) {
+      after_def = after_def && planner.HappensBefore(tensor.def_op, op);
+    }
+    if (!after_def) {
+      continue;
+    }
+    total_bytes += tensor.size;
+    var_ids.push_back(var_id);
+    tensors.push_back(std::move(tensor));
+  }
+  if (tensors.empty()) {
+    return;
+  }
+
+  size_t arena_size = planner.Plan(&tensors);
+  int64_t dynamic_peak =
+      AllocatedMemoryStat(place_, true) - memory_stat_before_plan_;
+  memory_arena_ = memory::AllocShared(place_, arena_size);
+  auto* base = reinterpret_cast<uint8_t*>(memory_arena_->ptr());
+  is_planned_var_.assign(var_nums, false);
+  for (size_t i = 0; i < tensors.size(); ++i) {
+    is_planned_var_[var_ids[i]] = true;
+    planned_holders_.emplace_back(
+        var_ids[i],
+        std::make_shared<phi::Allocation>(base + tensors[i].offset,
+                                          tensors[i].size, place_));
+  }
+  // the dynamic peak is of the whole process since the memory stats have no
+  // reset, so it is an upper bound of the first step
+  LOG(INFO) << "Static memory plan of " << tensors.size()
+            << " vars: " << total_bytes << " bytes in an arena of "
+            << arena_size << " bytes, dynamic peak of the first step at most "
+            << dynamic_peak << " bytes";
+}
+
+void InterpreterCore::ApplyMemoryPlan() {
+  platform::RecordEvent record("ApplyMemoryPlan",
+                               platform::TracerEventType::UserDefined, 10);
+  for (auto& pair : planned_holders_) {
+    auto* tensor = global_scope_->Var(pair.first)->GetMutable<LoDTensor>();
+    // a kernel that needed more memory than planned has replaced it
+    if (tensor->Holder() != pair.second) {
+      tensor->MoveMemoryHolder();
+      tensor->set_offset(0);
+      tensor->ResetHolder(pair.second);
+    }
+  }
+}
+
 void InterpreterCore::Prepare(
     const std::vector<std::string>& feed_names,
     const std::vector<framework::LoDTensor>& feed_tensors, bool prepare_feed) {
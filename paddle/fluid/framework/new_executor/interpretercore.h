@@ -13,7 +13,9 @@
 // limitations under the License.
 #pragma once
 
+#include <array>
 #include <map>
+#include <mutex>  // NOLINT
 #include <queue>
 #include <string>
 #include <unordered_map>
@@ -22,9 +24,11 @@
 #include "paddle/fluid/framework/details/exception_holder.h"
 #include "paddle/fluid/framework/new_executor/event_manager.h"
 #include "paddle/fluid/framework/new_executor/garbage_collector/garbage_collector.h"
+#include "paddle/fluid/framework/new_executor/interpretercore_plan.h"
 #include "paddle/fluid/framework/new_executor/interpretercore_util.h"
 #include "paddle/fluid/framework/new_executor/new_executor_defs.h"
 #include "paddle/fluid/framework/new_executor/profiler.h"
+#include "paddle/fluid/framework/new_executor/static_memory_planner.h"
 #include "paddle/fluid/framework/new_executor/stream_analyzer.h"
 #include "paddle/fluid/framework/program_desc.h"
 #include "paddle/fluid/framework/tensor.h"
@@ -89,7 +93,32 @@ class InterpreterCore {
 
   void BuildSkipShareLoDInfo();
 
-  void BuildOperatorDependences();
+  // builds the dependences from plan instead of analysing the instructions
+  // when plan is not null
+  void BuildOperatorDependences(
+      const interpreter::InterpreterPlan* plan = nullptr);
+
+  // last_live_ops_ and the gc check vars of the instructions
+  void BuildLastLiveOps();
+
+  // see interpreter::InterpreterPlan, the plans are saved to and loaded from
+  // FLAGS_new_executor_plan_cache_dir
+  uint64_t PlanKey() const;
+  bool LoadPlan(interpreter::InterpreterPlan* plan) const;
+  void ApplyPlan(const interpreter::InterpreterPlan& plan);
+  void SavePlan();
+
+  // instr_priority_[i] is the cost of the longest path from instruction i to
+  // the end of the program, ready instructions are dispatched by it
+  void BuildCriticalPathPriority();
+  void SortByPriority(std::vector<size_t>* instr_ids) const;
+
+  // the intermediates collected by gc are given a fixed place in one arena,
+  // see interpreter::StaticMemoryPlanner. Their sizes and whether they share
+  // a buffer with other vars are recorded in the first step.
+  void RecordMemoryPlanVars(const Instruction& instr);
+  void BuildMemoryPlan();
+  void ApplyMemoryPlan();
 
   void SetFeedVarsInplaceSkip(const std::vector<std::string>& feed_names);
 
@@ -115,6 +144,29 @@ class InterpreterCore {
   std::map<size_t, std::set<size_t>> last_live_ops_;
 
   std::vector<size_t> dependecy_count_;
+  // the cost of every instruction is 1 until the first run has timed them
+  std::vector<double> instr_cost_;
+  std::vector<double> instr_priority_;
+  bool record_instr_cost_{false};
+  uint64_t plan_key_{0};
+  // instr_threads_[i][type] is the worker thread of the queue of OpFuncType
+  // type that ran i, or else the nearest producer upstream of i. It is passed
+  // on from the producer that makes i ready, and is the affinity of i when i
+  // is dispatched from outside its queue, so that i follows the thread that
+  // produced its inputs.
+  std::vector<std::array<int, 2>> instr_threads_;
+
+  bool record_memory_plan_{false};
+  std::mutex memory_plan_mutex_;
+  std::vector<size_t> var_plan_bytes_;
+  std::vector<bool> var_plan_shared_;
+  int64_t memory_stat_before_plan_{0};
+  std::shared_ptr<phi::Allocation> memory_arena_;
+  // (var id, its part of memory_arena_), reset at the start of every step
+  std::vector<std::pair<size_t, std::shared_ptr<phi::Allocation>>>
+      planned_holders_;
+  std::vector<bool> is_planned_var_;
+
   std::atomic<size_t> unfinished_op_numer_{0};
   std::vector<std::vector<size_t>> input_var2op_info_;
 
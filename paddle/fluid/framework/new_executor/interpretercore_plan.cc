@@ -0,0 +1,180 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/new_executor/interpretercore_plan.h"
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include "glog/logging.h"
+#include "paddle/fluid/platform/os_info.h"
+
+namespace paddle {
+namespace framework {
+namespace interpreter {
+
+static const char* kPlanMagic = "interpreter_plan";
+static const int kPlanVersion = 1;
+
+// Text format, one record per line:
+//
+//   interpreter_plan <version> <key> <instruction_num>
+//   instr <op_type> <kernel_type> <cost> <downstream_num> <id>...
+//   inplace <instr_id> <in_var> <out_var>
+//   live <var> <instr_num> <id>...
+std::string InterpreterPlan::Serialize() const {
+  std::ostringstream ss;
+  ss << std::setprecision(17);
+  ss << kPlanMagic << " " << kPlanVersion << " " << key << " "
+     << instructions.size() << "\n";
+  for (auto& instr : instructions) {
+    ss << "instr " << instr.op_type << " " << instr.kernel_type << " "
+       << instr.cost << " " << instr.downstream.size();
+    for (auto id : instr.downstream) {
+      ss << " " << id;
+    }
+    ss << "\n";
+  }
+  for (size_t i = 0; i < instructions.size(); ++i) {
+    for (auto& pair : instructions[i].inplace) {
+      ss << "inplace " << i << " " << pair.first << " " << pair.second << "\n";
+    }
+  }
+  for (auto& kv : last_live_ops) {
+    ss << "live " << kv.first << " " << kv.second.size();
+    for (auto id : kv.second) {
+      ss << " " << id;
+    }
+    ss << "\n";
+  }
+  return ss.str();
+}
+
+bool InterpreterPlan::Parse(const std::string& text) {
+  std::istringstream ss(text);
+  std::string magic;
+  int version = 0;
+  size_t instr_num = 0;
+  if (!(ss >> magic >> version >> key >> instr_num) || magic != kPlanMagic ||
+      version != kPlanVersion) {
+    return false;
+  }
+  instructions.clear();
+  last_live_ops.clear();
+  auto ValidIds = [instr_num](const std::vector<size_t>& ids) {
+    for (auto id : ids) {
+      if (id >= instr_num) {
+        return false;
+      }
+    }
+    return true;
+  };
+  auto ReadIds = [&ss](std::vector<size_t>* ids) {
+    size_t num = 0;
+    if (!(ss >> num)) {
+      return false;
+    }
+    ids->resize(num);
+    for (auto& id : *ids) {
+      if (!(ss >> id)) {
+        return false;
+      }
+    }
+    return true;
+  };
+  std::string record;
+  while (ss >> record) {
+    if (record == "instr") {
+      InstructionPlan instr;
+      if (!(ss >> instr.op_type >> instr.kernel_type >> instr.cost) ||
+          !ReadIds(&instr.downstream) || !ValidIds(instr.downstream)) {
+        return false;
+      }
+      instructions.push_back(std::move(instr));
+    } else if (record == "inplace") {
+      size_t id = 0;
+      std::string in, out;
+      if (!(ss >> id >> in >> out) || id >= instructions.size()) {
+        return false;
+      }
+      instructions[id].inplace.emplace_back(in, out);
+    } else if (record == "live") {
+      std::string var;
+      std::vector<size_t> ids;
+      if (!(ss >> var) || !ReadIds(&ids) || !ValidIds(ids)) {
+        return false;
+      }
+      last_live_ops[var] = std::move(ids);
+    } else {
+      return false;
+    }
+  }
+  return instructions.size() == instr_num;
+}
+
+uint64_t InstructionListKey(const std::string& desc) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (unsigned char c : desc) {
+    hash ^= c;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+std::string PlanFilePath(const std::string& dir, uint64_t key) {
+  std::ostringstream ss;
+  ss << dir << "/" << std::hex << std::setw(16) << std::setfill('0') << key
+     << ".plan";
+  return ss.str();
+}
+
+bool LoadPlan(const std::string& dir, uint64_t key, InterpreterPlan* plan) {
+  std::ifstream fin(PlanFilePath(dir, key));
+  if (!fin) {
+    return false;
+  }
+  std::stringstream buffer;
+  buffer << fin.rdbuf();
+  if (!plan->Parse(buffer.str()) || plan->key != key) {
+    LOG(WARNING) << "ignore the corrupted interpreter plan "
+                 << PlanFilePath(dir, key);
+    return false;
+  }
+  return true;
+}
+
+bool SavePlan(const std::string& dir, const InterpreterPlan& plan) {
+  std::string path = PlanFilePath(dir, plan.key);
+  std::string tmp_path = path + ".tmp." +
+                         std::to_string(platform::GetProcessId()) + "." +
+                         std::to_string(platform::GetCurrentThreadStdId());
+  {
+    std::ofstream fout(tmp_path, std::ios::out | std::ios::trunc);
+    fout << plan.Serialize();
+    if (!fout) {
+      LOG(WARNING) << "failed to write the interpreter plan " << tmp_path;
+      return false;
+    }
+  }
+  if (std::rename(tmp_path.c_str(), path.c_str()) != 0) {
+    LOG(WARNING) << "failed to rename the interpreter plan to " << path;
+    std::remove(tmp_path.c_str());
+    return false;
+  }
+  return true;
+}
+
+}  // namespace interpreter
+}  // namespace framework
+}  // namespace paddle
@@ -0,0 +1,69 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+namespace interpreter {
+
+// The analysis InterpreterCore::Convert does on the instruction list: the
+// downstream instructions of every instruction, the inplace pairs, the
+// instructions after which a variable can be garbage collected and the
+// measured instruction costs. It only depends on the instruction list, so
+// it is saved once and reloaded by later InterpreterCores of the same
+// program, keyed by InstructionListKey. Variables are stored by name since
+// their ids depend on the VariableScope.
+struct InstructionPlan {
+  std::string op_type;
+  int kernel_type = 0;
+  std::vector<size_t> downstream;
+  // (input var, output var) pairs that share a buffer
+  std::vector<std::pair<std::string, std::string>> inplace;
+  double cost = 1.0;
+};
+
+struct InterpreterPlan {
+  uint64_t key = 0;
+  std::vector<InstructionPlan> instructions;
+  // var name -> instructions after which the var can be collected
+  std::map<std::string, std::vector<size_t>> last_live_ops;
+
+  std::string Serialize() const;
+  // returns false when text is not a plan of this version
+  bool Parse(const std::string& text);
+};
+
+// 64 bit FNV-1a of the description of an instruction list, see
+// InterpreterCore::PlanKey
+uint64_t InstructionListKey(const std::string& desc);
+
+std::string PlanFilePath(const std::string& dir, uint64_t key);
+
+// Returns false when there is no readable plan of key in dir.
+bool LoadPlan(const std::string& dir, uint64_t key, InterpreterPlan* plan);
+
+// Writes to a temporary file that is renamed into place, so processes that
+// share dir never read a partial plan.
+bool SavePlan(const std::string& dir, const InterpreterPlan& plan);
+
+}  // namespace interpreter
+}  // namespace framework
+}  // namespace paddle
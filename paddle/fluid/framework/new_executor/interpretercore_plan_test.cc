@@ -0,0 +1,183 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/new_executor/interpretercore_plan.h"
+#include <dirent.h>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <chrono>  // NOLINT
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/framework/new_executor/interpretercore.h"
+#include "paddle/fluid/framework/op_registry.h"
+#include "paddle/fluid/framework/program_desc.h"
+#include "paddle/phi/core/kernel_registry.h"
+
+USE_OP_ITSELF(fill_constant);
+USE_OP_ITSELF(elementwise_add);
+USE_OP_ITSELF(relu);
+
+PD_DECLARE_KERNEL(full, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(add, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(relu, CPU, ALL_LAYOUT);
+
+DECLARE_string(new_executor_plan_cache_dir);
+DECLARE_bool(new_executor_use_local_scope);
+
+namespace paddle {
+namespace framework {
+namespace interpreter {
+
+static std::string MakeTempDir() {
+  char dir[] = "/tmp/interpreter_plan_XXXXXX";
+  EXPECT_NE(mkdtemp(dir), nullptr);
+  return dir;
+}
+
+static InterpreterPlan MakePlan() {
+  InterpreterPlan plan;
+  plan.key = 0x1234abcdULL;
+  plan.instructions.resize(3);
+  plan.instructions[0] = {"fill_constant", 0, {1, 2}, {}, 12.5};
+  plan.instructions[1] = {"relu", 0, {2}, {{"x", "y"}}, 3.25};
+  plan.instructions[2] = {"elementwise_add", 1, {}, {}, 1.0};
+  plan.last_live_ops["x"] = {1, 2};
+  plan.last_live_ops["y"] = {2};
+  return plan;
+}
+
+TEST(InterpreterPlan, SerializeAndParse) {
+  auto plan = MakePlan();
+  InterpreterPlan parsed;
+  ASSERT_TRUE(parsed.Parse(plan.Serialize()));
+  EXPECT_EQ(parsed.key, plan.key);
+  ASSERT_EQ(parsed.instructions.size(), plan.instructions.size());
+  for (size_t i = 0; i < plan.instructions.size(); ++i) {
+    EXPECT_EQ(parsed.instructions[i].op_type, plan.instructions[i].op_type);
+    EXPECT_EQ(parsed.instructions[i].kernel_type,
+              plan.instructions[i].kernel_type);
+    EXPECT_EQ(parsed.instructions[i].downstream,
+              plan.instructions[i].downstream);
+    EXPECT_EQ(parsed.instructions[i].inplace, plan.instructions[i].inplace);
+    EXPECT_EQ(parsed.instructions[i].cost, plan.instructions[i].cost);
+  }
+  EXPECT_EQ(parsed.last_live_ops, plan.last_live_ops);
+
+  // truncated plans and plans with out of range ids are rejected
+  auto text = plan.Serialize();
+  EXPECT_FALSE(parsed.Parse(text.substr(0, text.size() / 2)));
+  EXPECT_FALSE(parsed.Parse("interpreter_plan 1 7 1\ninstr relu 0 1 1 5\n"));
+  EXPECT_FALSE(parsed.Parse("interpreter_plan 2 7 0\n"));
+}
+
+TEST(InterpreterPlan, SaveAndLoad) {
+  auto dir = MakeTempDir();
+  auto plan = MakePlan();
+  InterpreterPlan loaded;
+  EXPECT_FALSE(LoadPlan(dir, plan.key, &loaded));
+  ASSERT_TRUE(SavePlan(dir, plan));
+  ASSERT_TRUE(LoadPlan(dir, plan.key, &loaded));
+  EXPECT_EQ(loaded.Serialize(), plan.Serialize());
+
+  std::ofstream(PlanFilePath(dir, plan.key)) << "garbage";
+  EXPECT_FALSE(LoadPlan(dir, plan.key, &loaded));
+}
+
+}  // namespace interpreter
+
+// out = relu(a + b) + relu(a), where a + b can be computed inplace
+static ProgramDesc BuildPlanTestProgram() {
+  ProgramDesc program;
+  auto* block = program.MutableBlock(0);
+  block->Var(interpreter::kFetchVarName)->SetType(proto::VarType::FETCH_LIST);
+  for (auto name : {"a", "b", "sum", "relu_sum", "relu_a", "out"}) {
+    block->Var(name)->SetType(proto::VarType::LOD_TENSOR);
+  }
+  // read after the run, so it is not collected
+  block->Var("out")->SetPersistable(true);
+  auto AddOp = [block](const std::string& type, const VariableNameMap& inputs,
+                       const std::string& out) {
+    auto* op = block->AppendOp();
+    op->SetType(type);
+    for (auto& kv : inputs) {
+      op->SetInput(kv.first, kv.second);
+    }
+    op->SetOutput("Out", {out});
+    return op;
+  };
+  for (auto name : {"a", "b"}) {
+    auto* op = AddOp("fill_constant", {}, name);
+    op->SetAttr("shape", std::vector<int64_t>{32, 32});
+    op->SetAttr("value", name[0] == 'a' ? -1.5f : 4.0f);
+    op->SetAttr("dtype", static_cast<int>(proto::VarType::FP32));
+  }
+  AddOp("elementwise_add", {{"X", {"a"}}, {"Y", {"b"}}}, "sum");
+  AddOp("relu", {{"X", {"sum"}}}, "relu_sum");
+  AddOp("relu", {{"X", {"a"}}}, "relu_a");
+  AddOp("elementwise_add", {{"X", {"relu_sum"}}, {"Y", {"relu_a"}}}, "out");
+  return program;
+}
+
+// runs the program twice with a new InterpreterCore, the first run builds it
+static float RunPlanTestProgram(const ProgramDesc& program, double* build_ms) {
+  Scope scope;
+  VariableScope variable_scope(&scope);
+  InterpreterCore core(platform::CPUPlace(), program.Block(0),
+                       &variable_scope);
+  auto start = std::chrono::steady_clock::now();
+  core.Run({});
+  *build_ms = std::chrono::duration<double, std::milli>(
+                  std::chrono::steady_clock::now() - start)
+                  .count();
+  core.Run({});
+  return scope.FindVar("out")->Get<LoDTensor>().data<float>()[0];
+}
+
+static int CountPlanFiles(const std::string& dir) {
+  int count = 0;
+  DIR* d = opendir(dir.c_str());
+  while (auto* entry = readdir(d)) {
+    std::string name = entry->d_name;
+    if (name.size() > 5 && name.substr(name.size() - 5) == ".plan") {
+      ++count;
+    }
+  }
+  closedir(d);
+  return count;
+}
+
+TEST(InterpreterPlan, ReloadInInterpreterCore) {
+  auto dir = interpreter::MakeTempDir();
+  FLAGS_new_executor_use_local_scope = false;
+  FLAGS_new_executor_plan_cache_dir = dir;
+  auto program = BuildPlanTestProgram();
+
+  double cold_ms = 0;
+  double warm_ms = 0;
+  float cold = RunPlanTestProgram(program, &cold_ms);
+  EXPECT_EQ(CountPlanFiles(dir), 1);
+  float warm = RunPlanTestProgram(program, &warm_ms);
+  EXPECT_EQ(cold, 2.5f);
+  EXPECT_EQ(warm, cold);
+  LOG(INFO) << "first run without plan: " << cold_ms
+            << " ms, with plan: " << warm_ms << " ms";
+
+  FLAGS_new_executor_plan_cache_dir = "";
+  FLAGS_new_executor_use_local_scope = true;
+}
+
+}  // namespace framework
+}  // namespace paddle
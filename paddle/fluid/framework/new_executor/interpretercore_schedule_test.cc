@@ -0,0 +1,237 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include <gtest/gtest.h>
+#include <chrono>  // NOLINT
+#include <string>
+#include <vector>
+
+#include "paddle/fluid/framework/new_executor/interpretercore.h"
+#include "paddle/fluid/framework/new_executor/interpretercore_util.h"
+#include "paddle/fluid/framework/op_registry.h"
+#include "paddle/fluid/framework/program_desc.h"
+#include "paddle/phi/core/kernel_registry.h"
+
+USE_OP_ITSELF(fill_constant);
+USE_OP_ITSELF(matmul_v2);
+USE_OP_ITSELF(elementwise_add);
+USE_OP_ITSELF(relu);
+USE_OP_ITSELF(concat);
+
+PD_DECLARE_KERNEL(full, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(matmul, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(add, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(relu, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(concat, CPU, ALL_LAYOUT);
+
+DECLARE_bool(new_executor_use_critical_path_schedule);
+
+namespace paddle {
+namespace framework {
+
+class ScheduleProgramBuilder {
+ public:
+  ScheduleProgramBuilder() : block_(program_.MutableBlock(0)) {
+    block_->Var(interpreter::kFetchVarName)
+        ->SetType(proto::VarType::FETCH_LIST);
+  }
+
+  ProgramDesc* program() { return &program_; }
+
+  std::string Constant(const std::vector<int64_t>& shape, float value) {
+    auto out = NewVar();
+    auto* op = block_->AppendOp();
+    op->SetType("fill_constant");
+    op->SetOutput("Out", {out});
+    op->SetAttr("shape", shape);
+    op->SetAttr("value", value);
+    op->SetAttr("dtype", static_cast<int>(proto::VarType::FP32));
+    return out;
+  }
+
+  std::string MatMul(const std::string& x, const std::string& y,
+                     bool trans_y = false) {
+    auto out = NewVar();
+    auto* op = block_->AppendOp();
+    op->SetType("matmul_v2");
+    op->SetInput("X", {x});
+    op->SetInput("Y", {y});
+    op->SetOutput("Out", {out});
+    op->SetAttr("trans_x", false);
+    op->SetAttr("trans_y", trans_y);
+    return out;
+  }
+
+  std::string Add(const std::string& x, const std::string& y) {
+    auto out = NewVar();
+    auto* op = block_->AppendOp();
+    op->SetType("elementwise_add");
+    op->SetInput("X", {x});
+    op->SetInput("Y", {y});
+    op->SetOutput("Out", {out});
+    op->SetAttr("axis", -1);
+    return out;
+  }
+
+  std::string Relu(const std::string& x) {
+    auto out = NewVar();
+    auto* op = block_->AppendOp();
+    op->SetType("relu");
+    op->SetInput("X", {x});
+    op->SetOutput("Out", {out});
+    return out;
+  }
+
+  std::string Concat(const std::vector<std::string>& xs, int axis) {
+    auto out = NewVar();
+    auto* op = block_->AppendOp();
+    op->SetType("concat");
+    op->SetInput("X", xs);
+    op->SetOutput("Out", {out});
+    op->SetAttr("axis", axis);
+    return out;
+  }
+
+ private:
+  std::string NewVar() {
+    auto name = "tmp_" + std::to_string(var_num_++);
+    block_->Var(name)->SetType(proto::VarType::LOD_TENSOR);
+    return name;
+  }
+
+  ProgramDesc program_;
+  BlockDesc* block_;
+  int var_num_ = 0;
+};
+
+// residual blocks whose main branch is a chain of matmuls and whose shortcut
+// is a single one, the main branch is the critical path
+ProgramDesc* BuildResNetLikeProgram(ScheduleProgramBuilder* builder) {
+  const int64_t batch = 64;
+  const int64_t hidden = 256;
+  auto x = builder->Constant({batch, hidden}, 1.0f);
+  for (int block = 0; block < 8; ++block) {
+    auto main = x;
+    for (int layer = 0; layer < 3; ++layer) {
+      auto w = builder->Constant({hidden, hidden}, 1.0f / hidden);
+      main = builder->Relu(builder->MatMul(main, w));
+    }
+    auto shortcut_w = builder->Constant({hidden, hidden}, 1.0f / hidden);
+    auto shortcut = builder->MatMul(x, shortcut_w);
+    x = builder->Relu(builder->Add(main, shortcut));
+  }
+  return builder->program();
+}
+
+// attention layers with parallel q/k/v projections next to short side chains
+// that are ready early but are off the critical path
+ProgramDesc* BuildTransformerLikeProgram(ScheduleProgramBuilder* builder) {
+  const int64_t seq_len = 64;
+  const int64_t hidden = 256;
+  auto x = builder->Constant({seq_len, hidden}, 1.0f);
+  for (int layer = 0; layer < 6; ++layer) {
+    auto q = builder->MatMul(x, builder->Constant({hidden, hidden}, 0.01f));
+    auto k = builder->MatMul(x, builder->Constant({hidden, hidden}, 0.01f));
+    auto v = builder->MatMul(x, builder->Constant({hidden, hidden}, 0.01f));
+    auto score = builder->MatMul(q, k, true);
+    auto attention = builder->MatMul(score, v);
+    auto projection = builder->MatMul(
+        builder->Concat({attention, q, v}, 1),
+        builder->Constant({3 * hidden, hidden}, 1.0f / (3 * hidden)));
+    auto side = x;
+    for (int i = 0; i < 4; ++i) {
+      side = builder->Relu(builder->Add(side, x));
+    }
+    x = builder->Add(projection, side);
+  }
+  return builder->program();
+}
+
+// runs the tasks of ops, which are sorted from the most critical one, on one
+// thread, and returns the order they ran in. The tasks are added on the
+// worker thread when on_worker, and on this thread otherwise.
+std::vector<size_t> RunTasksByPriority(const std::vector<size_t>& ops,
+                                       bool on_worker) {
+  WorkQueueOptions options("ScheduleTest", /*num_threads*/ 1,
+                           /*allow_spinning*/ false, /*track_task*/ false);
+  auto work_queue = CreateSingleThreadedWorkQueue(options);
+  std::vector<size_t> run_order;
+  auto add_tasks = [&ops, &run_order, &work_queue] {
+    interpreter::add_tasks_by_priority(
+        ops, 0,
+        [&work_queue](size_t) { return work_queue->CurrentThreadId() >= 0; },
+        [&run_order, &work_queue](size_t op) {
+          work_queue->AddTask([&run_order, op] { run_order.push_back(op); });
+        });
+  };
+  if (on_worker) {
+    work_queue->AddAwaitableTask([&add_tasks] {
+                 add_tasks();
+                 return 0;
+               })
+        .get();
+  } else {
+    add_tasks();
+  }
+  // goes to the back of the queue, after the tasks of ops
+  return work_queue->AddAwaitableTask([&run_order] { return run_order; })
+      .get();
+}
+
+TEST(InterpreterCoreSchedule, AddTasksByPriority) {
+  std::vector<size_t> ops = {7, 2, 5, 0};
+  EXPECT_EQ(RunTasksByPriority(ops, true), ops);
+  EXPECT_EQ(RunTasksByPriority(ops, false), ops);
+}
+
+double RunSteps(const ProgramDesc& program, bool critical_path, int steps) {
+  FLAGS_new_executor_use_critical_path_schedule = critical_path;
+  Scope scope;
+  VariableScope variable_scope(&scope);
+  InterpreterCore core(platform::CPUPlace(), program.Block(0),
+                       &variable_scope);
+  // the first run builds the instructions, the second one times them
+  core.Run({});
+  core.Run({});
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < steps; ++i) {
+    core.Run({});
+  }
+  return std::chrono::duration<double, std::milli>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         steps;
+}
+
+void BenchmarkSchedule(const std::string& name, const ProgramDesc& program) {
+  const int steps = 50;
+  double unsorted_ms = RunSteps(program, false, steps);
+  double critical_path_ms = RunSteps(program, true, steps);
+  LOG(INFO) << name << " " << program.Block(0).OpSize()
+            << " ops, step time unsorted: " << unsorted_ms
+            << " ms, critical path: " << critical_path_ms << " ms";
+}
+
+TEST(BENCHMARK, InterpreterCoreScheduleResNetLike) {
+  ScheduleProgramBuilder builder;
+  BenchmarkSchedule("resnet_like", *BuildResNetLikeProgram(&builder));
+}
+
+TEST(BENCHMARK, InterpreterCoreScheduleTransformerLike) {
+  ScheduleProgramBuilder builder;
+  BenchmarkSchedule("transformer_like", *BuildTransformerLikeProgram(&builder));
+}
+
+}  // namespace framework
+}  // namespace paddle
@@ -38,18 +38,32 @@ namespace interpreter {
 
 constexpr size_t kPrepareWorkQueueIdx = 2;
 
-void AsyncWorkQueue::AddTask(const OpFuncType& op_func_type,
-                             std::function<void()> fn) {
-  VLOG(4) << "Add task: " << static_cast<size_t>(op_func_type) << " ";
+size_t AsyncWorkQueue::QueueIdx(const OpFuncType& op_func_type) const {
   // NOTE(zhiqiu): use thhe second queue of size of, so only one thread is used.
   if (FLAGS_new_executor_sequential_run) {
     VLOG(4) << "FLAGS_new_executor_sequential_run:"
             << FLAGS_new_executor_sequential_run;
-    queue_group_->AddTask(static_cast<size_t>(OpFuncType::kQueueAsync),
-                          std::move(fn));
-  } else {
-    queue_group_->AddTask(static_cast<size_t>(op_func_type), std::move(fn));
+    return static_cast<size_t>(OpFuncType::kQueueAsync);
   }
+  return static_cast<size_t>(op_func_type);
+}
+
+void AsyncWorkQueue::AddTask(const OpFuncType& op_func_type,
+                             std::function<void()> fn) {
+  VLOG(4) << "Add task: " << static_cast<size_t>(op_func_type) << " ";
+  queue_group_->AddTask(QueueIdx(op_func_type), std::move(fn));
+}
+
+void AsyncWorkQueue::AddTask(const OpFuncType& op_func_type,
+                             std::function<void()> fn, int affinity) {
+  VLOG(4) << "Add task: " << static_cast<size_t>(op_func_type)
+          << " affinity: " << affinity;
+  queue_group_->AddTaskWithAffinity(QueueIdx(op_func_type), std::move(fn),
+                                    affinity);
+}
+
+int AsyncWorkQueue::CurrentThreadId(const OpFuncType& op_func_type) const {
+  return queue_group_->QueueCurrentThreadId(QueueIdx(op_func_type));
 }
 
 using VariableIdMap = std::map<std::string, std::vector<int>>;
@@ -613,6 +627,21 @@ std::vector<size_t> merge_vector(const std::vector<size_t>& first,
   return out;
 }
 
+void add_tasks_by_priority(const std::vector<size_t>& ops, size_t begin,
+                           const std::function<bool(size_t)>& on_own_pool,
+                           const std::function<void(size_t)>& add_task) {
+  for (size_t i = begin; i < ops.size(); ++i) {
+    if (!on_own_pool(ops[i])) {
+      add_task(ops[i]);
+    }
+  }
+  for (size_t i = ops.size(); i-- > begin;) {
+    if (on_own_pool(ops[i])) {
+      add_task(ops[i]);
+    }
+  }
+}
+
 void update_var_min_rw_op(const std::map<int, std::set<int>>& op2dependences,
                           std::map<int, std::list<int>>* var2min_rw_op,
                           int cur_op, int rw_var) {
@@ -21,6 +21,7 @@
 #pragma once
 
 #include <chrono>
+#include <functional>
 #include <iostream>
 #include <string>
 
@@ -93,6 +94,14 @@ class AsyncWorkQueue {
 
   void AddTask(const OpFuncType& op_func_type, std::function<void()> fn);
 
+  // affinity is a thread as returned by CurrentThreadId, see
+  // WorkQueue::AddTaskWithAffinity
+  void AddTask(const OpFuncType& op_func_type, std::function<void()> fn,
+               int affinity);
+
+  // index of the calling thread in the queue of op_func_type, or -1
+  int CurrentThreadId(const OpFuncType& op_func_type) const;
+
   void Cancel() { queue_group_->Cancel(); }
 
   std::unique_ptr<std::vector<std::atomic<size_t>>> AtomicDeps() {
@@ -103,6 +112,8 @@ class AsyncWorkQueue {
   }
 
  private:
+  size_t QueueIdx(const OpFuncType& op_func_type) const;
+
   size_t host_num_thread_;
   std::unique_ptr<WorkQueueGroup> queue_group_;
   AtomicVectorSizeT atomic_deps_;
@@ -128,6 +139,15 @@ void add_fetch(const std::vector<std::string>& fetch_names,
 std::vector<size_t> merge_vector(const std::vector<size_t>& first,
                                  const std::vector<size_t>& second);
 
+// Adds the tasks of ops[begin:], which are sorted from the most critical one,
+// by add_task. A task added on a worker thread of its own pool is pushed to
+// the front of the queue of that thread, which pops from the front too, so
+// those are added from the least critical one. The others go to the back of a
+// queue and are added in order.
+void add_tasks_by_priority(const std::vector<size_t>& ops, size_t begin,
+                           const std::function<bool(size_t)>& on_own_pool,
+                           const std::function<void(size_t)>& add_task);
+
 }  // namespace interpreter
 }  // namespace framework
 }  // namespace paddle
@@ -0,0 +1,108 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/new_executor/static_memory_planner.h"
+#include <algorithm>
+#include <utility>
+
+namespace paddle {
+namespace framework {
+namespace interpreter {
+
+StaticMemoryPlanner::StaticMemoryPlanner(
+    const std::vector<std::vector<size_t>>& next_ops)
+    : op_num_(next_ops.size()),
+      words_((next_ops.size() + 63) / 64),
+      reach_(op_num_ * words_, 0) {
+  // the instructions after an instruction are computed before it in one
+  // backward pass
+  for (size_t i = op_num_; i-- > 0;) {
+    uint64_t* reach = &reach_[i * words_];
+    for (auto next : next_ops[i]) {
+      reach[next / 64] |= uint64_t(1) << (next % 64);
+      const uint64_t* next_reach = &reach_[next * words_];
+      for (size_t w = 0; w < words_; ++w) {
+        reach[w] |= next_reach[w];
+      }
+    }
+  }
+}
+
+bool StaticMemoryPlanner::AllAccessesBefore(const PlannedTensor& a,
+                                            const PlannedTensor& b) const {
+  if (!HappensBefore(a.def_op, b.def_op)) {
+    return false;
+  }
+  for (auto op : a.use_ops) {
+    if (!HappensBefore(op, b.def_op)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static size_t AlignedSize(size_t size) {
+  return (size + kMemoryPlanAlignment - 1) / kMemoryPlanAlignment *
+         kMemoryPlanAlignment;
+}
+
+size_t StaticMemoryPlanner::Plan(std::vector<PlannedTensor>* tensors) const {
+  std::vector<size_t> order(tensors->size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::stable_sort(order.begin(), order.end(), [tensors](size_t a, size_t b) {
+    return tensors->at(a).size > tensors->at(b).size;
+  });
+
+  size_t arena_size = 0;
+  std::vector<size_t> placed;
+  // [begin, end) of the placed tensors that interfere with the current one
+  std::vector<std::pair<size_t, size_t>> used;
+  for (auto id : order) {
+    auto& tensor = tensors->at(id);
+    size_t size = AlignedSize(tensor.size);
+    used.clear();
+    for (auto other_id : placed) {
+      auto& other = tensors->at(other_id);
+      if (!AllAccessesBefore(tensor, other) &&
+          !AllAccessesBefore(other, tensor)) {
+        used.emplace_back(other.offset, other.offset + AlignedSize(other.size));
+      }
+    }
+    std::sort(used.begin(), used.end());
+
+    size_t best_offset = 0;
+    size_t best_gap = SIZE_MAX;
+    size_t gap_begin = 0;
+    for (auto& range : used) {
+      if (range.first > gap_begin) {
+        size_t gap = range.first - gap_begin;
+        if (gap >= size && gap < best_gap) {
+          best_gap = gap;
+          best_offset = gap_begin;
+        }
+      }
+      gap_begin = std::max(gap_begin, range.second);
+    }
+    tensor.offset = best_gap == SIZE_MAX ? gap_begin : best_offset;
+    arena_size = std::max(arena_size, tensor.offset + size);
+    placed.push_back(id);
+  }
+  return arena_size;
+}
+
+}  // namespace interpreter
+}  // namespace framework
+}  // namespace paddle
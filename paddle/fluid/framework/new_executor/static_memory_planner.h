@@ -0,0 +1,69 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+namespace paddle {
+namespace framework {
+namespace interpreter {
+
+// offsets in the arena are aligned as the device allocators do
+static constexpr size_t kMemoryPlanAlignment = 256;
+
+// A tensor placed in the arena. It is written by def_op and then accessed
+// by use_ops, all of which run after def_op.
+struct PlannedTensor {
+  size_t size = 0;
+  size_t def_op = 0;
+  std::vector<size_t> use_ops;
+  // assigned by StaticMemoryPlanner::Plan
+  size_t offset = 0;
+};
+
+// Assigns every tensor an offset in one arena, so that two tensors overlap
+// only if all accesses of one happen before the other is written. Since
+// instructions run in parallel, happens before is the reachability in the
+// instruction dependence graph, not the order of the instructions.
+class StaticMemoryPlanner {
+ public:
+  // next_ops[i] are the instructions that wait for instruction i, they
+  // always come after i
+  explicit StaticMemoryPlanner(
+      const std::vector<std::vector<size_t>>& next_ops);
+
+  bool HappensBefore(size_t a, size_t b) const {
+    return (reach_[a * words_ + b / 64] >> (b % 64)) & 1;
+  }
+
+  // Best fit offset assignment, the largest tensor first: every tensor goes
+  // into the smallest gap between the tensors it interferes with that holds
+  // it, or after them all. Returns the size of the arena.
+  size_t Plan(std::vector<PlannedTensor>* tensors) const;
+
+ private:
+  bool AllAccessesBefore(const PlannedTensor& a, const PlannedTensor& b) const;
+
+  size_t op_num_;
+  size_t words_;
+  // reach_[i * words_ ...] is the bitset of the instructions after i
+  std::vector<uint64_t> reach_;
+};
+
+}  // namespace interpreter
+}  // namespace framework
+}  // namespace paddle
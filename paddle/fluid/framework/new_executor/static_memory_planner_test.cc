@@ -0,0 +1,207 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/framework/new_executor/static_memory_planner.h"
+#include <gtest/gtest.h>
+#include <random>
+#include <vector>
+
+#include "paddle/fluid/framework/new_executor/interpretercore.h"
+#include "paddle/fluid/framework/op_registry.h"
+#include "paddle/fluid/framework/program_desc.h"
+#include "paddle/phi/core/kernel_registry.h"
+
+USE_OP_ITSELF(fill_constant);
+USE_OP_ITSELF(elementwise_add);
+USE_OP_ITSELF(relu);
+
+PD_DECLARE_KERNEL(full, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(add, CPU, ALL_LAYOUT);
+PD_DECLARE_KERNEL(relu, CPU, ALL_LAYOUT);
+
+DECLARE_bool(new_executor_use_static_memory_plan);
+
+namespace paddle {
+namespace framework {
+namespace interpreter {
+
+static PlannedTensor MakeTensor(size_t size, size_t def_op,
+                                std::vector<size_t> use_ops) {
+  PlannedTensor tensor;
+  tensor.size = size;
+  tensor.def_op = def_op;
+  tensor.use_ops = std::move(use_ops);
+  return tensor;
+}
+
+TEST(StaticMemoryPlanner, ReuseAlongChain) {
+  // 0 -> 1 -> 2 -> 3
+  StaticMemoryPlanner planner({{1}, {2}, {3}, {}});
+  EXPECT_TRUE(planner.HappensBefore(0, 3));
+  EXPECT_FALSE(planner.HappensBefore(3, 0));
+  EXPECT_FALSE(planner.HappensBefore(1, 1));
+
+  std::vector<PlannedTensor> tensors = {MakeTensor(1000, 0, {1}),
+                                        MakeTensor(1000, 1, {2}),
+                                        MakeTensor(1000, 2, {3})};
+  EXPECT_EQ(planner.Plan(&tensors), 2 * kMemoryPlanAlignment * 4);
+  EXPECT_EQ(tensors[0].offset, tensors[2].offset);
+  EXPECT_NE(tensors[0].offset, tensors[1].offset);
+}
+
+TEST(StaticMemoryPlanner, ParallelBranchesDoNotShare) {
+  // 0 -> {1, 2} -> 3
+  StaticMemoryPlanner planner({{1, 2}, {3}, {3}, {}});
+  EXPECT_FALSE(planner.HappensBefore(1, 2));
+  EXPECT_FALSE(planner.HappensBefore(2, 1));
+
+  std::vector<PlannedTensor> tensors = {
+      MakeTensor(512, 0, {1, 2}), MakeTensor(512, 1, {3}),
+      MakeTensor(512, 2, {3}), MakeTensor(512, 3, {})};
+  EXPECT_EQ(planner.Plan(&tensors), 3 * 512);
+  EXPECT_NE(tensors[1].offset, tensors[2].offset);
+  // only the tensor of op 0 is no longer read by op 3
+  EXPECT_EQ(tensors[3].offset, tensors[0].offset);
+}
+
+TEST(StaticMemoryPlanner, BestFitGap) {
+  // 0 -> 1 -> 2 -> 3 -> 4, the tensors read by op 1 leave the gaps
+  // [0, 4096) and [6144, 7168) when the last one is written by op 2
+  StaticMemoryPlanner planner({{1}, {2}, {3}, {4}, {}});
+  std::vector<PlannedTensor> tensors = {
+      MakeTensor(4096, 0, {1}), MakeTensor(2048, 0, {4}),
+      MakeTensor(1024, 0, {1}), MakeTensor(1024, 0, {4}),
+      MakeTensor(1024, 2, {3})};
+  EXPECT_EQ(planner.Plan(&tensors), 8192UL);
+  EXPECT_EQ(tensors[2].offset, 6144UL);
+  EXPECT_EQ(tensors[4].offset, 6144UL);
+}
+
+TEST(StaticMemoryPlanner, RandomGraphsHaveNoConflicts) {
+  std::mt19937 rng(2022);
+  for (int round = 0; round < 20; ++round) {
+    const size_t op_num = 64;
+    std::vector<std::vector<size_t>> next_ops(op_num);
+    for (size_t i = 0; i < op_num; ++i) {
+      for (size_t j = i + 1; j < op_num; ++j) {
+        if (rng() % 16 == 0) {
+          next_ops[i].push_back(j);
+        }
+      }
+    }
+    StaticMemoryPlanner planner(next_ops);
+    std::vector<PlannedTensor> tensors;
+    size_t total = 0;
+    for (size_t i = 0; i + 1 < op_num; ++i) {
+      std::vector<size_t> uses;
+      for (size_t j = i + 1; j < op_num; ++j) {
+        if (planner.HappensBefore(i, j) && rng() % 4 == 0) {
+          uses.push_back(j);
+        }
+      }
+      tensors.push_back(MakeTensor(1 + rng() % 100000, i, uses));
+      total += tensors.back().size;
+    }
+    size_t arena_size = planner.Plan(&tensors);
+    EXPECT_LE(arena_size, total + tensors.size() * kMemoryPlanAlignment);
+
+    auto AllBefore = [&planner](const PlannedTensor& a,
+                                const PlannedTensor& b) {
+      if (!planner.HappensBefore(a.def_op, b.def_op)) {
+        return false;
+      }
+      for (auto op : a.use_ops) {
+        if (!planner.HappensBefore(op, b.def_op)) {
+          return false;
+        }
+      }
+      return true;
+    };
+    for (size_t i = 0; i < tensors.size(); ++i) {
+      auto& a = tensors[i];
+      EXPECT_EQ(a.offset % kMemoryPlanAlignment, 0UL);
+      EXPECT_LE(a.offset + a.size, arena_size);
+      for (size_t j = i + 1; j < tensors.size(); ++j) {
+        auto& b = tensors[j];
+        bool overlap =
+            a.offset < b.offset + b.size && b.offset < a.offset + a.size;
+        if (overlap) {
+          EXPECT_TRUE(AllBefore(a, b) || AllBefore(b, a));
+        }
+      }
+    }
+  }
+}
+
+}  // namespace interpreter
+
+// out = relu(relu(a + b) + a) + b, the intermediates are collected by gc
+static ProgramDesc BuildMemoryPlanTestProgram() {
+  ProgramDesc program;
+  auto* block = program.MutableBlock(0);
+  block->Var(interpreter::kFetchVarName)->SetType(proto::VarType::FETCH_LIST);
+  for (auto name : {"a", "b", "t0", "t1", "t2", "t3", "out"}) {
+    block->Var(name)->SetType(proto::VarType::LOD_TENSOR);
+  }
+  block->Var("out")->SetPersistable(true);
+  auto AddOp = [block](const std::string& type, const VariableNameMap& inputs,
+                       const std::string& out) {
+    auto* op = block->AppendOp();
+    op->SetType(type);
+    for (auto& kv : inputs) {
+      op->SetInput(kv.first, kv.second);
+    }
+    op->SetOutput("Out", {out});
+    return op;
+  };
+  for (auto name : {"a", "b"}) {
+    auto* op = AddOp("fill_constant", {}, name);
+    op->SetAttr("shape", std::vector<int64_t>{64, 64});
+    op->SetAttr("value", name[0] == 'a' ? -1.5f : 4.0f);
+    op->SetAttr("dtype", static_cast<int>(proto::VarType::FP32));
+  }
+  AddOp("elementwise_add", {{"X", {"a"}}, {"Y", {"b"}}}, "t0");
+  AddOp("relu", {{"X", {"t0"}}}, "t1");
+  AddOp("elementwise_add", {{"X", {"t1"}}, {"Y", {"a"}}}, "t2");
+  AddOp("relu", {{"X", {"t2"}}}, "t3");
+  AddOp("elementwise_add", {{"X", {"t3"}}, {"Y", {"b"}}}, "out");
+  return program;
+}
+
+static std::vector<float> RunMemoryPlanTestProgram(const ProgramDesc& program,
+                                                   bool use_plan) {
+  FLAGS_new_executor_use_static_memory_plan = use_plan;
+  Scope scope;
+  VariableScope variable_scope(&scope);
+  InterpreterCore core(platform::CPUPlace(), program.Block(0),
+                       &variable_scope);
+  std::vector<float> results;
+  // build, record the sizes and then run with the plan
+  for (int step = 0; step < 4; ++step) {
+    core.Run({});
+    results.push_back(scope.FindVar("out")->Get<LoDTensor>().data<float>()[0]);
+  }
+  FLAGS_new_executor_use_static_memory_plan = false;
+  return results;
+}
+
+TEST(StaticMemoryPlanner, InterpreterCore) {
+  auto program = BuildMemoryPlanTestProgram();
+  auto expected = RunMemoryPlanTestProgram(program, false);
+  EXPECT_EQ(expected[0], 5.0f);
+  EXPECT_EQ(RunMemoryPlanTestProgram(program, true), expected);
+}
+
+}  // namespace framework
+}  // namespace paddle
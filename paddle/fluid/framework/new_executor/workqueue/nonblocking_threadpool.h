@@ -75,6 +75,7 @@ class ThreadPoolTempl {
       // Empty them to prevent their destructor from asserting.
       for (size_t i = 0; i < thread_data_.size(); i++) {
         thread_data_[i].queue.Flush();
+        thread_data_[i].affinity_queue.Flush();
       }
     }
     // Join threads explicitly (by destroying) to avoid destruction order within
@@ -142,6 +143,29 @@ class ThreadPoolTempl {
     }
   }
 
+  // Prefers to run fn on the worker thread_id, e.g. the thread that produced
+  // the inputs of fn. The task waits in the affinity queue of that thread,
+  // which other threads only steal from after they found no other work.
+  void AddTaskWithAffinity(std::function<void()> fn, int thread_id) {
+    PerThread* pt = GetPerThread();
+    if (thread_id < 0 || thread_id >= num_threads_ ||
+        (pt->pool == this && pt->thread_id == thread_id)) {
+      AddTask(std::move(fn));
+      return;
+    }
+    Task t = env_.CreateTask(std::move(fn));
+    uint64_t num_tasks = num_tasks_.fetch_add(1, std::memory_order_relaxed) + 1;
+    t = thread_data_[thread_id].affinity_queue.PushBack(std::move(t));
+    if (!t.f) {
+      if (num_tasks > num_threads_ - blocked_) {
+        ec_.Notify(false);
+      }
+    } else {
+      num_tasks_.fetch_sub(1, std::memory_order_relaxed);
+      env_.ExecuteTask(t);  // Push failed, execute directly.
+    }
+  }
+
   void Cancel() {
     cancelled_ = true;
     done_ = true;
@@ -228,10 +252,14 @@ class ThreadPoolTempl {
   };
 
   struct ThreadData {
-    constexpr ThreadData() : thread(), steal_partition(0), queue() {}
+    constexpr ThreadData()
+        : thread(), steal_partition(0), queue(), affinity_queue() {}
     std::unique_ptr<Thread> thread;
     std::atomic<unsigned> steal_partition;
     Queue queue;
+    // tasks added by other threads with this thread as affinity, the owner
+    // pops the front and thieves the back
+    Queue affinity_queue;
   };
 
   Environment env_;
@@ -258,6 +286,8 @@ class ThreadPoolTempl {
     pt->rand = GlobalThreadIdHash();
     pt->thread_id = thread_id;
     Queue& q = thread_data_[thread_id].queue;
+    Queue& affinity_q = thread_data_[thread_id].affinity_queue;
+    WorkQueueThreadStats* stats = CurrentWorkQueueThreadStats();
     EventCount::Waiter* waiter = ec_.GetWaiter(thread_id);
     // TODO(dvyukov,rmlarsen): The time spent in NonEmptyQueueIndex() is
     // proportional to num_threads_ and we assume that new work is scheduled at
@@ -274,24 +304,40 @@ class ThreadPoolTempl {
       // pools tend to be used for.
       while (!cancelled_) {
         Task t = q.PopFront();
+        if (!t.f) {
+          t = affinity_q.PopFront();
+        }
         for (int i = 0; i < spin_count && !t.f; i++) {
           if (!cancelled_.load(std::memory_order_relaxed)) {
             t = q.PopFront();
+            if (!t.f) {
+              t = affinity_q.PopFront();
+            }
           }
         }
         if (!t.f) {
-          if (!WaitForWork(waiter, &t)) {
+          if (spin_count > 0) {
+            WorkQueueThreadStats::Increase(&stats->spins);
+          }
+          if (!WaitForWork(waiter, &t, stats)) {
             return;
           }
         }
         if (t.f) {
           env_.ExecuteTask(t);
           num_tasks_.fetch_sub(1, std::memory_order_relaxed);
+          WorkQueueThreadStats::Increase(&stats->tasks);
         }
       }
     } else {
       while (!cancelled_) {
         Task t = q.PopFront();
+        if (!t.f) {
+          t = affinity_q.PopFront();
+          if (t.f) {
+            WorkQueueThreadStats::Increase(&stats->affinity_hits);
+          }
+        }
         if (!t.f) {
           t = LocalSteal();
           if (!t.f) {
@@ -301,13 +347,28 @@ class ThreadPoolTempl {
                 for (int i = 0; i < spin_count && !t.f; i++) {
                   if (!cancelled_.load(std::memory_order_relaxed)) {
                     t = GlobalSteal();
+                    if (!t.f) {
+                      // the owner may have become free in the meantime
+                      t = affinity_q.PopFront();
+                      if (t.f) {
+                        WorkQueueThreadStats::Increase(
+                            &stats->affinity_hits);
+                      }
+                    }
                   } else {
                     return;
                   }
                 }
+                if (!t.f) {
+                  WorkQueueThreadStats::Increase(&stats->spins);
+                }
               }
               if (!t.f) {
-                if (!WaitForWork(waiter, &t)) {
+                // the hinted tasks of threads that are still busy
+                t = AffinitySteal();
+              }
+              if (!t.f) {
+                if (!WaitForWork(waiter, &t, stats)) {
                   return;
                 }
               }
@@ -317,6 +378,7 @@ class ThreadPoolTempl {
         if (t.f) {
           env_.ExecuteTask(t);
           num_tasks_.fetch_sub(1, std::memory_order_relaxed);
+          WorkQueueThreadStats::Increase(&stats->tasks);
         }
       }
     }
@@ -340,6 +402,7 @@ class ThreadPoolTempl {
       assert(start + victim < limit);
       Task t = thread_data_[start + victim].queue.PopBack();
       if (t.f) {
+        CountTaken(start + victim, false);
         return t;
       }
       victim += inc;
@@ -367,10 +430,39 @@ class ThreadPoolTempl {
   // Steals work from any other thread in the pool.
   Task GlobalSteal() { return Steal(0, num_threads_); }
 
+  // Steals from the affinity queues, own one included.
+  Task AffinitySteal() {
+    PerThread* pt = GetPerThread();
+    unsigned victim = Rand(&pt->rand) % num_threads_;
+    for (int i = 0; i < num_threads_; i++) {
+      Task t = thread_data_[victim].affinity_queue.PopBack();
+      if (t.f) {
+        CountTaken(victim, true);
+        return t;
+      }
+      if (++victim == static_cast<unsigned>(num_threads_)) {
+        victim = 0;
+      }
+    }
+    return Task();
+  }
+
+  // Counts a task the calling worker took from the back of a queue of thread
+  // victim, which may be the worker itself.
+  void CountTaken(unsigned victim, bool from_affinity_queue) {
+    WorkQueueThreadStats* stats = CurrentWorkQueueThreadStats();
+    if (static_cast<int>(victim) != GetPerThread()->thread_id) {
+      WorkQueueThreadStats::Increase(&stats->steals);
+    } else if (from_affinity_queue) {
+      WorkQueueThreadStats::Increase(&stats->affinity_hits);
+    }
+  }
+
   // WaitForWork blocks until new work is available (returns true), or if it is
   // time to exit (returns false). Can optionally return a task to execute in t
   // (in such case t.f != nullptr on return).
-  bool WaitForWork(EventCount::Waiter* waiter, Task* t) {
+  bool WaitForWork(EventCount::Waiter* waiter, Task* t,
+                   WorkQueueThreadStats* stats) {
     assert(t != nullptr && !t->f);
     // We already did best-effort emptiness check in Steal, so prepare for
     // blocking.
@@ -389,6 +481,14 @@ class ThreadPoolTempl {
     if (victim != -1) {
       ec_.CancelWait();
       *t = thread_data_[victim].queue.PopBack();
+      if (t->f) {
+        CountTaken(victim, false);
+      } else {
+        *t = thread_data_[victim].affinity_queue.PopBack();
+        if (t->f) {
+          CountTaken(victim, true);
+        }
+      }
       blocked_--;
       return true;
     }
@@ -428,6 +528,7 @@ class ThreadPoolTempl {
     // Wait for work
     platform::RecordEvent record("WaitForWork",
                                  platform::TracerEventType::UserDefined, 10);
+    WorkQueueThreadStats::Increase(&stats->parks);
     ec_.CommitWait(waiter);
     blocked_--;
     return true;
@@ -443,7 +544,8 @@ class ThreadPoolTempl {
     unsigned inc = all_coprimes_[size - 1][r % all_coprimes_[size - 1].size()];
     unsigned victim = r % size;
     for (unsigned i = 0; i < size; i++) {
-      if (!thread_data_[victim].queue.Empty()) {
+      if (!thread_data_[victim].queue.Empty() ||
+          !thread_data_[victim].affinity_queue.Empty()) {
         return victim;
       }
       victim += inc;
@@ -63,14 +63,14 @@ class WorkQueueImpl : public WorkQueue {
     platform::RecordEvent record("WorkQueue::AddTask",
                                  platform::TracerEventType::UserDefined,
                                  10 /*level*/);
-    if (tracker_ != nullptr) {
-      fn = [
-        task = std::move(fn), raii = CounterGuard<TaskTracker>(tracker_)
-      ]() mutable {
-        task();
-      };
-    }
-    queue_->AddTask(std::move(fn));
+    queue_->AddTask(TrackTask(std::move(fn)));
+  }
+
+  void AddTaskWithAffinity(std::function<void()> fn, int affinity) override {
+    platform::RecordEvent record("WorkQueue::AddTask",
+                                 platform::TracerEventType::UserDefined,
+                                 10 /*level*/);
+    queue_->AddTaskWithAffinity(TrackTask(std::move(fn)), affinity);
   }
 
   void Cancel() override {
@@ -80,7 +80,18 @@ class WorkQueueImpl : public WorkQueue {
 
   size_t NumThreads() const override { return queue_->NumThreads(); }
 
+  int CurrentThreadId() const override { return queue_->CurrentThreadId(); }
+
  private:
+  std::function<void()> TrackTask(std::function<void()> fn) {
+    if (tracker_ == nullptr) {
+      return fn;
+    }
+    return [
+      task = std::move(fn), raii = CounterGuard<TaskTracker>(tracker_)
+    ]() mutable { task(); };
+  }
+
   NonblockingThreadPool* queue_{nullptr};
   TaskTracker* tracker_{nullptr};
   std::shared_ptr<EventsWaiter::EventNotifier> empty_notifier_;
@@ -96,13 +107,20 @@ class WorkQueueGroupImpl : public WorkQueueGroup {
 
   void AddTask(size_t queue_idx, std::function<void()> fn) override;
 
+  void AddTaskWithAffinity(size_t queue_idx, std::function<void()> fn,
+                           int affinity) override;
+
   size_t QueueNumThreads(size_t queue_idx) const override;
 
   size_t QueueGroupNumThreads() const override;
 
+  int QueueCurrentThreadId(size_t queue_idx) const override;
+
   void Cancel() override;
 
  private:
+  std::function<void()> TrackTask(size_t queue_idx, std::function<void()> fn);
+
   std::vector<NonblockingThreadPool*> queues_;
   NonblockingThreadPool* queues_storage_;
   TaskTracker* tracker_;
@@ -152,19 +170,33 @@ WorkQueueGroupImpl::~WorkQueueGroupImpl() {
   }
 }
 
+std::function<void()> WorkQueueGroupImpl::TrackTask(
+    size_t queue_idx, std::function<void()> fn) {
+  if (!queues_options_.at(queue_idx).track_task) {
+    return fn;
+  }
+  return [
+    task = std::move(fn), raii = CounterGuard<TaskTracker>(tracker_)
+  ]() mutable { task(); };
+}
+
 void WorkQueueGroupImpl::AddTask(size_t queue_idx, std::function<void()> fn) {
   platform::RecordEvent record("WorkQueue::AddTask",
                                platform::TracerEventType::UserDefined,
                                10 /*level*/);
   assert(queue_idx < queues_.size());
-  if (queues_options_.at(queue_idx).track_task) {
-    fn = [
-      task = std::move(fn), raii = CounterGuard<TaskTracker>(tracker_)
-    ]() mutable {
-      task();
-    };
-  }
-  queues_[queue_idx]->AddTask(std::move(fn));
+  queues_[queue_idx]->AddTask(TrackTask(queue_idx, std::move(fn)));
+}
+
+void WorkQueueGroupImpl::AddTaskWithAffinity(size_t queue_idx,
+                                             std::function<void()> fn,
+                                             int affinity) {
+  platform::RecordEvent record("WorkQueue::AddTask",
+                               platform::TracerEventType::UserDefined,
+                               10 /*level*/);
+  assert(queue_idx < queues_.size());
+  queues_[queue_idx]->AddTaskWithAffinity(TrackTask(queue_idx, std::move(fn)),
+                                          affinity);
 }
 
 size_t WorkQueueGroupImpl::QueueNumThreads(size_t queue_idx) const {
@@ -180,6 +212,11 @@ size_t WorkQueueGroupImpl::QueueGroupNumThreads() const {
   return total_num;
 }
 
+int WorkQueueGroupImpl::QueueCurrentThreadId(size_t queue_idx) const {
+  assert(queue_idx < queues_.size());
+  return queues_.at(queue_idx)->CurrentThreadId();
+}
+
 void WorkQueueGroupImpl::Cancel() {
   for (auto queue : queues_) {
     queue->Cancel();
@@ -109,6 +109,11 @@ class WorkQueue {
 
   virtual void AddTask(std::function<void()> fn) = 0;
 
+  // Prefers to run fn on the thread affinity of the queue, e.g. the thread
+  // that produced the inputs of fn, idle threads still steal it. affinity is
+  // a value returned by CurrentThreadId, -1 means no preference.
+  virtual void AddTaskWithAffinity(std::function<void()> fn, int affinity) = 0;
+
   // Higher cost than AddTask
   template <typename F, typename... Args>
   std::future<typename std::result_of<F(Args...)>::type> AddAwaitableTask(
@@ -130,6 +135,9 @@ class WorkQueue {
 
   virtual size_t NumThreads() const = 0;
 
+  // index of the calling thread in the queue, -1 if it is not a worker of it
+  virtual int CurrentThreadId() const = 0;
+
   virtual void Cancel() = 0;
 
  protected:
@@ -149,6 +157,10 @@ class WorkQueueGroup {
 
   virtual void AddTask(size_t queue_idx, std::function<void()> fn) = 0;
 
+  // See WorkQueue::AddTaskWithAffinity
+  virtual void AddTaskWithAffinity(size_t queue_idx, std::function<void()> fn,
+                                   int affinity) = 0;
+
   // Higher cost than AddTask
   template <typename F, typename... Args>
   std::future<typename std::result_of<F(Args...)>::type> AddAwaitableTask(
@@ -172,6 +184,9 @@ class WorkQueueGroup {
 
   virtual size_t QueueGroupNumThreads() const = 0;
 
+  // See WorkQueue::CurrentThreadId
+  virtual int QueueCurrentThreadId(size_t queue_idx) const = 0;
+
   virtual void Cancel() = 0;
 
  protected:
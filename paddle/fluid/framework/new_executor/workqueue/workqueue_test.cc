@@ -193,3 +193,90 @@ TEST(WorkQueue, TestWorkQueueGroup) {
   queue_group.reset();
   waiter_thread.join();
 }
+
+TEST(WorkQueue, TestAddTaskWithAffinity) {
+  using paddle::framework::WorkQueueOptions;
+  using paddle::framework::WorkQueue;
+  using paddle::framework::CreateMultiThreadedWorkQueue;
+  using paddle::framework::GetAllWorkQueueThreadStats;
+  constexpr int kNumThreads = 4;
+  constexpr unsigned kTaskNum = 1000;
+  WorkQueueOptions options(/*name*/ "AffinityWorkQueueForTesting",
+                           /*num_threads*/ kNumThreads,
+                           /*allow_spinning*/ true, /*track_task*/ false);
+  auto work_queue = CreateMultiThreadedWorkQueue(options);
+  EXPECT_EQ(work_queue->CurrentThreadId(), -1);
+  std::atomic<unsigned> counter{0};
+  std::atomic<unsigned> on_affinity{0};
+  for (unsigned i = 0; i < kTaskNum; ++i) {
+    int affinity = i % kNumThreads;
+    work_queue->AddTaskWithAffinity(
+        [&work_queue, &counter, &on_affinity, affinity, kNumThreads]() {
+          int thread_id = work_queue->CurrentThreadId();
+          EXPECT_GE(thread_id, 0);
+          EXPECT_LT(thread_id, kNumThreads);
+          if (thread_id == affinity) {
+            ++on_affinity;
+          }
+          ++counter;
+        },
+        affinity);
+  }
+  // out of range affinity means no preference
+  work_queue->AddTaskWithAffinity([&counter]() { ++counter; }, kNumThreads);
+  // the queue may run empty while tasks are still being added, so the
+  // QueueEmpty event can not be used here
+  while (counter.load() < kTaskNum + 1) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(counter.load(), kTaskNum + 1);
+  VLOG(1) << on_affinity.load() << " of " << kTaskNum
+          << " tasks ran on their affinity thread";
+
+  // every worker is held by a task, and only the one of the affinity thread
+  // is released, which then takes the hinted task before any other thread
+  // is free to steal it
+  for (int affinity = 0; affinity < kNumThreads; ++affinity) {
+    std::atomic<int> held{0};
+    std::atomic<bool> release[kNumThreads] = {};
+    for (int i = 0; i < kNumThreads; ++i) {
+      work_queue->AddTask([&work_queue, &held, &release]() {
+        int thread_id = work_queue->CurrentThreadId();
+        ++held;
+        while (!release[thread_id].load()) {
+          std::this_thread::yield();
+        }
+        --held;
+      });
+    }
+    while (held.load() < kNumThreads) {
+      std::this_thread::yield();
+    }
+    std::atomic<int> ran_on{-1};
+    work_queue->AddTaskWithAffinity(
+        [&work_queue, &ran_on]() { ran_on = work_queue->CurrentThreadId(); },
+        affinity);
+    release[affinity] = true;
+    while (ran_on.load() == -1) {
+      std::this_thread::yield();
+    }
+    EXPECT_EQ(ran_on.load(), affinity);
+    for (auto& flag : release) {
+      flag = true;
+    }
+    while (held.load() > 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  uint64_t tasks = 0;
+  uint64_t affinity_hits = 0;
+  for (auto& kv : GetAllWorkQueueThreadStats()) {
+    tasks += kv.second.tasks;
+    affinity_hits += kv.second.affinity_hits;
+  }
+  // a worker counts its task after the task finished
+  EXPECT_GE(tasks + kNumThreads, kTaskNum + 1);
+  EXPECT_GE(affinity_hits, static_cast<uint64_t>(kNumThreads));
+  work_queue.reset();
+}
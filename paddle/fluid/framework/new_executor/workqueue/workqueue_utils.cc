@@ -55,5 +55,11 @@ void AlignedFree(void* mem_ptr) {
 #endif
 }
 
+std::unordered_map<uint64_t, WorkQueueThreadStats>
+GetAllWorkQueueThreadStats() {
+  return ThreadDataRegistry<WorkQueueThreadStats>::GetInstance()
+      .GetAllThreadDataByValue();
+}
+
 }  // namespace framework
 }  // namespace paddle
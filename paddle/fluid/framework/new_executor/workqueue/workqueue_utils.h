@@ -21,7 +21,9 @@
 #include <memory>
 #include <set>
 #include <string>
+#include <unordered_map>
 #include "paddle/fluid/framework/new_executor/workqueue/events_waiter.h"
+#include "paddle/fluid/framework/new_executor/workqueue/thread_data_registry.h"
 #include "paddle/fluid/platform/enforce.h"
 
 namespace paddle {
@@ -104,5 +106,51 @@ class TaskTracker {
   Notifier* notifier_{nullptr};
 };
 
+// Scheduling counters of a worker thread of a WorkQueue. They are only updated
+// by the thread itself but read by others at any time, so they are relaxed
+// atomics, bumped by Increase without a read-modify-write.
+struct WorkQueueThreadStats {
+  WorkQueueThreadStats() = default;
+  WorkQueueThreadStats(const WorkQueueThreadStats& other) { *this = other; }
+  WorkQueueThreadStats& operator=(const WorkQueueThreadStats& other) {
+    Copy(other.tasks, &tasks);
+    Copy(other.affinity_hits, &affinity_hits);
+    Copy(other.steals, &steals);
+    Copy(other.spins, &spins);
+    Copy(other.parks, &parks);
+    return *this;
+  }
+
+  static void Increase(std::atomic<uint64_t>* counter) {
+    counter->store(counter->load(std::memory_order_relaxed) + 1,
+                   std::memory_order_relaxed);
+  }
+
+  std::atomic<uint64_t> tasks{0};
+  // tasks that ran on the thread given as their affinity
+  std::atomic<uint64_t> affinity_hits{0};
+  // tasks taken from the queues of another thread
+  std::atomic<uint64_t> steals{0};
+  // spin rounds that found no task
+  std::atomic<uint64_t> spins{0};
+  // times the thread went to sleep for lack of tasks
+  std::atomic<uint64_t> parks{0};
+
+ private:
+  static void Copy(const std::atomic<uint64_t>& from,
+                   std::atomic<uint64_t>* to) {
+    to->store(from.load(std::memory_order_relaxed), std::memory_order_relaxed);
+  }
+};
+
+inline WorkQueueThreadStats* CurrentWorkQueueThreadStats() {
+  return ThreadDataRegistry<WorkQueueThreadStats>::GetInstance()
+      .GetMutableCurrentThreadData();
+}
+
+// Snapshot of the counters of all live worker threads, keyed by the same
+// thread id as platform::GetAllThreadNames.
+std::unordered_map<uint64_t, WorkQueueThreadStats> GetAllWorkQueueThreadStats();
+
 }  // namespace framework
 }  // namespace paddle
@@ -26,6 +26,7 @@ limitations under the License. */
 #include "paddle/fluid/framework/transfer_scope_cache.h"
 #include "paddle/fluid/framework/unused_var_check.h"
 #include "paddle/fluid/framework/var_type.h"
+#include "paddle/fluid/memory/allocation/allocation_tracer.h"
 #include "paddle/fluid/platform/device/device_wrapper.h"
 #include "paddle/fluid/platform/enforce.h"
 #include "paddle/fluid/platform/profiler.h"
@@ -58,6 +59,7 @@ DECLARE_bool(check_nan_inf);
 DECLARE_bool(enable_unused_var_check);
 DECLARE_bool(run_kp_kernel);
 DECLARE_bool(enable_host_event_recorder_hook);
+DECLARE_int32(infer_shape_cache_capacity);
 
 namespace paddle {
 namespace framework {
@@ -266,6 +268,7 @@ void OperatorBase::Run(const Scope& scope, const platform::Place& place) {
           op_name, platform::TracerEventType::Operator,
           FLAGS_enable_host_event_recorder_hook ? 20 : 1,
           platform::EventRole::kUniqueOp);
+      memory::allocation::AllocationTraceScope trace_scope(Type());
       RunImpl(scope, place);
     }
 
@@ -1230,6 +1233,31 @@ void OperatorWithKernel::RuntimeInferShape(const Scope& scope,
   this->Info().infer_shape_(&infer_shape_ctx);
 }
 
+void OperatorWithKernel::InferShapeWithCache(
+    const RuntimeContext& ctx, InferShapeContext* infer_shape_ctx) const {
+  InferShapeCache::Signature signature;
+  if (FLAGS_infer_shape_cache_capacity <= 0 ||
+      !InferShapeCache::GetSignature(ctx.inputs, ctx.outputs, &signature)) {
+    this->Info().infer_shape_(infer_shape_ctx);
+    return;
+  }
+  if (infer_shape_cache_ == nullptr) {
+    std::lock_guard<std::mutex> lock(cache_update_mutex_);
+    if (infer_shape_cache_ == nullptr) {
+      infer_shape_cache_.reset(
+          new InferShapeCache(FLAGS_infer_shape_cache_capacity));
+    }
+  }
+  if (infer_shape_cache_->Apply(signature, ctx.outputs)) {
+    VLOG(6) << "Op(" << type_ << ") reuses the cached InferShape result, "
+            << infer_shape_cache_->Hits() << " hits and "
+            << infer_shape_cache_->Misses() << " misses";
+    return;
+  }
+  this->Info().infer_shape_(infer_shape_ctx);
+  infer_shape_cache_->Insert(std::move(signature), ctx.outputs);
+}
+
 void OperatorWithKernel::RunImpl(const Scope& scope,
                                  const platform::Place& place) const {
   // To reduce the elapsed time of HasAttr, we use bool variable to record the
@@ -1494,7 +1522,7 @@ void OperatorWithKernel::RunImpl(const Scope& scope,
                                        platform::TracerEventType::OperatorInner,
                                        1, platform::EventRole::kInnerOp);
     RuntimeInferShapeContext infer_shape_ctx(*this, *runtime_ctx);
-    this->Info().infer_shape_(&infer_shape_ctx);
+    InferShapeWithCache(*runtime_ctx, &infer_shape_ctx);
   }
 
   if (FLAGS_enable_unused_var_check) {
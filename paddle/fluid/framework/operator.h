@@ -27,6 +27,7 @@ limitations under the License. */
 #include "glog/logging.h"  // For VLOG
 #include "paddle/fluid/framework/attribute.h"
 #include "paddle/fluid/framework/block_desc.h"
+#include "paddle/fluid/framework/infer_shape_cache.h"
 #include "paddle/fluid/framework/lod_tensor.h"
 #include "paddle/fluid/framework/op_info.h"
 #include "paddle/fluid/framework/op_kernel_type.h"
@@ -588,6 +589,24 @@ class OperatorWithKernel : public OperatorBase {
   void RuntimeInferShape(const Scope& scope, const platform::Place& place,
                          const RuntimeContext& ctx) const override;
 
+  // Runs InferShape with infer_shape_ctx, which must be built from ctx, or
+  // reuses the outputs that InferShape computed for the same input shapes
+  // when FLAGS_infer_shape_cache_capacity > 0.
+  void InferShapeWithCache(const RuntimeContext& ctx,
+                           InferShapeContext* infer_shape_ctx) const;
+
+  // nullptr before the op runs with the cache enabled
+  const InferShapeCache* GetInferShapeCache() const {
+    return infer_shape_cache_.get();
+  }
+
+  // Whether the next run in scope reuses the RuntimeContext cached by the
+  // op, see kEnableCacheRuntimeContext.
+  bool HasCachedRuntimeContext(const Scope& scope) const {
+    return enable_cache_runtime_context_ && runtime_ctx_ != nullptr &&
+           pre_scope_ == &scope;
+  }
+
   proto::VarType::Type IndicateVarDataType(const ExecutionContext& ctx,
                                            const std::string& name) const;
 
@@ -710,6 +729,7 @@ class OperatorWithKernel : public OperatorBase {
   mutable std::unique_ptr<phi::KernelSignature> kernel_signature_;
   mutable std::unique_ptr<phi::Kernel> pt_kernel_;
   mutable std::unique_ptr<phi::ArgumentMappingFn> arg_map_fn_;
+  mutable std::unique_ptr<InferShapeCache> infer_shape_cache_;
 };
 
 extern bool OpSupportGPU(const std::string& op_type);
@@ -0,0 +1,433 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/allocation_tracer.h"
+
+#include <algorithm>
+#include <chrono>  // NOLINT
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+#include <utility>
+
+#include "paddle/fluid/platform/flags.h"
+
+PADDLE_DEFINE_EXPORTED_READONLY_bool(
+    trace_allocation, false,
+    "Whether to record the size, op and lifetime of every allocation of the "
+    "allocator facade, and the free blocks of the auto growth allocators. "
+    "The records can be dumped by AllocationTracer as a chrome tracing "
+    "timeline and a fragmentation report.");
+
+PADDLE_DEFINE_EXPORTED_uint64(
+    trace_allocation_max_events, 1UL << 20,
+    "The number of freed allocations kept by the allocation tracer, the "
+    "oldest ones are dropped first. Only works when "
+    "FLAGS_trace_allocation=true.");
+
+PADDLE_DEFINE_EXPORTED_string(
+    trace_allocation_timeline_path, "",
+    "The file the allocation tracer saves its chrome tracing timeline to at "
+    "exit, none by default. Only works when FLAGS_trace_allocation=true.");
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+static thread_local const std::string* tls_trace_tag = nullptr;
+
+AllocationTraceScope::AllocationTraceScope(const std::string& tag)
+    : prev_tag_(tls_trace_tag) {
+  tls_trace_tag = &tag;
+}
+
+AllocationTraceScope::~AllocationTraceScope() { tls_trace_tag = prev_tag_; }
+
+const std::string* AllocationTraceScope::CurrentTag() { return tls_trace_tag; }
+
+AllocationTracer& AllocationTracer::Instance() {
+  // never destroyed, the pools may unregister during exit
+  static auto* instance = new AllocationTracer();
+  return *instance;
+}
+
+bool AllocationTracer::IsEnabled() { return FLAGS_trace_allocation; }
+
+AllocationTracer::AllocationTracer()
+    : start_ns_(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch())
+                    .count()) {
+  tags_.emplace_back("unknown");
+  if (!FLAGS_trace_allocation_timeline_path.empty()) {
+    std::atexit([] {
+      AllocationTracer::Instance().SaveTimeline(
+          FLAGS_trace_allocation_timeline_path);
+    });
+  }
+}
+
+int64_t AllocationTracer::NowNs() const {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+             .count() -
+         start_ns_;
+}
+
+// the records a thread buffers before it merges them
+static constexpr size_t kThreadBufferRecords = 4096;
+
+size_t AllocationTracer::ThreadBuffer::LocalTagId(const std::string* tag) {
+  if (tag == nullptr) {
+    return 0;
+  }
+  // the allocations of an op come in a row
+  if (tags[last_tag_id] == *tag) {
+    return last_tag_id;
+  }
+  auto iter = tag_ids.emplace(*tag, tags.size());
+  if (iter.second) {
+    tags.push_back(*tag);
+  }
+  last_tag_id = iter.first->second;
+  return last_tag_id;
+}
+
+AllocationTracer::ThreadBuffer* AllocationTracer::CurrentThreadBuffer() {
+  // the buffer is released when the thread exits, and the thread records
+  // without one after that, e.g. in the destructors of statics
+  static thread_local bool exited = false;
+  struct Holder {
+    ~Holder() { exited = true; }
+    std::shared_ptr<ThreadBuffer> buffer;
+  };
+  if (exited) {
+    return nullptr;
+  }
+  static thread_local Holder holder;
+  if (holder.buffer == nullptr) {
+    holder.buffer = std::make_shared<ThreadBuffer>();
+    std::lock_guard<std::mutex> guard(mutex_);
+    buffers_.push_back(holder.buffer);
+  }
+  return holder.buffer.get();
+}
+
+size_t AllocationTracer::TagIdLocked(const std::string& tag) {
+  auto iter = tag_ids_.emplace(tag, tags_.size());
+  if (iter.second) {
+    tags_.push_back(tag);
+  }
+  return iter.first->second;
+}
+
+void AllocationTracer::Append(const Record& record) {
+  auto* buffer = CurrentThreadBuffer();
+  if (buffer == nullptr) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    MergeLocked();
+    Record global_record = record;
+    global_record.tag = tls_trace_tag ? TagIdLocked(*tls_trace_tag) : 0;
+    ApplyLocked(global_record);
+    return;
+  }
+  bool full = false;
+  {
+    // only contended while the buffers are merged
+    std::lock_guard<std::mutex> guard(buffer->mutex);
+    buffer->records.push_back(record);
+    buffer->records.back().tag = buffer->LocalTagId(tls_trace_tag);
+    full = buffer->records.size() >= kThreadBufferRecords;
+  }
+  if (full) {
+    std::lock_guard<std::mutex> guard(mutex_);
+    MergeLocked();
+  }
+}
+
+void AllocationTracer::RecordAllocate(const phi::Allocation* allocation) {
+  Append({allocation, reinterpret_cast<uintptr_t>(allocation->ptr()),
+          allocation->size(), allocation->place(), 0, NowNs(), false});
+}
+
+void AllocationTracer::RecordFree(const phi::Allocation* allocation) {
+  Append({allocation, 0, 0, platform::Place(), 0, NowNs(), true});
+}
+
+void AllocationTracer::MergeLocked() {
+  // All the buffers are locked at once, so that a free that was appended
+  // after its allocation on another thread is never merged before it.
+  std::vector<std::unique_lock<std::mutex>> locks;
+  locks.reserve(buffers_.size());
+  for (auto& buffer : buffers_) {
+    locks.emplace_back(buffer->mutex);
+  }
+  std::vector<Record> records;
+  for (auto& buffer : buffers_) {
+    for (size_t i = buffer->global_tag_ids.size(); i < buffer->tags.size();
+         ++i) {
+      buffer->global_tag_ids.push_back(TagIdLocked(buffer->tags[i]));
+    }
+    for (auto& record : buffer->records) {
+      records.push_back(record);
+      records.back().tag = buffer->global_tag_ids[record.tag];
+    }
+    buffer->records.clear();
+  }
+  locks.clear();
+  // the buffer of an exited thread is only held here
+  buffers_.erase(std::remove_if(buffers_.begin(), buffers_.end(),
+                                [](const std::shared_ptr<ThreadBuffer>& b) {
+                                  return b.use_count() == 1;
+                                }),
+                 buffers_.end());
+
+  // an allocation comes before its free at the same time
+  std::stable_sort(records.begin(), records.end(),
+                   [](const Record& a, const Record& b) {
+                     return a.ns < b.ns || (a.ns == b.ns && !a.is_free &&
+                                            b.is_free);
+                   });
+  for (auto& record : records) {
+    ApplyLocked(record);
+  }
+}
+
+void AllocationTracer::ApplyLocked(const Record& record) {
+  if (!record.is_free) {
+    live_[record.allocation] = {record.ptr, record.size, record.place,
+                                record.tag, record.ns, -1};
+    return;
+  }
+  auto iter = live_.find(record.allocation);
+  if (iter == live_.end()) {
+    // allocated before Clear
+    return;
+  }
+  iter->second.free_ns = record.ns;
+  freed_.push_back(iter->second);
+  live_.erase(iter);
+  if (freed_.size() > FLAGS_trace_allocation_max_events) {
+    freed_.pop_front();
+  }
+}
+
+void AllocationTracer::RegisterPool(const void* pool,
+                                    FreeBlockCollector collector) {
+  std::lock_guard<std::mutex> guard(pool_mutex_);
+  pools_[pool] = std::move(collector);
+}
+
+void AllocationTracer::UnregisterPool(const void* pool) {
+  std::lock_guard<std::mutex> guard(pool_mutex_);
+  pools_.erase(pool);
+}
+
+static std::string PlaceString(const platform::Place& place) {
+  std::ostringstream os;
+  os << place;
+  return os.str();
+}
+
+static std::string JsonEscape(const std::string& str) {
+  std::string escaped;
+  for (char c : str) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+std::string AllocationTracer::Timeline() {
+  std::vector<Event> events;
+  std::vector<std::string> tags;
+  int64_t now = NowNs();
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    MergeLocked();
+    events.assign(freed_.begin(), freed_.end());
+    for (auto& pair : live_) {
+      events.push_back(pair.second);
+    }
+    tags = tags_;
+  }
+  std::sort(events.begin(), events.end(), [](const Event& a, const Event& b) {
+    return a.allocate_ns < b.allocate_ns;
+  });
+
+  std::map<std::string, int> place_ids;
+  // (time, place, bytes) of the counter of allocated bytes
+  std::vector<std::tuple<int64_t, std::string, int64_t>> deltas;
+  std::ostringstream os;
+  os << "{\"traceEvents\":[";
+  const char* sep = "";
+  for (auto& event : events) {
+    auto place = PlaceString(event.place);
+    int place_id = place_ids.emplace(place, place_ids.size()).first->second;
+    bool live = event.free_ns < 0;
+    int64_t free_ns = live ? now : event.free_ns;
+    os << sep << "{\"name\":\"" << JsonEscape(tags[event.tag])
+       << "\",\"cat\":\"" << place << "\",\"ph\":\"X\",\"pid\":0,\"tid\":"
+       << place_id << ",\"ts\":" << event.allocate_ns / 1000.0
+       << ",\"dur\":" << (free_ns - event.allocate_ns) / 1000.0
+       << ",\"args\":{\"bytes\":" << event.size << ",\"ptr\":\"0x" << std::hex
+       << event.ptr << std::dec << "\",\"live\":" << (live ? "true" : "false")
+       << "}}";
+    sep = ",";
+    deltas.emplace_back(event.allocate_ns, place, event.size);
+    if (!live) {
+      deltas.emplace_back(event.free_ns, place,
+                          -static_cast<int64_t>(event.size));
+    }
+  }
+  std::sort(deltas.begin(), deltas.end());
+  // the freed allocations that were dropped are missing, so the counter
+  // starts from the oldest kept allocation
+  std::map<std::string, int64_t> allocated;
+  for (auto& delta : deltas) {
+    auto& bytes = allocated[std::get<1>(delta)];
+    bytes += std::get<2>(delta);
+    os << sep << "{\"name\":\"allocated\",\"ph\":\"C\",\"pid\":0,\"ts\":"
+       << std::get<0>(delta) / 1000.0 << ",\"args\":{\"" << std::get<1>(delta)
+       << "\":" << bytes << "}}";
+    sep = ",";
+  }
+  os << "]}";
+  return os.str();
+}
+
+bool AllocationTracer::SaveTimeline(const std::string& path) {
+  std::ofstream fout(path);
+  if (!fout) {
+    LOG(WARNING) << "Cannot open " << path << " to save the allocation "
+                 << "timeline";
+    return false;
+  }
+  fout << Timeline();
+  return static_cast<bool>(fout);
+}
+
+std::string AllocationTracer::LiveAllocationReport() {
+  std::map<std::pair<std::string, std::string>, std::pair<size_t, size_t>>
+      usage;
+  {
+    std::lock_guard<std::mutex> guard(mutex_);
+    MergeLocked();
+    for (auto& pair : live_) {
+      auto& event = pair.second;
+      auto& item = usage[{PlaceString(event.place), tags_[event.tag]}];
+      item.first += event.size;
+      ++item.second;
+    }
+  }
+  std::vector<std::pair<size_t, std::string>> lines;
+  for (auto& pair : usage) {
+    std::ostringstream os;
+    os << "  " << pair.first.first << " " << pair.first.second << ": "
+       << pair.second.first << " bytes in " << pair.second.second
+       << " allocations\n";
+    lines.emplace_back(pair.second.first, os.str());
+  }
+  std::sort(lines.begin(), lines.end(),
+            [](const std::pair<size_t, std::string>& a,
+               const std::pair<size_t, std::string>& b) {
+              return a.first > b.first;
+            });
+  std::string report = "Live allocations:\n";
+  for (auto& line : lines) {
+    report += line.second;
+  }
+  return report;
+}
+
+std::string AllocationTracer::FragmentationReport() {
+  struct FreeBlocks {
+    size_t bytes = 0;
+    size_t largest = 0;
+    // bucket i holds the blocks in [2^i, 2^(i+1))
+    std::map<int, std::pair<size_t, size_t>> buckets;
+  };
+  std::map<std::string, FreeBlocks> places;
+  FreeBlockVisitor visitor = [&places](const platform::Place& place,
+                                       size_t size) {
+    auto& blocks = places[PlaceString(place)];
+    blocks.bytes += size;
+    blocks.largest = std::max(blocks.largest, size);
+    int bucket = 0;
+    while ((size >> (bucket + 1)) > 0) {
+      ++bucket;
+    }
+    auto& item = blocks.buckets[bucket];
+    ++item.first;
+    item.second += size;
+  };
+  {
+    std::lock_guard<std::mutex> guard(pool_mutex_);
+    for (auto& pair : pools_) {
+      pair.second(visitor);
+    }
+  }
+
+  std::ostringstream os;
+  os << "Free blocks:\n";
+  for (auto& pair : places) {
+    auto& blocks = pair.second;
+    double fragmentation =
+        blocks.bytes == 0
+            ? 0.0
+            : 1.0 - static_cast<double>(blocks.largest) / blocks.bytes;
+    os << "  " << pair.first << ": " << blocks.bytes << " bytes, largest "
+       << blocks.largest << ", fragmentation " << fragmentation << "\n";
+    for (auto& bucket : blocks.buckets) {
+      os << "    [" << (1UL << bucket.first) << ", "
+         << (1UL << (bucket.first + 1)) << "): " << bucket.second.first
+         << " blocks, " << bucket.second.second << " bytes\n";
+    }
+  }
+  return os.str();
+}
+
+void AllocationTracer::Clear() {
+  std::lock_guard<std::mutex> guard(mutex_);
+  MergeLocked();
+  live_.clear();
+  freed_.clear();
+}
+
+phi::Allocation* TracingAllocator::AllocateImpl(size_t size) {
+  auto& tracer = AllocationTracer::Instance();
+  AllocationPtr allocation;
+  try {
+    allocation = underlying_allocator_->Allocate(size);
+  } catch (BadAlloc&) {
+    LOG(WARNING) << "Fail to allocate " << size << " bytes.\n"
+                 << tracer.LiveAllocationReport()
+                 << tracer.FragmentationReport();
+    throw;
+  }
+  tracer.RecordAllocate(allocation.get());
+  return allocation.release();
+}
+
+void TracingAllocator::FreeImpl(phi::Allocation* allocation) {
+  AllocationTracer::Instance().RecordFree(allocation);
+  underlying_allocator_->Free(allocation);
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
@@ -0,0 +1,171 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stdint.h>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>  // NOLINT
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "paddle/fluid/memory/allocation/allocator.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+// Tags the allocations of the current thread with the name of what runs,
+// usually an op type, while it is alive. The tag must outlive the scope.
+class AllocationTraceScope {
+ public:
+  explicit AllocationTraceScope(const std::string& tag);
+  ~AllocationTraceScope();
+
+  static const std::string* CurrentTag();
+
+ private:
+  const std::string* prev_tag_;
+};
+
+// Records the size, tag and lifetime of the allocations of the facade when
+// FLAGS_trace_allocation is set, and the free blocks of the registered
+// memory pools.
+//
+// Every thread appends its allocations and frees to a buffer of its own, so
+// that the threads of the allocator do not contend on the tracer. The buffers
+// are merged into the records of all threads when one of them is full, and
+// before the records are read.
+class AllocationTracer {
+ public:
+  // calls the visitor with the place and the size of every free block
+  using FreeBlockVisitor = std::function<void(const platform::Place&, size_t)>;
+  using FreeBlockCollector = std::function<void(const FreeBlockVisitor&)>;
+
+  static AllocationTracer& Instance();
+
+  static bool IsEnabled();
+
+  void RecordAllocate(const phi::Allocation* allocation);
+  void RecordFree(const phi::Allocation* allocation);
+
+  // Pools register at construction, and must unregister before they are
+  // destroyed. The collector may run on any thread.
+  void RegisterPool(const void* pool, FreeBlockCollector collector);
+  void UnregisterPool(const void* pool);
+
+  // The allocations in chrome tracing format, one complete event for each,
+  // and a counter of the allocated bytes of every place. It is saved to
+  // FLAGS_trace_allocation_timeline_path at exit when the flag is set.
+  std::string Timeline();
+  bool SaveTimeline(const std::string& path);
+
+  // The live bytes of every tag and place, the largest first.
+  std::string LiveAllocationReport();
+
+  // The free blocks of every place in power of two size buckets, with
+  // 1 - largest free block / free bytes as the fragmentation.
+  std::string FragmentationReport();
+
+  void Clear();
+
+ private:
+  AllocationTracer();
+
+  struct Event {
+    uintptr_t ptr;
+    size_t size;
+    platform::Place place;
+    size_t tag;
+    int64_t allocate_ns;
+    int64_t free_ns;
+  };
+
+  // an allocation, or a free of which only allocation and ns are set
+  struct Record {
+    const phi::Allocation* allocation;
+    uintptr_t ptr;
+    size_t size;
+    platform::Place place;
+    // index into the tags of the thread buffer
+    size_t tag;
+    int64_t ns;
+    bool is_free;
+  };
+
+  struct ThreadBuffer {
+    size_t LocalTagId(const std::string* tag);
+
+    std::mutex mutex;
+    std::vector<Record> records;
+    // tag 0 is no tag, global_tag_ids are extended by MergeLocked
+    std::vector<std::string> tags{""};
+    std::vector<size_t> global_tag_ids{0};
+    std::unordered_map<std::string, size_t> tag_ids;
+    size_t last_tag_id{0};
+  };
+
+  int64_t NowNs() const;
+  ThreadBuffer* CurrentThreadBuffer();
+  void Append(const Record& record);
+  // The ones below are called with mutex_ held. MergeLocked moves the records
+  // of all the thread buffers into live_ and freed_ by ApplyLocked.
+  size_t TagIdLocked(const std::string& tag);
+  void MergeLocked();
+  void ApplyLocked(const Record& record);
+
+  const int64_t start_ns_;
+  std::mutex mutex_;
+  // the buffers of the threads that ever allocated or freed, the ones of
+  // exited threads are dropped once merged
+  std::vector<std::shared_ptr<ThreadBuffer>> buffers_;
+  std::vector<std::string> tags_;
+  std::unordered_map<std::string, size_t> tag_ids_;
+  // keyed by the allocation object, not the pointer, since allocations of
+  // size 0 share pointers
+  std::unordered_map<const phi::Allocation*, Event> live_;
+  std::deque<Event> freed_;
+
+  std::mutex pool_mutex_;
+  std::unordered_map<const void*, FreeBlockCollector> pools_;
+};
+
+// Records the allocations of the underlying allocator to AllocationTracer,
+// and reports the owners of the memory when an allocation fails.
+class TracingAllocator : public Allocator {
+ public:
+  explicit TracingAllocator(std::shared_ptr<Allocator> underlying_allocator)
+      : underlying_allocator_(std::move(underlying_allocator)) {}
+
+  bool IsAllocThreadSafe() const override {
+    return underlying_allocator_->IsAllocThreadSafe();
+  }
+
+ protected:
+  phi::Allocation* AllocateImpl(size_t size) override;
+  void FreeImpl(phi::Allocation* allocation) override;
+  uint64_t ReleaseImpl(const platform::Place& place) override {
+    return underlying_allocator_->Release(place);
+  }
+
+ private:
+  std::shared_ptr<Allocator> underlying_allocator_;
+};
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
@@ -0,0 +1,146 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/allocation_tracer.h"
+
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/fluid/memory/allocation/auto_growth_best_fit_allocator.h"
+#include "paddle/fluid/memory/allocation/cpu_allocator.h"
+
+DECLARE_bool(trace_allocation);
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+TEST(AllocationTracer, TraceAndFragmentation) {
+  FLAGS_trace_allocation = true;
+  auto& tracer = AllocationTracer::Instance();
+  tracer.Clear();
+  {
+    // one chunk of 4096 bytes
+    auto pool = std::make_shared<AutoGrowthBestFitAllocator>(
+        std::make_shared<CPUAllocator>(), 64, 4096);
+    auto allocator = std::make_shared<TracingAllocator>(pool);
+
+    std::string op_a = "op_a";
+    std::string op_b = "op_b";
+    AllocationPtr a, b, c;
+    {
+      AllocationTraceScope scope(op_a);
+      a = allocator->Allocate(1024);
+      {
+        AllocationTraceScope inner_scope(op_b);
+        b = allocator->Allocate(1024);
+      }
+      c = allocator->Allocate(1024);
+    }
+    ASSERT_EQ(AllocationTraceScope::CurrentTag(), nullptr);
+
+    auto live = tracer.LiveAllocationReport();
+    EXPECT_NE(live.find("op_a: 2048 bytes in 2 allocations"),
+              std::string::npos)
+        << live;
+    EXPECT_NE(live.find("op_b: 1024 bytes in 1 allocations"),
+              std::string::npos)
+        << live;
+    // the larger owner comes first
+    EXPECT_LT(live.find("op_a"), live.find("op_b")) << live;
+
+    // b and the tail of the chunk are free, but not adjacent
+    b.reset();
+    auto fragmentation = tracer.FragmentationReport();
+    EXPECT_NE(fragmentation.find("2048 bytes, largest 1024, "
+                                 "fragmentation 0.5"),
+              std::string::npos)
+        << fragmentation;
+    EXPECT_NE(fragmentation.find("[1024, 2048): 2 blocks, 2048 bytes"),
+              std::string::npos)
+        << fragmentation;
+
+    auto timeline = tracer.Timeline();
+    EXPECT_EQ(timeline.find("{\"traceEvents\":["), 0UL);
+    EXPECT_NE(timeline.find("\"name\":\"op_b\",\"cat\":\"Place(cpu)\""),
+              std::string::npos)
+        << timeline;
+    EXPECT_NE(timeline.find("\"live\":false"), std::string::npos);
+    EXPECT_NE(timeline.find("\"ph\":\"C\""), std::string::npos);
+
+    a.reset();
+    c.reset();
+    EXPECT_EQ(tracer.LiveAllocationReport(), "Live allocations:\n");
+  }
+  // the pool unregisters when it is destroyed
+  EXPECT_EQ(tracer.FragmentationReport(), "Free blocks:\n");
+  tracer.Clear();
+  FLAGS_trace_allocation = false;
+}
+
+TEST(AllocationTracer, ThreadBuffers) {
+  FLAGS_trace_allocation = true;
+  auto& tracer = AllocationTracer::Instance();
+  tracer.Clear();
+  auto allocator =
+      std::make_shared<TracingAllocator>(std::make_shared<CPUAllocator>());
+
+  // more allocations than a thread buffers, freed on another thread
+  const int thread_num = 4;
+  const int allocation_num = 5000;
+  std::vector<std::vector<AllocationPtr>> allocations(thread_num);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < thread_num; ++t) {
+    threads.emplace_back([t, &allocator, &allocations] {
+      std::string tag = "op_" + std::to_string(t);
+      AllocationTraceScope scope(tag);
+      for (int i = 0; i < allocation_num; ++i) {
+        allocations[t].push_back(allocator->Allocate(64));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& thread_allocations : allocations) {
+    thread_allocations.resize(allocation_num / 2);
+  }
+  auto live = tracer.LiveAllocationReport();
+  for (int t = 0; t < thread_num; ++t) {
+    std::ostringstream line;
+    line << "op_" << t << ": " << 64 * allocation_num / 2 << " bytes in "
+         << allocation_num / 2 << " allocations";
+    EXPECT_NE(live.find(line.str()), std::string::npos) << live;
+  }
+
+  allocations.clear();
+  EXPECT_EQ(tracer.LiveAllocationReport(), "Live allocations:\n");
+  std::string path = "allocation_tracer_test_timeline.json";
+  ASSERT_TRUE(tracer.SaveTimeline(path));
+  std::ifstream fin(path);
+  std::stringstream saved;
+  saved << fin.rdbuf();
+  EXPECT_EQ(saved.str(), tracer.Timeline());
+  EXPECT_NE(saved.str().find("\"name\":\"op_3\""), std::string::npos);
+  tracer.Clear();
+  FLAGS_trace_allocation = false;
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
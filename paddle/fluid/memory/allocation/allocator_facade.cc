@@ -16,13 +16,16 @@
 
 #include "gflags/gflags.h"
 #include "paddle/fluid/memory/allocation/aligned_allocator.h"
+#include "paddle/fluid/memory/allocation/allocation_tracer.h"
 #include "paddle/fluid/memory/allocation/allocator.h"
 #include "paddle/fluid/memory/allocation/allocator_strategy.h"
 #include "paddle/fluid/memory/allocation/auto_growth_best_fit_allocator.h"
 #include "paddle/fluid/memory/allocation/cpu_allocator.h"
+#include "paddle/fluid/memory/allocation/hugepage_allocator.h"
 #include "paddle/fluid/memory/allocation/naive_best_fit_allocator.h"
 #include "paddle/fluid/memory/allocation/retry_allocator.h"
 #include "paddle/fluid/memory/allocation/stat_allocator.h"
+#include "paddle/fluid/memory/allocation/thread_caching_allocator.h"
 #include "paddle/fluid/platform/enforce.h"
 #include "paddle/fluid/platform/place.h"
 
@@ -212,8 +215,13 @@ class AllocatorFacadePrivate {
         break;
       }
 
-      case AllocatorStrategy::kAutoGrowth: {
-        InitNaiveBestFitCPUAllocator();
+      case AllocatorStrategy::kAutoGrowth:
+      case AllocatorStrategy::kThreadCaching: {
+        if (strategy_ == AllocatorStrategy::kThreadCaching) {
+          InitThreadCachingCPUAllocator(allow_free_idle_chunk);
+        } else {
+          InitNaiveBestFitCPUAllocator();
+        }
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
         allow_free_idle_chunk_ = allow_free_idle_chunk;
         for (int dev_id = 0; dev_id < platform::GetGPUDeviceCount(); ++dev_id) {
@@ -318,6 +326,10 @@ class AllocatorFacadePrivate {
 
     WrapStatAllocator();
 
+    if (AllocationTracer::IsEnabled()) {
+      WrapTracingAllocator();
+    }
+
     CheckAllocThreadSafe();
 
 #ifdef PADDLE_WITH_CUDA
@@ -488,6 +500,18 @@ class AllocatorFacadePrivate {
         std::make_shared<NaiveBestFitAllocator>(platform::CPUPlace());
   }
 
+  void InitThreadCachingCPUAllocator(bool allow_free_idle_chunk) {
+    // CPUAllocator chunks are page aligned, the blocks in them are aligned
+    // to cache lines. The chunks are as large as a huge page, so that they
+    // can be huge page regions.
+    constexpr size_t kAlignment = 64;
+    auto auto_growth_allocator = std::make_shared<AutoGrowthBestFitAllocator>(
+        std::make_shared<CPUAllocator>(), kAlignment, kHugePageSize,
+        allow_free_idle_chunk);
+    allocators_[platform::CPUPlace()] =
+        std::make_shared<ThreadCachingAllocator>(auto_growth_allocator);
+  }
+
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
   void InitNaiveBestFitCUDAPinnedAllocator() {
     allocators_[platform::CUDAPinnedPlace()] =
@@ -502,7 +526,7 @@ class AllocatorFacadePrivate {
   std::shared_ptr<Allocator> CreateCUDAAllocator(platform::CUDAPlace p) {
     if (FLAGS_use_cuda_managed_memory) {
       PADDLE_ENFORCE_EQ(
-          strategy_, AllocatorStrategy::kAutoGrowth,
+          IsAutoGrowthStrategy(strategy_), true,
           platform::errors::InvalidArgument(
               "CUDA managed memory is only implemented for auto_growth "
               "strategy, not support %s strategy.\n"
@@ -528,7 +552,7 @@ class AllocatorFacadePrivate {
 
   void InitStreamSafeCUDAAllocator(platform::CUDAPlace p, gpuStream_t stream) {
     PADDLE_ENFORCE_EQ(
-        strategy_, AllocatorStrategy::kAutoGrowth,
+        IsAutoGrowthStrategy(strategy_), true,
         platform::errors::Unimplemented(
             "Only support auto-growth strategey for StreamSafeCUDAAllocator, "
             "the allocator strategy %d is unsupported for multi-stream",
@@ -540,6 +564,9 @@ class AllocatorFacadePrivate {
       WrapStreamSafeCUDAAllocator(p, stream);
       WrapCUDARetryAllocator(p, stream, FLAGS_gpu_allocator_retry_time);
       WrapStatAllocator(p, stream);
+      if (AllocationTracer::IsEnabled()) {
+        WrapTracingAllocator(p, stream);
+      }
     }
   }
 
@@ -739,6 +766,11 @@ class AllocatorFacadePrivate {
     allocator = std::make_shared<StatAllocator>(allocator);
   }
 
+  void WrapTracingAllocator(platform::CUDAPlace p, gpuStream_t stream) {
+    std::shared_ptr<Allocator>& allocator = cuda_allocators_[p][stream];
+    allocator = std::make_shared<TracingAllocator>(allocator);
+  }
+
 #ifdef PADDLE_WITH_CUDA
   void WrapCUDAGraphAllocator() {
     for (auto& item : allocators_) {
@@ -935,6 +967,12 @@ class AllocatorFacadePrivate {
     }
   }
 
+  void WrapTracingAllocator() {
+    for (auto& pair : allocators_) {
+      pair.second = std::make_shared<TracingAllocator>(pair.second);
+    }
+  }
+
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
   // a standalone CUDA allocator to support multi-stream GC in new executor
   std::map<platform::Place, std::shared_ptr<StreamSafeCUDAAllocator>>
@@ -988,7 +1026,7 @@ const std::shared_ptr<Allocator>& AllocatorFacade::GetAllocator(
 
 void* AllocatorFacade::GetBasePtr(
     const std::shared_ptr<phi::Allocation>& allocation) {
-  PADDLE_ENFORCE_EQ(GetAllocatorStrategy(), AllocatorStrategy::kAutoGrowth,
+  PADDLE_ENFORCE_EQ(IsAutoGrowthStrategy(GetAllocatorStrategy()), true,
                     paddle::platform::errors::Unimplemented(
                         "GetBasePtr() is only implemented for auto_growth "
                         "strategy, not support allocator strategy: %d",
@@ -1064,6 +1102,13 @@ bool AllocatorFacade::IsStreamSafeCUDAAllocatorUsed() {
   return GetPrivate()->IsStreamSafeCUDAAllocatorUsed();
 }
 
+bool AllocatorFacade::IsHugePageAllocatorUsed(const platform::Place& place) {
+  // all the CPU allocators get their chunks from a CPU system allocator,
+  // which maps the large ones as huge page regions
+  return platform::is_cpu_place(place) &&
+         GetHugePageMode() != HugePageMode::kDisabled;
+}
+
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
 uint64_t AllocatorFacade::Release(const platform::CUDAPlace& place,
                                   gpuStream_t stream) {
@@ -1111,7 +1156,7 @@ void AllocatorFacade::SetDefaultStream(const platform::CUDAPlace& place,
 
 #ifdef PADDLE_WITH_CUDA
 void AllocatorFacade::PrepareMemoryPoolForCUDAGraph(CUDAGraphID id) {
-  PADDLE_ENFORCE_EQ(GetAllocatorStrategy(), AllocatorStrategy::kAutoGrowth,
+  PADDLE_ENFORCE_EQ(IsAutoGrowthStrategy(GetAllocatorStrategy()), true,
                     platform::errors::InvalidArgument(
                         "CUDA Graph is only supported when the "
                         "FLAGS_allocator_strategy=\"auto_growth\", but got "
@@ -78,6 +78,10 @@ class AllocatorFacade {
 
   bool IsStreamSafeCUDAAllocatorUsed();
 
+  // Whether the large chunks of the place are NUMA local huge page regions,
+  // see FLAGS_cpu_hugepage_mode.
+  bool IsHugePageAllocatorUsed(const platform::Place& place);
+
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
   // TODO(zhiqiu): change gpuStream_t to phi::Stream if needed.
   uint64_t Release(const platform::CUDAPlace& place, gpuStream_t stream);
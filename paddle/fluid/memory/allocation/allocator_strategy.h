@@ -18,7 +18,19 @@ namespace paddle {
 namespace memory {
 namespace allocation {
 
-enum class AllocatorStrategy { kNaiveBestFit, kAutoGrowth, kThreadLocal };
+enum class AllocatorStrategy {
+  kNaiveBestFit,
+  kAutoGrowth,
+  kThreadLocal,
+  // auto growth, with a thread caching front end on CPU
+  kThreadCaching
+};
+
+// kThreadCaching allocates device memory the same way as kAutoGrowth
+inline bool IsAutoGrowthStrategy(AllocatorStrategy strategy) {
+  return strategy == AllocatorStrategy::kAutoGrowth ||
+         strategy == AllocatorStrategy::kThreadCaching;
+}
 
 extern AllocatorStrategy GetAllocatorStrategy();
 
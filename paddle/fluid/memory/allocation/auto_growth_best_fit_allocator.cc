@@ -17,6 +17,7 @@
 #include <algorithm>
 #include <mutex>  // NOLINT
 #include "paddle/fluid/memory/allocation/aligned_allocator.h"
+#include "paddle/fluid/memory/allocation/allocation_tracer.h"
 #include "paddle/fluid/platform/flags.h"
 #include "paddle/fluid/platform/profiler/event_tracing.h"
 
@@ -44,7 +45,25 @@ AutoGrowthBestFitAllocator::AutoGrowthBestFitAllocator(
     : underlying_allocator_(underlying_allocator),
       alignment_(alignment),
       chunk_size_(std::max(AlignedSize(chunk_size, alignment), alignment)),
-      allow_free_idle_chunk_(allow_free_idle_chunk) {}
+      allow_free_idle_chunk_(allow_free_idle_chunk),
+      traced_(AllocationTracer::IsEnabled()) {
+  if (traced_) {
+    AllocationTracer::Instance().RegisterPool(
+        this, [this](const AllocationTracer::FreeBlockVisitor &visitor) {
+          std::lock_guard<SpinLock> guard(spinlock_);
+          for (auto &pair : free_blocks_) {
+            auto &block = *pair.second;
+            visitor(block.chunk_->allocation_->place(), block.size_);
+          }
+        });
+  }
+}
+
+AutoGrowthBestFitAllocator::~AutoGrowthBestFitAllocator() {
+  if (traced_) {
+    AllocationTracer::Instance().UnregisterPool(this);
+  }
+}
 
 phi::Allocation *AutoGrowthBestFitAllocator::AllocateImpl(
     size_t unaligned_size) {
@@ -33,6 +33,8 @@ class AutoGrowthBestFitAllocator : public Allocator {
       const std::shared_ptr<Allocator> &underlying_allocator, size_t alignment,
       size_t chunk_size = 0, bool allow_free_idle_chunk = true);
 
+  ~AutoGrowthBestFitAllocator();
+
   bool IsAllocThreadSafe() const override { return true; }
 
  protected:
@@ -88,6 +90,8 @@ class AutoGrowthBestFitAllocator : public Allocator {
   size_t alignment_;
   size_t chunk_size_;
   bool allow_free_idle_chunk_;
+  // whether the free blocks are reported to AllocationTracer
+  bool traced_;
 
   SpinLock spinlock_;
 };
@@ -12,10 +12,15 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include <chrono>  // NOLINT
 #include <cstdlib>
+#include <random>
+#include <thread>  // NOLINT
 
 #include "paddle/fluid/memory/allocation/aligned_allocator.h"
 #include "paddle/fluid/memory/allocation/auto_growth_best_fit_allocator.h"
+#include "paddle/fluid/memory/allocation/thread_caching_allocator.h"
+#include "paddle/fluid/memory/stats.h"
 
 #include "gtest/gtest.h"
 
@@ -171,6 +176,90 @@ TEST(test_auto_growth_allocator, test_free_when_no_cache_hit) {
   TestFreeWhenNoCacheHit(true);
 }
 
+TEST(test_auto_growth_allocator, test_thread_caching_allocator) {
+  FLAGS_free_idle_chunk = false;
+  FLAGS_free_when_no_cache_hit = false;
+  auto recorded_allocator = std::make_shared<RecordedAllocator>();
+  size_t alignment = 64;
+  auto ag_allocator = std::make_shared<AutoGrowthBestFitAllocator>(
+      std::make_shared<AlignedAllocator>(recorded_allocator, alignment),
+      alignment, 1 << 20);
+  auto tc_allocator = std::make_shared<ThreadCachingAllocator>(ag_allocator);
+  auto CachedBytes = [] {
+    return HOST_MEMORY_STAT_CURRENT_VALUE(ThreadCached, 0);
+  };
+  int64_t cached = CachedBytes();
+
+  // a batch of 32 allocations of the 128 bytes size class is cached
+  void *ptr = nullptr;
+  {
+    auto allocation = tc_allocator->Allocate(100);
+    ASSERT_EQ(allocation->size(), 128UL);
+    ptr = allocation->ptr();
+    ASSERT_EQ(CachedBytes() - cached, 31 * 128);
+  }
+  ASSERT_EQ(CachedBytes() - cached, 32 * 128);
+  ASSERT_EQ(tc_allocator->Allocate(128)->ptr(), ptr);
+
+  // large allocations bypass the cache
+  tc_allocator->Allocate(ThreadCachingAllocator::kDefaultMaxCachedSize + 1);
+  ASSERT_EQ(CachedBytes() - cached, 32 * 128);
+
+  tc_allocator->Release(platform::CPUPlace());
+  ASSERT_EQ(CachedBytes(), cached);
+  ASSERT_EQ(recorded_allocator->AllocatedSize(), 0UL);
+
+  // an allocation freed by another thread is returned when it exits
+  auto allocation = tc_allocator->Allocate(1000);
+  std::thread([&allocation] { allocation.reset(); }).join();
+  tc_allocator->Release(platform::CPUPlace());
+  ASSERT_EQ(recorded_allocator->AllocatedSize(), 0UL);
+}
+
+// every thread keeps 16 allocations of random small sizes alive and
+// replaces one of them in every iteration
+static double AllocateAndFreeInThreads(
+    const std::shared_ptr<Allocator> &allocator, int thread_num,
+    int iterations) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < thread_num; ++i) {
+    threads.emplace_back([&allocator, iterations, i] {
+      std::mt19937 rng(i);
+      std::vector<AllocationPtr> allocations(16);
+      for (int iter = 0; iter < iterations; ++iter) {
+        allocations[iter % 16] = allocator->Allocate(64 + rng() % 4096);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  return std::chrono::duration<double, std::nano>(
+             std::chrono::steady_clock::now() - start)
+             .count() /
+         (static_cast<double>(thread_num) * iterations);
+}
+
+TEST(test_auto_growth_allocator, test_thread_caching_contention) {
+  FLAGS_free_idle_chunk = false;
+  FLAGS_free_when_no_cache_hit = false;
+  const int thread_num = 8;
+  const int iterations = 100000;
+  size_t alignment = 64;
+  auto ag_allocator = std::make_shared<AutoGrowthBestFitAllocator>(
+      std::make_shared<AlignedAllocator>(std::make_shared<RecordedAllocator>(),
+                                         alignment),
+      alignment, 1 << 20);
+  auto tc_allocator = std::make_shared<ThreadCachingAllocator>(ag_allocator);
+
+  double ag_ns = AllocateAndFreeInThreads(ag_allocator, thread_num, iterations);
+  double tc_ns = AllocateAndFreeInThreads(tc_allocator, thread_num, iterations);
+  LOG(INFO) << thread_num << " threads, AutoGrowthBestFitAllocator: " << ag_ns
+            << " ns per allocation, with ThreadCachingAllocator: " << tc_ns
+            << " ns per allocation";
+}
+
 }  // namespace allocation
 }  // namespace memory
 }  // namespace paddle
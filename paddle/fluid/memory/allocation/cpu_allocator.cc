@@ -16,26 +16,46 @@
 
 #include <stdlib.h>
 
+#include "paddle/fluid/memory/allocation/hugepage_allocator.h"
 #include "paddle/fluid/platform/enforce.h"
 
 namespace paddle {
 namespace memory {
 namespace allocation {
 
+class CPUAllocation : public Allocation {
+ public:
+  CPUAllocation(void *ptr, size_t size, bool is_hugepage)
+      : Allocation(ptr, size, platform::CPUPlace()),
+        is_hugepage_(is_hugepage) {}
+
+  bool IsHugePage() const { return is_hugepage_; }
+
+ private:
+  bool is_hugepage_;
+};
+
 bool CPUAllocator::IsAllocThreadSafe() const { return true; }
 
 void CPUAllocator::FreeImpl(phi::Allocation *allocation) {
   void *p = allocation->ptr();
+  if (static_cast<CPUAllocation *>(allocation)->IsHugePage()) {
+    HugePageFree(p, allocation->size());
+  } else {
 #ifdef _WIN32
-  _aligned_free(p);
+    _aligned_free(p);
 #else
-  free(p);
+    free(p);
 #endif
+  }
   delete allocation;
 }
 
 phi::Allocation *CPUAllocator::AllocateImpl(size_t size) {
-  void *p;
+  void *p = ShouldUseHugePage(size) ? HugePageAlloc(size) : nullptr;
+  if (p != nullptr) {
+    return new CPUAllocation(p, size, true);
+  }
 #ifdef _WIN32
   p = _aligned_malloc(size, kAlignment);
 #else
@@ -45,7 +65,7 @@ phi::Allocation *CPUAllocator::AllocateImpl(size_t size) {
       platform::errors::ResourceExhausted(
           "Fail to alloc memory of %ld size, error code is %d.", size, error));
 #endif
-  return new Allocation(p, size, platform::CPUPlace());
+  return new CPUAllocation(p, size, false);
 }
 }  // namespace allocation
 }  // namespace memory
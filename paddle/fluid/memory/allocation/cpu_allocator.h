@@ -31,6 +31,9 @@ namespace allocation {
 //
 // NOTE(yy): It is no need to use `BestFitAllocator` in CPU. We can import
 // an open-sourced allocator into Paddle.
+//
+// Large allocations are NUMA local huge page regions when
+// FLAGS_cpu_hugepage_mode is set, see hugepage_allocator.h.
 class CPUAllocator : public Allocator {
  public:
   constexpr static size_t kAlignment = 4096UL;
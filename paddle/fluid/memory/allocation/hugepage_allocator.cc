@@ -0,0 +1,173 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/hugepage_allocator.h"
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#include <stdint.h>
+
+#include "paddle/fluid/platform/enforce.h"
+#include "paddle/fluid/platform/flags.h"
+
+PADDLE_DEFINE_EXPORTED_string(
+    cpu_hugepage_mode, "",
+    "How large CPU memory chunks are backed, enum in [\"\", transparent, "
+    "explicit]. The empty string uses aligned malloc. transparent maps 2MB "
+    "aligned regions and advises the kernel to back them with transparent "
+    "huge pages. explicit maps regions from the reserved hugetlb pages, and "
+    "falls back to transparent when no page is left. The regions are bound "
+    "to the NUMA node of the allocating thread. Only works on Linux.");
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+HugePageMode GetHugePageMode() {
+  if (FLAGS_cpu_hugepage_mode.empty()) {
+    return HugePageMode::kDisabled;
+  }
+  if (FLAGS_cpu_hugepage_mode == "transparent") {
+    return HugePageMode::kTransparent;
+  }
+  if (FLAGS_cpu_hugepage_mode == "explicit") {
+    return HugePageMode::kExplicit;
+  }
+  PADDLE_THROW(platform::errors::InvalidArgument(
+      "Unsupported cpu hugepage mode: %s, candidates are \"\", transparent "
+      "or explicit.",
+      FLAGS_cpu_hugepage_mode));
+}
+
+#ifdef __linux__
+
+static size_t HugePageAlignedSize(size_t size) {
+  return (size + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+}
+
+// MPOL_PREFERRED of <linux/mempolicy.h>, which is not always installed
+static constexpr int kMemPolicyPreferred = 1;
+static constexpr unsigned kMaxNumaNodes = 1024;
+
+// Prefers the NUMA node of the calling thread for the pages of a region
+// that has not been touched yet. Failures only lose the locality.
+static void BindToLocalNumaNode(void* ptr, size_t size) {
+#if defined(SYS_getcpu) && defined(SYS_mbind)
+  unsigned cpu = 0;
+  unsigned node = 0;
+  if (syscall(SYS_getcpu, &cpu, &node, nullptr) != 0 ||
+      node >= kMaxNumaNodes) {
+    return;
+  }
+  constexpr unsigned kBitsPerWord = sizeof(unsigned long) * 8;  // NOLINT
+  unsigned long node_mask[kMaxNumaNodes / kBitsPerWord] = {0};  // NOLINT
+  node_mask[node / kBitsPerWord] = 1UL << (node % kBitsPerWord);
+  // the kernel reads one bit less than maxnode
+  if (syscall(SYS_mbind, ptr, size, kMemPolicyPreferred, node_mask,
+              kMaxNumaNodes + 1, 0) != 0) {
+    VLOG(4) << "Fail to bind " << size << " bytes to NUMA node " << node;
+    return;
+  }
+  VLOG(10) << "Bind " << size << " bytes to NUMA node " << node;
+#endif
+}
+
+static void* MapExplicitHugePages(size_t size) {
+#ifdef MAP_HUGETLB
+  void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (ptr != MAP_FAILED) {
+    return ptr;
+  }
+  LOG_FIRST_N(WARNING, 1) << "Fail to map " << size
+                          << " bytes of hugetlb pages, fall back to "
+                             "transparent huge pages. Reserve more pages in "
+                             "/proc/sys/vm/nr_hugepages to avoid this.";
+#endif
+  return nullptr;
+}
+
+// maps size + kHugePageSize bytes and unmaps the unaligned head and tail,
+// so that the kernel can back the region with whole huge pages
+static void* MapTransparentHugePages(size_t size) {
+  size_t mapped_size = size + kHugePageSize;
+  void* mapped = mmap(nullptr, mapped_size, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapped == MAP_FAILED) {
+    return nullptr;
+  }
+  auto begin = reinterpret_cast<uintptr_t>(mapped);
+  auto aligned =
+      (begin + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+  if (aligned > begin) {
+    munmap(mapped, aligned - begin);
+  }
+  size_t tail = begin + mapped_size - (aligned + size);
+  if (tail > 0) {
+    munmap(reinterpret_cast<void*>(aligned + size), tail);
+  }
+  void* ptr = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+  if (madvise(ptr, size, MADV_HUGEPAGE) != 0) {
+    LOG_FIRST_N(WARNING, 1) << "Transparent huge pages are not supported, "
+                               "fall back to normal pages.";
+  }
+#endif
+  return ptr;
+}
+
+void* HugePageAlloc(size_t size) {
+  auto mode = GetHugePageMode();
+  if (mode == HugePageMode::kDisabled || size == 0) {
+    return nullptr;
+  }
+  size = HugePageAlignedSize(size);
+  void* ptr = nullptr;
+  if (mode == HugePageMode::kExplicit) {
+    ptr = MapExplicitHugePages(size);
+  }
+  if (ptr == nullptr) {
+    ptr = MapTransparentHugePages(size);
+  }
+  if (ptr != nullptr) {
+    BindToLocalNumaNode(ptr, size);
+    VLOG(10) << "Map " << size << " bytes of huge pages at " << ptr;
+  }
+  return ptr;
+}
+
+void HugePageFree(void* ptr, size_t size) {
+  PADDLE_ENFORCE_EQ(
+      munmap(ptr, HugePageAlignedSize(size)), 0,
+      platform::errors::Fatal("Fail to unmap %d bytes of huge pages at %p.",
+                              size, ptr));
+}
+
+#else
+
+void* HugePageAlloc(size_t size) { return nullptr; }
+
+void HugePageFree(void* ptr, size_t size) {
+  PADDLE_THROW(platform::errors::Unimplemented(
+      "Huge pages are only supported on Linux."));
+}
+
+#endif
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
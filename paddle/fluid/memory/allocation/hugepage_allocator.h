@@ -0,0 +1,53 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <stddef.h>
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+// How large CPU memory regions are backed, selected by
+// FLAGS_cpu_hugepage_mode:
+//   kDisabled:    aligned malloc
+//   kTransparent: 2MB aligned mmap regions advised with MADV_HUGEPAGE
+//   kExplicit:    mmap regions from the reserved 2MB hugetlb pages, which
+//                 fall back to kTransparent when no page is left
+// The hugepage regions are bound to the NUMA node of the allocating thread
+// when the node is known, with a preferred policy so that the kernel still
+// uses other nodes once the local one is full.
+enum class HugePageMode { kDisabled, kTransparent, kExplicit };
+
+static constexpr size_t kHugePageSize = 2UL << 20;
+
+HugePageMode GetHugePageMode();
+
+// Whether an allocation of size bytes should be a hugepage region. Smaller
+// allocations would waste most of the page.
+inline bool ShouldUseHugePage(size_t size) {
+  return size >= kHugePageSize && GetHugePageMode() != HugePageMode::kDisabled;
+}
+
+// Maps a region of size bytes rounded up to kHugePageSize. Returns nullptr
+// if no region can be mapped, the caller then falls back to malloc.
+void* HugePageAlloc(size_t size);
+
+// Unmaps a region returned by HugePageAlloc with the same size.
+void HugePageFree(void* ptr, size_t size);
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
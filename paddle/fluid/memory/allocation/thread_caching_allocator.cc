@@ -0,0 +1,254 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "paddle/fluid/memory/allocation/thread_caching_allocator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "paddle/fluid/memory/stats.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+static void UpdateThreadCachedStat(const platform::Place &place,
+                                   int64_t increment) {
+  if (platform::is_cpu_place(place)) {
+    HOST_MEMORY_STAT_UPDATE(ThreadCached, place.GetDeviceId(), increment);
+  } else {
+    DEVICE_MEMORY_STAT_UPDATE(ThreadCached, place.GetDeviceId(), increment);
+  }
+}
+
+// the smallest size class that holds size
+static size_t SizeClassOf(size_t size) {
+  size_t size_class = 0;
+  while ((ThreadCachingAllocator::kMinSizeClass << size_class) < size) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+// the largest size class that an allocation of size can serve
+static size_t SizeClassServedBy(size_t size) {
+  size_t size_class = 0;
+  while ((ThreadCachingAllocator::kMinSizeClass << (size_class + 1)) <= size) {
+    ++size_class;
+  }
+  return size_class;
+}
+
+static size_t BatchSize(size_t size_class) {
+  size_t bytes = ThreadCachingAllocator::kMinSizeClass << size_class;
+  return std::max<size_t>(
+      1, std::min(ThreadCachingAllocator::kMaxBatchSize,
+                  ThreadCachingAllocator::kBatchBytes / bytes));
+}
+
+class AllocationThreadCache {
+ public:
+  AllocationThreadCache(const std::shared_ptr<Allocator> &underlying_allocator,
+                        size_t size_class_num)
+      : underlying_allocator_(underlying_allocator),
+        free_lists_(size_class_num) {}
+
+  // At thread exit the stats of the thread are dropped together with it.
+  ~AllocationThreadCache() {
+    for (size_t i = 0; i < free_lists_.size(); ++i) {
+      Return(i, free_lists_[i].size(), false);
+    }
+  }
+
+  std::vector<phi::Allocation *> &FreeList(size_t size_class) {
+    return free_lists_[size_class];
+  }
+
+  // returns the num least recently freed allocations of a size class to
+  // the underlying allocator
+  void Return(size_t size_class, size_t num, bool update_stat) {
+    auto &free_list = free_lists_[size_class];
+    num = std::min(num, free_list.size());
+    for (size_t i = 0; i < num; ++i) {
+      auto *allocation = free_list[i];
+      if (update_stat) {
+        UpdateThreadCachedStat(allocation->place(),
+                               -static_cast<int64_t>(allocation->size()));
+      }
+      underlying_allocator_->Free(allocation);
+    }
+    free_list.erase(free_list.begin(), free_list.begin() + num);
+  }
+
+  void ReturnAll() {
+    for (size_t i = 0; i < free_lists_.size(); ++i) {
+      Return(i, free_lists_[i].size(), true);
+    }
+  }
+
+ private:
+  // keeps the underlying allocator alive until the thread exits
+  std::shared_ptr<Allocator> underlying_allocator_;
+  std::vector<std::vector<phi::Allocation *>> free_lists_;
+};
+
+// set when the thread caches of this thread are destroyed at thread exit,
+// allocations freed after that go to the underlying allocator directly
+static thread_local bool tls_thread_caches_destroyed = false;
+
+struct ThreadCacheMap {
+  ~ThreadCacheMap() { tls_thread_caches_destroyed = true; }
+
+  std::unordered_map<uint64_t, std::unique_ptr<AllocationThreadCache>> caches;
+};
+
+static thread_local ThreadCacheMap tls_thread_caches;
+// the last thread cache looked up, most threads use a single allocator
+static thread_local uint64_t tls_last_id = 0;
+static thread_local AllocationThreadCache *tls_last_cache = nullptr;
+
+static std::atomic<uint64_t> next_thread_caching_allocator_id{1};
+
+constexpr size_t ThreadCachingAllocator::kMinSizeClass;
+constexpr size_t ThreadCachingAllocator::kDefaultMaxCachedSize;
+constexpr size_t ThreadCachingAllocator::kBatchBytes;
+constexpr size_t ThreadCachingAllocator::kMaxBatchSize;
+
+ThreadCachingAllocator::ThreadCachingAllocator(
+    const std::shared_ptr<Allocator> &underlying_allocator,
+    size_t max_cached_size)
+    : underlying_allocator_(underlying_allocator),
+      id_(next_thread_caching_allocator_id++) {
+  PADDLE_ENFORCE_NOT_NULL(
+      underlying_allocator_,
+      platform::errors::InvalidArgument(
+          "The underlying allocator of ThreadCachingAllocator is NULL."));
+  PADDLE_ENFORCE_GE(
+      max_cached_size, kMinSizeClass,
+      platform::errors::InvalidArgument(
+          "The max cached size of ThreadCachingAllocator should be at least "
+          "%d, but got %d.",
+          kMinSizeClass, max_cached_size));
+  size_class_num_ = SizeClassServedBy(max_cached_size) + 1;
+  max_cached_size_ = kMinSizeClass << (size_class_num_ - 1);
+}
+
+ThreadCachingAllocator::~ThreadCachingAllocator() {
+  // the caches of other threads are returned when they exit
+  if (tls_thread_caches_destroyed) {
+    return;
+  }
+  auto iter = tls_thread_caches.caches.find(id_);
+  if (iter != tls_thread_caches.caches.end()) {
+    iter->second->ReturnAll();
+    tls_thread_caches.caches.erase(iter);
+  }
+  if (tls_last_id == id_) {
+    tls_last_id = 0;
+    tls_last_cache = nullptr;
+  }
+}
+
+AllocationThreadCache *ThreadCachingAllocator::GetThreadCache() {
+  if (tls_last_id == id_) {
+    return tls_last_cache;
+  }
+  if (tls_thread_caches_destroyed) {
+    return nullptr;
+  }
+  auto &cache = tls_thread_caches.caches[id_];
+  if (cache == nullptr) {
+    cache.reset(new AllocationThreadCache(underlying_allocator_,
+                                          size_class_num_));
+  }
+  tls_last_id = id_;
+  tls_last_cache = cache.get();
+  return tls_last_cache;
+}
+
+phi::Allocation *ThreadCachingAllocator::AllocateImpl(size_t size) {
+  auto *cache = size <= max_cached_size_ ? GetThreadCache() : nullptr;
+  if (cache == nullptr) {
+    return underlying_allocator_->Allocate(size).release();
+  }
+
+  size_t size_class = SizeClassOf(size);
+  auto &free_list = cache->FreeList(size_class);
+  if (free_list.empty()) {
+    size_t bytes = kMinSizeClass << size_class;
+    AllocationPtr allocation;
+    try {
+      allocation = underlying_allocator_->Allocate(bytes);
+    } catch (BadAlloc &) {
+      VLOG(2) << "Return the thread cache and retry to allocate " << bytes;
+      cache->ReturnAll();
+      allocation = underlying_allocator_->Allocate(bytes);
+    }
+    free_list.push_back(allocation.release());
+    // the rest of the batch is best effort
+    size_t batch_size = BatchSize(size_class);
+    try {
+      while (free_list.size() < batch_size) {
+        free_list.push_back(underlying_allocator_->Allocate(bytes).release());
+      }
+    } catch (BadAlloc &) {
+    }
+    for (auto *cached : free_list) {
+      UpdateThreadCachedStat(cached->place(), cached->size());
+    }
+    VLOG(10) << "Refill " << free_list.size() << " allocations of " << bytes
+             << " bytes";
+  }
+
+  auto *allocation = free_list.back();
+  free_list.pop_back();
+  UpdateThreadCachedStat(allocation->place(),
+                         -static_cast<int64_t>(allocation->size()));
+  return allocation;
+}
+
+void ThreadCachingAllocator::FreeImpl(phi::Allocation *allocation) {
+  size_t size = allocation->size();
+  auto *cache = size >= kMinSizeClass && size <= max_cached_size_
+                    ? GetThreadCache()
+                    : nullptr;
+  if (cache == nullptr) {
+    underlying_allocator_->Free(allocation);
+    return;
+  }
+
+  size_t size_class = SizeClassServedBy(size);
+  auto &free_list = cache->FreeList(size_class);
+  free_list.push_back(allocation);
+  UpdateThreadCachedStat(allocation->place(), size);
+  size_t batch_size = BatchSize(size_class);
+  if (free_list.size() > 2 * batch_size) {
+    cache->Return(size_class, batch_size, true);
+  }
+}
+
+uint64_t ThreadCachingAllocator::ReleaseImpl(const platform::Place &place) {
+  auto *cache = GetThreadCache();
+  if (cache != nullptr) {
+    cache->ReturnAll();
+  }
+  return underlying_allocator_->Release(place);
+}
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
@@ -0,0 +1,74 @@
+// Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include "paddle/fluid/memory/allocation/allocator.h"
+
+namespace paddle {
+namespace memory {
+namespace allocation {
+
+class AllocationThreadCache;
+
+// A front end that keeps freed small allocations in per thread free lists,
+// so that most allocations of a thread never take the lock of the
+// underlying allocator.
+//
+// Sizes up to max_cached_size are rounded up to power of two size classes.
+// A thread refills an empty size class with a batch of allocations of the
+// underlying allocator, and returns a batch when a size class holds more
+// than two batches. An allocation may be freed by another thread than the
+// one that allocated it, it then goes to the free lists of that thread.
+// The free lists of a thread are returned when the thread exits.
+class ThreadCachingAllocator : public Allocator {
+ public:
+  static constexpr size_t kMinSizeClass = 64;
+  static constexpr size_t kDefaultMaxCachedSize = 1 << 16;
+  // the bytes of a batch, one allocation for the size classes above
+  static constexpr size_t kBatchBytes = 1 << 16;
+  static constexpr size_t kMaxBatchSize = 32;
+
+  explicit ThreadCachingAllocator(
+      const std::shared_ptr<Allocator> &underlying_allocator,
+      size_t max_cached_size = kDefaultMaxCachedSize);
+
+  ~ThreadCachingAllocator();
+
+  bool IsAllocThreadSafe() const override { return true; }
+
+ protected:
+  phi::Allocation *AllocateImpl(size_t size) override;
+
+  void FreeImpl(phi::Allocation *allocation) override;
+
+  // Returns the free lists of the calling thread and releases the
+  // underlying allocator. Other threads keep their free lists.
+  uint64_t ReleaseImpl(const platform::Place &place) override;
+
+ private:
+  AllocationThreadCache *GetThreadCache();
+
+  std::shared_ptr<Allocator> underlying_allocator_;
+  size_t max_cached_size_;
+  size_t size_class_num_;
+  // never reused, unlike the address of the allocator
+  uint64_t id_;
+};
+
+}  // namespace allocation
+}  // namespace memory
+}  // namespace paddle
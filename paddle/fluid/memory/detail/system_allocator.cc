@@ -28,6 +28,7 @@ limitations under the License. */
 #endif
 #include "gflags/gflags.h"
 #include "paddle/fluid/memory/allocation/allocator.h"
+#include "paddle/fluid/memory/allocation/hugepage_allocator.h"
 #include "paddle/fluid/platform/cpu_info.h"
 #include "paddle/fluid/platform/device/gpu/gpu_info.h"
 #include "paddle/fluid/platform/device/npu/npu_info.h"
@@ -73,6 +74,10 @@ void* AlignedMalloc(size_t size) {
   return p;
 }
 
+// the bits of the index of CPUAllocator
+static constexpr size_t kLockedMemoryIndex = 1;
+static constexpr size_t kHugePageIndex = 2;
+
 void* CPUAllocator::Alloc(size_t* index, size_t size) {
   // According to http://www.cplusplus.com/reference/cstdlib/malloc/,
   // malloc might not return nullptr if size is zero, but the returned
@@ -81,11 +86,20 @@ void* CPUAllocator::Alloc(size_t* index, size_t size) {
 
   *index = 0;  // unlock memory
 
-  void* p = AlignedMalloc(size);
+  void* p = nullptr;
+  if (allocation::ShouldUseHugePage(size)) {
+    p = allocation::HugePageAlloc(size);
+    if (p != nullptr) {
+      *index = kHugePageIndex;
+    }
+  }
+  if (p == nullptr) {
+    p = AlignedMalloc(size);
+  }
 
   if (p != nullptr) {
     if (FLAGS_use_pinned_memory) {
-      *index = 1;
+      *index |= kLockedMemoryIndex;
 #ifdef _WIN32
       VirtualLock(p, size);
 #else
@@ -100,18 +114,22 @@ void* CPUAllocator::Alloc(size_t* index, size_t size) {
 }
 
 void CPUAllocator::Free(void* p, size_t size, size_t index) {
-  if (p != nullptr && index == 1) {
+  if (p != nullptr && (index & kLockedMemoryIndex)) {
 #ifdef _WIN32
     VirtualUnlock(p, size);
 #else
     munlock(p, size);
 #endif
   }
+  if (index & kHugePageIndex) {
+    allocation::HugePageFree(p, size);
+  } else {
 #ifdef _WIN32
-  _aligned_free(p);
+    _aligned_free(p);
 #else
-  free(p);
+    free(p);
 #endif
+  }
 
   HOST_MEMORY_STAT_UPDATE(Reserved, 0, -size);
 }
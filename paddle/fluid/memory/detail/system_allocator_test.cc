@@ -14,14 +14,17 @@ limitations under the License. */
 
 #include "paddle/fluid/memory/detail/system_allocator.h"
 
+#include <cstring>
 #include <memory>
 
 #include "gflags/gflags.h"
 #include "gtest/gtest.h"
 #include "paddle/fluid/memory/allocation/allocator.h"
+#include "paddle/fluid/memory/allocation/hugepage_allocator.h"
 #include "paddle/fluid/platform/device/device_wrapper.h"
 
 DECLARE_bool(use_pinned_memory);
+DECLARE_string(cpu_hugepage_mode);
 
 void TestAllocator(paddle::memory::detail::SystemAllocator* a, size_t size) {
   bool freed = false;
@@ -57,6 +60,28 @@ TEST(CPUAllocator, LockMem) {
   TestAllocator(&a, 0);
 }
 
+#ifdef __linux__
+TEST(CPUAllocator, HugePage) {
+  FLAGS_use_pinned_memory = false;
+  using paddle::memory::allocation::kHugePageSize;
+  paddle::memory::detail::CPUAllocator a;
+  size_t size = 3 * kHugePageSize;
+  // explicit huge pages fall back to transparent ones when none is reserved
+  for (auto mode : {"transparent", "explicit"}) {
+    FLAGS_cpu_hugepage_mode = mode;
+    size_t index;
+    void* p = a.Alloc(&index, size);
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(p) % kHugePageSize, 0UL);
+    memset(p, 1, size);
+    a.Free(p, size, index);
+    // small allocations are not worth a huge page
+    TestAllocator(&a, 2048);
+  }
+  FLAGS_cpu_hugepage_mode = "";
+}
+#endif
+
 #if defined(PADDLE_WITH_CUDA) || defined(PADDLE_WITH_HIP)
 TEST(GPUAllocator, Alloc) {
   paddle::memory::detail::GPUAllocator a(0);
@@ -195,9 +195,12 @@ void HostMemoryStatUpdate(const std::string& stat_type, int dev_id,
 // To add a new STAT type, declare here and register in stats.cc
 DEVICE_MEMORY_STAT_DECLARE(Allocated);
 DEVICE_MEMORY_STAT_DECLARE(Reserved);
+DEVICE_MEMORY_STAT_DECLARE(ThreadCached);
 
 HOST_MEMORY_STAT_DECLARE(Allocated);
 HOST_MEMORY_STAT_DECLARE(Reserved);
+// bytes held in the free lists of ThreadCachingAllocator
+HOST_MEMORY_STAT_DECLARE(ThreadCached);
 
 }  // namespace memory
 }  // namespace paddle
@@ -499,6 +499,8 @@ void BenchKernelVBroadcast() {
 #define BenchKernelVExp BenchKernelXYN
 #define BenchKernelVSigmoid BenchKernelXYN
 #define BenchKernelVTanh BenchKernelXYN
+#define BenchKernelVGeluTanh BenchKernelXYN
+#define BenchKernelVGeluErf BenchKernelXYN
 #define BenchKernelVCopy BenchKernelXYN
 
 #define BenchKernelHMax BenchKernelXRN
@@ -535,6 +537,8 @@ BENCH_FP32_CPU(VSquare);
 BENCH_FP32_CPU(VExp);
 BENCH_FP32_CPU(VSigmoid);
 BENCH_FP32_CPU(VTanh);
+BENCH_FP32_CPU(VGeluTanh);
+BENCH_FP32_CPU(VGeluErf);
 BENCH_FP32_CPU(VCopy);
 
 // xrn
@@ -39,7 +39,16 @@ const float ALIGN32_BEG exp_float_consts[] ALIGN32_END = {
     REPEAT_8TIMES(CEPHES_EXP_P5),
     REPEAT_8TIMES(EXP_MAX_INPUT),
     REPEAT_8TIMES(SIGMOID_THRESHOLD_MAX),
-    REPEAT_8TIMES(SIGMOID_THRESHOLD_MIN)};
+    REPEAT_8TIMES(SIGMOID_THRESHOLD_MIN),
+    REPEAT_8TIMES(GELU_TANH_A),
+    REPEAT_8TIMES(GELU_TANH_B),
+    REPEAT_8TIMES(GELU_SQRT1_2),
+    REPEAT_8TIMES(GELU_ERF_P),
+    REPEAT_8TIMES(GELU_ERF_A1),
+    REPEAT_8TIMES(GELU_ERF_A2),
+    REPEAT_8TIMES(GELU_ERF_A3),
+    REPEAT_8TIMES(GELU_ERF_A4),
+    REPEAT_8TIMES(GELU_ERF_A5)};
 
 const int ALIGN32_BEG exp_int_0x7f[] ALIGN32_END = {REPEAT_8TIMES(0x7f)};
 int ALIGN32_BEG g_tmp_mem[16] ALIGN32_END = {0};
@@ -95,6 +104,8 @@ DECLARE_ACT_CREATOR(VIdentity);
 DECLARE_ACT_CREATOR(VExp);
 DECLARE_ACT_CREATOR(VSigmoid);
 DECLARE_ACT_CREATOR(VTanh);
+DECLARE_ACT_CREATOR(VGeluTanh);
+DECLARE_ACT_CREATOR(VGeluErf);
 
 // TODO(TJ): tuning use me
 bool VReluCreator::CanBeUsed(const int& d) const {
@@ -121,6 +132,16 @@ bool VTanhCreator::CanBeUsed(const int& d) const {
   return platform::MayIUse(platform::avx);
 }
 
+// exp_jmm spills to g_tmp_mem without avx2, which is not safe when the
+// kernel runs in several threads at once, as the gelu kernels do
+bool VGeluTanhCreator::CanBeUsed(const int& d) const {
+  return platform::MayIUse(platform::avx2);
+}
+
+bool VGeluErfCreator::CanBeUsed(const int& d) const {
+  return platform::MayIUse(platform::avx2);
+}
+
 size_t VReluCreator::CodeSize(const int& d) const {
   return 96 /* init size */ +
          (d / YMM_FLOAT_BLOCK + 3) * 4 /* instructions */ *
@@ -147,6 +168,14 @@ size_t VTanhCreator::CodeSize(const int& d) const {
   return 96 + (d / YMM_FLOAT_BLOCK + 3) * 84 * 8;
 }
 
+size_t VGeluTanhCreator::CodeSize(const int& d) const {
+  return 96 + (d / YMM_FLOAT_BLOCK + 3) * 84 * 8;
+}
+
+size_t VGeluErfCreator::CodeSize(const int& d) const {
+  return 96 + (d / YMM_FLOAT_BLOCK + 3) * 108 * 8;
+}
+
 #undef DECLARE_ACT_CREATOR
 
 }  // namespace gen
@@ -162,3 +191,5 @@ REGISTER_JITKERNEL_GEN(kVIdentity, gen::VIdentityCreator);
 REGISTER_JITKERNEL_GEN(kVExp, gen::VExpCreator);
 REGISTER_JITKERNEL_GEN(kVSigmoid, gen::VSigmoidCreator);
 REGISTER_JITKERNEL_GEN(kVTanh, gen::VTanhCreator);
+REGISTER_JITKERNEL_GEN(kVGeluTanh, gen::VGeluTanhCreator);
+REGISTER_JITKERNEL_GEN(kVGeluErf, gen::VGeluErfCreator);
@@ -40,6 +40,18 @@ extern int g_tmp_mem[];
 #define CEPHES_EXP_P3 4.1665795894E-2
 #define CEPHES_EXP_P4 1.6666665459E-1
 #define CEPHES_EXP_P5 5.0000001201E-1
+// -2 * sqrt(2 / pi) and -2 * sqrt(2 / pi) * 0.044715
+#define GELU_TANH_A -1.5957691216057308f
+#define GELU_TANH_B -0.07135481627260025f
+#define GELU_SQRT1_2 0.7071067811865476f
+// erf(x) = 1 - (a1 t + ... + a5 t^5) e^(-x^2), t = 1 / (1 + p x), x >= 0,
+// Abramowitz and Stegun 7.1.26, the absolute error is less than 1.5e-7
+#define GELU_ERF_P 0.3275911f
+#define GELU_ERF_A1 0.254829592f
+#define GELU_ERF_A2 -0.284496736f
+#define GELU_ERF_A3 1.421413741f
+#define GELU_ERF_A4 -1.453152027f
+#define GELU_ERF_A5 1.061405429f
 
 #define REPEAT_8TIMES(val) val, val, val, val, val, val, val, val
 
@@ -60,6 +72,15 @@ extern int g_tmp_mem[];
 #define OFFSET_EXP_MAX_INPUT 14 * YMM_FLOAT_BLOCK * sizeof(float)
 #define OFFSET_SIGMOID_MAX 15 * YMM_FLOAT_BLOCK * sizeof(float)
 #define OFFSET_SIGMOID_MIN 16 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_TANH_A 17 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_TANH_B 18 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_SQRT1_2 19 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_ERF_P 20 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_ERF_A1 21 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_ERF_A2 22 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_ERF_A3 23 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_ERF_A4 24 * YMM_FLOAT_BLOCK * sizeof(float)
+#define OFFSET_GELU_ERF_A5 25 * YMM_FLOAT_BLOCK * sizeof(float)
 
 class VActFunc : public JitCode {
  public:
@@ -218,6 +239,73 @@ class VActFunc : public JitCode {
     pop(reg_ptr_global);
   }
 
+  // compute GELU with tanh with ymm, xmm
+  template <typename JMM>
+  void gelu_tanh_jmm(JMM& dst, JMM& src, int src_idx = 11,  // NOLINT
+                     int fx_idx = 12, int fy_idx = 13, int mask_idx = 14,
+                     int tmp_idx = 15) {
+    // y = 0.5 * x * (1 + tanh(z)) = x / (1 + e^(-2z)),
+    // z = sqrt(2 / pi) * (x + 0.044715 * x^3)
+    reg64_t reg_ptr_global = rax;
+    push(reg_ptr_global);
+    mov(reg_ptr_global, reinterpret_cast<size_t>(exp_float_consts));
+    vmulps(dst, src, src);
+    vmulps(dst, dst, ptr[reg_ptr_global + OFFSET_GELU_TANH_B]);
+    vaddps(dst, dst, ptr[reg_ptr_global + OFFSET_GELU_TANH_A]);
+    vmulps(dst, dst, src);
+    exp_jmm<JMM>(dst, dst, src_idx, fx_idx, fy_idx, mask_idx, tmp_idx);
+    vaddps(dst, dst, ptr[reg_ptr_global + OFFSET_EXP_ONE]);
+    vdivps(dst, src, dst);
+    pop(reg_ptr_global);
+  }
+
+  // compute GELU with erf with ymm, xmm, which also uses 8~10
+  template <typename JMM>
+  void gelu_erf_jmm(JMM& dst, JMM& src, int src_idx = 11,  // NOLINT
+                    int fx_idx = 12, int fy_idx = 13, int mask_idx = 14,
+                    int tmp_idx = 15) {
+    // y = 0.5 * x * (1 + erf(x / sqrt(2)))
+    JMM jmm_z = JMM(10);
+    JMM jmm_t = JMM(9);
+    JMM jmm_p = JMM(8);
+    reg64_t reg_ptr_global = rax;
+    push(reg_ptr_global);
+    mov(reg_ptr_global, reinterpret_cast<size_t>(exp_float_consts));
+    // z = |x / sqrt(2)|
+    vmulps(jmm_z, src, ptr[reg_ptr_global + OFFSET_GELU_SQRT1_2]);
+    vxorps(jmm_t, jmm_t, jmm_t);
+    vsubps(jmm_t, jmm_t, jmm_z);
+    vmaxps(jmm_z, jmm_z, jmm_t);
+    // t = 1 / (1 + p * z)
+    vmulps(jmm_t, jmm_z, ptr[reg_ptr_global + OFFSET_GELU_ERF_P]);
+    vaddps(jmm_t, jmm_t, ptr[reg_ptr_global + OFFSET_EXP_ONE]);
+    vmovaps(jmm_p, ptr[reg_ptr_global + OFFSET_EXP_ONE]);
+    vdivps(jmm_t, jmm_p, jmm_t);
+    // p = a1 * t + a2 * t^2 + ... + a5 * t^5
+    vmulps(jmm_p, jmm_t, ptr[reg_ptr_global + OFFSET_GELU_ERF_A5]);
+    for (size_t i = OFFSET_GELU_ERF_A4; i >= OFFSET_GELU_ERF_A1;
+         i -= (YMM_FLOAT_BLOCK * sizeof(float))) {
+      vaddps(jmm_p, jmm_p, ptr[reg_ptr_global + i]);  // A4~A1
+      vmulps(jmm_p, jmm_p, jmm_t);
+    }
+    // 1 - erf(z) = p * e^(-z^2)
+    vmulps(jmm_z, jmm_z, jmm_z);
+    vxorps(dst, dst, dst);
+    vsubps(jmm_z, dst, jmm_z);
+    exp_jmm<JMM>(dst, jmm_z, src_idx, fx_idx, fy_idx, mask_idx, tmp_idx);
+    vmulps(dst, dst, jmm_p);
+    // 1 + erf(x / sqrt(2)) is 2 - (1 - erf(z)) when x >= 0 and 1 - erf(z)
+    // otherwise
+    vxorps(jmm_t, jmm_t, jmm_t);
+    vcmpltps(jmm_t, src, jmm_t);
+    vmovaps(jmm_z, ptr[reg_ptr_global + OFFSET_EXP_TWO]);
+    vsubps(jmm_z, jmm_z, dst);
+    vblendvps(dst, jmm_z, dst, jmm_t);
+    vmulps(dst, dst, src);
+    vmulps(dst, dst, ptr[reg_ptr_global + OFFSET_EXP_0P5]);
+    pop(reg_ptr_global);
+  }
+
   // compute IDENTITY with ymm, xmm
   template <typename JMM>
   void identity_jmm(JMM& dst, JMM& src, int zero_idx) {  // NOLINT
@@ -250,6 +338,12 @@ class VActFunc : public JitCode {
       case operand_type::IDENTITY:
         identity_jmm<JMM>(dst, src, 15);
         break;
+      case operand_type::GELU_TANH:
+        gelu_tanh_jmm<JMM>(dst, src, 11, 12, 13, 14, 15);
+        break;
+      case operand_type::GELU_ERF:
+        gelu_erf_jmm<JMM>(dst, src, 11, 12, 13, 14, 15);
+        break;
       default:
         PADDLE_THROW(platform::errors::Unimplemented(
             "Do not support operand type code: %d.", type));
@@ -265,7 +359,9 @@ class VActJitCode : public VActFunc {
       : VActFunc(code_size, code_ptr), num_(d), type_(type) {
     if (!(type_ == operand_type::RELU || type_ == operand_type::EXP ||
           type_ == operand_type::SIGMOID || type_ == operand_type::TANH ||
-          type_ == operand_type::IDENTITY || type_ == operand_type::SQUARE)) {
+          type_ == operand_type::IDENTITY || type_ == operand_type::SQUARE ||
+          type_ == operand_type::GELU_TANH ||
+          type_ == operand_type::GELU_ERF)) {
       PADDLE_THROW(platform::errors::Unimplemented(
           "Do not support operand type code: %d.", type));
     }
@@ -293,6 +389,12 @@ class VActJitCode : public VActFunc {
       case operand_type::IDENTITY:
         base += "_Identity";
         break;
+      case operand_type::GELU_TANH:
+        base += "_GeluTanh";
+        break;
+      case operand_type::GELU_ERF:
+        base += "_GeluErf";
+        break;
       default:
         break;
     }
@@ -326,6 +428,8 @@ DECLARE_ACT_JITCODE(VIdentity, operand_type::IDENTITY);
 DECLARE_ACT_JITCODE(VExp, operand_type::EXP);
 DECLARE_ACT_JITCODE(VSigmoid, operand_type::SIGMOID);
 DECLARE_ACT_JITCODE(VTanh, operand_type::TANH);
+DECLARE_ACT_JITCODE(VGeluTanh, operand_type::GELU_TANH);
+DECLARE_ACT_JITCODE(VGeluErf, operand_type::GELU_ERF);
 
 #undef DECLARE_ACT_JITCODE
 
@@ -58,7 +58,9 @@ typedef enum {
   SQUARE,
   SIGMOID,
   TANH,
-  IDENTITY
+  IDENTITY,
+  GELU_TANH,
+  GELU_ERF
 } operand_type;
 
 #define DECLARE_JIT_CODE(codename) \
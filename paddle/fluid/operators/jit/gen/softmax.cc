@@ -0,0 +1,229 @@
+/* Copyright (c) 2018 PaddlePaddle Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#include "paddle/fluid/operators/jit/gen/softmax.h"
+
+#include "paddle/fluid/operators/jit/registry.h"
+#include "paddle/fluid/platform/cpu_info.h"
+
+namespace paddle {
+namespace operators {
+namespace jit {
+namespace gen {
+
+void SoftmaxJitCode::reduceXmm(const xmm_t& dst, bool is_max) {
+  vpermilps(xmm_tmp, dst, 16 + 8 + 3);
+  if (is_max) {
+    vmaxps(dst, dst, xmm_tmp);
+  } else {
+    vaddps(dst, dst, xmm_tmp);
+  }
+  vpermilps(xmm_tmp, dst, 1);
+  if (is_max) {
+    vmaxss(dst, dst, xmm_tmp);
+  } else {
+    vaddss(dst, dst, xmm_tmp);
+  }
+}
+
+void SoftmaxJitCode::computeMax() {
+  const int num_blocks = num_ / YMM_FLOAT_BLOCK;
+  const int block_size = sizeof(float) * YMM_FLOAT_BLOCK;
+  int offset = num_blocks * block_size;
+  int rest = num_ % YMM_FLOAT_BLOCK;
+  if (num_blocks > 0) {
+    vmovups(ymm_max, ptr[param_x]);
+    if (num_blocks > 1) {
+      Label l_next_block;
+      mov(reg_offset, block_size);
+      L(l_next_block);
+      vmaxps(ymm_max, ymm_max, ptr[param_x + reg_offset]);
+      add(reg_offset, block_size);
+      cmp(reg_offset, offset);
+      jl(l_next_block, T_NEAR);
+    }
+    vextractf128(xmm_tmp, ymm_max, 1);
+    vmaxps(xmm_max, xmm_max, xmm_tmp);
+  } else {
+    vbroadcastss(xmm_max, ptr[param_x]);
+  }
+  if (rest >= 4) {
+    vmaxps(xmm_max, xmm_max, ptr[param_x + offset]);
+    offset += sizeof(float) * 4;
+    rest -= 4;
+  }
+  reduceXmm(xmm_max, true);
+  for (int i = 0; i < rest; ++i) {
+    vmaxss(xmm_max, xmm_max, ptr[param_x + offset]);
+    offset += sizeof(float);
+  }
+  vbroadcastss(ymm_max, xmm_max);
+}
+
+void SoftmaxJitCode::computeExpSum() {
+  const int num_blocks = num_ / YMM_FLOAT_BLOCK;
+  const int block_size = sizeof(float) * YMM_FLOAT_BLOCK;
+  int offset = num_blocks * block_size;
+  int rest = num_ % YMM_FLOAT_BLOCK;
+  vxorps(ymm_sum, ymm_sum, ymm_sum);
+  if (num_blocks > 0) {
+    Label l_next_block;
+    xor_(reg_offset, reg_offset);
+    L(l_next_block);
+    vmovups(ymm_src, ptr[param_x + reg_offset]);
+    vsubps(ymm_src, ymm_src, ymm_max);
+    exp_jmm<ymm_t>(ymm_dst, ymm_src, 11, 12, 13, 14, 15);
+    vmovups(ptr[param_y + reg_offset], ymm_dst);
+    vaddps(ymm_sum, ymm_sum, ymm_dst);
+    add(reg_offset, block_size);
+    cmp(reg_offset, offset);
+    jl(l_next_block, T_NEAR);
+    vextractf128(xmm_tmp, ymm_sum, 1);
+    vaddps(xmm_sum, xmm_sum, xmm_tmp);
+  }
+  if (rest >= 4) {
+    vmovups(xmm_src, ptr[param_x + offset]);
+    vsubps(xmm_src, xmm_src, xmm_max);
+    exp_jmm<xmm_t>(xmm_dst, xmm_src, 11, 12, 13, 14, 15);
+    vmovups(ptr[param_y + offset], xmm_dst);
+    vaddps(xmm_sum, xmm_sum, xmm_dst);
+    offset += sizeof(float) * 4;
+    rest -= 4;
+  }
+  reduceXmm(xmm_sum, false);
+  for (int i = 0; i < rest; ++i) {
+    // the upper floats of xmm_src are zeros, which is safe for exp
+    vmovss(xmm_src, ptr[param_x + offset]);
+    vsubss(xmm_src, xmm_src, xmm_max);
+    exp_jmm<xmm_t>(xmm_dst, xmm_src, 11, 12, 13, 14, 15);
+    vmovss(ptr[param_y + offset], xmm_dst);
+    vaddss(xmm_sum, xmm_sum, xmm_dst);
+    offset += sizeof(float);
+  }
+}
+
+void SoftmaxJitCode::scaleRow() {
+  const int num_blocks = num_ / YMM_FLOAT_BLOCK;
+  const int block_size = sizeof(float) * YMM_FLOAT_BLOCK;
+  int offset = num_blocks * block_size;
+  int rest = num_ % YMM_FLOAT_BLOCK;
+  vdivss(xmm_sum, xmm_one, xmm_sum);
+  vbroadcastss(ymm_sum, xmm_sum);
+  if (num_blocks > 0) {
+    Label l_next_block;
+    xor_(reg_offset, reg_offset);
+    L(l_next_block);
+    vmulps(ymm_dst, ymm_sum, ptr[param_y + reg_offset]);
+    vmovups(ptr[param_y + reg_offset], ymm_dst);
+    add(reg_offset, block_size);
+    cmp(reg_offset, offset);
+    jl(l_next_block, T_NEAR);
+  }
+  if (rest >= 4) {
+    vmulps(xmm_dst, xmm_sum, ptr[param_y + offset]);
+    vmovups(ptr[param_y + offset], xmm_dst);
+    offset += sizeof(float) * 4;
+    rest -= 4;
+  }
+  for (int i = 0; i < rest; ++i) {
+    vmulss(xmm_dst, xmm_sum, ptr[param_y + offset]);
+    vmovss(ptr[param_y + offset], xmm_dst);
+    offset += sizeof(float);
+  }
+}
+
+void SoftmaxJitCode::scaleColumns() {
+  // y[j], y[j + remain], ... are normalized together, for j < remain
+  Label l_next_col, l_col_sum, l_col_scale;
+  movsxd(reg_stride, param_remain.cvt32());
+  shl(reg_stride, 2);
+  lea(reg_row_end, ptr[param_y + num_ * sizeof(float)]);
+  mov(reg_col, param_y);
+  lea(reg_col_end, ptr[param_y + reg_stride]);
+  L(l_next_col);
+  {
+    vxorps(xmm_sum, xmm_sum, xmm_sum);
+    mov(reg_offset, reg_col);
+    L(l_col_sum);
+    vaddss(xmm_sum, xmm_sum, ptr[reg_offset]);
+    add(reg_offset, reg_stride);
+    cmp(reg_offset, reg_row_end);
+    jb(l_col_sum, T_NEAR);
+
+    vdivss(xmm_sum, xmm_one, xmm_sum);
+    mov(reg_offset, reg_col);
+    L(l_col_scale);
+    vmulss(xmm_dst, xmm_sum, ptr[reg_offset]);
+    vmovss(ptr[reg_offset], xmm_dst);
+    add(reg_offset, reg_stride);
+    cmp(reg_offset, reg_row_end);
+    jb(l_col_scale, T_NEAR);
+
+    add(reg_col, sizeof(float));
+    cmp(reg_col, reg_col_end);
+    jb(l_next_col, T_NEAR);
+  }
+}
+
+void SoftmaxJitCode::genCode() {
+  Label l_next_row, l_strided, l_row_done, l_end;
+  mov(rax, reinterpret_cast<size_t>(exp_float_consts));
+  vmovss(xmm_one, ptr[rax + OFFSET_EXP_ONE]);
+
+  test(param_bs.cvt32(), param_bs.cvt32());
+  jle(l_end, T_NEAR);
+  L(l_next_row);
+  {
+    computeMax();
+    computeExpSum();
+    cmp(param_remain.cvt32(), 1);
+    jne(l_strided, T_NEAR);
+    scaleRow();
+    jmp(l_row_done, T_NEAR);
+    L(l_strided);
+    scaleColumns();
+    L(l_row_done);
+
+    add(param_x, num_ * sizeof(float));
+    add(param_y, num_ * sizeof(float));
+    dec(param_bs.cvt32());
+    jnz(l_next_row, T_NEAR);
+  }
+  L(l_end);
+  ret();
+}
+
+class SoftmaxCreator : public JitCodeCreator<int> {
+ public:
+  // exp_jmm needs avx2 to keep away from the shared g_tmp_mem, since the
+  // phi softmax kernel runs it in several threads
+  bool CanBeUsed(const int& d) const override {
+    return platform::MayIUse(platform::avx2) && d > 0;
+  }
+  size_t CodeSize(const int& d) const override {
+    return 96 + (5 * 72 + 160) * 8;
+  }
+  std::unique_ptr<GenBase> CreateJitCode(const int& d) const override {
+    return make_unique<SoftmaxJitCode>(d, CodeSize(d));
+  }
+};
+
+}  // namespace gen
+}  // namespace jit
+}  // namespace operators
+}  // namespace paddle
+
+namespace gen = paddle::operators::jit::gen;
+
+REGISTER_JITKERNEL_GEN(kSoftmax, gen::SoftmaxCreator);
@@ -0,0 +1,82 @@
+/* Copyright (c) 2018 PaddlePaddle Authors. All Rights Reserved.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License. */
+
+#pragma once
+
+#include <string>
+
+#include "glog/logging.h"
+#include "paddle/fluid/operators/jit/gen/act.h"
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace operators {
+namespace jit {
+namespace gen {
+
+// Fused row-wise softmax: max, exp(x - max), the sum and the scaling of a
+// row are done in one pass of generated code, for bs rows of width d.
+// When remain > 1, every row is normalized along the columns of stride
+// remain instead.
+class SoftmaxJitCode : public VActFunc {
+ public:
+  explicit SoftmaxJitCode(int d, size_t code_size, void* code_ptr = nullptr)
+      : VActFunc(code_size, code_ptr), num_(d) {
+    this->genCode();
+  }
+
+  DECLARE_JIT_CODE(SoftmaxJitCode);
+  void genCode() override;
+
+ private:
+  // reduces the 4 floats of dst to the lowest one
+  void reduceXmm(const xmm_t& dst, bool is_max);
+  // every pass over a row runs the ymm blocks in a loop, then the rest of 4
+  // floats and then the single floats
+  void computeMax();
+  void computeExpSum();
+  void scaleRow();
+  void scaleColumns();
+
+ private:
+  int num_;
+  reg64_t param_x{abi_param1};
+  reg64_t param_y{abi_param2};
+  reg64_t param_bs{abi_param4};
+  reg64_t param_remain{abi_param5};
+
+  reg64_t reg_offset{r9};
+  reg64_t reg_stride{r10};
+  reg64_t reg_row_end{r11};
+  reg64_t reg_col{rdx};
+  reg64_t reg_col_end{rax};
+
+  ymm_t ymm_max = ymm_t(0);
+  ymm_t ymm_sum = ymm_t(1);
+  ymm_t ymm_src = ymm_t(2);
+  ymm_t ymm_dst = ymm_t(3);
+  ymm_t ymm_tmp = ymm_t(4);
+
+  xmm_t xmm_max = xmm_t(0);
+  xmm_t xmm_sum = xmm_t(1);
+  xmm_t xmm_src = xmm_t(2);
+  xmm_t xmm_dst = xmm_t(3);
+  xmm_t xmm_tmp = xmm_t(4);
+  xmm_t xmm_one = xmm_t(5);
+};
+
+}  // namespace gen
+}  // namespace jit
+}  // namespace operators
+}  // namespace paddle
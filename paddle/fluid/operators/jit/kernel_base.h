@@ -48,6 +48,8 @@ typedef enum {
   kVBroadcast,
   kVCopy,
   kVExp,
+  kVGeluErf,
+  kVGeluTanh,
   kVIdentity,
   kVMul,
   kVRelu,
@@ -129,6 +131,8 @@ DECLARE_KERNELTUPLE(XYNTuple, VSquare);
 DECLARE_KERNELTUPLE(XYNTuple, VExp);
 DECLARE_KERNELTUPLE(XYNTuple, VSigmoid);
 DECLARE_KERNELTUPLE(XYNTuple, VTanh);
+DECLARE_KERNELTUPLE(XYNTuple, VGeluTanh);
+DECLARE_KERNELTUPLE(XYNTuple, VGeluErf);
 DECLARE_KERNELTUPLE(XYNTuple, VCopy);
 
 DECLARE_KERNELTUPLE(XRNTuple, HMax);
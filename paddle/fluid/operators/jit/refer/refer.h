@@ -136,6 +136,26 @@ void VTanh(const T* x, T* y, int n) {
   }
 }
 
+// y = 0.5 * x * (1 + tanh(sqrt(2 / pi) * (x + 0.044715 * x^3)))
+template <typename T>
+void VGeluTanh(const T* x, T* y, int n) {
+  const T a = static_cast<T>(M_2_SQRTPI * M_SQRT1_2);
+  const T b = static_cast<T>(0.044715);
+  for (int i = 0; i < n; ++i) {
+    T tmp = std::tanh(a * (x[i] + b * x[i] * x[i] * x[i]));
+    y[i] = static_cast<T>(0.5) * x[i] * (static_cast<T>(1) + tmp);
+  }
+}
+
+// y = 0.5 * x * (1 + erf(x / sqrt(2)))
+template <typename T>
+void VGeluErf(const T* x, T* y, int n) {
+  for (int i = 0; i < n; ++i) {
+    T tmp = std::erf(x[i] * static_cast<T>(M_SQRT1_2));
+    y[i] = static_cast<T>(0.5) * x[i] * (static_cast<T>(1) + tmp);
+  }
+}
+
 template <typename T>
 void (*getActFunc(KernelType type))(const T*, T*, int) {  // NOLINT
   if (type == kVSigmoid) {
@@ -606,6 +626,8 @@ DECLARE_REFER_KERNEL(VIdentity);
 DECLARE_REFER_KERNEL(VExp);
 DECLARE_REFER_KERNEL(VSigmoid);
 DECLARE_REFER_KERNEL(VTanh);
+DECLARE_REFER_KERNEL(VGeluTanh);
+DECLARE_REFER_KERNEL(VGeluErf);
 DECLARE_REFER_KERNEL(VSquare);
 DECLARE_REFER_KERNEL(VCopy);
 
@@ -1478,6 +1478,8 @@ TEST(JITKernel_key, sgd) {
 #define TestKernelVExp TestKernelXYN
 #define TestKernelVSigmoid TestKernelXYN
 #define TestKernelVTanh TestKernelXYN
+#define TestKernelVGeluTanh TestKernelXYN
+#define TestKernelVGeluErf TestKernelXYN
 #define TestKernelVCopy TestKernelXYN
 
 #define TestKernelHMax TestKernelXRN
@@ -1510,6 +1512,8 @@ TEST_CPU_KERNEL(VSquare);
 TEST_CPU_KERNEL(VExp);
 TEST_CPU_KERNEL(VSigmoid);
 TEST_CPU_KERNEL(VTanh);
+TEST_CPU_KERNEL(VGeluTanh);
+TEST_CPU_KERNEL(VGeluErf);
 TEST_CPU_KERNEL(VCopy);
 
 TEST_CPU_KERNEL(HMax);
@@ -0,0 +1,451 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include "paddle/fluid/platform/cpu_device_code.h"
+
+#include <algorithm>
+#include <cmath>
+
+#ifdef PADDLE_WITH_MKLML
+#include <omp.h>
+#endif
+
+#include "paddle/fluid/platform/enforce.h"
+
+namespace paddle {
+namespace platform {
+
+// The number of elements computed by every instruction at a time, the
+// values of a block stay in the L1 cache.
+static constexpr int64_t kCPUCodeBlockSize = 1024;
+// The blocks run in parallel when there are at least so many elements.
+static constexpr int64_t kCPUCodeMinParallelNumel = 1 << 16;
+
+template <typename T>
+static T ApplyCPUCodeOp(CPUCodeOp op, T a, T b, T c) {
+  switch (op) {
+    case CPUCodeOp::kNeg:
+      return -a;
+    case CPUCodeOp::kNot:
+      return static_cast<T>(a == static_cast<T>(0));
+    case CPUCodeOp::kExp:
+      return std::exp(a);
+    case CPUCodeOp::kLog:
+      return std::log(a);
+    case CPUCodeOp::kSqrt:
+      return std::sqrt(a);
+    case CPUCodeOp::kAdd:
+      return a + b;
+    case CPUCodeOp::kSub:
+      return a - b;
+    case CPUCodeOp::kMul:
+      return a * b;
+    case CPUCodeOp::kDiv:
+      return a / b;
+    case CPUCodeOp::kMax:
+      return a > b ? a : b;
+    case CPUCodeOp::kLT:
+      return static_cast<T>(a < b);
+    case CPUCodeOp::kLE:
+      return static_cast<T>(a <= b);
+    case CPUCodeOp::kGT:
+      return static_cast<T>(a > b);
+    case CPUCodeOp::kGE:
+      return static_cast<T>(a >= b);
+    case CPUCodeOp::kEQ:
+      return static_cast<T>(a == b);
+    case CPUCodeOp::kNE:
+      return static_cast<T>(a != b);
+    case CPUCodeOp::kSelect:
+      return a != static_cast<T>(0) ? b : c;
+  }
+  return a;
+}
+
+CPUCodeOperand CPUCodeBuilder::AddInput() {
+  PADDLE_ENFORCE_EQ(num_outputs_, 0,
+                    errors::PreconditionNotMet(
+                        "The inputs should be added before the outputs."));
+  CPUCodeOperand operand;
+  operand.kind = CPUCodeOperand::kArg;
+  operand.index = program_.num_args++;
+  return operand;
+}
+
+void CPUCodeBuilder::AddOutput(const CPUCodeOperand& value) {
+  program_.stores.emplace_back(program_.num_args++, value);
+  ++num_outputs_;
+}
+
+CPUCodeOperand CPUCodeBuilder::Emit(CPUCodeOp op, int num_srcs,
+                                    const CPUCodeOperand* srcs) {
+  bool is_const = true;
+  double values[3] = {0, 0, 0};
+  for (int i = 0; i < num_srcs; ++i) {
+    is_const = is_const && srcs[i].kind == CPUCodeOperand::kConst;
+    values[i] = srcs[i].value;
+  }
+  CPUCodeOperand result;
+  if (is_const) {
+    result.value = ApplyCPUCodeOp(op, values[0], values[1], values[2]);
+    return result;
+  }
+  if (op == CPUCodeOp::kSelect && srcs[0].kind == CPUCodeOperand::kConst) {
+    return srcs[0].value != 0 ? srcs[1] : srcs[2];
+  }
+
+  CPUCodeInstruction instruction;
+  instruction.op = op;
+  instruction.num_srcs = num_srcs;
+  std::copy(srcs, srcs + num_srcs, instruction.srcs);
+  instruction.dst.kind = CPUCodeOperand::kReg;
+  // Every value has its own register until the program is compiled.
+  instruction.dst.index = program_.num_regs++;
+  program_.instructions.push_back(instruction);
+  return instruction.dst;
+}
+
+static void OptimizeCPUCodeProgram(CPUCodeProgram* program) {
+  auto& instructions = program->instructions;
+  auto& stores = program->stores;
+  int num_values = program->num_regs;
+
+  // Remove the instructions whose results are not used, like the ones of
+  // the intermediate values which are not saved.
+  std::vector<bool> is_used(num_values, false);
+  for (auto& store : stores) {
+    if (store.second.kind == CPUCodeOperand::kReg) {
+      is_used[store.second.index] = true;
+    }
+  }
+  std::vector<CPUCodeInstruction> used_instructions;
+  for (auto iter = instructions.rbegin(); iter != instructions.rend();
+       ++iter) {
+    if (!is_used[iter->dst.index]) {
+      continue;
+    }
+    for (int j = 0; j < iter->num_srcs; ++j) {
+      if (iter->srcs[j].kind == CPUCodeOperand::kReg) {
+        is_used[iter->srcs[j].index] = true;
+      }
+    }
+    used_instructions.push_back(*iter);
+  }
+  std::reverse(used_instructions.begin(), used_instructions.end());
+
+  // An output is written by the instruction computing it instead of being
+  // copied from a register, and the later instructions read it back from the
+  // output. Like the kernels for GPU, the outputs should not share the buffers
+  // with the inputs.
+  std::vector<int> outputs(num_values, -1);
+  std::vector<std::pair<int, CPUCodeOperand>> copies;
+  for (auto& store : stores) {
+    auto& value = store.second;
+    if (value.kind == CPUCodeOperand::kReg && outputs[value.index] < 0) {
+      outputs[value.index] = store.first;
+    } else {
+      if (value.kind == CPUCodeOperand::kReg) {
+        value.kind = CPUCodeOperand::kArg;
+        value.index = outputs[value.index];
+      }
+      copies.push_back(store);
+    }
+  }
+  auto to_output = [&](CPUCodeOperand* operand) {
+    if (operand->kind == CPUCodeOperand::kReg && outputs[operand->index] >= 0) {
+      operand->kind = CPUCodeOperand::kArg;
+      operand->index = outputs[operand->index];
+    }
+  };
+
+  // Map the other values to as few registers as possible. A register is
+  // reused as soon as its value is dead, also by the instruction that reads it
+  // last, which is safe since every element only depends on the same element.
+  int num_instructions = used_instructions.size();
+  std::vector<int> last_use(num_values, -1);
+  for (int i = 0; i < num_instructions; ++i) {
+    auto& instruction = used_instructions[i];
+    for (int j = 0; j < instruction.num_srcs; ++j) {
+      if (instruction.srcs[j].kind == CPUCodeOperand::kReg) {
+        last_use[instruction.srcs[j].index] = i;
+      }
+    }
+  }
+  std::vector<int> registers(num_values, -1);
+  std::vector<int> free_registers;
+  int num_registers = 0;
+  for (int i = 0; i < num_instructions; ++i) {
+    auto& instruction = used_instructions[i];
+    std::vector<int> dead_values;
+    for (int j = 0; j < instruction.num_srcs; ++j) {
+      auto& src = instruction.srcs[j];
+      to_output(&src);
+      if (src.kind == CPUCodeOperand::kReg) {
+        if (last_use[src.index] == i) {
+          dead_values.push_back(src.index);
+        }
+        src.index = registers[src.index];
+      }
+    }
+    for (int value : dead_values) {
+      free_registers.push_back(registers[value]);
+    }
+    to_output(&instruction.dst);
+    if (instruction.dst.kind == CPUCodeOperand::kArg) {
+      continue;
+    }
+    int value = instruction.dst.index;
+    if (free_registers.empty()) {
+      registers[value] = num_registers++;
+    } else {
+      registers[value] = free_registers.back();
+      free_registers.pop_back();
+    }
+    instruction.dst.index = registers[value];
+  }
+
+  instructions = std::move(used_instructions);
+  stores = std::move(copies);
+  program->num_regs = num_registers;
+}
+
+// The loops of the instructions, written for every combination of register
+// and constant operands so that the compiler vectorizes them.
+template <typename T, typename Functor>
+static void RunUnary(const T* a, T* dst, int64_t size, Functor func) {
+  for (int64_t i = 0; i < size; ++i) {
+    dst[i] = func(a[i]);
+  }
+}
+
+template <typename T, typename Functor>
+static void RunBinary(const CPUCodeInstruction& instruction,
+                      const T* const* srcs, T* dst, int64_t size,
+                      Functor func) {
+  const T* a = srcs[0];
+  const T* b = srcs[1];
+  if (instruction.srcs[0].kind == CPUCodeOperand::kConst) {
+    T value = static_cast<T>(instruction.srcs[0].value);
+    for (int64_t i = 0; i < size; ++i) {
+      dst[i] = func(value, b[i]);
+    }
+  } else if (instruction.srcs[1].kind == CPUCodeOperand::kConst) {
+    T value = static_cast<T>(instruction.srcs[1].value);
+    for (int64_t i = 0; i < size; ++i) {
+      dst[i] = func(a[i], value);
+    }
+  } else {
+    for (int64_t i = 0; i < size; ++i) {
+      dst[i] = func(a[i], b[i]);
+    }
+  }
+}
+
+template <typename T>
+static void RunSelect(const CPUCodeInstruction& instruction,
+                      const T* const* srcs, T* dst, int64_t size) {
+  const T* cond = srcs[0];
+  const T* a = srcs[1];
+  const T* b = srcs[2];
+  bool is_a_const = instruction.srcs[1].kind == CPUCodeOperand::kConst;
+  bool is_b_const = instruction.srcs[2].kind == CPUCodeOperand::kConst;
+  T a_value = static_cast<T>(instruction.srcs[1].value);
+  T b_value = static_cast<T>(instruction.srcs[2].value);
+  T zero = static_cast<T>(0);
+  if (is_a_const && is_b_const) {
+    for (int64_t i = 0; i < size; ++i) {
+      dst[i] = cond[i] != zero ? a_value : b_value;
+    }
+  } else if (is_a_const) {
+    // load both of the values, so that the loop has no branch
+    for (int64_t i = 0; i < size; ++i) {
+      T b_i = b[i];
+      dst[i] = cond[i] != zero ? a_value : b_i;
+    }
+  } else if (is_b_const) {
+    for (int64_t i = 0; i < size; ++i) {
+      T a_i = a[i];
+      dst[i] = cond[i] != zero ? a_i : b_value;
+    }
+  } else {
+    for (int64_t i = 0; i < size; ++i) {
+      T a_i = a[i];
+      T b_i = b[i];
+      dst[i] = cond[i] != zero ? a_i : b_i;
+    }
+  }
+}
+
+template <typename T>
+static void RunInstruction(const CPUCodeInstruction& instruction,
+                           const T* const* srcs, T* dst, int64_t size) {
+  switch (instruction.op) {
+    case CPUCodeOp::kNeg:
+      RunUnary(srcs[0], dst, size, [](T a) { return -a; });
+      break;
+    case CPUCodeOp::kNot:
+      RunUnary(srcs[0], dst, size,
+               [](T a) { return static_cast<T>(a == static_cast<T>(0)); });
+      break;
+    case CPUCodeOp::kExp:
+      RunUnary(srcs[0], dst, size, [](T a) { return std::exp(a); });
+      break;
+    case CPUCodeOp::kLog:
+      RunUnary(srcs[0], dst, size, [](T a) { return std::log(a); });
+      break;
+    case CPUCodeOp::kSqrt:
+      RunUnary(srcs[0], dst, size, [](T a) { return std::sqrt(a); });
+      break;
+    case CPUCodeOp::kAdd:
+      RunBinary(instruction, srcs, dst, size, [](T a, T b) { return a + b; });
+      break;
+    case CPUCodeOp::kSub:
+      RunBinary(instruction, srcs, dst, size, [](T a, T b) { return a - b; });
+      break;
+    case CPUCodeOp::kMul:
+      RunBinary(instruction, srcs, dst, size, [](T a, T b) { return a * b; });
+      break;
+    case CPUCodeOp::kDiv:
+      RunBinary(instruction, srcs, dst, size, [](T a, T b) { return a / b; });
+      break;
+    case CPUCodeOp::kMax:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return a > b ? a : b; });
+      break;
+    case CPUCodeOp::kLT:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return static_cast<T>(a < b); });
+      break;
+    case CPUCodeOp::kLE:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return static_cast<T>(a <= b); });
+      break;
+    case CPUCodeOp::kGT:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return static_cast<T>(a > b); });
+      break;
+    case CPUCodeOp::kGE:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return static_cast<T>(a >= b); });
+      break;
+    case CPUCodeOp::kEQ:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return static_cast<T>(a == b); });
+      break;
+    case CPUCodeOp::kNE:
+      RunBinary(instruction, srcs, dst, size,
+                [](T a, T b) { return static_cast<T>(a != b); });
+      break;
+    case CPUCodeOp::kSelect:
+      RunSelect(instruction, srcs, dst, size);
+      break;
+  }
+}
+
+template <typename T>
+static void RunBlock(const CPUCodeProgram& program, T* const* args,
+                     int64_t offset, int64_t size, T* registers) {
+  auto get = [&](const CPUCodeOperand& operand) -> T* {
+    if (operand.kind == CPUCodeOperand::kArg) {
+      return args[operand.index] + offset;
+    } else if (operand.kind == CPUCodeOperand::kReg) {
+      return registers + operand.index * kCPUCodeBlockSize;
+    }
+    return nullptr;
+  };
+
+  for (auto& instruction : program.instructions) {
+    const T* srcs[3] = {nullptr, nullptr, nullptr};
+    for (int i = 0; i < instruction.num_srcs; ++i) {
+      srcs[i] = get(instruction.srcs[i]);
+    }
+    RunInstruction(instruction, srcs, get(instruction.dst), size);
+  }
+
+  for (auto& store : program.stores) {
+    T* dst = args[store.first] + offset;
+    const T* src = get(store.second);
+    if (src == nullptr) {
+      std::fill(dst, dst + size, static_cast<T>(store.second.value));
+    } else if (src != dst) {
+      std::copy(src, src + size, dst);
+    }
+  }
+}
+
+template <typename T>
+static void RunProgram(const CPUCodeProgram& program, int64_t n,
+                       const std::vector<void*>& args) {
+  std::vector<T*> ptrs(program.num_args);
+  for (int i = 0; i < program.num_args; ++i) {
+    ptrs[i] = *static_cast<T**>(args[i + 1]);
+  }
+  int64_t num_blocks = (n + kCPUCodeBlockSize - 1) / kCPUCodeBlockSize;
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel if (n >= kCPUCodeMinParallelNumel)
+#endif
+  {
+    std::vector<T> registers(program.num_regs * kCPUCodeBlockSize);
+#ifdef PADDLE_WITH_MKLML
+#pragma omp for
+#endif
+    for (int64_t block = 0; block < num_blocks; ++block) {
+      int64_t offset = block * kCPUCodeBlockSize;
+      int64_t size = std::min(kCPUCodeBlockSize, n - offset);
+      RunBlock(program, ptrs.data(), offset, size, registers.data());
+    }
+  }
+}
+
+CPUDeviceCode::CPUDeviceCode(const Place& place, const std::string& name,
+                             const CPUCodeProgram& program)
+    : program_(program) {
+  PADDLE_ENFORCE_EQ(
+      is_cpu_place(place), true,
+      errors::InvalidArgument(
+          "CPUDeviceCode can only launch on CPU, but received %s.", place));
+  place_ = place;
+  name_ = name;
+}
+
+bool CPUDeviceCode::Compile(bool include_path) {
+  if (!is_compiled_) {
+    int num_values = program_.num_regs;
+    OptimizeCPUCodeProgram(&program_);
+    VLOG(3) << "Compile < " << name_ << " > with " << num_values
+            << " values to " << program_.instructions.size()
+            << " instructions on " << program_.num_regs << " registers.";
+    is_compiled_ = true;
+  }
+  return true;
+}
+
+void CPUDeviceCode::Launch(const size_t n, std::vector<void*>* args) const {
+  PADDLE_ENFORCE_EQ(
+      is_compiled_, true,
+      errors::PreconditionNotMet("Please compile < %s > before launching it.",
+                                 name_));
+  PADDLE_ENFORCE_EQ(
+      args->size(), static_cast<size_t>(program_.num_args + 1),
+      errors::InvalidArgument("< %s > expects %d arguments, but received %d.",
+                              name_, program_.num_args + 1, args->size()));
+  if (program_.is_double) {
+    RunProgram<double>(program_, n, *args);
+  } else {
+    RunProgram<float>(program_, n, *args);
+  }
+}
+
+}  // namespace platform
+}  // namespace paddle
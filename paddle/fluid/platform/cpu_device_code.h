@@ -0,0 +1,134 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "paddle/fluid/platform/device_code.h"
+
+namespace paddle {
+namespace platform {
+
+enum class CPUCodeOp {
+  kNeg,
+  kNot,
+  kExp,
+  kLog,
+  kSqrt,
+  kAdd,
+  kSub,
+  kMul,
+  kDiv,
+  kMax,
+  kLT,
+  kLE,
+  kGT,
+  kGE,
+  kEQ,
+  kNE,
+  // srcs[0] != 0 ? srcs[1] : srcs[2]
+  kSelect,
+};
+
+struct CPUCodeOperand {
+  enum Kind { kConst, kArg, kReg };
+
+  Kind kind{kConst};
+  // the index of the argument or the register
+  int index{0};
+  double value{0};
+};
+
+struct CPUCodeInstruction {
+  CPUCodeOp op;
+  int num_srcs;
+  CPUCodeOperand srcs[3];
+  // a register, or the output argument the value is stored to
+  CPUCodeOperand dst;
+};
+
+struct CPUCodeProgram {
+  bool is_double{false};
+  int num_args{0};
+  int num_regs{0};
+  std::vector<CPUCodeInstruction> instructions;
+  // (argument, value) of the outputs which are not written by an instruction,
+  // they are written after all the instructions of a block ran
+  std::vector<std::pair<int, CPUCodeOperand>> stores;
+};
+
+/*
+ * Records the computation of one element of an elementwise kernel as a
+ * CPUCodeProgram. The arguments are numbered in the order they are added,
+ * all the inputs come before the outputs. Every value emitted gets its own
+ * register, constant subexpressions are folded.
+ */
+class CPUCodeBuilder {
+ public:
+  explicit CPUCodeBuilder(bool is_double) { program_.is_double = is_double; }
+
+  CPUCodeOperand AddInput();
+  void AddOutput(const CPUCodeOperand& value);
+
+  static CPUCodeOperand Const(double value) {
+    CPUCodeOperand operand;
+    operand.value = value;
+    return operand;
+  }
+  CPUCodeOperand Emit(CPUCodeOp op, const CPUCodeOperand& a) {
+    return Emit(op, 1, &a);
+  }
+  CPUCodeOperand Emit(CPUCodeOp op, const CPUCodeOperand& a,
+                      const CPUCodeOperand& b) {
+    CPUCodeOperand srcs[2] = {a, b};
+    return Emit(op, 2, srcs);
+  }
+  CPUCodeOperand Emit(CPUCodeOp op, const CPUCodeOperand& a,
+                      const CPUCodeOperand& b, const CPUCodeOperand& c) {
+    CPUCodeOperand srcs[3] = {a, b, c};
+    return Emit(op, 3, srcs);
+  }
+
+  const CPUCodeProgram& Program() const { return program_; }
+
+ private:
+  CPUCodeOperand Emit(CPUCodeOp op, int num_srcs, const CPUCodeOperand* srcs);
+
+  CPUCodeProgram program_;
+  int num_outputs_{0};
+};
+
+// Runs the elementwise kernels of fusion_group on CPU. Instead of compiling
+// source code, it runs a CPUCodeProgram built by fusion_group from the
+// operations: Compile() drops the values which are not stored and maps the
+// others to as few registers as possible, and Launch() runs all the
+// instructions on a block of elements at a time, so the intermediate values
+// never leave the cache. Only float and double kernels are supported.
+class CPUDeviceCode : public DeviceCode {
+ public:
+  explicit CPUDeviceCode(const Place& place, const std::string& name,
+                         const CPUCodeProgram& program);
+  bool Compile(bool include_path = false) override;
+  void Launch(const size_t n, std::vector<void*>* args) const override;
+
+ private:
+  CPUCodeProgram program_;
+  bool is_compiled_{false};
+};
+
+}  // namespace platform
+}  // namespace paddle
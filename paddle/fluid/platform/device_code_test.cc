@@ -16,6 +16,7 @@ limitations under the License. */
 #include <utility>
 #include "gtest/gtest.h"
 #include "paddle/fluid/framework/lod_tensor.h"
+#include "paddle/fluid/platform/cpu_device_code.h"
 #include "paddle/fluid/platform/init.h"
 
 #ifdef PADDLE_WITH_CUDA
@@ -123,3 +124,76 @@ TEST(DeviceCodePool, cuda) {
   LOG(INFO) << "get ptr: " << code_get;
 }
 #endif
+
+// z = max(2 * x + y, 0), x + y
+paddle::platform::CPUCodeProgram BuildCPUSaxpyProgram() {
+  using paddle::platform::CPUCodeBuilder;
+  using paddle::platform::CPUCodeOp;
+  CPUCodeBuilder builder(false);
+  auto x = builder.AddInput();
+  auto y = builder.AddInput();
+  // folded to 2
+  auto a = builder.Emit(CPUCodeOp::kAdd, CPUCodeBuilder::Const(1),
+                        CPUCodeBuilder::Const(1));
+  auto z = builder.Emit(CPUCodeOp::kAdd, builder.Emit(CPUCodeOp::kMul, a, x),
+                        y);
+  // never stored, so it is removed by Compile()
+  builder.Emit(CPUCodeOp::kExp, z);
+  auto zero = CPUCodeBuilder::Const(0);
+  builder.AddOutput(builder.Emit(CPUCodeOp::kSelect,
+                                 builder.Emit(CPUCodeOp::kGT, z, zero), z,
+                                 zero));
+  builder.AddOutput(builder.Emit(CPUCodeOp::kAdd, x, y));
+  return builder.Program();
+}
+
+TEST(DeviceCode, cpu) {
+  paddle::platform::CPUPlace place;
+  paddle::platform::CPUCodeProgram program = BuildCPUSaxpyProgram();
+  EXPECT_EQ(program.num_args, 4);
+  EXPECT_EQ(program.instructions.size(), 6UL);
+  paddle::platform::CPUDeviceCode code(place, "saxpy_kernel", program);
+  EXPECT_EQ(code.Compile(), true);
+
+  // more than one block, and the last block is not full
+  size_t n = 256 * 1024 + 3;
+  std::vector<float> x(n), y(n), z(n), w(n);
+  for (size_t i = 0; i < n; ++i) {
+    x[i] = static_cast<float>(i % 100) - 50;
+    y[i] = 0.5;
+  }
+  float* x_data = x.data();
+  float* y_data = y.data();
+  float* z_data = z.data();
+  float* w_data = w.data();
+  std::vector<void*> args = {&n, &x_data, &y_data, &z_data, &w_data};
+  code.Launch(n, &args);
+
+  for (size_t i = 0; i < n; i++) {
+    float expected = x[i] * 2 + 0.5;
+    EXPECT_EQ(z[i], expected > 0 ? expected : 0);
+    EXPECT_EQ(w[i], x[i] + 0.5f);
+  }
+
+  args.pop_back();
+  EXPECT_ANY_THROW(code.Launch(n, &args));
+
+  // the inputs should be added before the outputs
+  paddle::platform::CPUCodeBuilder builder(false);
+  builder.AddOutput(builder.AddInput());
+  EXPECT_ANY_THROW(builder.AddInput());
+}
+
+TEST(DeviceCodePool, cpu) {
+  paddle::platform::CPUPlace place;
+  paddle::platform::DeviceCodePool& pool =
+      paddle::platform::DeviceCodePool::Init({place});
+  EXPECT_EQ(pool.size(place), 0UL);
+
+  std::unique_ptr<paddle::platform::DeviceCode> code(
+      new paddle::platform::CPUDeviceCode(place, "saxpy_kernel",
+                                          BuildCPUSaxpyProgram()));
+  pool.Set(std::move(code));
+  EXPECT_EQ(pool.size(place), 1UL);
+  EXPECT_NE(pool.Get(place, "saxpy_kernel"), nullptr);
+}
@@ -397,8 +397,8 @@ PADDLE_DEFINE_EXPORTED_double(
  * Allocator related FLAG
  * Name: FLAGS_allocator_strategy
  * Since Version: 1.2
- * Value Range: string, {naive_best_fit, auto_growth, thread_local},
- * default=auto_growth
+ * Value Range: string, {naive_best_fit, auto_growth, thread_local,
+ * thread_caching}, default=auto_growth
  * Example:
  * Note: For selecting allocator policy of PaddlePaddle.
  */
@@ -415,7 +415,10 @@ PADDLE_DEFINE_EXPORTED_string(
     "size of models may be larger). auto_growth strategy would allocate "
     "GPU memory on demand, which allows users to start several Paddle jobs "
     "on the same GPU card but may lead to more memory fragmentation "
-    "(i.e., maximum batch size of models may be smaller).");
+    "(i.e., maximum batch size of models may be smaller). "
+    "thread_caching works as auto_growth, and also serves CPU memory from "
+    "an auto-growth allocator with per thread caches of small blocks, "
+    "which reduces lock contention of multi-threaded CPU training.");
 
 /**
  * Memory related FLAG
@@ -827,6 +830,9 @@ DEFINE_bool(enable_slotrecord_reset_shrink, false,
             "enable slotrecord obejct reset shrink memory, default false");
 DEFINE_bool(enable_ins_parser_file, false,
             "enable parser ins file , default false");
+DEFINE_bool(enable_fast_multislot_parser, false,
+            "parse the numbers of MultiSlot text input with the SIMD parser "
+            "instead of strtol/strtoull/strtof, the result is the same");
 
 /**
  * ProcessGroupNCCL related FLAG
@@ -861,3 +867,20 @@ PADDLE_DEFINE_EXPORTED_bool(use_autotune, false, "Whether enable autotune.");
 PADDLE_DEFINE_EXPORTED_bool(
     einsum_opt, false,
     "EinsumOp backward will be speedup at the expense of more gpu memory.");
+
+/**
+ * Performance related FLAG
+ * Name: sparse_conv_rulebook_cache_capacity
+ * Since Version: 2.3.0
+ * Value Range: int32, default=0
+ * Example: FLAGS_sparse_conv_rulebook_cache_capacity=8 keeps the rulebooks of
+ * the last 8 different inputs or kernel geometries.
+ * Note: The number of rulebooks kept by the CPU sparse conv and pool
+ * kernels, which are reused by the calls with the same indices of input and
+ * the same kernel geometry, e.g. the stacked submanifold convs. Every entry
+ * also keeps a copy of the indices of input, so the cache is disabled by
+ * default.
+ */
+PADDLE_DEFINE_EXPORTED_int32(
+    sparse_conv_rulebook_cache_capacity, 0,
+    "The capacity of the rulebook cache of the CPU sparse conv kernels.");
@@ -245,6 +245,8 @@ void BindDataset(py::module *m) {
            py::call_guard<py::gil_scoped_release>())
       .def("load_into_memory", &framework::Dataset::LoadIntoMemory,
            py::call_guard<py::gil_scoped_release>())
+      .def("dump_columnar", &framework::Dataset::DumpColumnar,
+           py::call_guard<py::gil_scoped_release>())
       .def("preload_into_memory", &framework::Dataset::PreLoadIntoMemory,
            py::call_guard<py::gil_scoped_release>())
       .def("wait_preload_done", &framework::Dataset::WaitPreLoadDone,
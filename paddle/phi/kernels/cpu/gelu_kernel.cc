@@ -15,6 +15,7 @@
 #include "paddle/phi/kernels/gelu_kernel.h"
 #include <algorithm>
 #include <cmath>
+#include "paddle/fluid/operators/jit/kernels.h"
 #include "paddle/phi/backends/cpu/cpu_context.h"
 #include "paddle/phi/core/kernel_registry.h"
 #include "paddle/phi/kernels/funcs/blas/blas.h"
@@ -83,12 +84,66 @@ struct GeluFunctor {
   }
 };
 
+// the number of elements computed by one call of the jit gelu
+constexpr int kGeluJitBlockNumel = 128;
+// the number of elements in a chunk run by one thread
+constexpr int64_t kGeluChunkNumel = 1 << 14;
+
+// Computes gelu with the generated VGeluTanh or VGeluErf of KernelTuple,
+// and returns false when there is no such code for T or for the cpu. Only
+// the kernel of a fixed block is used, the tail of the tensor is padded into
+// a block, so that no code is generated per shape of x.
+template <typename KernelTuple, typename T>
+bool GeluJit(const T* x, T* out, int64_t numel) {
+  namespace jit = paddle::operators::jit;
+  // the refer kernels are slower than Eigen, so only the jit code is used
+  if (numel <= 0 ||
+      !jit::GetJitCode<KernelTuple, phi::CPUPlace>(kGeluJitBlockNumel)) {
+    return false;
+  }
+  auto compute_block =
+      jit::KernelFuncs<KernelTuple, phi::CPUPlace>::Cache().At(
+          kGeluJitBlockNumel);
+  int64_t num_blocks = numel / kGeluJitBlockNumel;
+  constexpr int64_t kBlocksPerChunk = kGeluChunkNumel / kGeluJitBlockNumel;
+  int64_t num_chunks = (num_blocks + kBlocksPerChunk - 1) / kBlocksPerChunk;
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (num_chunks > 1)
+#endif
+  for (int64_t i = 0; i < num_chunks; ++i) {
+    int64_t end = std::min(num_blocks, (i + 1) * kBlocksPerChunk);
+    for (int64_t j = i * kBlocksPerChunk; j < end; ++j) {
+      compute_block(x + j * kGeluJitBlockNumel,
+                    out + j * kGeluJitBlockNumel,
+                    kGeluJitBlockNumel);
+    }
+  }
+  int tail = static_cast<int>(numel % kGeluJitBlockNumel);
+  if (tail > 0) {
+    int64_t offset = num_blocks * kGeluJitBlockNumel;
+    alignas(32) T block[kGeluJitBlockNumel] = {};
+    std::copy(x + offset, x + numel, block);
+    compute_block(block, block, kGeluJitBlockNumel);
+    std::copy(block, block + tail, out + offset);
+  }
+  return true;
+}
+
 template <typename T, typename Context>
 void GeluKernel(const Context& dev_ctx,
                 const DenseTensor& x,
                 bool approximate,
                 DenseTensor* out) {
   dev_ctx.template Alloc<T>(out);
+  bool done =
+      approximate
+          ? GeluJit<paddle::operators::jit::VGeluTanhTuple<T>>(
+                x.data<T>(), out->data<T>(), x.numel())
+          : GeluJit<paddle::operators::jit::VGeluErfTuple<T>>(
+                x.data<T>(), out->data<T>(), x.numel());
+  if (done) {
+    return;
+  }
   auto eigen_out = EigenVector<T>::Flatten(*out);
   auto eigen_x = EigenVector<T>::Flatten(x);
   auto& dev = *dev_ctx.eigen_device();
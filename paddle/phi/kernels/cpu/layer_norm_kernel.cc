@@ -13,6 +13,9 @@
 // limitations under the License.
 
 #include "paddle/phi/kernels/layer_norm_kernel.h"
+
+#include <algorithm>
+
 #include "paddle/phi/kernels/cpu/elementwise.h"
 #include "paddle/phi/kernels/funcs/layer_norm_util.h"
 #if !defined(PADDLE_WITH_CUDA) && !defined(_WIN32) && !defined(__APPLE__) && \
@@ -27,6 +30,12 @@
 
 namespace phi {
 
+#if !defined(PADDLE_WITH_CUDA) && !defined(_WIN32) && !defined(__APPLE__) && \
+    !defined(__OSX__)
+// the number of elements in a chunk of rows run by one thread
+constexpr int64_t kLayerNormChunkNumel = 1 << 15;
+#endif
+
 template <typename T, typename Context>
 void LayerNormKernel(const Context& dev_ctx,
                      const DenseTensor& x,
@@ -127,15 +136,33 @@ void LayerNormKernel(const Context& dev_ctx,
                  paddle::operators::jit::LayerNormTuple<T>,
                  phi::CPUPlace>::Cache()
                  .At(right);
-  ker(x_tmp.data<T>(),
-      out.data<T>(),
-      mean->data<T>(),
-      var->data<T>(),
-      scale ? scale->data<T>() : nullptr,
-      bias ? bias->data<T>() : nullptr,
-      static_cast<int>(left),
-      static_cast<const float>(epsilon),
-      right);
+  T* x_data = x_tmp.data<T>();
+  T* out_data = out.data<T>();
+  T* mean_data = mean->data<T>();
+  T* var_data = var->data<T>();
+  const T* scale_data = scale ? scale->data<T>() : nullptr;
+  const T* bias_data = bias ? bias->data<T>() : nullptr;
+  // the rows are normalized independently, so chunks of rows run in parallel
+  int rows_per_chunk = static_cast<int>(
+      std::max<int64_t>(1, kLayerNormChunkNumel / std::max(right, 1)));
+  int num_chunks = (left + rows_per_chunk - 1) / rows_per_chunk;
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (num_chunks > 1)
+#endif
+  for (int i = 0; i < num_chunks; ++i) {
+    int begin = i * rows_per_chunk;
+    int rows = std::min(rows_per_chunk, left - begin);
+    int64_t offset = static_cast<int64_t>(begin) * right;
+    ker(x_data + offset,
+        out_data + offset,
+        mean_data + begin,
+        var_data + begin,
+        scale_data,
+        bias_data,
+        rows,
+        static_cast<const float>(epsilon),
+        right);
+  }
 #endif
 }
 
@@ -0,0 +1,330 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <type_traits>
+
+#include "paddle/phi/core/ddim.h"
+#include "paddle/phi/core/enforce.h"
+
+#ifdef PADDLE_WITH_MKLML
+#include <omp.h>
+#endif
+
+namespace phi {
+namespace funcs {
+
+/*
+ * The iteration space of a broadcast binary op on CPU.
+ *
+ * The dims arrays are the ones of GetBroadcastDimsArrays. Dims of size 1 are
+ * dropped, and adjacent dims are collapsed when both operands are either
+ * contiguous or broadcast in them, so x=[2,3,4,5] with y=[1,1,4,5] runs as
+ * x=[6,20] with y=[1,20]. In the innermost dim every operand steps by 1 or
+ * 0, which the compiler vectorizes.
+ *
+ * The output is split into blocks of at most kBlockSize elements of a row,
+ * which run in parallel with OpenMP when the output is large enough.
+ */
+class CPUBroadcastPlan {
+ public:
+  static constexpr int64_t kBlockSize = 8192;
+  static constexpr int64_t kMinParallelNumel = 1 << 16;
+
+  CPUBroadcastPlan(const int *x_dims_array,
+                   const int *y_dims_array,
+                   const int *out_dims_array,
+                   int max_dim) {
+    PADDLE_ENFORCE_LE(
+        max_dim,
+        DDim::kMaxRank,
+        errors::InvalidArgument("The rank of a broadcast op should be at most "
+                                "%d, but received %d.",
+                                DDim::kMaxRank,
+                                max_dim));
+    int64_t x_stride = 1, y_stride = 1;
+    int64_t x_strides[DDim::kMaxRank], y_strides[DDim::kMaxRank];
+    for (int i = max_dim - 1; i >= 0; --i) {
+      x_strides[i] = x_dims_array[i] == 1 ? 0 : x_stride;
+      y_strides[i] = y_dims_array[i] == 1 ? 0 : y_stride;
+      x_stride *= x_dims_array[i];
+      y_stride *= y_dims_array[i];
+      numel_ *= out_dims_array[i];
+    }
+    x_numel_ = x_stride;
+    y_numel_ = y_stride;
+    if (numel_ <= 0) {
+      numel_ = 0;
+      return;
+    }
+
+    for (int i = 0; i < max_dim; ++i) {
+      if (out_dims_array[i] == 1) {
+        continue;
+      }
+      if (rank_ > 0 &&
+          x_strides_[rank_ - 1] == x_strides[i] * out_dims_array[i] &&
+          y_strides_[rank_ - 1] == y_strides[i] * out_dims_array[i]) {
+        dims_[rank_ - 1] *= out_dims_array[i];
+        x_strides_[rank_ - 1] = x_strides[i];
+        y_strides_[rank_ - 1] = y_strides[i];
+        continue;
+      }
+      dims_[rank_] = out_dims_array[i];
+      x_strides_[rank_] = x_strides[i];
+      y_strides_[rank_] = y_strides[i];
+      ++rank_;
+    }
+    if (rank_ == 0) {
+      dims_[0] = 1;
+      x_strides_[0] = 0;
+      y_strides_[0] = 0;
+      rank_ = 1;
+    }
+    blocks_per_row_ = (dims_[rank_ - 1] + kBlockSize - 1) / kBlockSize;
+  }
+
+  int64_t numel() const { return numel_; }
+  int64_t x_numel() const { return x_numel_; }
+  int64_t y_numel() const { return y_numel_; }
+  int rank() const { return rank_; }
+  const int64_t *dims() const { return dims_; }
+
+  // the steps of x and y in the innermost dim, 0 or 1
+  int64_t x_inner_stride() const { return x_strides_[rank_ - 1]; }
+  int64_t y_inner_stride() const { return y_strides_[rank_ - 1]; }
+
+  int64_t NumBlocks() const {
+    return numel_ == 0 ? 0 : numel_ / dims_[rank_ - 1] * blocks_per_row_;
+  }
+
+  void GetBlock(int64_t block,
+                int64_t *out_offset,
+                int64_t *x_offset,
+                int64_t *y_offset,
+                int64_t *size) const {
+    int64_t inner = dims_[rank_ - 1];
+    int64_t row = block / blocks_per_row_;
+    int64_t begin = block % blocks_per_row_ * kBlockSize;
+    *out_offset = row * inner + begin;
+    *x_offset = begin * x_strides_[rank_ - 1];
+    *y_offset = begin * y_strides_[rank_ - 1];
+    *size = inner - begin < kBlockSize ? inner - begin : kBlockSize;
+    for (int i = rank_ - 2; i >= 0 && row > 0; --i) {
+      int64_t index = row % dims_[i];
+      row /= dims_[i];
+      *x_offset += index * x_strides_[i];
+      *y_offset += index * y_strides_[i];
+    }
+  }
+
+ private:
+  int rank_{0};
+  int64_t numel_{1};
+  int64_t x_numel_{1};
+  int64_t y_numel_{1};
+  int64_t blocks_per_row_{0};
+  int64_t dims_[DDim::kMaxRank];
+  int64_t x_strides_[DDim::kMaxRank];
+  int64_t y_strides_[DDim::kMaxRank];
+};
+
+// Calls visitor with the inner strides of x and y as compile time constants.
+template <typename Visitor>
+inline void VisitInnerStrides(int64_t x_stride,
+                              int64_t y_stride,
+                              Visitor &&visitor) {
+  using Zero = std::integral_constant<int64_t, 0>;
+  using One = std::integral_constant<int64_t, 1>;
+  if (x_stride == 1 && y_stride == 1) {
+    visitor(One(), One());
+  } else if (x_stride == 1) {
+    visitor(One(), Zero());
+  } else if (y_stride == 1) {
+    visitor(Zero(), One());
+  } else {
+    visitor(Zero(), Zero());
+  }
+}
+
+// Calls visitor(out_offset, x_offset, y_offset, size) for every block.
+template <typename Visitor>
+inline void ParallelForBroadcastBlocks(const CPUBroadcastPlan &plan,
+                                       Visitor &&visitor) {
+  int64_t num_blocks = plan.NumBlocks();
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (plan.numel() >= \
+                             CPUBroadcastPlan::kMinParallelNumel)
+#endif
+  for (int64_t block = 0; block < num_blocks; ++block) {
+    int64_t out_offset, x_offset, y_offset, size;
+    plan.GetBlock(block, &out_offset, &x_offset, &y_offset, &size);
+    visitor(out_offset, x_offset, y_offset, size);
+  }
+}
+
+// out = func(x, y), or func(y, x) when is_xsize_larger is false, which is
+// the order of CommonForwardBroadcastCPU.
+template <typename InT, typename OutT, typename Functor>
+void CPUBroadcastForward(const CPUBroadcastPlan &plan,
+                         const InT *x,
+                         const InT *y,
+                         OutT *out,
+                         Functor func,
+                         bool is_xsize_larger) {
+  auto run = [&](auto x_stride, auto y_stride) {
+    auto compute = [&](int64_t out_offset,
+                       int64_t x_offset,
+                       int64_t y_offset,
+                       int64_t size) {
+      const InT *x_ptr = x + x_offset;
+      const InT *y_ptr = y + y_offset;
+      OutT *out_ptr = out + out_offset;
+      if (is_xsize_larger) {
+        for (int64_t i = 0; i < size; ++i) {
+          out_ptr[i] = func(x_ptr[i * x_stride], y_ptr[i * y_stride]);
+        }
+      } else {
+        for (int64_t i = 0; i < size; ++i) {
+          out_ptr[i] = func(y_ptr[i * y_stride], x_ptr[i * x_stride]);
+        }
+      }
+    };
+    ParallelForBroadcastBlocks(plan, compute);
+  };
+  VisitInnerStrides(plan.x_inner_stride(), plan.y_inner_stride(), run);
+}
+
+/*
+ * Computes the gradient of x (kIsX) or y with grad_op(x, y, out, dout).
+ *
+ * When the operand is not broadcast every element is written once. When it
+ * is, the gradients are summed into it: each thread sums a contiguous range
+ * of blocks into its own buffer and the buffers are added up in a fixed
+ * order, so the result does not depend on the scheduling. The number of
+ * buffers is limited so that they stay small compared to the output.
+ */
+template <bool kIsX, typename T, typename Tout, typename GradOp>
+void CPUBroadcastGrad(const CPUBroadcastPlan &plan,
+                      const T *x,
+                      const T *y,
+                      const Tout *out,
+                      const Tout *dout,
+                      GradOp grad_op,
+                      T *grad) {
+  int64_t grad_numel = kIsX ? plan.x_numel() : plan.y_numel();
+  if (plan.numel() == 0) {
+    std::fill(grad, grad + grad_numel, static_cast<T>(0));
+    return;
+  }
+
+  if (grad_numel == plan.numel()) {
+    auto run = [&](auto x_stride, auto y_stride) {
+      auto compute = [&](int64_t out_offset,
+                         int64_t x_offset,
+                         int64_t y_offset,
+                         int64_t size) {
+        const T *x_ptr = x + x_offset;
+        const T *y_ptr = y + y_offset;
+        for (int64_t i = 0; i < size; ++i) {
+          grad[out_offset + i] = grad_op(x_ptr[i * x_stride],
+                                         y_ptr[i * y_stride],
+                                         out[out_offset + i],
+                                         dout[out_offset + i]);
+        }
+      };
+      ParallelForBroadcastBlocks(plan, compute);
+    };
+    VisitInnerStrides(plan.x_inner_stride(), plan.y_inner_stride(), run);
+    return;
+  }
+
+  int64_t num_blocks = plan.NumBlocks();
+  auto accumulate = [&](int64_t block_begin, int64_t block_end, T *sum) {
+    auto run = [&](auto x_stride, auto y_stride) {
+      int64_t grad_stride = kIsX ? static_cast<int64_t>(x_stride)
+                                 : static_cast<int64_t>(y_stride);
+      for (int64_t block = block_begin; block < block_end; ++block) {
+        int64_t out_offset, x_offset, y_offset, size;
+        plan.GetBlock(block, &out_offset, &x_offset, &y_offset, &size);
+        const T *x_ptr = x + x_offset;
+        const T *y_ptr = y + y_offset;
+        T *sum_ptr = sum + (kIsX ? x_offset : y_offset);
+        if (grad_stride == 0) {
+          T block_sum = sum_ptr[0];
+          for (int64_t i = 0; i < size; ++i) {
+            block_sum += grad_op(x_ptr[i * x_stride],
+                                 y_ptr[i * y_stride],
+                                 out[out_offset + i],
+                                 dout[out_offset + i]);
+          }
+          sum_ptr[0] = block_sum;
+        } else {
+          for (int64_t i = 0; i < size; ++i) {
+            sum_ptr[i] += grad_op(x_ptr[i * x_stride],
+                                  y_ptr[i * y_stride],
+                                  out[out_offset + i],
+                                  dout[out_offset + i]);
+          }
+        }
+      }
+    };
+    VisitInnerStrides(plan.x_inner_stride(), plan.y_inner_stride(), run);
+  };
+
+  int64_t num_threads = 1;
+#ifdef PADDLE_WITH_MKLML
+  if (plan.numel() >= CPUBroadcastPlan::kMinParallelNumel) {
+    num_threads = std::min<int64_t>(
+        {static_cast<int64_t>(omp_get_max_threads()),
+         plan.numel() / (4 * grad_numel),
+         num_blocks});
+  }
+#endif
+  if (num_threads <= 1) {
+    std::fill(grad, grad + grad_numel, static_cast<T>(0));
+    accumulate(0, num_blocks, grad);
+    return;
+  }
+
+  // not a std::vector, whose bool specialization has no data()
+  std::unique_ptr<T[]> partial_sums(new T[num_threads * grad_numel]);
+  std::fill(partial_sums.get(),
+            partial_sums.get() + num_threads * grad_numel,
+            static_cast<T>(0));
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for num_threads(num_threads)
+#endif
+  for (int64_t i = 0; i < num_threads; ++i) {
+    accumulate(num_blocks * i / num_threads,
+               num_blocks * (i + 1) / num_threads,
+               partial_sums.get() + i * grad_numel);
+  }
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (grad_numel >= CPUBroadcastPlan::kBlockSize)
+#endif
+  for (int64_t j = 0; j < grad_numel; ++j) {
+    T sum = partial_sums[j];
+    for (int64_t i = 1; i < num_threads; ++i) {
+      sum += partial_sums[i * grad_numel + j];
+    }
+    grad[j] = sum;
+  }
+}
+
+}  // namespace funcs
+}  // namespace phi
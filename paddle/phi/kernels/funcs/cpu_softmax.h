@@ -0,0 +1,79 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+
+#include "paddle/fluid/operators/jit/kernels.h"
+#include "paddle/fluid/platform/cpu_info.h"
+#include "paddle/phi/common/place.h"
+
+#ifdef PADDLE_WITH_MKLML
+#include <omp.h>
+#endif
+
+namespace phi {
+namespace funcs {
+
+// the number of elements in a chunk of rows run by one thread
+constexpr int64_t kSoftmaxChunkNumel = 1 << 15;
+
+/*
+ * Runs the softmax of n rows of d over chunks of rows in parallel. A row is
+ * normalized along the axis of axis_dim with stride d / axis_dim.
+ *
+ * The jit softmax chosen by d only runs in several threads at once with
+ * AVX2: without it, the softmax falls back to the exp jit code, which spills
+ * to the shared g_tmp_mem buffer. So without AVX2 the chunks run the refer
+ * kernel when they run in parallel. may_use_avx2 lets the tests take both
+ * paths on any cpu.
+ */
+template <typename T>
+void CPUSoftmax(const T* x,
+                T* out,
+                int n,
+                int d,
+                int axis_dim,
+                bool may_use_avx2 = paddle::platform::MayIUse(
+                    paddle::platform::avx2)) {
+  namespace jit = paddle::operators::jit;
+  int remain = d / axis_dim;
+  int rows_per_chunk =
+      static_cast<int>(std::max<int64_t>(1, kSoftmaxChunkNumel / d));
+  int num_chunks = (n + rows_per_chunk - 1) / rows_per_chunk;
+#ifdef PADDLE_WITH_MKLML
+  bool is_parallel = num_chunks > 1;
+#else
+  bool is_parallel = false;
+#endif
+  auto compute_softmax =
+      (may_use_avx2 || !is_parallel)
+          ? jit::KernelFuncs<jit::SoftmaxTuple<T>, phi::CPUPlace>::Cache().At(
+                d)
+          : jit::GetReferFunc<jit::SoftmaxTuple<T>>();
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (is_parallel)
+#endif
+  for (int i = 0; i < num_chunks; ++i) {
+    int begin = i * rows_per_chunk;
+    int rows = std::min(rows_per_chunk, n - begin);
+    int64_t offset = static_cast<int64_t>(begin) * d;
+    compute_softmax(x + offset, out + offset, d, rows, remain);
+  }
+}
+
+}  // namespace funcs
+}  // namespace phi
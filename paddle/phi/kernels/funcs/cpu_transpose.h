@@ -0,0 +1,318 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "paddle/phi/core/ddim.h"
+#include "paddle/phi/core/enforce.h"
+
+#ifdef PADDLE_WITH_MKLML
+#include <omp.h>
+#endif
+
+namespace phi {
+namespace funcs {
+
+/*
+ * The iteration space of a transpose on CPU.
+ *
+ * Dims of size 1 are dropped, and adjacent output dims which are also
+ * adjacent and in the same order in the input are collapsed, so x=[N,C,H,W]
+ * with axis=[0,2,3,1] runs as [N,HW,C] with axis=[0,2,1]. After that:
+ *
+ *  - when the innermost dim is the same in the input and the output, the
+ *    output is a list of contiguous rows copied from the input;
+ *  - otherwise the output dim with input stride 1 (tile_dim) and the
+ *    innermost output dim are transposed in tiles, so that both the reads
+ *    and the writes of a tile stay in the cache.
+ *
+ * The rows or tiles run in parallel with OpenMP when the tensor is large
+ * enough.
+ */
+class CPUTransposePlan {
+ public:
+  static constexpr int64_t kMinParallelNumel = 1 << 16;
+  // the number of elements copied by a task of the row copy
+  static constexpr int64_t kRowBlockNumel = 8192;
+
+  CPUTransposePlan(const DDim &in_dims, const std::vector<int> &axis) {
+    int in_rank = in_dims.size();
+    PADDLE_ENFORCE_EQ(
+        static_cast<int>(axis.size()),
+        in_rank,
+        errors::InvalidArgument("The size of axis of transpose should be "
+                                "equal to the rank of input %d, but "
+                                "received %d.",
+                                in_rank,
+                                axis.size()));
+    int64_t in_strides[DDim::kMaxRank];
+    int64_t stride = 1;
+    for (int i = in_rank - 1; i >= 0; --i) {
+      in_strides[i] = stride;
+      stride *= in_dims[i];
+    }
+    numel_ = stride;
+    if (numel_ <= 0) {
+      numel_ = 0;
+      return;
+    }
+
+    for (int i = 0; i < in_rank; ++i) {
+      int64_t dim = in_dims[axis[i]];
+      if (dim == 1) {
+        continue;
+      }
+      if (rank_ > 0 && in_strides_[rank_ - 1] == in_strides[axis[i]] * dim) {
+        dims_[rank_ - 1] *= dim;
+        in_strides_[rank_ - 1] = in_strides[axis[i]];
+        continue;
+      }
+      dims_[rank_] = dim;
+      in_strides_[rank_] = in_strides[axis[i]];
+      ++rank_;
+    }
+    if (rank_ == 0) {
+      dims_[0] = 1;
+      in_strides_[0] = 1;
+      rank_ = 1;
+    }
+    stride = 1;
+    for (int i = rank_ - 1; i >= 0; --i) {
+      out_strides_[i] = stride;
+      stride *= dims_[i];
+      if (in_strides_[i] == 1) {
+        tile_dim_ = i;
+      }
+    }
+  }
+
+  int64_t numel() const { return numel_; }
+  int rank() const { return rank_; }
+  const int64_t *dims() const { return dims_; }
+  // the input stride of every output dim
+  const int64_t *in_strides() const { return in_strides_; }
+  const int64_t *out_strides() const { return out_strides_; }
+
+  bool IsRowCopy() const { return tile_dim_ == rank_ - 1; }
+  // the output dim whose input stride is 1
+  int tile_dim() const { return tile_dim_; }
+
+  // Computes the input and output offsets of index in the dims except
+  // tile_dim and the innermost one, or except the innermost one only for
+  // the row copy. The skipped dims count as size 1.
+  void GetOuterOffsets(int64_t index,
+                       int64_t *in_offset,
+                       int64_t *out_offset) const {
+    *in_offset = 0;
+    *out_offset = 0;
+    for (int i = rank_ - 2; i >= 0 && index > 0; --i) {
+      if (i == tile_dim_) {
+        continue;
+      }
+      int64_t dim_index = index % dims_[i];
+      index /= dims_[i];
+      *in_offset += dim_index * in_strides_[i];
+      *out_offset += dim_index * out_strides_[i];
+    }
+  }
+
+ private:
+  int rank_{0};
+  int tile_dim_{0};
+  int64_t numel_{1};
+  int64_t dims_[DDim::kMaxRank];
+  int64_t in_strides_[DDim::kMaxRank];
+  int64_t out_strides_[DDim::kMaxRank];
+};
+
+// out[a * out_stride + b] = in[b * in_stride + a] for a tile of
+// kSize x kSize. The sizes are compile time constants, so the compiler
+// unrolls the loops and writes every row of the tile with vector stores.
+template <int kSize, typename T>
+inline void TransposeMicroTile(const T *in,
+                               int64_t in_stride,
+                               T *out,
+                               int64_t out_stride) {
+  for (int a = 0; a < kSize; ++a) {
+    for (int b = 0; b < kSize; ++b) {
+      out[a * out_stride + b] = in[b * in_stride + a];
+    }
+  }
+}
+
+// The same for a tile of rows x cols at the edges of a block.
+template <typename T>
+inline void TransposeEdgeTile(const T *in,
+                              int64_t in_stride,
+                              T *out,
+                              int64_t out_stride,
+                              int64_t rows,
+                              int64_t cols) {
+  for (int64_t a = 0; a < rows; ++a) {
+    for (int64_t b = 0; b < cols; ++b) {
+      out[a * out_stride + b] = in[b * in_stride + a];
+    }
+  }
+}
+
+// The elements are moved as unsigned integers of the same size, so that
+// float16, bfloat16 and complex types share the kernels of the integers.
+template <typename T, typename Enable = void>
+struct TransposeElementType {
+  using Type = T;
+};
+
+template <typename T>
+struct TransposeElementType<
+    T,
+    typename std::enable_if<std::is_trivially_copyable<T>::value &&
+                            sizeof(T) == 1>::type> {
+  using Type = uint8_t;
+};
+
+template <typename T>
+struct TransposeElementType<
+    T,
+    typename std::enable_if<std::is_trivially_copyable<T>::value &&
+                            sizeof(T) == 2>::type> {
+  using Type = uint16_t;
+};
+
+template <typename T>
+struct TransposeElementType<
+    T,
+    typename std::enable_if<std::is_trivially_copyable<T>::value &&
+                            sizeof(T) == 4>::type> {
+  using Type = uint32_t;
+};
+
+template <typename T>
+struct TransposeElementType<
+    T,
+    typename std::enable_if<std::is_trivially_copyable<T>::value &&
+                            sizeof(T) == 8>::type> {
+  using Type = uint64_t;
+};
+
+// Short rows are grouped and long ones are split, so that every task copies
+// about kRowBlockNumel elements.
+template <typename T>
+void CPUTransposeRows(const CPUTransposePlan &plan, const T *in, T *out) {
+  constexpr int64_t kBlockNumel = CPUTransposePlan::kRowBlockNumel;
+  int64_t row_size = plan.dims()[plan.rank() - 1];
+  int64_t num_rows = plan.numel() / row_size;
+  int64_t rows_per_block = std::max<int64_t>(1, kBlockNumel / row_size);
+  int64_t segments_per_row = (row_size + kBlockNumel - 1) / kBlockNumel;
+  int64_t segment_size = std::min(row_size, kBlockNumel);
+  int64_t num_blocks =
+      (num_rows + rows_per_block - 1) / rows_per_block * segments_per_row;
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (plan.numel() >= \
+                             CPUTransposePlan::kMinParallelNumel)
+#endif
+  for (int64_t block = 0; block < num_blocks; ++block) {
+    int64_t row_begin = block / segments_per_row * rows_per_block;
+    int64_t row_end = std::min(num_rows, row_begin + rows_per_block);
+    int64_t begin = block % segments_per_row * segment_size;
+    int64_t size = std::min(segment_size, row_size - begin);
+    for (int64_t row = row_begin; row < row_end; ++row) {
+      int64_t in_offset, out_offset;
+      plan.GetOuterOffsets(row, &in_offset, &out_offset);
+      std::copy(in + in_offset + begin,
+                in + in_offset + begin + size,
+                out + out_offset + begin);
+    }
+  }
+}
+
+template <typename T>
+void CPUTransposeTiles(const CPUTransposePlan &plan, const T *in, T *out) {
+  // 16x16 micro tiles fill the vector registers for elements of at most 4
+  // bytes, and 8x8 ones for the larger elements. A block of 4x4 micro
+  // tiles reads and writes at most 64 cache lines each.
+  constexpr int kMicroSize = sizeof(T) <= 4 ? 16 : 8;
+  constexpr int64_t kBlockSize = 4 * kMicroSize;
+
+  int rank = plan.rank();
+  int tile_dim = plan.tile_dim();
+  int64_t rows = plan.dims()[tile_dim];
+  int64_t cols = plan.dims()[rank - 1];
+  int64_t in_stride = plan.in_strides()[rank - 1];
+  int64_t out_stride = plan.out_strides()[tile_dim];
+  int64_t row_blocks = (rows + kBlockSize - 1) / kBlockSize;
+  int64_t col_blocks = (cols + kBlockSize - 1) / kBlockSize;
+  int64_t blocks_per_outer = row_blocks * col_blocks;
+  int64_t num_blocks = plan.numel() / (rows * cols) * blocks_per_outer;
+
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (plan.numel() >= \
+                             CPUTransposePlan::kMinParallelNumel)
+#endif
+  for (int64_t block = 0; block < num_blocks; ++block) {
+    int64_t in_offset, out_offset;
+    plan.GetOuterOffsets(block / blocks_per_outer, &in_offset, &out_offset);
+    int64_t row_begin = block % blocks_per_outer / col_blocks * kBlockSize;
+    int64_t col_begin = block % col_blocks * kBlockSize;
+    int64_t row_end = std::min(rows, row_begin + kBlockSize);
+    int64_t col_end = std::min(cols, col_begin + kBlockSize);
+    const T *in_ptr = in + in_offset;
+    T *out_ptr = out + out_offset;
+    for (int64_t a = row_begin; a < row_end; a += kMicroSize) {
+      for (int64_t b = col_begin; b < col_end; b += kMicroSize) {
+        const T *in_tile = in_ptr + b * in_stride + a;
+        T *out_tile = out_ptr + a * out_stride + b;
+        if (a + kMicroSize <= row_end && b + kMicroSize <= col_end) {
+          TransposeMicroTile<kMicroSize>(
+              in_tile, in_stride, out_tile, out_stride);
+        } else {
+          TransposeEdgeTile(in_tile,
+                            in_stride,
+                            out_tile,
+                            out_stride,
+                            std::min<int64_t>(kMicroSize, row_end - a),
+                            std::min<int64_t>(kMicroSize, col_end - b));
+        }
+      }
+    }
+  }
+}
+
+// out = x.transpose(axis), where in is the data of x with in_dims and out
+// is the contiguous output.
+template <typename T>
+void CPUTranspose(const T *in,
+                  const DDim &in_dims,
+                  const std::vector<int> &axis,
+                  T *out) {
+  CPUTransposePlan plan(in_dims, axis);
+  if (plan.numel() == 0) {
+    return;
+  }
+  using ElementT = typename TransposeElementType<T>::Type;
+  const ElementT *in_data = reinterpret_cast<const ElementT *>(in);
+  ElementT *out_data = reinterpret_cast<ElementT *>(out);
+  if (plan.IsRowCopy()) {
+    CPUTransposeRows(plan, in_data, out_data);
+  } else {
+    CPUTransposeTiles(plan, in_data, out_data);
+  }
+}
+
+}  // namespace funcs
+}  // namespace phi
@@ -19,6 +19,7 @@ limitations under the License. */
 #include "paddle/phi/core/dense_tensor.h"
 #include "paddle/phi/kernels/empty_kernel.h"
 #include "paddle/phi/kernels/funcs/common_shape.h"
+#include "paddle/phi/kernels/funcs/cpu_broadcast.h"
 #include "paddle/phi/kernels/funcs/elementwise_utils.h"
 #include "paddle/phi/kernels/funcs/math_function.h"
 
@@ -283,7 +284,6 @@ void CommonForwardBroadcastCPU(const DenseTensor &x,
                                const CPUContext &ctx,
                                Functor func,
                                const bool is_xsize_larger = true) {
-  std::vector<int> index_array(max_dim, 0);
   const T *x_data = x.data<T>();
   const T *y_data = y.data<T>();
   PADDLE_ENFORCE_NOT_NULL(
@@ -292,20 +292,8 @@ void CommonForwardBroadcastCPU(const DenseTensor &x,
       y_data, errors::InvalidArgument("The input Y should not be empty."));
   OutType *out_data = ctx.Alloc<OutType>(z);
 
-  const int out_size = std::accumulate(
-      out_dims_array, out_dims_array + max_dim, 1, std::multiplies<int>());
-  int x_index, y_index;
-  for (int out_index = 0; out_index < out_size; ++out_index) {
-    x_index = GetElementwiseIndex(x_dims_array, max_dim, index_array.data());
-    y_index = GetElementwiseIndex(y_dims_array, max_dim, index_array.data());
-    if (is_xsize_larger) {
-      out_data[out_index] = func(x_data[x_index], y_data[y_index]);
-    } else {
-      out_data[out_index] = func(y_data[y_index], x_data[x_index]);
-    }
-
-    UpdateElementwiseIndexArray(out_dims_array, max_dim, index_array.data());
-  }
+  CPUBroadcastPlan plan(x_dims_array, y_dims_array, out_dims_array, max_dim);
+  CPUBroadcastForward(plan, x_data, y_data, out_data, func, is_xsize_larger);
 }
 
 template <typename Functor, typename T, typename OutType = T>
@@ -362,6 +350,7 @@ void CommonElementwiseBroadcastForward(const CPUContext &dev_ctx,
 //    like AddFunctor and InverseAddFunctor.
 // 2. The corresponding GPU implementation supports all the broadcast cases,
 //    thus there is no need to define and call with XxxInverseFunctor.
+// All the cases run with CPUBroadcastPlan, see cpu_broadcast.h.
 // TODO(liuyiqun): optimize the CPU implementation to support all broadcast
 // cases and avoid the need of XxxInverseFunctor.
 template <typename Functor, typename T, typename OutType = T>
@@ -380,10 +369,21 @@ void ElementwiseCompute(const CPUContext &dev_ctx,
     is_xsize_larger = false;
     max_dim = y_dims.size();
   }
-  TransformFunctor<Functor, T, CPUContext, OutType> functor(
-      x, y, z, dev_ctx, func, is_xsize_larger);
+  if (z->numel() == 0) {
+    return;
+  }
   if (x_dims == y_dims) {
-    functor.Run();
+    auto dims_array = phi::vectorize<int>(x_dims);
+    CommonForwardBroadcastCPU<Functor, T, OutType>(x,
+                                                   y,
+                                                   z,
+                                                   dims_array.data(),
+                                                   dims_array.data(),
+                                                   dims_array.data(),
+                                                   dims_array.size(),
+                                                   dev_ctx,
+                                                   func,
+                                                   is_xsize_larger);
     return;
   }
 
@@ -401,44 +401,25 @@ void ElementwiseCompute(const CPUContext &dev_ctx,
                         max_dim,
                         axis));
 
-  int pre, n, post, is_run_common_broadcast, axis_trim = 0;
-  if (is_xsize_larger) {
-    auto y_dims_trimed = TrimTrailingSingularDims(y_dims);
-    axis_trim = (y_dims_trimed.size() == 0) ? x_dims.size() : axis;
-    GetMidDims(x_dims,
-               y_dims_trimed,
-               axis_trim,
-               &pre,
-               &n,
-               &post,
-               &is_run_common_broadcast);
-  } else {
-    auto x_dims_trimed = TrimTrailingSingularDims(x_dims);
-    axis_trim = (x_dims_trimed.size() == 0) ? y_dims.size() : axis;
-    GetMidDims(y_dims,
-               x_dims_trimed,
-               axis_trim,
-               &pre,
-               &n,
-               &post,
-               &is_run_common_broadcast);
-  }
-  // special case for common implementation.
-  // case 1: x=[2,3,1,5], y=[2,1,4,1]
-  // case 2: x=[2,3,4], y=[1,1,4]
-  if (is_run_common_broadcast == 1) {
-    CommonElementwiseBroadcastForward<Functor, T, OutType>(
-        dev_ctx, x, y, z, x_dims, y_dims, func, axis, is_xsize_larger);
-    return;
-  }
-
-  if (post == 1) {
-    functor.RunRowWise(n, pre);
-    return;
-  } else {
-    functor.RunMidWise(n, pre, post);
-    return;
-  }
+  // the trailing 1s of the smaller operand may go beyond the larger one
+  DDim x_dims_trimed = x_dims;
+  DDim y_dims_trimed = y_dims;
+  DDim &smaller_dims = is_xsize_larger ? y_dims_trimed : x_dims_trimed;
+  smaller_dims = TrimTrailingSingularDims(smaller_dims);
+  int axis_trim = axis;
+  if (smaller_dims.size() == 0) {
+    smaller_dims = phi::make_ddim({1});
+    axis_trim = max_dim - 1;
+  }
+  CommonElementwiseBroadcastForward<Functor, T, OutType>(dev_ctx,
+                                                         x,
+                                                         y,
+                                                         z,
+                                                         x_dims_trimed,
+                                                         y_dims_trimed,
+                                                         func,
+                                                         axis_trim,
+                                                         is_xsize_larger);
 }
 
 // for broadcast backwards
@@ -29,6 +29,7 @@ limitations under the License. */
 #include "paddle/fluid/platform/bfloat16.h"
 #include "paddle/fluid/platform/float16.h"
 #include "paddle/phi/backends/cpu/cpu_context.h"
+#include "paddle/phi/kernels/funcs/cpu_transpose.h"
 #include "paddle/phi/kernels/funcs/eigen/common.h"
 #include "paddle/phi/kernels/funcs/math_function_impl.h"
 #include "unsupported/Eigen/CXX11/Tensor"
@@ -139,26 +140,7 @@ void TransposeNormal<DeviceContext, T>::operator()(
     const paddle::framework::Tensor& in,
     paddle::framework::Tensor* out,
     const std::vector<int>& axis) {
-  const int rank = axis.size();
-  auto in_stride = phi::stride(in.dims());
-  auto out_stride = phi::stride(out->dims());
-  const T* in_ptr = in.data<T>();
-  T* out_ptr = out->data<T>();
-
-  auto transpose_helper = [&](int64_t beg, int64_t end) {
-    for (int64_t out_idx = beg; out_idx < end; ++out_idx) {
-      int64_t in_idx = 0;
-      int64_t tmp_idx = out_idx;
-      // calculate the input index
-      for (int i = 0; i < rank; ++i) {
-        const int64_t coordinate = tmp_idx / out_stride[i];
-        tmp_idx -= coordinate * out_stride[i];
-        in_idx += coordinate * in_stride[axis[i]];
-      }
-      out_ptr[out_idx] = in_ptr[in_idx];
-    }
-  };
-  transpose_helper(0, out->numel());
+  CPUTranspose(in.data<T>(), in.dims(), axis, out->data<T>());
 }
 
 // define transpose normal
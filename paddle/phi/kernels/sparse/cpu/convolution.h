@@ -14,7 +14,8 @@ limitations under the License. */
 
 #pragma once
 
-#include <set>
+#include <algorithm>
+#include <vector>
 
 #include "paddle/phi/core/dense_tensor.h"
 #include "paddle/phi/core/kernel_registry.h"
@@ -22,15 +23,179 @@ limitations under the License. */
 #include "paddle/phi/core/tensor_meta.h"
 #include "paddle/phi/kernels/funcs/blas/blas.h"
 #include "paddle/phi/kernels/sparse/convolution_kernel.h"
+#include "paddle/phi/kernels/sparse/cpu/rulebook_cache.h"
 
 namespace phi {
 namespace sparse {
 
 using Dims4D = phi::funcs::sparse::Dims4D;
 
+// The number of input points handled by a task of the rulebook, and the
+// number of elements gathered or scattered by a thread.
+constexpr int64_t kRulebookChunkSize = 4096;
+constexpr int64_t kMinParallelNumel = 1 << 15;
+
+// Builds the rulebook of a sparse conv or pool from the indices of x.
+//
+// The rules are produced by tasks of (kernel offset, chunk of input points),
+// which run in parallel. Count() sizes every task first, and Fill() writes
+// every task at its own offset, so the rulebook is sorted by kernel offset
+// and then by input point, the same as a serial loop.
+//
+// rulebook:
+//[
+//  [kernel_index],
+//  [in_i],
+//  [out_index],
+//]
+// where out_index is the linear index of the output point.
+template <typename IntT>
+class RulebookBuilder {
+ public:
+  RulebookBuilder(const IntT* indices,
+                  const int64_t non_zero_num,
+                  const DDim& x_dims,
+                  const std::vector<int>& kernel_sizes,
+                  const std::vector<int>& paddings,
+                  const std::vector<int>& dilations,
+                  const std::vector<int>& strides,
+                  const DDim& out_dims,
+                  const bool subm)
+      : indices_(indices),
+        non_zero_num_(non_zero_num),
+        kernel_sizes_(kernel_sizes),
+        paddings_(paddings),
+        dilations_(dilations),
+        strides_(strides),
+        out_dims_(out_dims),
+        subm_(subm),
+        c_x_dims_(x_dims[0], x_dims[3], x_dims[2], x_dims[1]),
+        c_kernel_dims_(1, kernel_sizes[2], kernel_sizes[1], kernel_sizes[0]),
+        c_paddings_(1, paddings[2], paddings[1], paddings[0]),
+        c_strides_(1, strides[2], strides[1], strides[0]),
+        c_dilations_(1, dilations[2], dilations[1], dilations[0]) {
+    kernel_size_ = kernel_sizes[0] * kernel_sizes[1] * kernel_sizes[2];
+    num_chunks_ = (non_zero_num + kRulebookChunkSize - 1) / kRulebookChunkSize;
+    if (subm) {
+      // the out points of subm conv must be in x, which is looked up with a
+      // binary search so that the tasks only read it
+      sorted_in_.resize(non_zero_num);
+      for (int64_t i = 0; i < non_zero_num; ++i) {
+        sorted_in_[i] = phi::funcs::sparse::PointToIndex<DDim>(
+            indices[i],
+            indices[i + 3 * non_zero_num],
+            indices[i + 2 * non_zero_num],
+            indices[i + non_zero_num],
+            x_dims);
+      }
+      std::sort(sorted_in_.begin(), sorted_in_.end());
+      sorted_in_.erase(std::unique(sorted_in_.begin(), sorted_in_.end()),
+                       sorted_in_.end());
+    }
+  }
+
+  // Counts the rules of every kernel offset into counter, which has
+  // kernel_size elements, and returns the length of the rulebook.
+  int64_t Count(int* counter) {
+    int64_t num_tasks = kernel_size_ * num_chunks_;
+    task_offsets_.assign(num_tasks + 1, 0);
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for schedule(dynamic) if (num_tasks > 1)
+#endif
+    for (int64_t task = 0; task < num_tasks; ++task) {
+      int64_t count = 0;
+      ForEachRule(task, [&](int64_t in_i, IntT out_index) { ++count; });
+      task_offsets_[task + 1] = count;
+    }
+    for (int i = 0; i < kernel_size_; ++i) {
+      counter[i] = 0;
+    }
+    for (int64_t task = 0; task < num_tasks; ++task) {
+      counter[task / num_chunks_] += task_offsets_[task + 1];
+      task_offsets_[task + 1] += task_offsets_[task];
+    }
+    return task_offsets_[num_tasks];
+  }
+
+  // Writes the rules into rulebook, which has 3 x rulebook_len elements.
+  void Fill(IntT* rulebook, const int64_t rulebook_len) const {
+    int64_t num_tasks = kernel_size_ * num_chunks_;
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for schedule(dynamic) if (num_tasks > 1)
+#endif
+    for (int64_t task = 0; task < num_tasks; ++task) {
+      int64_t rulebook_index = task_offsets_[task];
+      int kernel_index = task / num_chunks_;
+      ForEachRule(task, [&](int64_t in_i, IntT out_index) {
+        rulebook[rulebook_index] = kernel_index;
+        rulebook[rulebook_index + rulebook_len] = in_i;
+        rulebook[rulebook_index + rulebook_len * 2] = out_index;
+        ++rulebook_index;
+      });
+    }
+  }
+
+ private:
+  template <typename Func>
+  void ForEachRule(const int64_t task, Func func) const {
+    const int kernel_index = task / num_chunks_;
+    const int kz = kernel_index / (kernel_sizes_[1] * kernel_sizes_[2]);
+    const int ky = kernel_index / kernel_sizes_[2] % kernel_sizes_[1];
+    const int kx = kernel_index % kernel_sizes_[2];
+    const int64_t begin = task % num_chunks_ * kRulebookChunkSize;
+    const int64_t end = std::min(non_zero_num_, begin + kRulebookChunkSize);
+    for (int64_t i = begin; i < end; i++) {
+      IntT batch = indices_[i];
+      IntT in_z = indices_[i + non_zero_num_];
+      IntT in_y = indices_[i + 2 * non_zero_num_];
+      IntT in_x = indices_[i + 3 * non_zero_num_];
+      if (!phi::funcs::sparse::Check(c_x_dims_,
+                                     c_kernel_dims_,
+                                     c_paddings_,
+                                     c_dilations_,
+                                     c_strides_,
+                                     in_x,
+                                     in_y,
+                                     in_z,
+                                     kx,
+                                     ky,
+                                     kz)) {
+        continue;
+      }
+      IntT out_z = (in_z + paddings_[0] - kz * dilations_[0]) / strides_[0];
+      IntT out_y = (in_y + paddings_[1] - ky * dilations_[1]) / strides_[1];
+      IntT out_x = (in_x + paddings_[2] - kx * dilations_[2]) / strides_[2];
+      IntT out_index = phi::funcs::sparse::PointToIndex<DDim>(
+          batch, out_x, out_y, out_z, out_dims_);
+      if (subm_ && !std::binary_search(
+                       sorted_in_.begin(), sorted_in_.end(), out_index)) {
+        continue;
+      }
+      func(i, out_index);
+    }
+  }
+
+  const IntT* indices_;
+  const int64_t non_zero_num_;
+  const std::vector<int>& kernel_sizes_;
+  const std::vector<int>& paddings_;
+  const std::vector<int>& dilations_;
+  const std::vector<int>& strides_;
+  const DDim out_dims_;
+  const bool subm_;
+  const Dims4D c_x_dims_;
+  const Dims4D c_kernel_dims_;
+  const Dims4D c_paddings_;
+  const Dims4D c_strides_;
+  const Dims4D c_dilations_;
+  int kernel_size_;
+  int64_t num_chunks_;
+  std::vector<IntT> sorted_in_;
+  std::vector<int64_t> task_offsets_;
+};
+
 // such as: kernel(3, 3, 3), kernel_size = 27
 // counter_per_weight: (kernel_size)
-// TODO(zhangkaihuo): optimize performance with multithreading
 template <typename T, typename Context, typename IntT = int>
 void ProductRuleBook(const Context& dev_ctx,
                      const SparseCooTensor& x,
@@ -42,99 +207,28 @@ void ProductRuleBook(const Context& dev_ctx,
                      const bool subm,
                      DenseTensor* rulebook,
                      DenseTensor* counter_per_kernel) {
-  const int64_t non_zero_num = x.nnz();
-  const auto& non_zero_indices = x.non_zero_indices();
-  const IntT* indices_ptr = non_zero_indices.data<IntT>();
-  int* counter_ptr = counter_per_kernel->data<int>();
-  int kernel_size = kernel_sizes[0] * kernel_sizes[1] * kernel_sizes[2];
-  memset(counter_ptr, 0, kernel_size * sizeof(int));
-
-  int rulebook_len = 0;
-  // calc the rulebook_len
-  const auto& x_dims = x.dims();
-  const Dims4D c_x_dims(x_dims[0], x_dims[3], x_dims[2], x_dims[1]);
-  const Dims4D c_kernel_dims(
-      1, kernel_sizes[2], kernel_sizes[1], kernel_sizes[0]);
-  const Dims4D c_out_dims(out_dims[0], out_dims[3], out_dims[2], out_dims[1]);
-  const Dims4D c_paddings(1, paddings[2], paddings[1], paddings[0]);
-  const Dims4D c_strides(1, strides[2], strides[1], strides[0]);
-  const Dims4D c_dilations(1, dilations[2], dilations[1], dilations[0]);
-
-  std::set<IntT> hash_in;
-  if (subm) {
-    for (int i = 0; i < non_zero_num; i++) {
-      IntT batch = indices_ptr[i];
-      IntT in_z = indices_ptr[i + non_zero_num];
-      IntT in_y = indices_ptr[i + 2 * non_zero_num];
-      IntT in_x = indices_ptr[i + 3 * non_zero_num];
-      IntT index = phi::funcs::sparse::PointToIndex<DDim>(
-          batch, in_x, in_y, in_z, x_dims);
-      hash_in.insert(index);
-    }
-  }
-
-  auto f_calc_rulebook = [&](IntT* rulebook_ptr) {
-    int kernel_index = 0, rulebook_index = 0;
-    for (int kz = 0; kz < kernel_sizes[0]; kz++) {
-      for (int ky = 0; ky < kernel_sizes[1]; ky++) {
-        for (int kx = 0; kx < kernel_sizes[2]; kx++) {
-          ++kernel_index;
-          for (int64_t i = 0; i < non_zero_num; i++) {
-            IntT batch = indices_ptr[i];
-            IntT in_z = indices_ptr[i + non_zero_num];
-            IntT in_y = indices_ptr[i + 2 * non_zero_num];
-            IntT in_x = indices_ptr[i + 3 * non_zero_num];
-            IntT out_z = (in_z + paddings[0] - kz * dilations[0]) / strides[0];
-            IntT out_y = (in_y + paddings[1] - ky * dilations[1]) / strides[1];
-            IntT out_x = (in_x + paddings[2] - kx * dilations[2]) / strides[2];
-            if (phi::funcs::sparse::Check(c_x_dims,
-                                          c_kernel_dims,
-                                          c_paddings,
-                                          c_dilations,
-                                          c_strides,
-                                          in_x,
-                                          in_y,
-                                          in_z,
-                                          kx,
-                                          ky,
-                                          kz)) {
-              if (subm) {
-                IntT out_index = phi::funcs::sparse::PointToIndex<DDim>(
-                    batch, out_x, out_y, out_z, out_dims);
-                if (hash_in.find(out_index) == hash_in.end()) {
-                  continue;
-                }
-              }
-
-              if (rulebook_ptr == nullptr) {
-                counter_ptr[kernel_index - 1] += 1;
-                ++rulebook_len;
-              } else {
-                rulebook_ptr[rulebook_index] = kernel_index - 1;
-                rulebook_ptr[rulebook_index + rulebook_len] = i;  // in_i
-                rulebook_ptr[rulebook_index + rulebook_len * 2] =
-                    phi::funcs::sparse::PointToIndex<DDim>(
-                        batch, out_x, out_y, out_z, out_dims);  // out_index
-                ++rulebook_index;
-              }
-            }
-          }
-        }
-      }
-    }
-  };
-
-  f_calc_rulebook(nullptr);
+  RulebookBuilder<IntT> builder(x.non_zero_indices().data<IntT>(),
+                                x.nnz(),
+                                x.dims(),
+                                kernel_sizes,
+                                paddings,
+                                dilations,
+                                strides,
+                                out_dims,
+                                subm);
+  int64_t rulebook_len = builder.Count(counter_per_kernel->data<int>());
   // alloc the rulebook
   *rulebook = phi::Empty(
       dev_ctx,
       DenseTensorMeta(paddle::experimental::CppTypeToDataType<IntT>::Type(),
                       {3, rulebook_len},
                       DataLayout::NCHW));
-  IntT* rulebook_ptr = rulebook->data<IntT>();
-  f_calc_rulebook(rulebook_ptr);
+  builder.Fill(rulebook->data<IntT>(), rulebook_len);
 }
 
+// Replaces the out indexs in the rulebook with the positions of the out
+// points in the sorted out indices, and creates the indices and the values
+// of out.
 template <typename T, typename Context, typename IntT = int>
 void UpdateRulebookAndOutIndex(const Context& dev_ctx,
                                const SparseCooTensor& x,
@@ -143,12 +237,12 @@ void UpdateRulebookAndOutIndex(const Context& dev_ctx,
                                const DDim& out_dims,
                                DenseTensor* rulebook,
                                SparseCooTensor* out) {
-  std::set<IntT> out_indexs;
-  int n = rulebook->dims()[1];
+  int64_t n = rulebook->dims()[1];
   IntT* rulebook_ptr = rulebook->data<IntT>();
-  for (int i = 0; i < n; i++) {
-    out_indexs.insert(rulebook_ptr[i + n * 2]);
-  }
+  std::vector<IntT> out_indexs(rulebook_ptr + n * 2, rulebook_ptr + n * 3);
+  std::sort(out_indexs.begin(), out_indexs.end());
+  out_indexs.erase(std::unique(out_indexs.begin(), out_indexs.end()),
+                   out_indexs.end());
 
   int out_non_zero_num = out_indexs.size();
   const int64_t sparse_dim = 4;
@@ -162,41 +256,151 @@ void UpdateRulebookAndOutIndex(const Context& dev_ctx,
   phi::DenseTensor out_indices = phi::Empty(dev_ctx, std::move(indices_meta));
   phi::DenseTensor out_values = phi::Empty(dev_ctx, std::move(values_meta));
   IntT* out_indices_ptr = out_indices.data<IntT>();
-  int i = 0;
-  for (auto it = out_indexs.begin(); it != out_indexs.end(); it++, i++) {
-    const IntT index = *it;
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (out_non_zero_num >= kRulebookChunkSize)
+#endif
+  for (int i = 0; i < out_non_zero_num; i++) {
     IntT batch, x, y, z;
-    phi::funcs::sparse::IndexToPoint<DDim>(index, out_dims, &batch, &x, &y, &z);
+    phi::funcs::sparse::IndexToPoint<DDim>(
+        out_indexs[i], out_dims, &batch, &x, &y, &z);
     out_indices_ptr[i] = batch;
     out_indices_ptr[i + out_non_zero_num] = z;
     out_indices_ptr[i + out_non_zero_num * 2] = y;
     out_indices_ptr[i + out_non_zero_num * 3] = x;
   }
-  for (i = 0; i < n; i++) {
-    IntT out_index = rulebook_ptr[i + n * 2];
-    rulebook_ptr[i + n * 2] =
-        std::distance(out_indexs.begin(), out_indexs.find(out_index));
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (n >= kRulebookChunkSize)
+#endif
+  for (int64_t i = 0; i < n; i++) {
+    IntT* out_index = rulebook_ptr + i + n * 2;
+    *out_index = std::lower_bound(
+                     out_indexs.begin(), out_indexs.end(), *out_index) -
+                 out_indexs.begin();
   }
 
   out->SetMember(out_indices, out_values, out_dims, true);
 }
 
+// Builds the rulebook, the counter of every kernel offset and the indices of
+// out with ProductRuleBook and UpdateRulebookAndOutIndex, or copies them
+// from the RulebookCache when x has the same indices as a previous call with
+// the same geometry, e.g. the stacked subm convs of a block or the same
+// batch in the next step.
+template <typename T, typename Context, typename IntT = int>
+void ProductRuleBookWithCache(const Context& dev_ctx,
+                              const SparseCooTensor& x,
+                              const std::vector<int>& kernel_sizes,
+                              const std::vector<int>& paddings,
+                              const std::vector<int>& dilations,
+                              const std::vector<int>& strides,
+                              const DDim& out_dims,
+                              const bool subm,
+                              const int out_channels,
+                              DenseTensor* rulebook,
+                              DenseTensor* counter_per_kernel,
+                              SparseCooTensor* out) {
+  const int kernel_size = kernel_sizes[0] * kernel_sizes[1] * kernel_sizes[2];
+  auto& cache = RulebookCache::Instance();
+  std::vector<int64_t> key;
+  if (cache.capacity() > 0) {
+    key = RulebookCache::MakeKey(x.non_zero_indices().data<IntT>(),
+                                 x.nnz(),
+                                 x.dims(),
+                                 kernel_sizes,
+                                 paddings,
+                                 dilations,
+                                 strides,
+                                 out_dims,
+                                 subm);
+    DenseTensor out_indices;
+    if (cache.Get(dev_ctx,
+                  key,
+                  rulebook,
+                  counter_per_kernel->data<int>(),
+                  kernel_size,
+                  &out_indices)) {
+      DenseTensorMeta values_meta(x.dtype(),
+                                  {out_indices.dims()[1], out_channels},
+                                  x.non_zero_elements().layout());
+      phi::DenseTensor out_values =
+          phi::Empty(dev_ctx, std::move(values_meta));
+      out->SetMember(out_indices, out_values, out_dims, true);
+      return;
+    }
+  }
+
+  ProductRuleBook<T, Context, IntT>(dev_ctx,
+                                    x,
+                                    kernel_sizes,
+                                    paddings,
+                                    dilations,
+                                    strides,
+                                    out_dims,
+                                    subm,
+                                    rulebook,
+                                    counter_per_kernel);
+  UpdateRulebookAndOutIndex<T, Context, IntT>(
+      dev_ctx, x, kernel_size, out_channels, out_dims, rulebook, out);
+  if (cache.capacity() > 0) {
+    cache.Put(dev_ctx,
+              std::move(key),
+              *rulebook,
+              counter_per_kernel->data<int>(),
+              kernel_size,
+              out->non_zero_indices());
+  }
+}
+
 template <typename T, typename IntT = int>
 void Gather(
     const T* x, const IntT* indexs, const int n, const int channels, T* out) {
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (static_cast<int64_t>(n) * channels >= \
+                             kMinParallelNumel)
+#endif
   for (int i = 0; i < n; i++) {
     IntT real_i = indexs[i];
-    memcpy(out + i * channels, x + real_i * channels, channels * sizeof(T));
+    memcpy(out + static_cast<int64_t>(i) * channels,
+           x + static_cast<int64_t>(real_i) * channels,
+           channels * sizeof(T));
   }
 }
 
+// out[indexs[i]] += x[i] for the n rows of x, where out has out_num rows.
+// The rows of x are grouped by their out row first, so that every row of
+// out is summed by one thread, without atomics or a buffer per thread, and
+// in the same order as a serial loop.
 template <typename T, typename IntT = int>
-void Scatter(
-    const T* x, const IntT* indexs, const int n, const int channels, T* out) {
+void Scatter(const T* x,
+             const IntT* indexs,
+             const int n,
+             const int channels,
+             const int out_num,
+             T* out) {
+  std::vector<int> row_offsets(out_num + 1, 0);
   for (int i = 0; i < n; i++) {
-    IntT real_i = indexs[i];
-    for (int j = 0; j < channels; j++) {
-      out[real_i * channels + j] += x[i * channels + j];
+    ++row_offsets[indexs[i] + 1];
+  }
+  for (int i = 0; i < out_num; i++) {
+    row_offsets[i + 1] += row_offsets[i];
+  }
+  std::vector<int> rows(n);
+  std::vector<int> next(row_offsets.begin(), row_offsets.end() - 1);
+  for (int i = 0; i < n; i++) {
+    rows[next[indexs[i]]++] = i;
+  }
+
+#ifdef PADDLE_WITH_MKLML
+#pragma omp parallel for if (static_cast<int64_t>(n) * channels >= \
+                             kMinParallelNumel)
+#endif
+  for (int i = 0; i < out_num; i++) {
+    T* out_row = out + static_cast<int64_t>(i) * channels;
+    for (int j = row_offsets[i]; j < row_offsets[i + 1]; j++) {
+      const T* x_row = x + static_cast<int64_t>(rows[j]) * channels;
+      for (int c = 0; c < channels; c++) {
+        out_row[c] += x_row[c];
+      }
     }
   }
 }
@@ -174,6 +174,7 @@ void Conv3dGradCPUKernel(const CPUContext& dev_ctx,
                    rulebook.data<IntT>() + rulebook_len,
                    rulebook_len,
                    in_channels,
+                   x.nnz(),
                    x_grad_values_ptr);
 }
 
@@ -70,19 +70,18 @@ void Conv3dCPUKernel(const CPUContext& dev_ctx,
       DataType::INT32, {kernel_size}, DataLayout::NCHW);
   DenseTensor counter_per_kernel = phi::Empty(dev_ctx, std::move(counter_meta));
 
-  ProductRuleBook<T, CPUContext, IntT>(dev_ctx,
-                                       x,
-                                       kernel_sizes,
-                                       subm_paddings,
-                                       dilations,
-                                       subm_strides,
-                                       out_dims,
-                                       subm,
-                                       rulebook,
-                                       &counter_per_kernel);
-
-  UpdateRulebookAndOutIndex<T, CPUContext, IntT>(
-      dev_ctx, x, kernel_size, out_channels, out_dims, rulebook, out);
+  ProductRuleBookWithCache<T, CPUContext, IntT>(dev_ctx,
+                                                x,
+                                                kernel_sizes,
+                                                subm_paddings,
+                                                dilations,
+                                                subm_strides,
+                                                out_dims,
+                                                subm,
+                                                out_channels,
+                                                rulebook,
+                                                &counter_per_kernel,
+                                                out);
 
   int n = rulebook->dims()[1];
   const int* counter_ptr = counter_per_kernel.data<int>();
@@ -147,6 +146,7 @@ void Conv3dCPUKernel(const CPUContext& dev_ctx,
                    rulebook->data<IntT>() + n * 2,
                    n,
                    out_channels,
+                   out->nnz(),
                    out_values_ptr);
 }
 
@@ -0,0 +1,182 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+    http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#pragma once
+
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <vector>
+
+#include "gflags/gflags.h"
+#include "paddle/phi/core/dense_tensor.h"
+#include "paddle/phi/core/tensor_meta.h"
+#include "paddle/phi/kernels/empty_kernel.h"
+
+DECLARE_int32(sparse_conv_rulebook_cache_capacity);
+
+namespace phi {
+namespace sparse {
+
+/*
+ * A LRU cache of the rulebooks built by the CPU sparse conv and pool kernels.
+ *
+ * The rulebook only depends on the indices of x and on the geometry of the
+ * kernel, so the key is made of both, including every index of x. The
+ * stacked subm convs of a block keep the indices of their input, and share
+ * one rulebook when they have the same kernel geometry.
+ *
+ * An entry keeps its own copy of the rulebook, the counter of every kernel
+ * offset and the indices of out, which are copied again into the outputs of
+ * a hit, so the kernels may own and modify them as before.
+ *
+ * The cache keeps at most FLAGS_sparse_conv_rulebook_cache_capacity entries.
+ * It is disabled by default, as the flag is 0, because every entry holds a
+ * copy of the indices of x besides the rulebook, which is large for big
+ * point clouds.
+ */
+class RulebookCache {
+ public:
+  static RulebookCache& Instance() {
+    // never destroyed, so that the entries are not freed after the
+    // allocators at exit
+    static RulebookCache* cache = new RulebookCache();
+    return *cache;
+  }
+
+  int capacity() const { return FLAGS_sparse_conv_rulebook_cache_capacity; }
+
+  size_t size() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+  }
+
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+  }
+
+  template <typename IntT>
+  static std::vector<int64_t> MakeKey(const IntT* indices,
+                                      const int64_t non_zero_num,
+                                      const DDim& x_dims,
+                                      const std::vector<int>& kernel_sizes,
+                                      const std::vector<int>& paddings,
+                                      const std::vector<int>& dilations,
+                                      const std::vector<int>& strides,
+                                      const DDim& out_dims,
+                                      const bool subm) {
+    std::vector<int64_t> key;
+    key.reserve(32 + 4 * non_zero_num);
+    key.push_back(sizeof(IntT));
+    key.push_back(subm);
+    for (int i = 0; i < x_dims.size(); ++i) {
+      key.push_back(x_dims[i]);
+    }
+    for (int i = 0; i < out_dims.size(); ++i) {
+      key.push_back(out_dims[i]);
+    }
+    for (int i = 0; i < 3; ++i) {
+      key.push_back(kernel_sizes[i]);
+      key.push_back(paddings[i]);
+      key.push_back(dilations[i]);
+      key.push_back(strides[i]);
+    }
+    key.push_back(non_zero_num);
+    key.insert(key.end(), indices, indices + 4 * non_zero_num);
+    return key;
+  }
+
+  // Copies the entry of key into rulebook, counter and out_indices, and
+  // returns false when there is no such entry.
+  template <typename Context>
+  bool Get(const Context& dev_ctx,
+           const std::vector<int64_t>& key,
+           DenseTensor* rulebook,
+           int* counter,
+           const int kernel_size,
+           DenseTensor* out_indices) {
+    size_t hash = Hash(key);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->hash != hash || it->key != key) {
+        continue;
+      }
+      // move the entry to the front, which is the most recently used one
+      entries_.splice(entries_.begin(), entries_, it);
+      Copy(dev_ctx, it->rulebook, rulebook);
+      Copy(dev_ctx, it->out_indices, out_indices);
+      std::memcpy(counter, it->counter.data(), kernel_size * sizeof(int));
+      return true;
+    }
+    return false;
+  }
+
+  template <typename Context>
+  void Put(const Context& dev_ctx,
+           std::vector<int64_t>&& key,
+           const DenseTensor& rulebook,
+           const int* counter,
+           const int kernel_size,
+           const DenseTensor& out_indices) {
+    Entry entry;
+    entry.hash = Hash(key);
+    entry.key = std::move(key);
+    entry.counter.assign(counter, counter + kernel_size);
+    Copy(dev_ctx, rulebook, &entry.rulebook);
+    Copy(dev_ctx, out_indices, &entry.out_indices);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.push_front(std::move(entry));
+    while (static_cast<int>(entries_.size()) > capacity()) {
+      entries_.pop_back();
+    }
+  }
+
+ private:
+  struct Entry {
+    size_t hash;
+    std::vector<int64_t> key;
+    std::vector<int> counter;
+    DenseTensor rulebook;
+    DenseTensor out_indices;
+  };
+
+  RulebookCache() = default;
+
+  static size_t Hash(const std::vector<int64_t>& key) {
+    size_t hash = key.size();
+    for (auto value : key) {
+      hash ^= static_cast<size_t>(value) + 0x9e3779b9 + (hash << 6) +
+              (hash >> 2);
+    }
+    return hash;
+  }
+
+  template <typename Context>
+  static void Copy(const Context& dev_ctx,
+                   const DenseTensor& src,
+                   DenseTensor* dst) {
+    *dst = phi::Empty(dev_ctx, DenseTensorMeta(src.meta()));
+    std::memcpy(dst->data(),
+                src.data(),
+                src.numel() * paddle::experimental::SizeOf(src.dtype()));
+  }
+
+  std::mutex mutex_;
+  std::list<Entry> entries_;
+};
+
+}  // namespace sparse
+}  // namespace phi
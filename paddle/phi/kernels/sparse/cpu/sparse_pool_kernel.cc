@@ -52,19 +52,18 @@ void MaxPoolCPUKernel(const CPUContext& dev_ctx,
 
   const T* in_features_ptr = x.non_zero_elements().data<T>();
   // 1. product rule book
-  ProductRuleBook<T, CPUContext, IntT>(dev_ctx,
-                                       x,
-                                       real_kernel_sizes,
-                                       paddings,
-                                       dilations,
-                                       strides,
-                                       out_dims,
-                                       false,
-                                       rulebook,
-                                       &counter_per_kernel);
-
-  UpdateRulebookAndOutIndex<T, CPUContext, IntT>(
-      dev_ctx, x, kernel_size, in_channels, out_dims, rulebook, out);
+  ProductRuleBookWithCache<T, CPUContext, IntT>(dev_ctx,
+                                                x,
+                                                real_kernel_sizes,
+                                                paddings,
+                                                dilations,
+                                                strides,
+                                                out_dims,
+                                                false,
+                                                in_channels,
+                                                rulebook,
+                                                &counter_per_kernel,
+                                                out);
 
   int rulebook_len = rulebook->dims()[1];
   const IntT* rulebook_ptr = rulebook->data<IntT>();
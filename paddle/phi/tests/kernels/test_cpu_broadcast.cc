@@ -0,0 +1,153 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/phi/kernels/funcs/cpu_broadcast.h"
+
+namespace phi {
+namespace tests {
+
+static int64_t Numel(const std::vector<int>& dims) {
+  int64_t numel = 1;
+  for (auto dim : dims) {
+    numel *= dim;
+  }
+  return numel;
+}
+
+// Compares the broadcast engine with an element by element loop for
+// out = 3 * x - y, dx = dout * y and dy = dout * x.
+static void TestBroadcast(const std::vector<int>& x_dims,
+                          const std::vector<int>& y_dims) {
+  int max_dim = x_dims.size();
+  std::vector<int> out_dims(max_dim);
+  for (int i = 0; i < max_dim; ++i) {
+    out_dims[i] = x_dims[i] == 1 ? y_dims[i] : x_dims[i];
+  }
+  int64_t x_numel = Numel(x_dims);
+  int64_t y_numel = Numel(y_dims);
+  int64_t out_numel = Numel(out_dims);
+
+  std::vector<double> x(x_numel), y(y_numel), dout(out_numel);
+  for (int64_t i = 0; i < x_numel; ++i) {
+    x[i] = i % 7;
+  }
+  for (int64_t i = 0; i < y_numel; ++i) {
+    y[i] = i % 5 + 1;
+  }
+  for (int64_t i = 0; i < out_numel; ++i) {
+    dout[i] = i % 3;
+  }
+
+  std::vector<double> expect_out(out_numel);
+  std::vector<double> expect_dx(x_numel, 0), expect_dy(y_numel, 0);
+  for (int64_t i = 0; i < out_numel; ++i) {
+    int64_t index = i;
+    int64_t x_index = 0, y_index = 0, x_stride = 1, y_stride = 1;
+    for (int j = max_dim - 1; j >= 0; --j) {
+      int64_t dim_index = index % out_dims[j];
+      index /= out_dims[j];
+      x_index += x_dims[j] == 1 ? 0 : dim_index * x_stride;
+      y_index += y_dims[j] == 1 ? 0 : dim_index * y_stride;
+      x_stride *= x_dims[j];
+      y_stride *= y_dims[j];
+    }
+    expect_out[i] = 3 * x[x_index] - y[y_index];
+    expect_dx[x_index] += dout[i] * y[y_index];
+    expect_dy[y_index] += dout[i] * x[x_index];
+  }
+
+  funcs::CPUBroadcastPlan plan(
+      x_dims.data(), y_dims.data(), out_dims.data(), max_dim);
+  ASSERT_EQ(plan.numel(), out_numel);
+  std::vector<double> out(out_numel), dx(x_numel, -1), dy(y_numel, -1);
+  funcs::CPUBroadcastForward(
+      plan,
+      x.data(),
+      y.data(),
+      out.data(),
+      [](double a, double b) { return 3 * a - b; },
+      true);
+  funcs::CPUBroadcastGrad<true>(
+      plan,
+      x.data(),
+      y.data(),
+      out.data(),
+      dout.data(),
+      [](double a, double b, double out, double dout) { return dout * b; },
+      dx.data());
+  funcs::CPUBroadcastGrad<false>(
+      plan,
+      x.data(),
+      y.data(),
+      out.data(),
+      dout.data(),
+      [](double a, double b, double out, double dout) { return dout * a; },
+      dy.data());
+
+  // all the values are small integers, so the sums are exact
+  for (int64_t i = 0; i < out_numel; ++i) {
+    ASSERT_EQ(out[i], expect_out[i]);
+  }
+  for (int64_t i = 0; i < x_numel; ++i) {
+    ASSERT_EQ(dx[i], expect_dx[i]);
+  }
+  for (int64_t i = 0; i < y_numel; ++i) {
+    ASSERT_EQ(dy[i], expect_dy[i]);
+  }
+}
+
+TEST(CPUBroadcast, collapse_dims) {
+  std::vector<int> x_dims = {2, 3, 4, 5};
+  std::vector<int> y_dims = {1, 1, 4, 5};
+  funcs::CPUBroadcastPlan plan(
+      x_dims.data(), y_dims.data(), x_dims.data(), x_dims.size());
+  ASSERT_EQ(plan.rank(), 2);
+  EXPECT_EQ(plan.dims()[0], 6);
+  EXPECT_EQ(plan.dims()[1], 20);
+  EXPECT_EQ(plan.x_inner_stride(), 1);
+  EXPECT_EQ(plan.y_inner_stride(), 1);
+
+  y_dims = {2, 1, 4, 1};
+  funcs::CPUBroadcastPlan other(
+      x_dims.data(), y_dims.data(), x_dims.data(), x_dims.size());
+  ASSERT_EQ(other.rank(), 4);
+  EXPECT_EQ(other.y_inner_stride(), 0);
+}
+
+TEST(CPUBroadcast, small) {
+  TestBroadcast({2, 3, 4, 5}, {1, 1, 4, 5});
+  TestBroadcast({2, 3, 4, 5}, {2, 1, 4, 1});
+  TestBroadcast({2, 3, 4, 5}, {1, 3, 1, 5});
+  TestBroadcast({2, 3, 4, 5}, {1, 1, 1, 1});
+  TestBroadcast({1, 1, 1, 1}, {2, 3, 4, 5});
+  TestBroadcast({2, 3, 4, 5}, {2, 3, 4, 5});
+  TestBroadcast({1, 5}, {3, 1});
+  TestBroadcast({1}, {1});
+  TestBroadcast({2, 0, 3}, {1, 1, 3});
+}
+
+// large enough to be split into blocks and to run in parallel
+TEST(CPUBroadcast, large) {
+  TestBroadcast({64, 300, 20}, {1, 300, 1});
+  TestBroadcast({64, 300, 20}, {64, 1, 20});
+  TestBroadcast({3, 40000}, {1, 40000});
+  TestBroadcast({256, 1024}, {256, 1});
+  TestBroadcast({70000}, {1});
+}
+
+}  // namespace tests
+}  // namespace phi
@@ -0,0 +1,80 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/phi/kernels/funcs/cpu_softmax.h"
+
+namespace phi {
+namespace tests {
+
+// Compares the softmax over chunks of rows with a softmax in double.
+static void TestSoftmax(int n, int d, int axis_dim, bool may_use_avx2) {
+  int remain = d / axis_dim;
+  int64_t numel = static_cast<int64_t>(n) * d;
+  std::vector<float> x(numel), out(numel);
+  std::mt19937 rng(100);
+  std::uniform_real_distribution<float> uniform_dist(-10, 10);
+  for (auto& v : x) {
+    v = uniform_dist(rng);
+  }
+
+  funcs::CPUSoftmax<float>(x.data(), out.data(), n, d, axis_dim, may_use_avx2);
+  for (int i = 0; i < n; ++i) {
+    for (int j = 0; j < remain; ++j) {
+      const float* x_row = x.data() + static_cast<int64_t>(i) * d + j;
+      const float* out_row = out.data() + static_cast<int64_t>(i) * d + j;
+      double max = x_row[0];
+      for (int k = 1; k < axis_dim; ++k) {
+        max = std::max<double>(max, x_row[k * remain]);
+      }
+      double sum = 0;
+      for (int k = 0; k < axis_dim; ++k) {
+        sum += std::exp(x_row[k * remain] - max);
+      }
+      for (int k = 0; k < axis_dim; ++k) {
+        double expect = std::exp(x_row[k * remain] - max) / sum;
+        ASSERT_NEAR(out_row[k * remain], expect, 1e-5)
+            << "at row " << i << ", " << j << ", " << k;
+      }
+    }
+  }
+}
+
+TEST(CPUSoftmax, without_avx2) {
+  // the small rows use the exp jit code on cpus with avx but without avx2,
+  // which is not thread safe
+  TestSoftmax(5000, 16, 16, false);
+  TestSoftmax(2000, 100, 100, false);
+  // strided rows
+  TestSoftmax(3000, 64, 16, false);
+  // one chunk
+  TestSoftmax(7, 10, 10, false);
+}
+
+TEST(CPUSoftmax, with_avx2) {
+  if (!paddle::platform::MayIUse(paddle::platform::avx2)) {
+    return;
+  }
+  TestSoftmax(5000, 16, 16, true);
+  TestSoftmax(2000, 100, 100, true);
+  TestSoftmax(3000, 64, 16, true);
+  TestSoftmax(7, 10, 10, true);
+}
+
+}  // namespace tests
+}  // namespace phi
@@ -0,0 +1,113 @@
+/* Copyright (c) 2022 PaddlePaddle Authors. All Rights Reserved.
+
+Licensed under the Apache License, Version 2.0 (the "License");
+you may not use this file except in compliance with the License.
+You may obtain a copy of the License at
+
+http://www.apache.org/licenses/LICENSE-2.0
+
+Unless required by applicable law or agreed to in writing, software
+distributed under the License is distributed on an "AS IS" BASIS,
+WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+See the License for the specific language governing permissions and
+limitations under the License. */
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "paddle/phi/common/complex.h"
+#include "paddle/phi/common/float16.h"
+#include "paddle/phi/kernels/funcs/cpu_transpose.h"
+
+namespace phi {
+namespace tests {
+
+// Compares the transpose engine with an element by element loop.
+template <typename T>
+static void TestTranspose(const std::vector<int64_t>& dims,
+                          const std::vector<int>& axis) {
+  int rank = dims.size();
+  std::vector<int64_t> in_strides(rank), out_strides(rank);
+  int64_t numel = 1;
+  for (int i = rank - 1; i >= 0; --i) {
+    in_strides[i] = numel;
+    numel *= dims[i];
+  }
+  int64_t stride = 1;
+  for (int i = rank - 1; i >= 0; --i) {
+    out_strides[i] = stride;
+    stride *= dims[axis[i]];
+  }
+
+  std::vector<T> in(numel), out(numel), expect(numel);
+  for (int64_t i = 0; i < numel; ++i) {
+    in[i] = static_cast<T>(i % 1000);
+  }
+  for (int64_t i = 0; i < numel; ++i) {
+    int64_t index = i, in_index = 0;
+    for (int j = 0; j < rank; ++j) {
+      int64_t dim_index = index / out_strides[j];
+      index -= dim_index * out_strides[j];
+      in_index += dim_index * in_strides[axis[j]];
+    }
+    expect[i] = in[in_index];
+  }
+
+  funcs::CPUTranspose(in.data(), make_ddim(dims), axis, out.data());
+  for (int64_t i = 0; i < numel; ++i) {
+    ASSERT_TRUE(out[i] == expect[i]) << "at " << i;
+  }
+}
+
+TEST(CPUTranspose, coalesce_dims) {
+  // NCHW to NHWC is a batch of [HW, C] transposes
+  funcs::CPUTransposePlan plan(make_ddim({2, 3, 4, 5}), {0, 2, 3, 1});
+  ASSERT_EQ(plan.rank(), 3);
+  EXPECT_EQ(plan.dims()[0], 2);
+  EXPECT_EQ(plan.dims()[1], 20);
+  EXPECT_EQ(plan.dims()[2], 3);
+  EXPECT_EQ(plan.tile_dim(), 1);
+  EXPECT_FALSE(plan.IsRowCopy());
+
+  // dims of size 1 do not break the contiguous rows
+  funcs::CPUTransposePlan rows(make_ddim({2, 1, 3, 4}), {2, 1, 0, 3});
+  ASSERT_EQ(rows.rank(), 3);
+  EXPECT_TRUE(rows.IsRowCopy());
+
+  funcs::CPUTransposePlan copy(make_ddim({1, 6, 1}), {2, 0, 1});
+  ASSERT_EQ(copy.rank(), 1);
+  EXPECT_TRUE(copy.IsRowCopy());
+}
+
+TEST(CPUTranspose, small) {
+  TestTranspose<float>({2, 3, 4, 5}, {0, 2, 3, 1});
+  TestTranspose<float>({2, 3, 4, 5}, {3, 2, 1, 0});
+  TestTranspose<double>({2, 3, 4, 5}, {1, 0, 2, 3});
+  TestTranspose<int>({7, 1, 9}, {2, 1, 0});
+  TestTranspose<int64_t>({1, 1, 1}, {2, 0, 1});
+  TestTranspose<uint8_t>({5, 3}, {1, 0});
+  TestTranspose<float>({5}, {0});
+  TestTranspose<float>({0, 3}, {1, 0});
+  // rank 8 is not handled by Eigen
+  TestTranspose<float>({2, 3, 2, 3, 2, 3, 2, 3}, {7, 5, 3, 1, 0, 2, 4, 6});
+}
+
+// edge tiles, blocks and the types moved as integers
+TEST(CPUTranspose, dtypes) {
+  TestTranspose<int8_t>({100, 300}, {1, 0});
+  TestTranspose<dtype::float16>({33, 65, 17}, {2, 0, 1});
+  TestTranspose<dtype::complex<float>>({17, 19, 3}, {1, 2, 0});
+  TestTranspose<dtype::complex<double>>({17, 19, 3}, {2, 0, 1});
+}
+
+// large enough to run in parallel
+TEST(CPUTranspose, large) {
+  TestTranspose<float>({4, 3, 96, 96}, {0, 2, 3, 1});
+  TestTranspose<float>({4, 96, 96, 3}, {0, 3, 1, 2});
+  TestTranspose<float>({2, 128, 12, 64}, {0, 2, 1, 3});
+  TestTranspose<dtype::float16>({2, 12, 128, 64}, {0, 1, 3, 2});
+  TestTranspose<int>({2, 3, 20000}, {1, 0, 2});
+}
+
+}  // namespace tests
+}  // namespace phi
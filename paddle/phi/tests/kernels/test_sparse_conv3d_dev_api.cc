@@ -20,6 +20,7 @@ limitations under the License. */
 #include "paddle/phi/kernels/copy_kernel.h"
 #include "paddle/phi/kernels/sparse/convolution_grad_kernel.h"
 #include "paddle/phi/kernels/sparse/convolution_kernel.h"
+#include "paddle/phi/kernels/sparse/cpu/rulebook_cache.h"
 
 #include "paddle/fluid/memory/allocation/allocator_facade.h"
 #include "paddle/phi/api/lib/utils/allocator.h"
@@ -39,6 +40,22 @@ std::vector<int> flatten(const std::vector<std::vector<int>>& in) {
   return out;
 }
 
+// Sets FLAGS_sparse_conv_rulebook_cache_capacity, and restores it at the end
+// of the scope.
+class RulebookCacheCapacityGuard {
+ public:
+  explicit RulebookCacheCapacityGuard(int capacity)
+      : old_capacity_(FLAGS_sparse_conv_rulebook_cache_capacity) {
+    FLAGS_sparse_conv_rulebook_cache_capacity = capacity;
+  }
+  ~RulebookCacheCapacityGuard() {
+    FLAGS_sparse_conv_rulebook_cache_capacity = old_capacity_;
+  }
+
+ private:
+  int old_capacity_;
+};
+
 template <typename T1, typename T2>
 std::vector<T2> cast(const std::vector<T1>& in) {
   std::vector<T2> out(in.size());
@@ -112,6 +129,8 @@ void TestConv3dBase(const std::vector<IntT>& indices,
   };
 
   if (!std::is_same<T, phi::dtype::float16>::value) {
+    // the rulebook cache is disabled by default
+    RulebookCacheCapacityGuard cache_guard(8);
     DenseTensor rulebook = phi::Empty(
         dev_ctx_cpu, DenseTensorMeta(indices_dtype, {1}, DataLayout::NCHW));
     SparseCooTensor out = sparse::Conv3d<T>(dev_ctx_cpu,
@@ -137,6 +156,30 @@ void TestConv3dBase(const std::vector<IntT>& indices,
 
     f_verify(out.non_zero_elements().data<T>(), correct_out_features);
 
+    // the same indices and kernel geometry hit the rulebook cache
+    DenseTensor cached_rulebook = phi::Empty(
+        dev_ctx_cpu, DenseTensorMeta(indices_dtype, {1}, DataLayout::NCHW));
+    SparseCooTensor cached_out = sparse::Conv3d<T>(dev_ctx_cpu,
+                                                   x_tensor,
+                                                   kernel_tensor,
+                                                   paddings,
+                                                   dilations,
+                                                   strides,
+                                                   1,
+                                                   subm,
+                                                   &cached_rulebook);
+    ASSERT_EQ(rulebook.dims(), cached_rulebook.dims());
+    int cmp_rulebook = memcmp(rulebook.data<IntT>(),
+                              cached_rulebook.data<IntT>(),
+                              rulebook.numel() * sizeof(IntT));
+    ASSERT_EQ(cmp_rulebook, 0);
+    ASSERT_EQ(out.nnz(), cached_out.nnz());
+    int cmp_cached_indices = memcmp(correct_out_indices.data(),
+                                    cached_out.non_zero_indices().data<IntT>(),
+                                    correct_out_indices.size() * sizeof(IntT));
+    ASSERT_EQ(cmp_cached_indices, 0);
+    f_verify(cached_out.non_zero_elements().data<T>(), correct_out_features);
+
     if (backward) {
       std::tuple<SparseCooTensor, DenseTensor> grads =
           sparse::Conv3dGrad<T>(dev_ctx_cpu,
@@ -821,5 +864,143 @@ TEST(DEV_API, sparse_conv3d_subm) {
              true);
 }
 
+TEST(DEV_API, sparse_conv3d_rulebook_cache) {
+  phi::CPUContext dev_ctx_cpu;
+  dev_ctx_cpu.SetAllocator(
+      paddle::memory::allocation::AllocatorFacade::Instance()
+          .GetAllocator(paddle::platform::CPUPlace())
+          .get());
+  dev_ctx_cpu.SetHostAllocator(
+      paddle::memory::allocation::AllocatorFacade::Instance()
+          .GetAllocator(paddle::platform::CPUPlace())
+          .get());
+  dev_ctx_cpu.Init();
+
+  const int non_zero_num = 4;
+  std::vector<int> indices = flatten(
+      {{0, 0, 0, 0}, {0, 2, 0, 2}, {3, 2, 2, 3}, {3, 2, 3, 2}});
+  DenseTensor indices_tensor = phi::Empty(
+      dev_ctx_cpu,
+      DenseTensorMeta(DataType::INT32, {4, non_zero_num}, DataLayout::NCHW));
+  memcpy(indices_tensor.data<int>(),
+         indices.data(),
+         indices.size() * sizeof(int));
+  DenseTensor features_tensor = phi::Empty(
+      dev_ctx_cpu,
+      DenseTensorMeta(DataType::FLOAT32, {non_zero_num, 1}, DataLayout::NHWC));
+  std::vector<float> features = {-0.2883, 0.0287, 0.2864, -0.0992};
+  memcpy(features_tensor.data<float>(),
+         features.data(),
+         features.size() * sizeof(float));
+  SparseCooTensor x_tensor(indices_tensor, features_tensor, {1, 4, 4, 4, 1});
+
+  const std::vector<int> kernel_sizes = {3, 3, 3};
+  const int kernel_size = 27;
+  DenseTensor kernel_tensor = phi::Empty(
+      dev_ctx_cpu,
+      DenseTensorMeta(DataType::FLOAT32, {3, 3, 3, 1, 1}, DataLayout::NHWC));
+  for (int i = 0; i < kernel_size; ++i) {
+    kernel_tensor.data<float>()[i] = 0.1 * (i % 7) - 0.3;
+  }
+
+  // the same indices with different strides, paddings or subm
+  struct Geometry {
+    std::vector<int> paddings;
+    std::vector<int> strides;
+    bool subm;
+  };
+  const std::vector<Geometry> geometries = {{{0, 0, 0}, {1, 1, 1}, false},
+                                            {{0, 0, 0}, {2, 2, 2}, false},
+                                            {{1, 1, 1}, {1, 1, 1}, false},
+                                            {{1, 1, 1}, {1, 1, 1}, true}};
+  const std::vector<int> dilations = {1, 1, 1};
+
+  auto conv = [&](const Geometry& geometry, DenseTensor* rulebook) {
+    *rulebook = phi::Empty(
+        dev_ctx_cpu, DenseTensorMeta(DataType::INT32, {1}, DataLayout::NCHW));
+    return sparse::Conv3d<float>(dev_ctx_cpu,
+                                 x_tensor,
+                                 kernel_tensor,
+                                 geometry.paddings,
+                                 dilations,
+                                 geometry.strides,
+                                 1,
+                                 geometry.subm,
+                                 rulebook);
+  };
+  auto expect_same = [](const DenseTensor& a, const DenseTensor& b) {
+    ASSERT_EQ(a.dims(), b.dims());
+    EXPECT_EQ(memcmp(a.data(),
+                     b.data(),
+                     a.numel() * paddle::experimental::SizeOf(a.dtype())),
+              0);
+  };
+
+  auto& cache = sparse::RulebookCache::Instance();
+  cache.Clear();
+
+  // capacity 0 bypasses the cache
+  std::vector<DenseTensor> rulebooks(geometries.size());
+  std::vector<SparseCooTensor> outs;
+  {
+    RulebookCacheCapacityGuard cache_guard(0);
+    for (size_t i = 0; i < geometries.size(); ++i) {
+      outs.push_back(conv(geometries[i], &rulebooks[i]));
+    }
+    EXPECT_EQ(cache.size(), 0UL);
+  }
+  // the last two geometries only differ in subm, which changes the rulebook
+  ASSERT_NE(rulebooks[2].dims(), rulebooks[3].dims());
+
+  {
+    RulebookCacheCapacityGuard cache_guard(8);
+    // every geometry misses once, then hits
+    for (int pass = 0; pass < 2; ++pass) {
+      for (size_t i = 0; i < geometries.size(); ++i) {
+        DenseTensor rulebook;
+        SparseCooTensor out = conv(geometries[i], &rulebook);
+        EXPECT_EQ(cache.size(), pass == 0 ? i + 1 : geometries.size());
+        expect_same(rulebooks[i], rulebook);
+        expect_same(outs[i].non_zero_indices(), out.non_zero_indices());
+        expect_same(outs[i].non_zero_elements(), out.non_zero_elements());
+      }
+    }
+  }
+
+  auto contains = [&](size_t i) {
+    auto key = sparse::RulebookCache::MakeKey(indices_tensor.data<int>(),
+                                              non_zero_num,
+                                              x_tensor.dims(),
+                                              kernel_sizes,
+                                              geometries[i].paddings,
+                                              dilations,
+                                              geometries[i].strides,
+                                              outs[i].dims(),
+                                              geometries[i].subm);
+    DenseTensor rulebook;
+    DenseTensor out_indices;
+    std::vector<int> counter(kernel_size);
+    return cache.Get(
+        dev_ctx_cpu, key, &rulebook, counter.data(), kernel_size, &out_indices);
+  };
+
+  // the least recently used entry is evicted
+  {
+    RulebookCacheCapacityGuard cache_guard(2);
+    cache.Clear();
+    DenseTensor rulebook;
+    conv(geometries[0], &rulebook);
+    conv(geometries[1], &rulebook);
+    conv(geometries[0], &rulebook);
+    conv(geometries[2], &rulebook);
+    EXPECT_EQ(cache.size(), 2UL);
+    EXPECT_FALSE(contains(1));
+    EXPECT_TRUE(contains(0));
+    EXPECT_TRUE(contains(2));
+    EXPECT_FALSE(contains(3));
+  }
+  cache.Clear();
+}
+
 }  // namespace tests
 }  // namespace phi